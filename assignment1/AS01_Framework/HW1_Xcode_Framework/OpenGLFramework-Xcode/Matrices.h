@@ -3,7 +3,10 @@
 // =========
 // NxN Matrix Math classes
 //
-// All matrices are row major. (OpenGL uses column-major matrix)
+// All matrices are indexed row major. (OpenGL uses column-major matrix)
+// Matrix4 stores its elements column major so they can be passed to OpenGL
+// without a copy; define MATH_MATRIX4_ROW_MAJOR to store them row major.
+// Matrix4 has no get(), getStorage() names the order it returns.
 // | 0 1 |    | 0 1 2 |    |  0  1  2  3 |
 // | 2 3 |    | 3 4 5 |    |  4  5  6  7 |
 //            | 6 7 8 |    |  8  9 10 11 |
@@ -20,6 +23,20 @@
 #define MATH_MATRICES_H
 
 #include "Vectors.h"
+#include "MatrixKernels.h"
+
+// products and transforms dispatch to the SIMD kernels at runtime; they can
+// only be constexpr where the compiler tells constant evaluation apart
+#if defined(MATH_HAS_CONSTEXPR) && defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+    #define MATH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+#ifdef MATH_CONSTANT_EVALUATED
+    #define MATH_CONSTEXPR_KERNEL constexpr
+#else
+    #define MATH_CONSTEXPR_KERNEL
+#endif
 
 ///////////////////////////////////////////////////////////////////////////
 // 2x2 matrix
@@ -129,6 +146,25 @@ private:
 
 
 
+///////////////////////////////////////////////////////////////////////////
+// element storage of Matrix4
+// maps the row major index used by the Matrix4 API to the storage order
+///////////////////////////////////////////////////////////////////////////
+struct Matrix4Storage
+{
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    static MATH_CONSTEXPR int index(int i)              { return i; }
+#else
+    static MATH_CONSTEXPR int index(int i)              { return ((i & 3) << 2) | (i >> 2); }
+#endif
+    MATH_CONSTEXPR float  operator[](int i) const       { return v[index(i)]; }
+    MATH_CONSTEXPR float& operator[](int i)             { return v[index(i)]; }
+
+    float v[16];
+};
+
+
+
 ///////////////////////////////////////////////////////////////////////////
 // 4x4 matrix
 ///////////////////////////////////////////////////////////////////////////
@@ -136,36 +172,38 @@ class Matrix4
 {
 public:
     // constructors
-    Matrix4();  // init with identity
-    Matrix4(const float src[16]);
-    Matrix4(float xx, float xy, float xz, float xw,
-            float yx, float yy, float yz, float yw,
-            float zx, float zy, float zz, float zw,
-            float wx, float wy, float wz, float ww);
-
-    void        set(const float src[16]);
-    void        set(float xx, float xy, float xz, float xw,
-                    float yx, float yy, float yz, float yw,
-                    float zx, float zy, float zz, float zw,
-                    float wx, float wy, float wz, float ww);
-    void        setRow(int index, const float row[4]);
-    void        setRow(int index, const Vector4& v);
-    void        setRow(int index, const Vector3& v);
-    void        setColumn(int index, const float col[4]);
-    void        setColumn(int index, const Vector4& v);
-    void        setColumn(int index, const Vector3& v);
-
-    const float* get() const;
-    const float* getTranspose();                        // return transposed matrix
+    MATH_CONSTEXPR Matrix4();  // init with identity
+    MATH_CONSTEXPR Matrix4(const float src[16]);
+    MATH_CONSTEXPR Matrix4(float xx, float xy, float xz, float xw,
+                           float yx, float yy, float yz, float yw,
+                           float zx, float zy, float zz, float zw,
+                           float wx, float wy, float wz, float ww);
+
+    MATH_CONSTEXPR void        set(const float src[16]);
+    MATH_CONSTEXPR void        set(float xx, float xy, float xz, float xw,
+                                   float yx, float yy, float yz, float yw,
+                                   float zx, float zy, float zz, float zw,
+                                   float wx, float wy, float wz, float ww);
+    MATH_CONSTEXPR void        setRow(int index, const float row[4]);
+    MATH_CONSTEXPR void        setRow(int index, const Vector4& v);
+    MATH_CONSTEXPR void        setRow(int index, const Vector3& v);
+    MATH_CONSTEXPR void        setColumn(int index, const float col[4]);
+    MATH_CONSTEXPR void        setColumn(int index, const Vector4& v);
+    MATH_CONSTEXPR void        setColumn(int index, const Vector3& v);
+
+    const float* getStorage() const;                    // elements in storage order, column major unless MATH_MATRIX4_ROW_MAJOR
+    const float* getTranspose() const;                  // column major elements for OpenGL
     float        getDeterminant();
+    float        getDeterminantScalar();                // reference version without SIMD
 
-    Matrix4&    identity();
-    Matrix4&    transpose();                            // transpose itself and return reference
+    MATH_CONSTEXPR Matrix4&    identity();
+    MATH_CONSTEXPR Matrix4&    transpose();                            // transpose itself and return reference
     Matrix4&    invert();                               // check best inverse method before inverse
     Matrix4&    invertEuclidean();                      // inverse of Euclidean transform matrix
     Matrix4&    invertAffine();                         // inverse of affine transform matrix
     Matrix4&    invertProjective();                     // inverse of projective matrix using partitioning
     Matrix4&    invertGeneral();                        // inverse of generic matrix
+    Matrix4&    invertGeneralScalar();                  // reference version without SIMD
 
     // transform matrix
     Matrix4&    translate(float x, float y, float z);   // translation by (x,y,z)
@@ -179,24 +217,28 @@ public:
     Matrix4&    scale(float sx, float sy, float sz);    // scale by (sx, sy, sz) on each axis
 
     // operators
-    Matrix4     operator+(const Matrix4& rhs) const;    // add rhs
-    Matrix4     operator-(const Matrix4& rhs) const;    // subtract rhs
-    Matrix4&    operator+=(const Matrix4& rhs);         // add rhs and update this object
-    Matrix4&    operator-=(const Matrix4& rhs);         // subtract rhs and update this object
-    Vector4     operator*(const Vector4& rhs) const;    // multiplication: v' = M * v
-    Vector3     operator*(const Vector3& rhs) const;    // multiplication: v' = M * v
-    Matrix4     operator*(const Matrix4& rhs) const;    // multiplication: M3 = M1 * M2
-    Matrix4&    operator*=(const Matrix4& rhs);         // multiplication: M1' = M1 * M2
-    bool        operator==(const Matrix4& rhs) const;   // exact compare, no epsilon
-    bool        operator!=(const Matrix4& rhs) const;   // exact compare, no epsilon
-    float       operator[](int index) const;            // subscript operator v[0], v[1]
-    float&      operator[](int index);                  // subscript operator v[0], v[1]
-
-    friend Matrix4 operator-(const Matrix4& m);                     // unary operator (-)
-    friend Matrix4 operator*(float scalar, const Matrix4& m);       // pre-multiplication
-    friend Vector3 operator*(const Vector3& vec, const Matrix4& m); // pre-multiplication
-    friend Vector4 operator*(const Vector4& vec, const Matrix4& m); // pre-multiplication
+    MATH_CONSTEXPR Matrix4     operator+(const Matrix4& rhs) const;    // add rhs
+    MATH_CONSTEXPR Matrix4     operator-(const Matrix4& rhs) const;    // subtract rhs
+    MATH_CONSTEXPR Matrix4&    operator+=(const Matrix4& rhs);         // add rhs and update this object
+    MATH_CONSTEXPR Matrix4&    operator-=(const Matrix4& rhs);         // subtract rhs and update this object
+    MATH_CONSTEXPR_KERNEL Vector4     operator*(const Vector4& rhs) const;    // multiplication: v' = M * v
+    MATH_CONSTEXPR Vector3     operator*(const Vector3& rhs) const;    // multiplication: v' = M * v
+    MATH_CONSTEXPR_KERNEL Matrix4     operator*(const Matrix4& rhs) const;    // multiplication: M3 = M1 * M2
+    MATH_CONSTEXPR_KERNEL Matrix4&    operator*=(const Matrix4& rhs);         // multiplication: M1' = M1 * M2
+    MATH_CONSTEXPR Matrix4     multiplyScalar(const Matrix4& rhs) const; // reference version of M1 * M2 without SIMD
+    Matrix4     multiplyAffine(const Matrix4& rhs) const; // M1 * M2 for affine M1, M2, 3x4 product
+    MATH_CONSTEXPR bool        isAffine() const;                       // last row is exactly (0 0 0 1)
+    MATH_CONSTEXPR bool        operator==(const Matrix4& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const Matrix4& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR float       operator[](int index) const;            // subscript operator v[0], v[1]
+    MATH_CONSTEXPR float&      operator[](int index);                  // subscript operator v[0], v[1]
+
+    friend MATH_CONSTEXPR Matrix4 operator-(const Matrix4& m);                     // unary operator (-)
+    friend MATH_CONSTEXPR Matrix4 operator*(float scalar, const Matrix4& m);       // pre-multiplication
+    friend MATH_CONSTEXPR Vector3 operator*(const Vector3& vec, const Matrix4& m); // pre-multiplication
+    friend MATH_CONSTEXPR_KERNEL Vector4 operator*(const Vector4& vec, const Matrix4& m); // pre-multiplication
     friend std::ostream& operator<<(std::ostream& os, const Matrix4& m);
+    friend class Matrix4Chain;
 
 protected:
 
@@ -205,8 +247,10 @@ private:
                             float m3, float m4, float m5,
                             float m6, float m7, float m8);
 
-    float m[16];
-    float tm[16];                                       // transpose m
+    Matrix4Storage m;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    mutable float tm[16] = {};                          // transpose m
+#endif
 
 };
 
@@ -631,7 +675,7 @@ inline std::ostream& operator<<(std::ostream& os, const Matrix3& m)
 ///////////////////////////////////////////////////////////////////////////
 // inline functions for Matrix4
 ///////////////////////////////////////////////////////////////////////////
-inline Matrix4::Matrix4()
+inline MATH_CONSTEXPR Matrix4::Matrix4() : m()
 {
     // initially identity matrix
     identity();
@@ -639,24 +683,24 @@ inline Matrix4::Matrix4()
 
 
 
-inline Matrix4::Matrix4(const float src[16])
+inline MATH_CONSTEXPR Matrix4::Matrix4(const float src[16]) : m()
 {
     set(src);
 }
 
 
 
-inline Matrix4::Matrix4(float xx, float xy, float xz, float xw,
-                        float yx, float yy, float yz, float yw,
-                        float zx, float zy, float zz, float zw,
-                        float wx, float wy, float wz, float ww)
+inline MATH_CONSTEXPR Matrix4::Matrix4(float xx, float xy, float xz, float xw,
+                                       float yx, float yy, float yz, float yw,
+                                       float zx, float zy, float zz, float zw,
+                                       float wx, float wy, float wz, float ww) : m()
 {
     set(xx, xy, xz, xw,  yx, yy, yz, yw,  zx, zy, zz, zw,  wx, wy, wz, ww);
 }
 
 
 
-inline void Matrix4::set(const float src[16])
+inline MATH_CONSTEXPR void Matrix4::set(const float src[16])
 {
     m[0] = src[0];  m[1] = src[1];  m[2] = src[2];  m[3] = src[3];
     m[4] = src[4];  m[5] = src[5];  m[6] = src[6];  m[7] = src[7];
@@ -666,10 +710,10 @@ inline void Matrix4::set(const float src[16])
 
 
 
-inline void Matrix4::set(float xx, float xy, float xz, float xw,
-                         float yx, float yy, float yz, float yw,
-                         float zx, float zy, float zz, float zw,
-                         float wx, float wy, float wz, float ww)
+inline MATH_CONSTEXPR void Matrix4::set(float xx, float xy, float xz, float xw,
+                                        float yx, float yy, float yz, float yw,
+                                        float zx, float zy, float zz, float zw,
+                                        float wx, float wy, float wz, float ww)
 {
     m[0] = xx;  m[1] = xy;  m[2] = xz;  m[3] = xw;
     m[4] = yx;  m[5] = yy;  m[6] = yz;  m[7] = yw;
@@ -679,67 +723,71 @@ inline void Matrix4::set(float xx, float xy, float xz, float xw,
 
 
 
-inline void Matrix4::setRow(int index, const float row[4])
+inline MATH_CONSTEXPR void Matrix4::setRow(int index, const float row[4])
 {
     m[index*4] = row[0];  m[index*4 + 1] = row[1];  m[index*4 + 2] = row[2];  m[index*4 + 3] = row[3];
 }
 
 
 
-inline void Matrix4::setRow(int index, const Vector4& v)
+inline MATH_CONSTEXPR void Matrix4::setRow(int index, const Vector4& v)
 {
     m[index*4] = v.x;  m[index*4 + 1] = v.y;  m[index*4 + 2] = v.z;  m[index*4 + 3] = v.w;
 }
 
 
 
-inline void Matrix4::setRow(int index, const Vector3& v)
+inline MATH_CONSTEXPR void Matrix4::setRow(int index, const Vector3& v)
 {
     m[index*4] = v.x;  m[index*4 + 1] = v.y;  m[index*4 + 2] = v.z;
 }
 
 
 
-inline void Matrix4::setColumn(int index, const float col[4])
+inline MATH_CONSTEXPR void Matrix4::setColumn(int index, const float col[4])
 {
     m[index] = col[0];  m[index + 4] = col[1];  m[index + 8] = col[2];  m[index + 12] = col[3];
 }
 
 
 
-inline void Matrix4::setColumn(int index, const Vector4& v)
+inline MATH_CONSTEXPR void Matrix4::setColumn(int index, const Vector4& v)
 {
     m[index] = v.x;  m[index + 4] = v.y;  m[index + 8] = v.z;  m[index + 12] = v.w;
 }
 
 
 
-inline void Matrix4::setColumn(int index, const Vector3& v)
+inline MATH_CONSTEXPR void Matrix4::setColumn(int index, const Vector3& v)
 {
     m[index] = v.x;  m[index + 4] = v.y;  m[index + 8] = v.z;
 }
 
 
 
-inline const float* Matrix4::get() const
+inline const float* Matrix4::getStorage() const
 {
-    return m;
+    return m.v;
 }
 
 
 
-inline const float* Matrix4::getTranspose()
+inline const float* Matrix4::getTranspose() const
 {
+#ifdef MATH_MATRIX4_ROW_MAJOR
     tm[0] = m[0];   tm[1] = m[4];   tm[2] = m[8];   tm[3] = m[12];
     tm[4] = m[1];   tm[5] = m[5];   tm[6] = m[9];   tm[7] = m[13];
     tm[8] = m[2];   tm[9] = m[6];   tm[10]= m[10];  tm[11]= m[14];
     tm[12]= m[3];   tm[13]= m[7];   tm[14]= m[11];  tm[15]= m[15];
     return tm;
+#else
+    return m.v;
+#endif
 }
 
 
 
-inline Matrix4& Matrix4::identity()
+inline MATH_CONSTEXPR Matrix4& Matrix4::identity()
 {
     m[0] = m[5] = m[10] = m[15] = 1.0f;
     m[1] = m[2] = m[3] = m[4] = m[6] = m[7] = m[8] = m[9] = m[11] = m[12] = m[13] = m[14] = 0.0f;
@@ -748,7 +796,24 @@ inline Matrix4& Matrix4::identity()
 
 
 
-inline Matrix4 Matrix4::operator+(const Matrix4& rhs) const
+inline MATH_CONSTEXPR Matrix4& Matrix4::transpose()
+{
+    // std::swap is not constexpr before C++20
+    for(int i = 0; i < 4; ++i)
+    {
+        for(int j = i + 1; j < 4; ++j)
+        {
+            float t = m[i*4 + j];
+            m[i*4 + j] = m[j*4 + i];
+            m[j*4 + i] = t;
+        }
+    }
+    return *this;
+}
+
+
+
+inline MATH_CONSTEXPR Matrix4 Matrix4::operator+(const Matrix4& rhs) const
 {
     return Matrix4(m[0]+rhs[0],   m[1]+rhs[1],   m[2]+rhs[2],   m[3]+rhs[3],
                    m[4]+rhs[4],   m[5]+rhs[5],   m[6]+rhs[6],   m[7]+rhs[7],
@@ -758,7 +823,7 @@ inline Matrix4 Matrix4::operator+(const Matrix4& rhs) const
 
 
 
-inline Matrix4 Matrix4::operator-(const Matrix4& rhs) const
+inline MATH_CONSTEXPR Matrix4 Matrix4::operator-(const Matrix4& rhs) const
 {
     return Matrix4(m[0]-rhs[0],   m[1]-rhs[1],   m[2]-rhs[2],   m[3]-rhs[3],
                    m[4]-rhs[4],   m[5]-rhs[5],   m[6]-rhs[6],   m[7]-rhs[7],
@@ -768,7 +833,7 @@ inline Matrix4 Matrix4::operator-(const Matrix4& rhs) const
 
 
 
-inline Matrix4& Matrix4::operator+=(const Matrix4& rhs)
+inline MATH_CONSTEXPR Matrix4& Matrix4::operator+=(const Matrix4& rhs)
 {
     m[0] += rhs[0];    m[1] += rhs[1];    m[2] += rhs[2];    m[3] += rhs[3];
     m[4] += rhs[4];    m[5] += rhs[5];    m[6] += rhs[6];    m[7] += rhs[7];
@@ -779,7 +844,7 @@ inline Matrix4& Matrix4::operator+=(const Matrix4& rhs)
 
 
 
-inline Matrix4& Matrix4::operator-=(const Matrix4& rhs)
+inline MATH_CONSTEXPR Matrix4& Matrix4::operator-=(const Matrix4& rhs)
 {
     m[0] -= rhs[0];    m[1] -= rhs[1];    m[2] -= rhs[2];    m[3] -= rhs[3];
     m[4] -= rhs[4];    m[5] -= rhs[5];    m[6] -= rhs[6];    m[7] -= rhs[7];
@@ -790,17 +855,27 @@ inline Matrix4& Matrix4::operator-=(const Matrix4& rhs)
 
 
 
-inline Vector4 Matrix4::operator*(const Vector4& rhs) const
+inline MATH_CONSTEXPR_KERNEL Vector4 Matrix4::operator*(const Vector4& rhs) const
 {
-    return Vector4(m[0]*rhs.x  + m[1]*rhs.y  + m[2]*rhs.z  + m[3]*rhs.w,
-                   m[4]*rhs.x  + m[5]*rhs.y  + m[6]*rhs.z  + m[7]*rhs.w,
-                   m[8]*rhs.x  + m[9]*rhs.y  + m[10]*rhs.z + m[11]*rhs.w,
-                   m[12]*rhs.x + m[13]*rhs.y + m[14]*rhs.z + m[15]*rhs.w);
+#ifdef MATH_CONSTANT_EVALUATED
+    if(MATH_CONSTANT_EVALUATED())
+        return Vector4(m[0]*rhs.x  + m[1]*rhs.y  + m[2]*rhs.z  + m[3]*rhs.w,
+                       m[4]*rhs.x  + m[5]*rhs.y  + m[6]*rhs.z  + m[7]*rhs.w,
+                       m[8]*rhs.x  + m[9]*rhs.y  + m[10]*rhs.z + m[11]*rhs.w,
+                       m[12]*rhs.x + m[13]*rhs.y + m[14]*rhs.z + m[15]*rhs.w);
+#endif
+    Vector4 v;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    mat4Transform(m.v, &rhs.x, &v.x);
+#else
+    vec4Multiply(&rhs.x, m.v, &v.x);
+#endif
+    return v;
 }
 
 
 
-inline Vector3 Matrix4::operator*(const Vector3& rhs) const
+inline MATH_CONSTEXPR Vector3 Matrix4::operator*(const Vector3& rhs) const
 {
     return Vector3(m[0]*rhs.x + m[1]*rhs.y + m[2]*rhs.z,
                    m[4]*rhs.x + m[5]*rhs.y + m[6]*rhs.z,
@@ -809,7 +884,25 @@ inline Vector3 Matrix4::operator*(const Vector3& rhs) const
 
 
 
-inline Matrix4 Matrix4::operator*(const Matrix4& n) const
+inline MATH_CONSTEXPR_KERNEL Matrix4 Matrix4::operator*(const Matrix4& n) const
+{
+#ifdef MATH_CONSTANT_EVALUATED
+    if(MATH_CONSTANT_EVALUATED())
+        return multiplyScalar(n);
+#endif
+    Matrix4 r;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    mat4Multiply(m.v, n.m.v, r.m.v);
+#else
+    mat4Multiply(n.m.v, m.v, r.m.v);            // (M * N)^T = N^T * M^T
+#endif
+    return r;
+}
+
+
+
+// reference version of operator*(const Matrix4&) without SIMD
+inline MATH_CONSTEXPR Matrix4 Matrix4::multiplyScalar(const Matrix4& n) const
 {
     return Matrix4(m[0]*n[0]  + m[1]*n[4]  + m[2]*n[8]  + m[3]*n[12],   m[0]*n[1]  + m[1]*n[5]  + m[2]*n[9]  + m[3]*n[13],   m[0]*n[2]  + m[1]*n[6]  + m[2]*n[10]  + m[3]*n[14],   m[0]*n[3]  + m[1]*n[7]  + m[2]*n[11]  + m[3]*n[15],
                    m[4]*n[0]  + m[5]*n[4]  + m[6]*n[8]  + m[7]*n[12],   m[4]*n[1]  + m[5]*n[5]  + m[6]*n[9]  + m[7]*n[13],   m[4]*n[2]  + m[5]*n[6]  + m[6]*n[10]  + m[7]*n[14],   m[4]*n[3]  + m[5]*n[7]  + m[6]*n[11]  + m[7]*n[15],
@@ -819,7 +912,27 @@ inline Matrix4 Matrix4::operator*(const Matrix4& n) const
 
 
 
-inline Matrix4& Matrix4::operator*=(const Matrix4& rhs)
+inline Matrix4 Matrix4::multiplyAffine(const Matrix4& n) const
+{
+    Matrix4 r;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    mat4MultiplyAffine(m.v, n.m.v, r.m.v);
+#else
+    mat4MultiplyAffineT(n.m.v, m.v, r.m.v);     // transposed affine matrices
+#endif
+    return r;
+}
+
+
+
+inline MATH_CONSTEXPR bool Matrix4::isAffine() const
+{
+    return m[12] == 0 && m[13] == 0 && m[14] == 0 && m[15] == 1;
+}
+
+
+
+inline MATH_CONSTEXPR_KERNEL Matrix4& Matrix4::operator*=(const Matrix4& rhs)
 {
     *this = *this * rhs;
     return *this;
@@ -827,7 +940,7 @@ inline Matrix4& Matrix4::operator*=(const Matrix4& rhs)
 
 
 
-inline bool Matrix4::operator==(const Matrix4& n) const
+inline MATH_CONSTEXPR bool Matrix4::operator==(const Matrix4& n) const
 {
     return (m[0] == n[0])   && (m[1] == n[1])   && (m[2] == n[2])   && (m[3] == n[3]) &&
            (m[4] == n[4])   && (m[5] == n[5])   && (m[6] == n[6])   && (m[7] == n[7]) &&
@@ -837,7 +950,7 @@ inline bool Matrix4::operator==(const Matrix4& n) const
 
 
 
-inline bool Matrix4::operator!=(const Matrix4& n) const
+inline MATH_CONSTEXPR bool Matrix4::operator!=(const Matrix4& n) const
 {
     return (m[0] != n[0])   || (m[1] != n[1])   || (m[2] != n[2])   || (m[3] != n[3]) ||
            (m[4] != n[4])   || (m[5] != n[5])   || (m[6] != n[6])   || (m[7] != n[7]) ||
@@ -847,42 +960,52 @@ inline bool Matrix4::operator!=(const Matrix4& n) const
 
 
 
-inline float Matrix4::operator[](int index) const
+inline MATH_CONSTEXPR float Matrix4::operator[](int index) const
 {
     return m[index];
 }
 
 
 
-inline float& Matrix4::operator[](int index)
+inline MATH_CONSTEXPR float& Matrix4::operator[](int index)
 {
     return m[index];
 }
 
 
 
-inline Matrix4 operator-(const Matrix4& rhs)
+inline MATH_CONSTEXPR Matrix4 operator-(const Matrix4& rhs)
 {
     return Matrix4(-rhs[0], -rhs[1], -rhs[2], -rhs[3], -rhs[4], -rhs[5], -rhs[6], -rhs[7], -rhs[8], -rhs[9], -rhs[10], -rhs[11], -rhs[12], -rhs[13], -rhs[14], -rhs[15]);
 }
 
 
 
-inline Matrix4 operator*(float s, const Matrix4& rhs)
+inline MATH_CONSTEXPR Matrix4 operator*(float s, const Matrix4& rhs)
 {
     return Matrix4(s*rhs[0], s*rhs[1], s*rhs[2], s*rhs[3], s*rhs[4], s*rhs[5], s*rhs[6], s*rhs[7], s*rhs[8], s*rhs[9], s*rhs[10], s*rhs[11], s*rhs[12], s*rhs[13], s*rhs[14], s*rhs[15]);
 }
 
 
 
-inline Vector4 operator*(const Vector4& v, const Matrix4& m)
+inline MATH_CONSTEXPR_KERNEL Vector4 operator*(const Vector4& v, const Matrix4& m)
 {
-    return Vector4(v.x*m[0] + v.y*m[4] + v.z*m[8] + v.w*m[12],  v.x*m[1] + v.y*m[5] + v.z*m[9] + v.w*m[13],  v.x*m[2] + v.y*m[6] + v.z*m[10] + v.w*m[14], v.x*m[3] + v.y*m[7] + v.z*m[11] + v.w*m[15]);
+#ifdef MATH_CONSTANT_EVALUATED
+    if(MATH_CONSTANT_EVALUATED())
+        return Vector4(v.x*m[0] + v.y*m[4] + v.z*m[8] + v.w*m[12],  v.x*m[1] + v.y*m[5] + v.z*m[9] + v.w*m[13],  v.x*m[2] + v.y*m[6] + v.z*m[10] + v.w*m[14], v.x*m[3] + v.y*m[7] + v.z*m[11] + v.w*m[15]);
+#endif
+    Vector4 r;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    vec4Multiply(&v.x, m.getStorage(), &r.x);
+#else
+    mat4Transform(m.getStorage(), &v.x, &r.x);
+#endif
+    return r;
 }
 
 
 
-inline Vector3 operator*(const Vector3& v, const Matrix4& m)
+inline MATH_CONSTEXPR Vector3 operator*(const Vector3& v, const Matrix4& m)
 {
     return Vector3(v.x*m[0] + v.y*m[4] + v.z*m[8],  v.x*m[1] + v.y*m[5] + v.z*m[9],  v.x*m[2] + v.y*m[6] + v.z*m[10]);
 }
@@ -898,4 +1021,333 @@ inline std::ostream& operator<<(std::ostream& os, const Matrix4& m)
     return os;
 }
 // END OF MATRIX4 INLINE //////////////////////////////////////////////////////
+
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// TRS transform builders
+// Evaluate T * Rx(r.x) * Ry(r.y) * Rz(r.z) * S directly from the Euler
+// angles (radian) instead of multiplying 4x4 matrices. sin/cos of each
+// angle is computed once, and the inverse and the normal matrix follow in
+// closed form because R is orthonormal.
+///////////////////////////////////////////////////////////////////////////
+inline void eulerToRotation(const Vector3& r, float rot[9])
+{
+    float sa = sinf(r.x), ca = cosf(r.x);
+    float sb = sinf(r.y), cb = cosf(r.y);
+    float sc = sinf(r.z), cc = cosf(r.z);
+
+    // Rx * Ry * Rz, row major
+    rot[0] =  cb*cc;              rot[1] = -cb*sc;              rot[2] =  sb;
+    rot[3] =  sa*sb*cc + ca*sc;   rot[4] = -sa*sb*sc + ca*cc;   rot[5] = -sa*cb;
+    rot[6] = -ca*sb*cc + sa*sc;   rot[7] =  ca*sb*sc + sa*cc;   rot[8] =  ca*cb;
+}
+
+
+
+// M = T * R * S
+inline Matrix4 composeTRS(const Vector3& t, const Vector3& r, const Vector3& s)
+{
+    float rot[9];
+    eulerToRotation(r, rot);
+    return Matrix4(rot[0]*s.x, rot[1]*s.y, rot[2]*s.z, t.x,
+                   rot[3]*s.x, rot[4]*s.y, rot[5]*s.z, t.y,
+                   rot[6]*s.x, rot[7]*s.y, rot[8]*s.z, t.z,
+                   0,          0,          0,          1);
+}
+
+
+
+// M^-1 = S^-1 * R^T * T^-1, scale must not have zero components
+inline Matrix4 composeTRSInverse(const Vector3& t, const Vector3& r, const Vector3& s)
+{
+    float rot[9];
+    eulerToRotation(r, rot);
+    float ix = 1.0f / s.x, iy = 1.0f / s.y, iz = 1.0f / s.z;
+    float m0 = rot[0]*ix, m1 = rot[3]*ix, m2 = rot[6]*ix;
+    float m4 = rot[1]*iy, m5 = rot[4]*iy, m6 = rot[7]*iy;
+    float m8 = rot[2]*iz, m9 = rot[5]*iz, m10= rot[8]*iz;
+    return Matrix4(m0, m1, m2,  -(m0*t.x + m1*t.y + m2*t.z),
+                   m4, m5, m6,  -(m4*t.x + m5*t.y + m6*t.z),
+                   m8, m9, m10, -(m8*t.x + m9*t.y + m10*t.z),
+                   0,  0,  0,   1);
+}
+
+
+
+// inverse transpose of the upper 3x3 of T * R * S, i.e. R * S^-1
+inline Matrix3 composeNormalMatrix(const Vector3& r, const Vector3& s)
+{
+    float rot[9];
+    eulerToRotation(r, rot);
+    float ix = 1.0f / s.x, iy = 1.0f / s.y, iz = 1.0f / s.z;
+    return Matrix3(rot[0]*ix, rot[1]*iy, rot[2]*iz,
+                   rot[3]*ix, rot[4]*iy, rot[5]*iz,
+                   rot[6]*ix, rot[7]*iy, rot[8]*iz);
+}
+
+
+
+// same builders with the rotation given as a unit quaternion, no sin / cos
+inline MATH_CONSTEXPR void quaternionToRotation(const Quaternion& q, float rot[9])
+{
+    // products in double, every element is rounded to float only once
+    double x = q.x, y = q.y, z = q.z, w = q.w;
+    double xx = x*x, yy = y*y, zz = z*z;
+    double xy = x*y, xz = x*z, yz = y*z;
+    double wx = w*x, wy = w*y, wz = w*z;
+
+    // row major
+    rot[0] = (float)(1 - 2*(yy + zz)); rot[1] = (float)(2*(xy - wz));     rot[2] = (float)(2*(xz + wy));
+    rot[3] = (float)(2*(xy + wz));     rot[4] = (float)(1 - 2*(xx + zz)); rot[5] = (float)(2*(yz - wx));
+    rot[6] = (float)(2*(xz - wy));     rot[7] = (float)(2*(yz + wx));     rot[8] = (float)(1 - 2*(xx + yy));
+}
+
+
+
+inline Matrix4 composeTRS(const Vector3& t, const Quaternion& q, const Vector3& s)
+{
+    float rot[9] = {};
+    quaternionToRotation(q, rot);
+    return Matrix4(rot[0]*s.x, rot[1]*s.y, rot[2]*s.z, t.x,
+                   rot[3]*s.x, rot[4]*s.y, rot[5]*s.z, t.y,
+                   rot[6]*s.x, rot[7]*s.y, rot[8]*s.z, t.z,
+                   0,          0,          0,          1);
+}
+
+
+
+inline Matrix4 composeTRSInverse(const Vector3& t, const Quaternion& q, const Vector3& s)
+{
+    float rot[9] = {};
+    quaternionToRotation(q, rot);
+    float ix = 1.0f / s.x, iy = 1.0f / s.y, iz = 1.0f / s.z;
+    float m0 = rot[0]*ix, m1 = rot[3]*ix, m2 = rot[6]*ix;
+    float m4 = rot[1]*iy, m5 = rot[4]*iy, m6 = rot[7]*iy;
+    float m8 = rot[2]*iz, m9 = rot[5]*iz, m10= rot[8]*iz;
+    return Matrix4(m0, m1, m2,  -(m0*t.x + m1*t.y + m2*t.z),
+                   m4, m5, m6,  -(m4*t.x + m5*t.y + m6*t.z),
+                   m8, m9, m10, -(m8*t.x + m9*t.y + m10*t.z),
+                   0,  0,  0,   1);
+}
+
+
+
+inline Matrix3 composeNormalMatrix(const Quaternion& q, const Vector3& s)
+{
+    float rot[9] = {};
+    quaternionToRotation(q, rot);
+    float ix = 1.0f / s.x, iy = 1.0f / s.y, iz = 1.0f / s.z;
+    return Matrix3(rot[0]*ix, rot[1]*iy, rot[2]*iz,
+                   rot[3]*ix, rot[4]*iy, rot[5]*iz,
+                   rot[6]*ix, rot[7]*iy, rot[8]*iz);
+}
+// END OF TRS BUILDERS ////////////////////////////////////////////////////////
+
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// constexpr builders
+// Usable in constant expressions, so fixed transforms fold at compile time.
+// mathSqrt() and mathTan() fall back to series / Newton iterations during
+// constant evaluation and call the libm functions otherwise.
+///////////////////////////////////////////////////////////////////////////
+inline MATH_CONSTEXPR float mathSqrt(float x)
+{
+#ifdef MATH_CONSTANT_EVALUATED
+    if(!MATH_CONSTANT_EVALUATED())
+        return sqrtf(x);
+#endif
+    if(!(x > 0.0f))
+        return 0.0f;
+    // Newton steps from above decrease monotonically until they converge
+    float r = x > 1.0f ? x : 1.0f;
+    for(int i = 0; i < 128; ++i)
+    {
+        float next = 0.5f * (r + x / r);
+        if(next >= r)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+
+
+// angle in radian
+inline MATH_CONSTEXPR float mathTan(float angle)
+{
+#ifdef MATH_CONSTANT_EVALUATED
+    if(!MATH_CONSTANT_EVALUATED())
+        return tanf(angle);
+#endif
+    // tan has period PI, reduce to [-PI/2, PI/2] and sum the sin / cos series
+    const double PI = 3.14159265358979323846;
+    double x = angle;
+    while(x > PI / 2)  x -= PI;
+    while(x < -PI / 2) x += PI;
+    double sine = 0.0, cosine = 0.0, term_s = x, term_c = 1.0;
+    for(int n = 0; n < 12; ++n)
+    {
+        sine += term_s;
+        cosine += term_c;
+        term_s *= -x * x / ((2*n + 2) * (2*n + 3));
+        term_c *= -x * x / ((2*n + 1) * (2*n + 2));
+    }
+    return (float)(sine / cosine);
+}
+
+
+
+inline MATH_CONSTEXPR Matrix4 makeTranslation(const Vector3& t)
+{
+    return Matrix4(1, 0, 0, t.x,
+                   0, 1, 0, t.y,
+                   0, 0, 1, t.z,
+                   0, 0, 0, 1);
+}
+
+
+
+inline MATH_CONSTEXPR Matrix4 makeScale(const Vector3& s)
+{
+    return Matrix4(s.x, 0,   0,   0,
+                   0,   s.y, 0,   0,
+                   0,   0,   s.z, 0,
+                   0,   0,   0,   1);
+}
+
+
+
+// view matrix of a camera at eye looking at center, same as gluLookAt()
+inline MATH_CONSTEXPR Matrix4 makeLookAt(const Vector3& eye, const Vector3& center, const Vector3& up)
+{
+    Vector3 f = eye - center;
+    f /= mathSqrt(f.dot(f));
+    Vector3 r = up.cross(f);
+    r /= mathSqrt(r.dot(r));
+    Vector3 u = f.cross(r);
+    u /= mathSqrt(u.dot(u));
+    return Matrix4(r.x, r.y, r.z, -r.dot(eye),
+                   u.x, u.y, u.z, -u.dot(eye),
+                   f.x, f.y, f.z, -f.dot(eye),
+                   0,   0,   0,   1);
+}
+
+
+
+// same as gluPerspective(), fovY in degree
+inline MATH_CONSTEXPR Matrix4 makePerspective(float fovY, float aspect, float front, float back)
+{
+    const float DEG2RAD = 3.141593f / 180;
+    float tangent = mathTan(fovY / 2 * DEG2RAD);
+    return Matrix4(1 / (tangent * aspect), 0,           0,                                0,
+                   0,                      1 / tangent, 0,                                0,
+                   0,                      0,           -(back + front) / (back - front), -(2 * back * front) / (back - front),
+                   0,                      0,           -1,                               0);
+}
+
+
+
+// view matrix of a camera at eye whose camera to world rotation is q, the
+// camera looks down its -z axis; R^T * T(-eye)
+inline MATH_CONSTEXPR Matrix4 makeView(const Vector3& eye, const Quaternion& q)
+{
+    float rot[9] = {};
+    quaternionToRotation(q, rot);
+    return Matrix4(rot[0], rot[3], rot[6], -(rot[0]*eye.x + rot[3]*eye.y + rot[6]*eye.z),
+                   rot[1], rot[4], rot[7], -(rot[1]*eye.x + rot[4]*eye.y + rot[7]*eye.z),
+                   rot[2], rot[5], rot[8], -(rot[2]*eye.x + rot[5]*eye.y + rot[8]*eye.z),
+                   0,      0,      0,      1);
+}
+
+
+
+// same as glOrtho()
+inline MATH_CONSTEXPR Matrix4 makeOrthographic(float l, float r, float b, float t, float n, float f)
+{
+    return Matrix4(2 / (r - l), 0,           0,            -(r + l) / (r - l),
+                   0,           2 / (t - b), 0,            -(t + b) / (t - b),
+                   0,           0,           -2 / (f - n), -(f + n) / (f - n),
+                   0,           0,           0,            1);
+}
+// END OF CONSTEXPR BUILDERS //////////////////////////////////////////////////
+
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// product chains
+// Matrix4Chain evaluates M1 * M2 * ... * Mn right to left in place, one
+// term at a time, so a chain needs no temporaries and every suffix product
+// can be read back on the way, e.g. MV = V * M before MVP = P * MV. Copy the
+// chain to branch off a shared suffix. Terms marked MatrixAffine use the
+// 3x4 product while the running product is still affine.
+///////////////////////////////////////////////////////////////////////////
+enum MatrixKind { MatrixGeneral, MatrixAffine };
+
+class Matrix4Chain
+{
+public:
+    explicit Matrix4Chain(const Matrix4& last, MatrixKind kind = MatrixGeneral)
+        : product(last), affine(kind == MatrixAffine) {}
+
+    Matrix4Chain&   preMultiply(const Matrix4& lhs, MatrixKind kind = MatrixGeneral); // product = lhs * product
+    const Matrix4&  get() const         { return product; }
+    bool            isAffine() const    { return affine; }
+
+private:
+    Matrix4 product;
+    bool    affine;
+};
+
+
+
+inline Matrix4Chain& Matrix4Chain::preMultiply(const Matrix4& lhs, MatrixKind kind)
+{
+    float* r = product.m.v;
+#ifdef MATH_MATRIX4_ROW_MAJOR
+    if(affine && kind == MatrixAffine)
+        mat4MultiplyAffine(lhs.m.v, r, r);
+    else
+        mat4Multiply(lhs.m.v, r, r);
+#else
+    if(affine && kind == MatrixAffine)
+        mat4MultiplyAffineT(r, lhs.m.v, r);
+    else
+        mat4Multiply(r, lhs.m.v, r);
+#endif
+    affine = affine && kind == MatrixAffine;
+    return *this;
+}
+// END OF PRODUCT CHAINS //////////////////////////////////////////////////////
+
+
+
+
+///////////////////////////////////////////////////////////////////////////
+// compile time checks of the constexpr paths
+///////////////////////////////////////////////////////////////////////////
+#ifdef MATH_HAS_CONSTEXPR
+static_assert(Matrix4()[0] == 1 && Matrix4()[5] == 1 && Matrix4()[15] == 1 && Matrix4()[4] == 0, "Matrix4() is identity");
+static_assert(Matrix4(1,2,3,4, 5,6,7,8, 9,10,11,12, 13,14,15,16).transpose()[1] == 5, "transpose()");
+static_assert((Matrix4() + Matrix4())[10] == 2 && (2.0f * Matrix4())[0] == 2, "element-wise arithmetic");
+static_assert(makeTranslation(Vector3(1, 2, 3))[7] == 2 && makeScale(Vector3(1, 2, 3))[5] == 2, "translate / scale builders");
+static_assert(mathSqrt(2.25f) == 1.5f && mathSqrt(0.0f) == 0.0f, "mathSqrt()");
+static_assert(mathTan(0.7853982f) > 0.99999f && mathTan(0.7853982f) < 1.00001f, "mathTan()");
+static_assert(makeLookAt(Vector3(0, 0, 2), Vector3(0, 0, 0), Vector3(0, 1, 0))[11] == -2, "makeLookAt()");
+static_assert(makePerspective(90, 1, 1, 3)[14] == -1 && makePerspective(90, 1, 1, 3)[10] == -2, "makePerspective()");
+static_assert(makeOrthographic(-1, 1, -1, 1, 0, 2)[10] == -1, "makeOrthographic()");
+static_assert(makeView(Vector3(0, 0, 2), Quaternion())[11] == -2 && makeView(Vector3(0, 0, 2), Quaternion())[0] == 1, "makeView()");
+#ifdef MATH_CONSTANT_EVALUATED
+static_assert((makeTranslation(Vector3(1, 2, 3)) * makeScale(Vector3(2, 2, 2)))[0] == 2 &&
+              (makeTranslation(Vector3(1, 2, 3)) * makeScale(Vector3(2, 2, 2)))[3] == 1, "Matrix4 product");
+static_assert((makeTranslation(Vector3(1, 2, 3)) * Vector4(1, 1, 1, 1)).y == 3, "Matrix4 * Vector4");
+#endif
+#ifndef MATH_MATRIX4_ROW_MAJOR
+static_assert(sizeof(Matrix4) == 16 * sizeof(float), "column major Matrix4 has no shadow copy");
+#endif
+#endif
 #endif
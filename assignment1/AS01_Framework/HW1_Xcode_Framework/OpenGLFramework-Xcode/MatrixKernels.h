@@ -0,0 +1,598 @@
+///////////////////////////////////////////////////////////////////////////////
+// MatrixKernels.h
+// ===============
+// SIMD kernels behind Matrix4 products, inverse and determinant
+//
+// All kernels work on row major float[16] and accept unaligned pointers.
+// A column major array is the row major array of the transposed matrix, so
+// Matrix4 in its default column major storage calls them with the operands
+// swapped, e.g. mat4Multiply(b, a, r) for A * B and vec4Multiply for M * v.
+// Products read all of their operands before storing, so r may alias a or b.
+// The backend is selected at compile time:
+//   AVX (+FMA)  when __AVX__ (and __FMA__) is defined, e.g. -mavx2 -mfma
+//   SSE2        on any x86-64 build
+//   NEON        on ARM with __ARM_NEON (products only)
+//   scalar      otherwise, or when MATH_SIMD_SCALAR is defined
+// The scalar kernels are always compiled as the reference implementation,
+// and every SIMD kernel available in the build is reachable under its own
+// name so the backends can be compared against each other.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MATH_MATRIX_KERNELS_H
+#define MATH_MATRIX_KERNELS_H
+
+#include <cmath>
+
+#if !defined(MATH_SIMD_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define MATH_SIMD_SSE2
+    #include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+    #define MATH_SIMD_AVX
+    #include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define MATH_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+#endif
+
+#define MATH_SINGULAR_EPSILON 0.00001f
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scalar reference kernels
+///////////////////////////////////////////////////////////////////////////////
+inline void mat4MultiplyScalar(const float* a, const float* b, float* r)
+{
+    float t[16];
+    for(int i = 0; i < 4; ++i)
+    {
+        const float* row = a + i*4;
+        for(int j = 0; j < 4; ++j)
+            t[i*4 + j] = row[0]*b[j] + row[1]*b[4 + j] + row[2]*b[8 + j] + row[3]*b[12 + j];
+    }
+    for(int i = 0; i < 16; ++i)
+        r[i] = t[i];
+}
+
+
+
+inline void mat4TransformScalar(const float* m, const float* v, float* r)
+{
+    float x = v[0], y = v[1], z = v[2], w = v[3];
+    r[0] = m[0]*x  + m[1]*y  + m[2]*z  + m[3]*w;
+    r[1] = m[4]*x  + m[5]*y  + m[6]*z  + m[7]*w;
+    r[2] = m[8]*x  + m[9]*y  + m[10]*z + m[11]*w;
+    r[3] = m[12]*x + m[13]*y + m[14]*z + m[15]*w;
+}
+
+
+
+// r = a * b for affine a, b (last row 0 0 0 1), 3x4 product
+inline void mat4MultiplyAffineScalar(const float* a, const float* b, float* r)
+{
+    float t[12];
+    for(int i = 0; i < 3; ++i)
+    {
+        const float* row = a + i*4;
+        for(int j = 0; j < 4; ++j)
+            t[i*4 + j] = row[0]*b[j] + row[1]*b[4 + j] + row[2]*b[8 + j];
+        t[i*4 + 3] += row[3];
+    }
+    for(int i = 0; i < 12; ++i)
+        r[i] = t[i];
+    r[12] = r[13] = r[14] = 0.0f;  r[15] = 1.0f;
+}
+
+
+
+// r = a * b for transposed affine a, b (last column 0 0 0 1), as Matrix4
+// stores affine matrices in column major order
+inline void mat4MultiplyAffineTScalar(const float* a, const float* b, float* r)
+{
+    float t[16];
+    for(int i = 0; i < 4; ++i)
+    {
+        const float* row = a + i*4;
+        for(int j = 0; j < 3; ++j)
+            t[i*4 + j] = row[0]*b[j] + row[1]*b[4 + j] + row[2]*b[8 + j];
+    }
+    t[12] += b[12];  t[13] += b[13];  t[14] += b[14];
+    for(int i = 0; i < 16; ++i)
+        r[i] = t[i];
+    r[3] = r[7] = r[11] = 0.0f;  r[15] = 1.0f;
+}
+
+
+
+// r = v * M (row vector)
+inline void vec4MultiplyScalar(const float* v, const float* m, float* r)
+{
+    float x = v[0], y = v[1], z = v[2], w = v[3];
+    r[0] = x*m[0] + y*m[4] + z*m[8]  + w*m[12];
+    r[1] = x*m[1] + y*m[5] + z*m[9]  + w*m[13];
+    r[2] = x*m[2] + y*m[6] + z*m[10] + w*m[14];
+    r[3] = x*m[3] + y*m[7] + z*m[11] + w*m[15];
+}
+
+
+
+inline float mat3CofactorScalar(float m0, float m1, float m2,
+                                float m3, float m4, float m5,
+                                float m6, float m7, float m8)
+{
+    return m0 * (m4 * m8 - m5 * m7) -
+           m1 * (m3 * m8 - m5 * m6) +
+           m2 * (m3 * m7 - m4 * m6);
+}
+
+
+
+inline float mat4DeterminantScalar(const float* m)
+{
+    return m[0] * mat3CofactorScalar(m[5],m[6],m[7], m[9],m[10],m[11], m[13],m[14],m[15]) -
+           m[1] * mat3CofactorScalar(m[4],m[6],m[7], m[8],m[10],m[11], m[12],m[14],m[15]) +
+           m[2] * mat3CofactorScalar(m[4],m[5],m[7], m[8],m[9], m[11], m[12],m[13],m[15]) -
+           m[3] * mat3CofactorScalar(m[4],m[5],m[6], m[8],m[9], m[10], m[12],m[13],m[14]);
+}
+
+
+
+// general inverse by cofactors, returns false (r untouched) if singular
+inline bool mat4InverseScalar(const float* m, float* r)
+{
+    float cofactor0 = mat3CofactorScalar(m[5],m[6],m[7], m[9],m[10],m[11], m[13],m[14],m[15]);
+    float cofactor1 = mat3CofactorScalar(m[4],m[6],m[7], m[8],m[10],m[11], m[12],m[14],m[15]);
+    float cofactor2 = mat3CofactorScalar(m[4],m[5],m[7], m[8],m[9], m[11], m[12],m[13],m[15]);
+    float cofactor3 = mat3CofactorScalar(m[4],m[5],m[6], m[8],m[9], m[10], m[12],m[13],m[14]);
+
+    float determinant = m[0] * cofactor0 - m[1] * cofactor1 + m[2] * cofactor2 - m[3] * cofactor3;
+    if(fabs(determinant) <= MATH_SINGULAR_EPSILON)
+        return false;
+
+    float cofactor4 = mat3CofactorScalar(m[1],m[2],m[3], m[9],m[10],m[11], m[13],m[14],m[15]);
+    float cofactor5 = mat3CofactorScalar(m[0],m[2],m[3], m[8],m[10],m[11], m[12],m[14],m[15]);
+    float cofactor6 = mat3CofactorScalar(m[0],m[1],m[3], m[8],m[9], m[11], m[12],m[13],m[15]);
+    float cofactor7 = mat3CofactorScalar(m[0],m[1],m[2], m[8],m[9], m[10], m[12],m[13],m[14]);
+
+    float cofactor8 = mat3CofactorScalar(m[1],m[2],m[3], m[5],m[6], m[7],  m[13],m[14],m[15]);
+    float cofactor9 = mat3CofactorScalar(m[0],m[2],m[3], m[4],m[6], m[7],  m[12],m[14],m[15]);
+    float cofactor10= mat3CofactorScalar(m[0],m[1],m[3], m[4],m[5], m[7],  m[12],m[13],m[15]);
+    float cofactor11= mat3CofactorScalar(m[0],m[1],m[2], m[4],m[5], m[6],  m[12],m[13],m[14]);
+
+    float cofactor12= mat3CofactorScalar(m[1],m[2],m[3], m[5],m[6], m[7],  m[9], m[10],m[11]);
+    float cofactor13= mat3CofactorScalar(m[0],m[2],m[3], m[4],m[6], m[7],  m[8], m[10],m[11]);
+    float cofactor14= mat3CofactorScalar(m[0],m[1],m[3], m[4],m[5], m[7],  m[8], m[9], m[11]);
+    float cofactor15= mat3CofactorScalar(m[0],m[1],m[2], m[4],m[5], m[6],  m[8], m[9], m[10]);
+
+    float invDeterminant = 1.0f / determinant;
+    r[0] =  invDeterminant * cofactor0;
+    r[1] = -invDeterminant * cofactor4;
+    r[2] =  invDeterminant * cofactor8;
+    r[3] = -invDeterminant * cofactor12;
+
+    r[4] = -invDeterminant * cofactor1;
+    r[5] =  invDeterminant * cofactor5;
+    r[6] = -invDeterminant * cofactor9;
+    r[7] =  invDeterminant * cofactor13;
+
+    r[8] =  invDeterminant * cofactor2;
+    r[9] = -invDeterminant * cofactor6;
+    r[10]=  invDeterminant * cofactor10;
+    r[11]= -invDeterminant * cofactor14;
+
+    r[12]= -invDeterminant * cofactor3;
+    r[13]=  invDeterminant * cofactor7;
+    r[14]= -invDeterminant * cofactor11;
+    r[15]=  invDeterminant * cofactor15;
+    return true;
+}
+
+
+
+#ifdef MATH_SIMD_SSE2
+///////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels
+///////////////////////////////////////////////////////////////////////////////
+inline void mat4MultiplySSE(const float* a, const float* b, float* r)
+{
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_loadu_ps(b + 12);
+
+    // row i of the result = sum_k a[i][k] * row k of b
+    __m128 rows[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[i*4]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 3]), b3));
+        rows[i] = row;
+    }
+    // stored last so r may alias a or b
+    _mm_storeu_ps(r,      rows[0]);
+    _mm_storeu_ps(r + 4,  rows[1]);
+    _mm_storeu_ps(r + 8,  rows[2]);
+    _mm_storeu_ps(r + 12, rows[3]);
+}
+
+
+
+inline void mat4TransformSSE(const float* m, const float* v, float* r)
+{
+    __m128 vec = _mm_loadu_ps(v);
+    __m128 p0 = _mm_mul_ps(_mm_loadu_ps(m),      vec);
+    __m128 p1 = _mm_mul_ps(_mm_loadu_ps(m + 4),  vec);
+    __m128 p2 = _mm_mul_ps(_mm_loadu_ps(m + 8),  vec);
+    __m128 p3 = _mm_mul_ps(_mm_loadu_ps(m + 12), vec);
+    // horizontal sums of the four products
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_storeu_ps(r, _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+}
+
+
+
+inline void mat4MultiplyAffineSSE(const float* a, const float* b, float* r)
+{
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+
+    // the 4th row of b is (0 0 0 1), so a[i][3] only adds to the w lane
+    __m128 rows[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[i*4]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 2]), b2));
+        rows[i] = _mm_add_ps(row, _mm_set_ps(a[i*4 + 3], 0.0f, 0.0f, 0.0f));
+    }
+    _mm_storeu_ps(r,      rows[0]);
+    _mm_storeu_ps(r + 4,  rows[1]);
+    _mm_storeu_ps(r + 8,  rows[2]);
+    _mm_storeu_ps(r + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+}
+
+
+
+inline void mat4MultiplyAffineTSSE(const float* a, const float* b, float* r)
+{
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_loadu_ps(b + 12);
+
+    // a[i][3] is 0 except a[3][3] = 1, and the w lanes of b carry (0 0 0 1)
+    __m128 rows[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[i*4]), b0);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 1]), b1));
+        rows[i] = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i*4 + 2]), b2));
+    }
+    rows[3] = _mm_add_ps(rows[3], b3);
+    _mm_storeu_ps(r,      rows[0]);
+    _mm_storeu_ps(r + 4,  rows[1]);
+    _mm_storeu_ps(r + 8,  rows[2]);
+    _mm_storeu_ps(r + 12, rows[3]);
+}
+
+
+
+inline void vec4MultiplySSE(const float* v, const float* m, float* r)
+{
+    __m128 t = _mm_mul_ps(_mm_set1_ps(v[0]), _mm_loadu_ps(m));
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(v[1]), _mm_loadu_ps(m + 4)));
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(v[2]), _mm_loadu_ps(m + 8)));
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(v[3]), _mm_loadu_ps(m + 12)));
+    _mm_storeu_ps(r, t);
+}
+
+
+
+#define MATH_SHUFFLE(a, b, x, y, z, w)  _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define MATH_SWIZZLE(v, x, y, z, w)     MATH_SHUFFLE(v, v, x, y, z, w)
+
+// 2x2 blocks packed as (m00, m01, m10, m11)
+inline __m128 mat2Mul(__m128 a, __m128 b)       // A * B
+{
+    return _mm_add_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 0,3,0,3)),
+                      _mm_mul_ps(MATH_SWIZZLE(a, 1,0,3,2), MATH_SWIZZLE(b, 2,1,2,1)));
+}
+
+inline __m128 mat2AdjMul(__m128 a, __m128 b)    // adj(A) * B
+{
+    return _mm_sub_ps(_mm_mul_ps(MATH_SWIZZLE(a, 3,3,0,0), b),
+                      _mm_mul_ps(MATH_SWIZZLE(a, 1,1,2,2), MATH_SWIZZLE(b, 2,3,0,1)));
+}
+
+inline __m128 mat2MulAdj(__m128 a, __m128 b)    // A * adj(B)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 3,0,3,0)),
+                      _mm_mul_ps(MATH_SWIZZLE(a, 1,0,3,2), MATH_SWIZZLE(b, 2,1,2,1)));
+}
+
+
+
+// determinant of the 4x4 and the intermediate 2x2 block terms of the inverse
+// M = | A B |   |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+//     | C D |
+struct Mat4Blocks
+{
+    __m128 A, B, C, D;
+    __m128 detA, detB, detC, detD;
+    __m128 A_B, D_C;        // adj(A)*B, adj(D)*C
+    __m128 det;             // |M| in all lanes
+};
+
+inline void mat4BlocksSSE(const float* m, Mat4Blocks& k)
+{
+    __m128 r0 = _mm_loadu_ps(m);
+    __m128 r1 = _mm_loadu_ps(m + 4);
+    __m128 r2 = _mm_loadu_ps(m + 8);
+    __m128 r3 = _mm_loadu_ps(m + 12);
+
+    k.A = _mm_movelh_ps(r0, r1);
+    k.B = _mm_movehl_ps(r1, r0);
+    k.C = _mm_movelh_ps(r2, r3);
+    k.D = _mm_movehl_ps(r3, r2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(MATH_SHUFFLE(r0, r2, 0,2,0,2), MATH_SHUFFLE(r1, r3, 1,3,1,3)),
+        _mm_mul_ps(MATH_SHUFFLE(r0, r2, 1,3,1,3), MATH_SHUFFLE(r1, r3, 0,2,0,2)));
+    k.detA = MATH_SWIZZLE(detSub, 0,0,0,0);
+    k.detB = MATH_SWIZZLE(detSub, 1,1,1,1);
+    k.detC = MATH_SWIZZLE(detSub, 2,2,2,2);
+    k.detD = MATH_SWIZZLE(detSub, 3,3,3,3);
+
+    k.D_C = mat2AdjMul(k.D, k.C);
+    k.A_B = mat2AdjMul(k.A, k.B);
+
+    // tr(adj(A)B * adj(D)C), horizontal add with SSE2 shuffles only
+    __m128 tr = _mm_mul_ps(k.A_B, MATH_SWIZZLE(k.D_C, 0,2,1,3));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 2,3,0,1));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 1,0,3,2));
+
+    k.det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(k.detA, k.detD), _mm_mul_ps(k.detB, k.detC)), tr);
+}
+
+
+
+inline float mat4DeterminantSSE(const float* m)
+{
+    Mat4Blocks k;
+    mat4BlocksSSE(m, k);
+    return _mm_cvtss_f32(k.det);
+}
+
+
+
+// block-wise inverse, returns false (r untouched) if singular
+inline bool mat4InverseSSE(const float* m, float* r)
+{
+    Mat4Blocks k;
+    mat4BlocksSSE(m, k);
+    float determinant = _mm_cvtss_f32(k.det);
+    if(fabs(determinant) <= MATH_SINGULAR_EPSILON)
+        return false;
+
+    // inverse = 1/|M| * | X Y |, computed as adjugates of the blocks
+    //                   | Z W |
+    __m128 X_ = _mm_sub_ps(_mm_mul_ps(k.detD, k.A), mat2Mul(k.B, k.D_C));
+    __m128 W_ = _mm_sub_ps(_mm_mul_ps(k.detA, k.D), mat2Mul(k.C, k.A_B));
+    __m128 Y_ = _mm_sub_ps(_mm_mul_ps(k.detB, k.C), mat2MulAdj(k.D, k.A_B));
+    __m128 Z_ = _mm_sub_ps(_mm_mul_ps(k.detC, k.B), mat2MulAdj(k.A, k.D_C));
+
+    __m128 rDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), k.det);
+    X_ = _mm_mul_ps(X_, rDet);
+    Y_ = _mm_mul_ps(Y_, rDet);
+    Z_ = _mm_mul_ps(Z_, rDet);
+    W_ = _mm_mul_ps(W_, rDet);
+
+    // adjugate shuffle combined with the store shuffle
+    _mm_storeu_ps(r,      MATH_SHUFFLE(X_, Y_, 3,1,3,1));
+    _mm_storeu_ps(r + 4,  MATH_SHUFFLE(X_, Y_, 2,0,2,0));
+    _mm_storeu_ps(r + 8,  MATH_SHUFFLE(Z_, W_, 3,1,3,1));
+    _mm_storeu_ps(r + 12, MATH_SHUFFLE(Z_, W_, 2,0,2,0));
+    return true;
+}
+#endif // MATH_SIMD_SSE2
+
+
+
+#ifdef MATH_SIMD_AVX
+///////////////////////////////////////////////////////////////////////////////
+// AVX kernels, two result rows per 256-bit register
+///////////////////////////////////////////////////////////////////////////////
+inline __m256 mat4MulAdd256(__m256 a, __m256 b, __m256 c)
+{
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+inline void mat4MultiplyAVX(const float* a, const float* b, float* r)
+{
+    // each row of b duplicated into both 128-bit lanes
+    __m256 b0 = _mm256_broadcast_ps((const __m128*)b);
+    __m256 b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+    __m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8));
+    __m256 b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+
+    __m256 a01 = _mm256_loadu_ps(a);
+    __m256 a23 = _mm256_loadu_ps(a + 8);
+
+    __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+    r01 = mat4MulAdd256(_mm256_permute_ps(a01, 0x55), b1, r01);
+    r01 = mat4MulAdd256(_mm256_permute_ps(a01, 0xAA), b2, r01);
+    r01 = mat4MulAdd256(_mm256_permute_ps(a01, 0xFF), b3, r01);
+
+    __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+    r23 = mat4MulAdd256(_mm256_permute_ps(a23, 0x55), b1, r23);
+    r23 = mat4MulAdd256(_mm256_permute_ps(a23, 0xAA), b2, r23);
+    r23 = mat4MulAdd256(_mm256_permute_ps(a23, 0xFF), b3, r23);
+
+    _mm256_storeu_ps(r, r01);
+    _mm256_storeu_ps(r + 8, r23);
+}
+#endif // MATH_SIMD_AVX
+
+
+
+#ifdef MATH_SIMD_NEON
+///////////////////////////////////////////////////////////////////////////////
+// NEON kernels
+///////////////////////////////////////////////////////////////////////////////
+inline void mat4MultiplyNEON(const float* a, const float* b, float* r)
+{
+    float32x4_t b0 = vld1q_f32(b);
+    float32x4_t b1 = vld1q_f32(b + 4);
+    float32x4_t b2 = vld1q_f32(b + 8);
+    float32x4_t b3 = vld1q_f32(b + 12);
+
+    float32x4_t rows[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        float32x4_t row = vld1q_f32(a + i*4);
+        float32x4_t t = vmulq_lane_f32(b0, vget_low_f32(row), 0);
+        t = vmlaq_lane_f32(t, b1, vget_low_f32(row), 1);
+        t = vmlaq_lane_f32(t, b2, vget_high_f32(row), 0);
+        t = vmlaq_lane_f32(t, b3, vget_high_f32(row), 1);
+        rows[i] = t;
+    }
+    vst1q_f32(r,      rows[0]);
+    vst1q_f32(r + 4,  rows[1]);
+    vst1q_f32(r + 8,  rows[2]);
+    vst1q_f32(r + 12, rows[3]);
+}
+
+
+
+inline void mat4TransformNEON(const float* m, const float* v, float* r)
+{
+    float32x4_t vec = vld1q_f32(v);
+    float32x4_t p0 = vmulq_f32(vld1q_f32(m),      vec);
+    float32x4_t p1 = vmulq_f32(vld1q_f32(m + 4),  vec);
+    float32x4_t p2 = vmulq_f32(vld1q_f32(m + 8),  vec);
+    float32x4_t p3 = vmulq_f32(vld1q_f32(m + 12), vec);
+    // (a0+a1, b0+b1) + (a2+a3, b2+b3) gives the full sums of rows a and b
+    float32x2_t lo = vpadd_f32(vget_low_f32(p0), vget_low_f32(p1));
+    float32x2_t hi = vpadd_f32(vget_high_f32(p0), vget_high_f32(p1));
+    float32x2_t lo2 = vpadd_f32(vget_low_f32(p2), vget_low_f32(p3));
+    float32x2_t hi2 = vpadd_f32(vget_high_f32(p2), vget_high_f32(p3));
+    vst1q_f32(r, vcombine_f32(vadd_f32(lo, hi), vadd_f32(lo2, hi2)));
+}
+
+
+
+inline void vec4MultiplyNEON(const float* v, const float* m, float* r)
+{
+    float32x4_t vec = vld1q_f32(v);
+    float32x4_t t = vmulq_lane_f32(vld1q_f32(m), vget_low_f32(vec), 0);
+    t = vmlaq_lane_f32(t, vld1q_f32(m + 4),  vget_low_f32(vec), 1);
+    t = vmlaq_lane_f32(t, vld1q_f32(m + 8),  vget_high_f32(vec), 0);
+    t = vmlaq_lane_f32(t, vld1q_f32(m + 12), vget_high_f32(vec), 1);
+    vst1q_f32(r, t);
+}
+#endif // MATH_SIMD_NEON
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// selected backend
+///////////////////////////////////////////////////////////////////////////////
+inline const char* mat4Backend()
+{
+#if defined(MATH_SIMD_AVX) && defined(__FMA__)
+    return "AVX+FMA";
+#elif defined(MATH_SIMD_AVX)
+    return "AVX";
+#elif defined(MATH_SIMD_SSE2)
+    return "SSE2";
+#elif defined(MATH_SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+inline void mat4Multiply(const float* a, const float* b, float* r)
+{
+#if defined(MATH_SIMD_AVX)
+    mat4MultiplyAVX(a, b, r);
+#elif defined(MATH_SIMD_SSE2)
+    mat4MultiplySSE(a, b, r);
+#elif defined(MATH_SIMD_NEON)
+    mat4MultiplyNEON(a, b, r);
+#else
+    mat4MultiplyScalar(a, b, r);
+#endif
+}
+
+inline void mat4MultiplyAffine(const float* a, const float* b, float* r)
+{
+#if defined(MATH_SIMD_SSE2)
+    mat4MultiplyAffineSSE(a, b, r);
+#else
+    mat4MultiplyAffineScalar(a, b, r);
+#endif
+}
+
+inline void mat4MultiplyAffineT(const float* a, const float* b, float* r)
+{
+#if defined(MATH_SIMD_SSE2)
+    mat4MultiplyAffineTSSE(a, b, r);
+#else
+    mat4MultiplyAffineTScalar(a, b, r);
+#endif
+}
+
+inline void mat4Transform(const float* m, const float* v, float* r)
+{
+#if defined(MATH_SIMD_SSE2)
+    mat4TransformSSE(m, v, r);
+#elif defined(MATH_SIMD_NEON)
+    mat4TransformNEON(m, v, r);
+#else
+    mat4TransformScalar(m, v, r);
+#endif
+}
+
+inline void vec4Multiply(const float* v, const float* m, float* r)
+{
+#if defined(MATH_SIMD_SSE2)
+    vec4MultiplySSE(v, m, r);
+#elif defined(MATH_SIMD_NEON)
+    vec4MultiplyNEON(v, m, r);
+#else
+    vec4MultiplyScalar(v, m, r);
+#endif
+}
+
+inline float mat4Determinant(const float* m)
+{
+#if defined(MATH_SIMD_SSE2)
+    return mat4DeterminantSSE(m);
+#else
+    return mat4DeterminantScalar(m);
+#endif
+}
+
+inline bool mat4Inverse(const float* m, float* r)
+{
+#if defined(MATH_SIMD_SSE2)
+    return mat4InverseSSE(m, r);
+#else
+    return mat4InverseScalar(m, r);
+#endif
+}
+
+#endif
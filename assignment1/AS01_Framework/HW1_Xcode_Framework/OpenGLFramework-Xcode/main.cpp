@@ -291,12 +291,8 @@ void drawPlane()
 
 	Matrix4 MVP;
 	MVP = project_matrix * view_matrix;
-	GLfloat mvp[16] = {MVP[0],  MVP[4],  MVP[8],  MVP[12],
-                       MVP[1],  MVP[5],  MVP[9],  MVP[13],
-                       MVP[2],  MVP[6],  MVP[10], MVP[14],
-					   MVP[3],  MVP[7],  MVP[11], MVP[15]};
 
-	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, mvp);
+	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, MVP.getTranspose());
 	glBindVertexArray(quad.vao);
 	glDrawArrays(GL_TRIANGLES, 0, quad.vertex_count);
 	glBindVertexArray(0);
@@ -307,25 +303,20 @@ void RenderScene(void) {
 	// clear canvas
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-	Matrix4 T, R, S;
 	// [TODO] update translation, rotation and scaling
-	T = translate(m_shape_list[cur_idx].trans);
-	R = rotate(m_shape_list[cur_idx].rotate);
-	S = scaling(m_shape_list[cur_idx].scale);
+	// T * R * S evaluated directly, see composeTRS()
+	Matrix4 model_matrix = composeTRS(m_shape_list[cur_idx].trans, m_shape_list[cur_idx].rotate, m_shape_list[cur_idx].scale);
 
     Matrix4 MVP;
-	MVP = project_matrix * view_matrix * T * R * S;
-	GLfloat mvp[16] = {MVP[0],  MVP[4],  MVP[8],  MVP[12],
-                       MVP[1],  MVP[5],  MVP[9],  MVP[13],
-                       MVP[2],  MVP[6],  MVP[10], MVP[14],
-					   MVP[3],  MVP[7],  MVP[11], MVP[15]};
+	MVP = project_matrix * view_matrix * model_matrix;
 
 	// [TODO] multiply all the matrix
 	// [TODO] row-major ---> column-major
+	// Matrix4 is stored column major, getTranspose() hands it to GL without a copy
 	// use uniform to send mvp to vertex shader
 	// [TODO] draw 3D model in solid or in wireframe mode here, and draw plane
 	
-	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, mvp);
+	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, MVP.getTranspose());
 	glBindVertexArray(m_shape_list[cur_idx].vao);
 	glDrawArrays(GL_TRIANGLES, 0, m_shape_list[cur_idx].vertex_count);
 	glBindVertexArray(0);
@@ -15,8 +15,23 @@
 #define VECTORS_H_DEF
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
+// hardware reciprocal square root estimate for fastInvSqrt()
+#if !defined(MATH_SIMD_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+    #define MATH_RSQRT_SSE
+    #include <xmmintrin.h>
+#endif
+
+// constexpr needs C++14 for the member functions that modify *this
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+    #define MATH_HAS_CONSTEXPR
+    #define MATH_CONSTEXPR constexpr
+#else
+    #define MATH_CONSTEXPR
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // 2D vector
 ///////////////////////////////////////////////////////////////////////////////
@@ -26,36 +41,36 @@ struct Vector2
     float y;
 
     // ctors
-    Vector2() : x(0), y(0) {};
-    Vector2(float x, float y) : x(x), y(y) {};
+    MATH_CONSTEXPR Vector2() : x(0), y(0) {};
+    MATH_CONSTEXPR Vector2(float x, float y) : x(x), y(y) {};
 
     // utils functions
-    void        set(float x, float y);
+    MATH_CONSTEXPR void        set(float x, float y);
     float       length() const;                         //
     float       distance(const Vector2& vec) const;     // distance between two vectors
     Vector2&    normalize();                            //
-    float       dot(const Vector2& vec) const;          // dot product
+    MATH_CONSTEXPR float       dot(const Vector2& vec) const;          // dot product
     bool        equal(const Vector2& vec, float e) const; // compare with epsilon
 
     // operators
-    Vector2     operator-() const;                      // unary operator (negate)
-    Vector2     operator+(const Vector2& rhs) const;    // add rhs
-    Vector2     operator-(const Vector2& rhs) const;    // subtract rhs
-    Vector2&    operator+=(const Vector2& rhs);         // add rhs and update this object
-    Vector2&    operator-=(const Vector2& rhs);         // subtract rhs and update this object
-    Vector2     operator*(const float scale) const;     // scale
-    Vector2     operator*(const Vector2& rhs) const;    // multiply each element
-    Vector2&    operator*=(const float scale);          // scale and update this object
-    Vector2&    operator*=(const Vector2& rhs);         // multiply each element and update this object
-    Vector2     operator/(const float scale) const;     // inverse scale
-    Vector2&    operator/=(const float scale);          // scale and update this object
-    bool        operator==(const Vector2& rhs) const;   // exact compare, no epsilon
-    bool        operator!=(const Vector2& rhs) const;   // exact compare, no epsilon
-    bool        operator<(const Vector2& rhs) const;    // comparison for sort
+    MATH_CONSTEXPR Vector2     operator-() const;                      // unary operator (negate)
+    MATH_CONSTEXPR Vector2     operator+(const Vector2& rhs) const;    // add rhs
+    MATH_CONSTEXPR Vector2     operator-(const Vector2& rhs) const;    // subtract rhs
+    MATH_CONSTEXPR Vector2&    operator+=(const Vector2& rhs);         // add rhs and update this object
+    MATH_CONSTEXPR Vector2&    operator-=(const Vector2& rhs);         // subtract rhs and update this object
+    MATH_CONSTEXPR Vector2     operator*(const float scale) const;     // scale
+    MATH_CONSTEXPR Vector2     operator*(const Vector2& rhs) const;    // multiply each element
+    MATH_CONSTEXPR Vector2&    operator*=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR Vector2&    operator*=(const Vector2& rhs);         // multiply each element and update this object
+    MATH_CONSTEXPR Vector2     operator/(const float scale) const;     // inverse scale
+    MATH_CONSTEXPR Vector2&    operator/=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR bool        operator==(const Vector2& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const Vector2& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator<(const Vector2& rhs) const;    // comparison for sort
     float       operator[](int index) const;            // subscript operator v[0], v[1]
     float&      operator[](int index);                  // subscript operator v[0], v[1]
 
-    friend Vector2 operator*(const float a, const Vector2 vec);
+    friend MATH_CONSTEXPR Vector2 operator*(const float a, const Vector2 vec);
     friend std::ostream& operator<<(std::ostream& os, const Vector2& vec);
 };
 
@@ -71,37 +86,39 @@ struct Vector3
     float z;
 
     // ctors
-    Vector3() : x(0), y(0), z(0) {};
-    Vector3(float x, float y, float z) : x(x), y(y), z(z) {};
+    MATH_CONSTEXPR Vector3() : x(0), y(0), z(0) {};
+    MATH_CONSTEXPR Vector3(float x, float y, float z) : x(x), y(y), z(z) {};
 
     // utils functions
-    void        set(float x, float y, float z);
+    MATH_CONSTEXPR void        set(float x, float y, float z);
     float       length() const;                         //
     float       distance(const Vector3& vec) const;     // distance between two vectors
     Vector3&    normalize();                            //
-    float       dot(const Vector3& vec) const;          // dot product
-    Vector3     cross(const Vector3& vec) const;        // cross product
+    float       fastLength() const;                     // approximate, see fastInvSqrt()
+    Vector3&    fastNormalize();                        // approximate, see fastInvSqrt()
+    MATH_CONSTEXPR float       dot(const Vector3& vec) const;          // dot product
+    MATH_CONSTEXPR Vector3     cross(const Vector3& vec) const;        // cross product
     bool        equal(const Vector3& vec, float e) const; // compare with epsilon
 
     // operators
-    Vector3     operator-() const;                      // unary operator (negate)
-    Vector3     operator+(const Vector3& rhs) const;    // add rhs
-    Vector3     operator-(const Vector3& rhs) const;    // subtract rhs
-    Vector3&    operator+=(const Vector3& rhs);         // add rhs and update this object
-    Vector3&    operator-=(const Vector3& rhs);         // subtract rhs and update this object
-    Vector3     operator*(const float scale) const;     // scale
-    Vector3     operator*(const Vector3& rhs) const;    // multiplay each element
-    Vector3&    operator*=(const float scale);          // scale and update this object
-    Vector3&    operator*=(const Vector3& rhs);         // product each element and update this object
-    Vector3     operator/(const float scale) const;     // inverse scale
-    Vector3&    operator/=(const float scale);          // scale and update this object
-    bool        operator==(const Vector3& rhs) const;   // exact compare, no epsilon
-    bool        operator!=(const Vector3& rhs) const;   // exact compare, no epsilon
-    bool        operator<(const Vector3& rhs) const;    // comparison for sort
+    MATH_CONSTEXPR Vector3     operator-() const;                      // unary operator (negate)
+    MATH_CONSTEXPR Vector3     operator+(const Vector3& rhs) const;    // add rhs
+    MATH_CONSTEXPR Vector3     operator-(const Vector3& rhs) const;    // subtract rhs
+    MATH_CONSTEXPR Vector3&    operator+=(const Vector3& rhs);         // add rhs and update this object
+    MATH_CONSTEXPR Vector3&    operator-=(const Vector3& rhs);         // subtract rhs and update this object
+    MATH_CONSTEXPR Vector3     operator*(const float scale) const;     // scale
+    MATH_CONSTEXPR Vector3     operator*(const Vector3& rhs) const;    // multiplay each element
+    MATH_CONSTEXPR Vector3&    operator*=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR Vector3&    operator*=(const Vector3& rhs);         // product each element and update this object
+    MATH_CONSTEXPR Vector3     operator/(const float scale) const;     // inverse scale
+    MATH_CONSTEXPR Vector3&    operator/=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR bool        operator==(const Vector3& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const Vector3& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator<(const Vector3& rhs) const;    // comparison for sort
     float       operator[](int index) const;            // subscript operator v[0], v[1]
     float&      operator[](int index);                  // subscript operator v[0], v[1]
 
-    friend Vector3 operator*(const float a, const Vector3 vec);
+    friend MATH_CONSTEXPR Vector3 operator*(const float a, const Vector3 vec);
     friend std::ostream& operator<<(std::ostream& os, const Vector3& vec);
 };
 
@@ -118,110 +135,175 @@ struct Vector4
     float w;
 
     // ctors
-    Vector4() : x(0), y(0), z(0), w(0) {};
-    Vector4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
+    MATH_CONSTEXPR Vector4() : x(0), y(0), z(0), w(0) {};
+    MATH_CONSTEXPR Vector4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
 
     // utils functions
-    void        set(float x, float y, float z, float w);
+    MATH_CONSTEXPR void        set(float x, float y, float z, float w);
     float       length() const;                         //
     float       distance(const Vector4& vec) const;     // distance between two vectors
     Vector4&    normalize();                            //
-    float       dot(const Vector4& vec) const;          // dot product
+    MATH_CONSTEXPR float       dot(const Vector4& vec) const;          // dot product
     bool        equal(const Vector4& vec, float e) const; // compare with epsilon
 
     // operators
-    Vector4     operator-() const;                      // unary operator (negate)
-    Vector4     operator+(const Vector4& rhs) const;    // add rhs
-    Vector4     operator-(const Vector4& rhs) const;    // subtract rhs
-    Vector4&    operator+=(const Vector4& rhs);         // add rhs and update this object
-    Vector4&    operator-=(const Vector4& rhs);         // subtract rhs and update this object
-    Vector4     operator*(const float scale) const;     // scale
-    Vector4     operator*(const Vector4& rhs) const;    // multiply each element
-    Vector4&    operator*=(const float scale);          // scale and update this object
-    Vector4&    operator*=(const Vector4& rhs);         // multiply each element and update this object
-    Vector4     operator/(const float scale) const;     // inverse scale
-    Vector4&    operator/=(const float scale);          // scale and update this object
-    bool        operator==(const Vector4& rhs) const;   // exact compare, no epsilon
-    bool        operator!=(const Vector4& rhs) const;   // exact compare, no epsilon
-    bool        operator<(const Vector4& rhs) const;    // comparison for sort
+    MATH_CONSTEXPR Vector4     operator-() const;                      // unary operator (negate)
+    MATH_CONSTEXPR Vector4     operator+(const Vector4& rhs) const;    // add rhs
+    MATH_CONSTEXPR Vector4     operator-(const Vector4& rhs) const;    // subtract rhs
+    MATH_CONSTEXPR Vector4&    operator+=(const Vector4& rhs);         // add rhs and update this object
+    MATH_CONSTEXPR Vector4&    operator-=(const Vector4& rhs);         // subtract rhs and update this object
+    MATH_CONSTEXPR Vector4     operator*(const float scale) const;     // scale
+    MATH_CONSTEXPR Vector4     operator*(const Vector4& rhs) const;    // multiply each element
+    MATH_CONSTEXPR Vector4&    operator*=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR Vector4&    operator*=(const Vector4& rhs);         // multiply each element and update this object
+    MATH_CONSTEXPR Vector4     operator/(const float scale) const;     // inverse scale
+    MATH_CONSTEXPR Vector4&    operator/=(const float scale);          // scale and update this object
+    MATH_CONSTEXPR bool        operator==(const Vector4& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const Vector4& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator<(const Vector4& rhs) const;    // comparison for sort
     float       operator[](int index) const;            // subscript operator v[0], v[1]
     float&      operator[](int index);                  // subscript operator v[0], v[1]
 
-    friend Vector4 operator*(const float a, const Vector4 vec);
+    friend MATH_CONSTEXPR Vector4 operator*(const float a, const Vector4 vec);
     friend std::ostream& operator<<(std::ostream& os, const Vector4& vec);
 };
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// quaternion
+// Unit quaternions represent rotations. p * q rotates by q first, then by p,
+// the same order as the matrix product P * Q.
+///////////////////////////////////////////////////////////////////////////////
+struct Quaternion
+{
+    float x;                                            // vector part
+    float y;
+    float z;
+    float w;                                            // scalar part
+
+    // ctors
+    MATH_CONSTEXPR Quaternion() : x(0), y(0), z(0), w(1) {};     // identity
+    MATH_CONSTEXPR Quaternion(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
+
+    static Quaternion fromAxisAngle(const Vector3& axis, float angle);     // unit axis, angle in radian
+    static Quaternion fromEuler(const Vector3& angles);                    // same rotation as Rx * Ry * Rz, radian
+    static Quaternion fromRotationVector(const Vector3& v);                // |v| radian around v, no sin / cos below 0.1 radian
+    static Quaternion fromBasis(const Vector3& right, const Vector3& up, const Vector3& back); // columns of a rotation matrix
+
+    // utils functions
+    float       length() const;                         //
+    Quaternion& normalize();                            //
+    MATH_CONSTEXPR Quaternion& renormalize();           // back to unit length from a nearly unit quaternion
+    MATH_CONSTEXPR Quaternion  conjugate() const;       // inverse rotation of a unit quaternion
+    MATH_CONSTEXPR float       dot(const Quaternion& q) const;         // dot product
+    MATH_CONSTEXPR Vector3     rotate(const Vector3& v) const;         // rotate v, unit quaternion only
+
+    // operators
+    MATH_CONSTEXPR Quaternion  operator*(const Quaternion& rhs) const; // composition: rhs first, then this
+    MATH_CONSTEXPR Quaternion& operator*=(const Quaternion& rhs);      // composition and update this object
+    MATH_CONSTEXPR bool        operator==(const Quaternion& rhs) const; // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const Quaternion& rhs) const; // exact compare, no epsilon
+
+    friend std::ostream& operator<<(std::ostream& os, const Quaternion& q);
+};
+
+Quaternion nlerp(const Quaternion& a, const Quaternion& b, float t);   // normalized lerp, shortest arc
+Quaternion slerp(const Quaternion& a, const Quaternion& b, float t);   // constant speed, shortest arc
+
+
+
 // fast math routines from Doom3 SDK
 inline float invSqrt(float x)
 {
     float xhalf = 0.5f * x;
-    int i = *(int*)&x;          // get bits for floating value
+    int i;
+    memcpy(&i, &x, sizeof(i));  // get bits for floating value
     i = 0x5f3759df - (i>>1);    // gives initial guess
-    x = *(float*)&i;            // convert bits back to float
+    memcpy(&x, &i, sizeof(x));  // convert bits back to float
     x = x * (1.5f - xhalf*x*x); // Newton step
     return x;
 }
 
+// 1 / sqrt(x) for normalizing in bulk, opt-in: normalize() and length() stay
+// correctly rounded. With SSE the rsqrtss estimate (rel. error < 1.5 * 2^-12)
+// is refined by one Newton step, the result is within 2.8e-7 relative (4 ulp)
+// of the exact value. Elsewhere invSqrt() gets a second Newton step and is
+// within 4.8e-6 (75 ulp). The Vector3 fast paths add up to 2 ulp of rounding.
+// x = 0 is not handled: the SSE estimate is +inf and the Newton step turns
+// it into NaN, invSqrt() gives a large finite value. fastNormalize() of a
+// zero vector is NaN either way, as with normalize(). On current x86 cores
+// sqrtss and divss are pipelined and fastNormalize() measures 5-20% slower
+// than normalize() in --bench; the estimate only pays off without them.
+inline float fastInvSqrt(float x)
+{
+#ifdef MATH_RSQRT_SSE
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f*x*y*y);
+#else
+    float y = invSqrt(x);
+    return y * (1.5f - 0.5f*x*y*y);
+#endif
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // inline functions for Vector2
 ///////////////////////////////////////////////////////////////////////////////
-inline Vector2 Vector2::operator-() const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator-() const {
     return Vector2(-x, -y);
 }
 
-inline Vector2 Vector2::operator+(const Vector2& rhs) const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator+(const Vector2& rhs) const {
     return Vector2(x+rhs.x, y+rhs.y);
 }
 
-inline Vector2 Vector2::operator-(const Vector2& rhs) const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator-(const Vector2& rhs) const {
     return Vector2(x-rhs.x, y-rhs.y);
 }
 
-inline Vector2& Vector2::operator+=(const Vector2& rhs) {
+inline MATH_CONSTEXPR Vector2& Vector2::operator+=(const Vector2& rhs) {
     x += rhs.x; y += rhs.y; return *this;
 }
 
-inline Vector2& Vector2::operator-=(const Vector2& rhs) {
+inline MATH_CONSTEXPR Vector2& Vector2::operator-=(const Vector2& rhs) {
     x -= rhs.x; y -= rhs.y; return *this;
 }
 
-inline Vector2 Vector2::operator*(const float a) const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator*(const float a) const {
     return Vector2(x*a, y*a);
 }
 
-inline Vector2 Vector2::operator*(const Vector2& rhs) const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator*(const Vector2& rhs) const {
     return Vector2(x*rhs.x, y*rhs.y);
 }
 
-inline Vector2& Vector2::operator*=(const float a) {
+inline MATH_CONSTEXPR Vector2& Vector2::operator*=(const float a) {
     x *= a; y *= a; return *this;
 }
 
-inline Vector2& Vector2::operator*=(const Vector2& rhs) {
+inline MATH_CONSTEXPR Vector2& Vector2::operator*=(const Vector2& rhs) {
     x *= rhs.x; y *= rhs.y; return *this;
 }
 
-inline Vector2 Vector2::operator/(const float a) const {
+inline MATH_CONSTEXPR Vector2 Vector2::operator/(const float a) const {
     return Vector2(x/a, y/a);
 }
 
-inline Vector2& Vector2::operator/=(const float a) {
+inline MATH_CONSTEXPR Vector2& Vector2::operator/=(const float a) {
     x /= a; y /= a; return *this;
 }
 
-inline bool Vector2::operator==(const Vector2& rhs) const {
+inline MATH_CONSTEXPR bool Vector2::operator==(const Vector2& rhs) const {
     return (x == rhs.x) && (y == rhs.y);
 }
 
-inline bool Vector2::operator!=(const Vector2& rhs) const {
+inline MATH_CONSTEXPR bool Vector2::operator!=(const Vector2& rhs) const {
     return (x != rhs.x) || (y != rhs.y);
 }
 
-inline bool Vector2::operator<(const Vector2& rhs) const {
+inline MATH_CONSTEXPR bool Vector2::operator<(const Vector2& rhs) const {
     if(x < rhs.x) return true;
     if(x > rhs.x) return false;
     if(y < rhs.y) return true;
@@ -237,7 +319,7 @@ inline float& Vector2::operator[](int index) {
     return (&x)[index];
 }
 
-inline void Vector2::set(float x, float y) {
+inline MATH_CONSTEXPR void Vector2::set(float x, float y) {
     this->x = x; this->y = y;
 }
 
@@ -262,7 +344,7 @@ inline Vector2& Vector2::normalize() {
     return *this;
 }
 
-inline float Vector2::dot(const Vector2& rhs) const {
+inline MATH_CONSTEXPR float Vector2::dot(const Vector2& rhs) const {
     return (x*rhs.x + y*rhs.y);
 }
 
@@ -270,7 +352,7 @@ inline bool Vector2::equal(const Vector2& rhs, float epsilon) const {
     return fabs(x - rhs.x) < epsilon && fabs(y - rhs.y) < epsilon;
 }
 
-inline Vector2 operator*(const float a, const Vector2 vec) {
+inline MATH_CONSTEXPR Vector2 operator*(const float a, const Vector2 vec) {
     return Vector2(a*vec.x, a*vec.y);
 }
 
@@ -286,59 +368,59 @@ inline std::ostream& operator<<(std::ostream& os, const Vector2& vec) {
 ///////////////////////////////////////////////////////////////////////////////
 // inline functions for Vector3
 ///////////////////////////////////////////////////////////////////////////////
-inline Vector3 Vector3::operator-() const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator-() const {
     return Vector3(-x, -y, -z);
 }
 
-inline Vector3 Vector3::operator+(const Vector3& rhs) const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator+(const Vector3& rhs) const {
     return Vector3(x+rhs.x, y+rhs.y, z+rhs.z);
 }
 
-inline Vector3 Vector3::operator-(const Vector3& rhs) const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator-(const Vector3& rhs) const {
     return Vector3(x-rhs.x, y-rhs.y, z-rhs.z);
 }
 
-inline Vector3& Vector3::operator+=(const Vector3& rhs) {
+inline MATH_CONSTEXPR Vector3& Vector3::operator+=(const Vector3& rhs) {
     x += rhs.x; y += rhs.y; z += rhs.z; return *this;
 }
 
-inline Vector3& Vector3::operator-=(const Vector3& rhs) {
+inline MATH_CONSTEXPR Vector3& Vector3::operator-=(const Vector3& rhs) {
     x -= rhs.x; y -= rhs.y; z -= rhs.z; return *this;
 }
 
-inline Vector3 Vector3::operator*(const float a) const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator*(const float a) const {
     return Vector3(x*a, y*a, z*a);
 }
 
-inline Vector3 Vector3::operator*(const Vector3& rhs) const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator*(const Vector3& rhs) const {
     return Vector3(x*rhs.x, y*rhs.y, z*rhs.z);
 }
 
-inline Vector3& Vector3::operator*=(const float a) {
+inline MATH_CONSTEXPR Vector3& Vector3::operator*=(const float a) {
     x *= a; y *= a; z *= a; return *this;
 }
 
-inline Vector3& Vector3::operator*=(const Vector3& rhs) {
+inline MATH_CONSTEXPR Vector3& Vector3::operator*=(const Vector3& rhs) {
     x *= rhs.x; y *= rhs.y; z *= rhs.z; return *this;
 }
 
-inline Vector3 Vector3::operator/(const float a) const {
+inline MATH_CONSTEXPR Vector3 Vector3::operator/(const float a) const {
     return Vector3(x/a, y/a, z/a);
 }
 
-inline Vector3& Vector3::operator/=(const float a) {
+inline MATH_CONSTEXPR Vector3& Vector3::operator/=(const float a) {
     x /= a; y /= a; z /= a; return *this;
 }
 
-inline bool Vector3::operator==(const Vector3& rhs) const {
+inline MATH_CONSTEXPR bool Vector3::operator==(const Vector3& rhs) const {
     return (x == rhs.x) && (y == rhs.y) && (z == rhs.z);
 }
 
-inline bool Vector3::operator!=(const Vector3& rhs) const {
+inline MATH_CONSTEXPR bool Vector3::operator!=(const Vector3& rhs) const {
     return (x != rhs.x) || (y != rhs.y) || (z != rhs.z);
 }
 
-inline bool Vector3::operator<(const Vector3& rhs) const {
+inline MATH_CONSTEXPR bool Vector3::operator<(const Vector3& rhs) const {
     if(x < rhs.x) return true;
     if(x > rhs.x) return false;
     if(y < rhs.y) return true;
@@ -356,7 +438,7 @@ inline float& Vector3::operator[](int index) {
     return (&x)[index];
 }
 
-inline void Vector3::set(float x, float y, float z) {
+inline MATH_CONSTEXPR void Vector3::set(float x, float y, float z) {
     this->x = x; this->y = y; this->z = z;
 }
 
@@ -368,6 +450,19 @@ inline float Vector3::distance(const Vector3& vec) const {
     return sqrtf((vec.x-x)*(vec.x-x) + (vec.y-y)*(vec.y-y) + (vec.z-z)*(vec.z-z));
 }
 
+inline float Vector3::fastLength() const {
+    float xxyyzz = x*x + y*y + z*z;
+    return xxyyzz > 0 ? xxyyzz * fastInvSqrt(xxyyzz) : 0.0f;
+}
+
+inline Vector3& Vector3::fastNormalize() {
+    float invLength = fastInvSqrt(x*x + y*y + z*z);
+    x *= invLength;
+    y *= invLength;
+    z *= invLength;
+    return *this;
+}
+
 inline Vector3& Vector3::normalize() {
     //@@const float EPSILON = 0.000001f;
     float xxyyzz = x*x + y*y + z*z;
@@ -382,11 +477,11 @@ inline Vector3& Vector3::normalize() {
     return *this;
 }
 
-inline float Vector3::dot(const Vector3& rhs) const {
+inline MATH_CONSTEXPR float Vector3::dot(const Vector3& rhs) const {
     return (x*rhs.x + y*rhs.y + z*rhs.z);
 }
 
-inline Vector3 Vector3::cross(const Vector3& rhs) const {
+inline MATH_CONSTEXPR Vector3 Vector3::cross(const Vector3& rhs) const {
     return Vector3(y*rhs.z - z*rhs.y, z*rhs.x - x*rhs.z, x*rhs.y - y*rhs.x);
 }
 
@@ -394,7 +489,7 @@ inline bool Vector3::equal(const Vector3& rhs, float epsilon) const {
     return fabs(x - rhs.x) < epsilon && fabs(y - rhs.y) < epsilon && fabs(z - rhs.z) < epsilon;
 }
 
-inline Vector3 operator*(const float a, const Vector3 vec) {
+inline MATH_CONSTEXPR Vector3 operator*(const float a, const Vector3 vec) {
     return Vector3(a*vec.x, a*vec.y, a*vec.z);
 }
 
@@ -409,59 +504,59 @@ inline std::ostream& operator<<(std::ostream& os, const Vector3& vec) {
 ///////////////////////////////////////////////////////////////////////////////
 // inline functions for Vector4
 ///////////////////////////////////////////////////////////////////////////////
-inline Vector4 Vector4::operator-() const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator-() const {
     return Vector4(-x, -y, -z, -w);
 }
 
-inline Vector4 Vector4::operator+(const Vector4& rhs) const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator+(const Vector4& rhs) const {
     return Vector4(x+rhs.x, y+rhs.y, z+rhs.z, w+rhs.w);
 }
 
-inline Vector4 Vector4::operator-(const Vector4& rhs) const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator-(const Vector4& rhs) const {
     return Vector4(x-rhs.x, y-rhs.y, z-rhs.z, w-rhs.w);
 }
 
-inline Vector4& Vector4::operator+=(const Vector4& rhs) {
+inline MATH_CONSTEXPR Vector4& Vector4::operator+=(const Vector4& rhs) {
     x += rhs.x; y += rhs.y; z += rhs.z; w += rhs.w; return *this;
 }
 
-inline Vector4& Vector4::operator-=(const Vector4& rhs) {
+inline MATH_CONSTEXPR Vector4& Vector4::operator-=(const Vector4& rhs) {
     x -= rhs.x; y -= rhs.y; z -= rhs.z; w -= rhs.w; return *this;
 }
 
-inline Vector4 Vector4::operator*(const float a) const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator*(const float a) const {
     return Vector4(x*a, y*a, z*a, w*a);
 }
 
-inline Vector4 Vector4::operator*(const Vector4& rhs) const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator*(const Vector4& rhs) const {
     return Vector4(x*rhs.x, y*rhs.y, z*rhs.z, w*rhs.w);
 }
 
-inline Vector4& Vector4::operator*=(const float a) {
+inline MATH_CONSTEXPR Vector4& Vector4::operator*=(const float a) {
     x *= a; y *= a; z *= a; w *= a; return *this;
 }
 
-inline Vector4& Vector4::operator*=(const Vector4& rhs) {
+inline MATH_CONSTEXPR Vector4& Vector4::operator*=(const Vector4& rhs) {
     x *= rhs.x; y *= rhs.y; z *= rhs.z; w *= rhs.w; return *this;
 }
 
-inline Vector4 Vector4::operator/(const float a) const {
+inline MATH_CONSTEXPR Vector4 Vector4::operator/(const float a) const {
     return Vector4(x/a, y/a, z/a, w/a);
 }
 
-inline Vector4& Vector4::operator/=(const float a) {
+inline MATH_CONSTEXPR Vector4& Vector4::operator/=(const float a) {
     x /= a; y /= a; z /= a; w /= a; return *this;
 }
 
-inline bool Vector4::operator==(const Vector4& rhs) const {
+inline MATH_CONSTEXPR bool Vector4::operator==(const Vector4& rhs) const {
     return (x == rhs.x) && (y == rhs.y) && (z == rhs.z) && (w == rhs.w);
 }
 
-inline bool Vector4::operator!=(const Vector4& rhs) const {
+inline MATH_CONSTEXPR bool Vector4::operator!=(const Vector4& rhs) const {
     return (x != rhs.x) || (y != rhs.y) || (z != rhs.z) || (w != rhs.w);
 }
 
-inline bool Vector4::operator<(const Vector4& rhs) const {
+inline MATH_CONSTEXPR bool Vector4::operator<(const Vector4& rhs) const {
     if(x < rhs.x) return true;
     if(x > rhs.x) return false;
     if(y < rhs.y) return true;
@@ -481,7 +576,7 @@ inline float& Vector4::operator[](int index) {
     return (&x)[index];
 }
 
-inline void Vector4::set(float x, float y, float z, float w) {
+inline MATH_CONSTEXPR void Vector4::set(float x, float y, float z, float w) {
     this->x = x; this->y = y; this->z = z; this->w = w;
 }
 
@@ -508,7 +603,7 @@ inline Vector4& Vector4::normalize() {
     return *this;
 }
 
-inline float Vector4::dot(const Vector4& rhs) const {
+inline MATH_CONSTEXPR float Vector4::dot(const Vector4& rhs) const {
     return (x*rhs.x + y*rhs.y + z*rhs.z + w*rhs.w);
 }
 
@@ -517,7 +612,7 @@ inline bool Vector4::equal(const Vector4& rhs, float epsilon) const {
            fabs(z - rhs.z) < epsilon && fabs(w - rhs.w) < epsilon;
 }
 
-inline Vector4 operator*(const float a, const Vector4 vec) {
+inline MATH_CONSTEXPR Vector4 operator*(const float a, const Vector4 vec) {
     return Vector4(a*vec.x, a*vec.y, a*vec.z, a*vec.w);
 }
 
@@ -527,4 +622,155 @@ inline std::ostream& operator<<(std::ostream& os, const Vector4& vec) {
 }
 // END OF VECTOR4 /////////////////////////////////////////////////////////////
 
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// inline functions for Quaternion
+///////////////////////////////////////////////////////////////////////////////
+inline Quaternion Quaternion::fromAxisAngle(const Vector3& axis, float angle) {
+    float s = sinf(angle * 0.5f);
+    return Quaternion(axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f));
+}
+
+inline Quaternion Quaternion::fromEuler(const Vector3& angles) {
+    float sa = sinf(angles.x * 0.5f), ca = cosf(angles.x * 0.5f);
+    float sb = sinf(angles.y * 0.5f), cb = cosf(angles.y * 0.5f);
+    float sc = sinf(angles.z * 0.5f), cc = cosf(angles.z * 0.5f);
+    // qx * qy * qz expanded
+    return Quaternion(sa*cb*cc + ca*sb*sc,
+                      ca*sb*cc - sa*cb*sc,
+                      ca*cb*sc + sa*sb*cc,
+                      ca*cb*cc - sa*sb*sc);
+}
+
+// small rotations, e.g. per input event increments, use the series of
+// cos(a/2) and sin(a/2)/a, which is float exact below a = 0.1 radian
+inline Quaternion Quaternion::fromRotationVector(const Vector3& v) {
+    float a2 = v.x*v.x + v.y*v.y + v.z*v.z;
+    float c, s;                                 // cos(a/2), sin(a/2)/a
+    if(a2 < 0.01f) {
+        c = 1.0f - a2 * (1.0f / 8.0f)  + a2 * a2 * (1.0f / 384.0f);
+        s = 0.5f - a2 * (1.0f / 48.0f) + a2 * a2 * (1.0f / 3840.0f);
+    }
+    else {
+        float a = sqrtf(a2);
+        c = cosf(a * 0.5f);
+        s = sinf(a * 0.5f) / a;
+    }
+    return Quaternion(v.x * s, v.y * s, v.z * s, c);
+}
+
+// from the orthonormal columns of a rotation matrix, branching on the largest
+// diagonal term so the square root never sees a small argument
+inline Quaternion Quaternion::fromBasis(const Vector3& r, const Vector3& u, const Vector3& b) {
+    // in double, the float quaternion is then within half an ulp per component
+    double rx = r.x, ry = r.y, rz = r.z, ux = u.x, uy = u.y, uz = u.z, bx = b.x, by = b.y, bz = b.z;
+    double trace = rx + uy + bz;
+    if(trace > 0) {
+        double s = 0.5 / sqrt(trace + 1.0);
+        return Quaternion((float)((uz - by) * s), (float)((bx - rz) * s), (float)((ry - ux) * s), (float)(0.25 / s));
+    }
+    if(rx > uy && rx > bz) {
+        double s = 2.0 * sqrt(1.0 + rx - uy - bz);
+        return Quaternion((float)(0.25 * s), (float)((ux + ry) / s), (float)((bx + rz) / s), (float)((uz - by) / s));
+    }
+    if(uy > bz) {
+        double s = 2.0 * sqrt(1.0 + uy - rx - bz);
+        return Quaternion((float)((ux + ry) / s), (float)(0.25 * s), (float)((by + uz) / s), (float)((bx - rz) / s));
+    }
+    double s = 2.0 * sqrt(1.0 + bz - rx - uy);
+    return Quaternion((float)((bx + rz) / s), (float)((by + uz) / s), (float)(0.25 * s), (float)((ry - ux) / s));
+}
+
+inline float Quaternion::length() const {
+    return sqrtf(x*x + y*y + z*z + w*w);
+}
+
+inline Quaternion& Quaternion::normalize() {
+    float invLength = 1.0f / sqrtf(x*x + y*y + z*z + w*w);
+    x *= invLength;
+    y *= invLength;
+    z *= invLength;
+    w *= invLength;
+    return *this;
+}
+
+// one Newton step of 1/sqrt(n) from 1, no sqrt or division; products of unit
+// quaternions only drift by rounding errors, well inside its convergence
+inline MATH_CONSTEXPR Quaternion& Quaternion::renormalize() {
+    float k = (3.0f - (x*x + y*y + z*z + w*w)) * 0.5f;
+    x *= k;
+    y *= k;
+    z *= k;
+    w *= k;
+    return *this;
+}
+
+inline MATH_CONSTEXPR Quaternion Quaternion::conjugate() const {
+    return Quaternion(-x, -y, -z, w);
+}
+
+inline MATH_CONSTEXPR float Quaternion::dot(const Quaternion& q) const {
+    return x*q.x + y*q.y + z*q.z + w*q.w;
+}
+
+// v + w * t + u x t with t = 2 * (u x v), u the vector part
+inline MATH_CONSTEXPR Vector3 Quaternion::rotate(const Vector3& v) const {
+    Vector3 u(x, y, z);
+    Vector3 t = u.cross(v) * 2.0f;
+    return v + t * w + u.cross(t);
+}
+
+inline MATH_CONSTEXPR Quaternion Quaternion::operator*(const Quaternion& q) const {
+    return Quaternion(w*q.x + x*q.w + y*q.z - z*q.y,
+                      w*q.y - x*q.z + y*q.w + z*q.x,
+                      w*q.z + x*q.y - y*q.x + z*q.w,
+                      w*q.w - x*q.x - y*q.y - z*q.z);
+}
+
+inline MATH_CONSTEXPR Quaternion& Quaternion::operator*=(const Quaternion& q) {
+    *this = *this * q;
+    return *this;
+}
+
+inline MATH_CONSTEXPR bool Quaternion::operator==(const Quaternion& q) const {
+    return (x == q.x) && (y == q.y) && (z == q.z) && (w == q.w);
+}
+
+inline MATH_CONSTEXPR bool Quaternion::operator!=(const Quaternion& q) const {
+    return (x != q.x) || (y != q.y) || (z != q.z) || (w != q.w);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Quaternion& q) {
+    os << "(" << q.x << ", " << q.y << ", " << q.z << ", " << q.w << ")";
+    return os;
+}
+
+inline Quaternion nlerp(const Quaternion& a, const Quaternion& b, float t) {
+    float sign = a.dot(b) < 0 ? -1.0f : 1.0f;     // q and -q are the same rotation
+    float s = 1.0f - t;
+    t *= sign;
+    Quaternion q(s*a.x + t*b.x, s*a.y + t*b.y, s*a.z + t*b.z, s*a.w + t*b.w);
+    return q.normalize();
+}
+
+inline Quaternion slerp(const Quaternion& a, const Quaternion& b, float t) {
+    float cosine = a.dot(b);
+    float sign = 1.0f;
+    if(cosine < 0) {
+        cosine = -cosine;
+        sign = -1.0f;
+    }
+    // nearly parallel: sin(angle) vanishes, and nlerp is as accurate
+    if(cosine > 0.9995f)
+        return nlerp(a, b, t);
+    float angle = acosf(cosine);
+    float invSine = 1.0f / sinf(angle);
+    float s = sinf((1.0f - t) * angle) * invSine;
+    t = sinf(t * angle) * invSine * sign;
+    return Quaternion(s*a.x + t*b.x, s*a.y + t*b.y, s*a.z + t*b.z, s*a.w + t*b.w);
+}
+// END OF QUATERNION //////////////////////////////////////////////////////////
+
 #endif
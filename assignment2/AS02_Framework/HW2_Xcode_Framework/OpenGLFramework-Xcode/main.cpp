@@ -301,25 +301,22 @@ void RenderScene(void) {
 	// clear canvas
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-	Matrix4 T, R, S, MVP, MV;
+	Matrix4 MVP, MV;
 	// [TODO] update translation, rotation and scaling
-	T = translate(models[cur_idx].position);
-	R = rotate(models[cur_idx].rotation);
-	S = scaling(models[cur_idx].scale);
-	MVP = project_matrix * view_matrix * T * R * S;
-	MV = view_matrix * T * R * S;
-	GLfloat mvp[16];
+	// T * R * S evaluated directly, see composeTRS()
+	Matrix4 model_matrix = composeTRS(models[cur_idx].position, models[cur_idx].rotation, models[cur_idx].scale);
+	// MV is the shared suffix of MVP: V * M once with the affine 3x4 product, then P * MV
+	Matrix4Chain chain(model_matrix, MatrixAffine);
+	MV = chain.preMultiply(view_matrix, MatrixAffine).get();
+	MVP = chain.preMultiply(project_matrix).get();
 	// [TODO] multiply all the matrix
 	// [TODO] row-major ---> column-major
-	mvp[0] = MVP[0];  mvp[4] = MVP[1];  mvp[8]  = MVP[2];  mvp[12] = MVP[3];
-	mvp[1] = MVP[4];  mvp[5] = MVP[5];  mvp[9]  = MVP[6];  mvp[13] = MVP[7];
-	mvp[2] = MVP[8];  mvp[6] = MVP[9];  mvp[10] = MVP[10]; mvp[14] = MVP[11];
-	mvp[3] = MVP[12]; mvp[7] = MVP[13]; mvp[11] = MVP[14]; mvp[15] = MVP[15];
+	// Matrix4 is stored column major, getTranspose() hands it to GL without a copy
 
 	// use uniform to send mvp to vertex shader
 	glUniformMatrix4fv(glGetUniformLocation(ShaderID, "mv"), 1, GL_FALSE, MV.getTranspose());
 	glUniformMatrix4fv(glGetUniformLocation(ShaderID, "view_matrix"), 1, GL_FALSE, view_matrix.getTranspose());
-	glUniformMatrix4fv(glGetUniformLocation(ShaderID, "mvp"), 1, GL_FALSE, mvp);
+	glUniformMatrix4fv(glGetUniformLocation(ShaderID, "mvp"), 1, GL_FALSE, MVP.getTranspose());
 	
 	glUniform1i(glGetUniformLocation(ShaderID, "vertex_pixel"), 0);
 	glViewport(0, 0, float(WINDOW_WIDTH)/2, WINDOW_HEIGHT);
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark.h
+// ===========
+// Minimal timing harness for the CPU side micro-benchmarks run by --bench.
+//
+// benchRun() calls the body once to warm up, then repeats it in batches
+// until at least BENCH_MIN_SECONDS have passed and reports the nanoseconds
+// per call of the fastest batch. Bodies must feed their results into
+// benchSink() so the compiler cannot drop the work.
+//
+// benchCheck() records the worst ulp error of a case against its limit;
+// benchFailures() counts the cases over their limit, so --accuracy can be
+// used as a regression gate through its exit code. Timings are too noisy
+// to gate on and are only reported.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef BENCHMARK_H_DEF
+#define BENCHMARK_H_DEF
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_BATCH 4096
+
+static volatile float bench_sink_value;
+static int bench_failures = 0;
+
+inline void benchSink(float v)
+{
+	bench_sink_value = bench_sink_value + v;
+}
+
+template <class Body>
+double benchRun(const char* name, Body body)
+{
+	typedef std::chrono::steady_clock clock;
+
+	body();
+	double best = 1e30;
+	double total = 0.0;
+	while (total < BENCH_MIN_SECONDS)
+	{
+		clock::time_point begin = clock::now();
+		for (int i = 0; i < BENCH_BATCH; i++)
+			body();
+		double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+		total += seconds;
+		if (seconds < best)
+			best = seconds;
+	}
+
+	double ns = best * 1e9 / BENCH_BATCH;
+	printf("%-40s %10.2f ns/op %12.0f op/s\n", name, ns, 1e9 / ns);
+	return ns;
+}
+
+// error of got against a double precision reference, in ulps of float at
+// max(|ref|, scale); pass the largest magnitude of the result as scale so
+// elements that cancel to ~0 are not measured against their own tiny ulp
+inline double ulpError(float got, double ref, double scale)
+{
+	float magnitude = (float)(fabs(ref) > scale ? fabs(ref) : scale);
+	if (magnitude == 0.0f)
+		return got == 0.0f ? 0.0 : INFINITY;
+	double ulp = (double)nextafterf(magnitude, INFINITY) - magnitude;
+	return fabs(got - ref) / ulp;
+}
+
+inline bool benchCheck(const char* name, double max_ulp, double limit_ulp)
+{
+	bool passed = max_ulp <= limit_ulp;
+	printf("%-40s %10.2f ulp  (limit %g)%s\n", name, max_ulp, limit_ulp, passed ? "" : "  FAILED");
+	if (!passed)
+		bench_failures++;
+	return passed;
+}
+
+inline int benchFailures()
+{
+	return bench_failures;
+}
+
+#endif
@@ -0,0 +1,541 @@
+///////////////////////////////////////////////////////////////////////////////
+// Bvh.h
+// =====
+// Bounding volume hierarchy over indexed triangle meshes, for ray casting,
+// picking and shadow queries on the CPU.
+//
+// build() splits the triangles by the surface area heuristic, evaluated at
+// the borders of BVH_BINS centroid bins per axis. It runs on a WorkerPool
+// in two phases: the top of the tree is split on the caller, with the bins
+// of large ranges filled in parallel, until there are a few subtrees per
+// thread; the subtrees are then built one per job and spliced behind the
+// top, so the node order does not depend on the thread count. Leaves hold
+// up to BVH_MAX_LEAF triangles, more only where the centroids cannot be
+// told apart or the tree reaches BVH_MAX_DEPTH.
+//
+// Rays are o + t d for t in (t_min, t_max); d need not be normalized, so a
+// ray from the near to the far plane can run over t in (0, 1). Triangles are
+// hit from both sides, as the rasterizers draw them without culling.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef BVH_H_DEF
+#define BVH_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Vectors.h"
+#include "WorkerPool.h"
+
+#define BVH_BINS 16	// SAH candidate planes per axis are the bin borders
+#define BVH_MAX_LEAF 8	// triangles of a leaf that is cheaper than its split
+#define BVH_TRAVERSAL_COST 1.0f	// of a node visit, in triangle tests
+#define BVH_MAX_DEPTH 64	// also the traversal stack size
+#define BVH_PARALLEL_BINS 16384	// references per job when binning in parallel
+
+// one indexed triangle list, the vertices start with x y z
+struct BvhMesh
+{
+	const float* vertices;
+	size_t stride;	// floats per vertex
+	const unsigned int* indices;	// 3 per triangle
+	size_t triangle_count;
+};
+
+struct BvhNode
+{
+	Vector3 lo;
+	uint32_t first;	// inner node: first child, the second follows it; leaf: first triangle
+	Vector3 hi;
+	uint32_t count;	// triangles of a leaf, 0 for an inner node
+};
+
+struct BvhHit
+{
+	float t;
+	float u, v;	// barycentrics of vertex 1 and 2, vertex 0 weighs 1 - u - v
+	uint32_t mesh, triangle;	// in the meshes passed to build()
+};
+
+class Bvh
+{
+public:
+	Bvh() : max_depth(0) {}
+
+	void build(const std::vector<BvhMesh>& meshes, WorkerPool& pool)
+	{
+		nodes.clear();
+		triangles.clear();
+		ids.clear();
+		max_depth = 0;
+		size_t count = 0;
+		std::vector<size_t> offsets;
+		for (const BvhMesh& mesh : meshes)
+		{
+			offsets.push_back(count);
+			count += mesh.triangle_count;
+		}
+		if (count == 0)
+			return;
+
+		// bounds and centroid of every triangle
+		ids.resize(count);
+		prim_lo.resize(count);
+		prim_hi.resize(count);
+		centroids.resize(count);
+		pool.run((count + BVH_PARALLEL_BINS - 1) / BVH_PARALLEL_BINS, [&](size_t job, int) {
+			size_t first = job * BVH_PARALLEL_BINS, last = std::min(first + BVH_PARALLEL_BINS, count);
+			size_t mesh = std::upper_bound(offsets.begin(), offsets.end(), first) - offsets.begin() - 1;
+			for (size_t i = first; i < last; i++)
+			{
+				while (i - offsets[mesh] >= meshes[mesh].triangle_count)
+					mesh++;
+				const BvhMesh& m = meshes[mesh];
+				uint32_t t = (uint32_t)(i - offsets[mesh]);
+				Vector3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					const float* v = m.vertices + m.indices[t * 3 + k] * m.stride;
+					p[k] = Vector3(v[0], v[1], v[2]);
+				}
+				ids[i].mesh = (uint32_t)mesh;
+				ids[i].triangle = t;
+				prim_lo[i] = vmin(p[0], vmin(p[1], p[2]));
+				prim_hi[i] = vmax(p[0], vmax(p[1], p[2]));
+				centroids[i] = (prim_lo[i] + prim_hi[i]) * 0.5f;
+			}
+		});
+		refs.resize(count);
+		for (size_t i = 0; i < count; i++)
+			refs[i] = (uint32_t)i;
+
+		// top of the tree on the caller, down to subtrees of about subtree_size
+		size_t subtree_size = pool.threadCount() > 1 ? std::max((size_t)BVH_PARALLEL_BINS / 4, count / (pool.threadCount() * 4)) : count;
+		nodes.resize(1);
+		Range root = { 0, 0, (uint32_t)count, 0 };
+		rangeBounds(root.begin, root.end, nodes[0].lo, nodes[0].hi);
+		std::vector<Range> open(1, root), subtrees;
+		while (!open.empty())
+		{
+			Range r = open.back();
+			open.pop_back();
+			if (r.end - r.begin <= subtree_size)
+			{
+				subtrees.push_back(r);
+				continue;
+			}
+			Range children[2];
+			if (!split(nodes, r, children, &pool))
+				continue;
+			open.push_back(children[1]);
+			open.push_back(children[0]);
+		}
+
+		// subtrees one per job, each into its own nodes with its root at 0
+		std::vector<std::vector<BvhNode> > built(subtrees.size());
+		std::vector<int> depths(subtrees.size());
+		pool.run(subtrees.size(), [&](size_t job, int) {
+			std::vector<BvhNode>& local = built[job];
+			local.push_back(nodes[subtrees[job].node]);
+			Range r = subtrees[job];
+			r.node = 0;
+			depths[job] = buildSubtree(local, r);
+		});
+		for (size_t j = 0; j < subtrees.size(); j++)
+		{
+			uint32_t base = (uint32_t)nodes.size() - 1;	// local node i lands at base + i
+			for (BvhNode& n : built[j])
+				if (n.count == 0)
+					n.first += base;
+			nodes[subtrees[j].node] = built[j][0];
+			nodes.insert(nodes.end(), built[j].begin() + 1, built[j].end());
+			max_depth = std::max(max_depth, depths[j]);
+		}
+
+		// triangles in leaf order
+		std::vector<TriangleId> ordered(count);
+		triangles.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			ordered[i] = ids[refs[i]];
+			const BvhMesh& m = meshes[ordered[i].mesh];
+			const unsigned int* index = m.indices + ordered[i].triangle * 3;
+			const float* v0 = m.vertices + index[0] * m.stride;
+			const float* v1 = m.vertices + index[1] * m.stride;
+			const float* v2 = m.vertices + index[2] * m.stride;
+			triangles[i].v0 = Vector3(v0[0], v0[1], v0[2]);
+			triangles[i].e1 = Vector3(v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]);
+			triangles[i].e2 = Vector3(v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]);
+		}
+		ids.swap(ordered);
+		std::vector<uint32_t>().swap(refs);
+		std::vector<Vector3>().swap(prim_lo);
+		std::vector<Vector3>().swap(prim_hi);
+		std::vector<Vector3>().swap(centroids);
+	}
+
+	bool empty() const { return nodes.empty(); }
+	size_t nodeCount() const { return nodes.size(); }
+	size_t triangleCount() const { return triangles.size(); }
+	int depth() const { return max_depth; }
+
+	// expected cost of a random ray in triangle tests, relative to the root box
+	float sahCost() const
+	{
+		if (nodes.empty())
+			return 0.0f;
+		float cost = 0.0f;
+		for (const BvhNode& n : nodes)
+			cost += area(n.lo, n.hi) * (n.count > 0 ? (float)n.count : BVH_TRAVERSAL_COST);
+		return cost / area(nodes[0].lo, nodes[0].hi);
+	}
+
+	// nearest hit, false (hit untouched) if there is none
+	bool intersect(const Vector3& origin, const Vector3& direction, float t_min, float t_max, BvhHit& hit) const
+	{
+		return traverse<false>(origin, direction, t_min, t_max, hit);
+	}
+
+	// any hit, for shadow rays
+	bool occluded(const Vector3& origin, const Vector3& direction, float t_min, float t_max) const
+	{
+		BvhHit hit;
+		return traverse<true>(origin, direction, t_min, t_max, hit);
+	}
+
+private:
+	struct Triangle
+	{
+		Vector3 v0, e1, e2;
+	};
+
+	struct TriangleId
+	{
+		uint32_t mesh, triangle;
+	};
+
+	struct Range
+	{
+		uint32_t node, begin, end;
+		int depth;
+	};
+
+	struct Bins
+	{
+		Vector3 lo[3][BVH_BINS], hi[3][BVH_BINS];
+		uint32_t count[3][BVH_BINS];
+
+		Bins()
+		{
+			for (int a = 0; a < 3; a++)
+				for (int b = 0; b < BVH_BINS; b++)
+				{
+					lo[a][b] = Vector3(INFINITY, INFINITY, INFINITY);
+					hi[a][b] = Vector3(-INFINITY, -INFINITY, -INFINITY);
+					count[a][b] = 0;
+				}
+		}
+	};
+
+	// plain compares instead of fminf() / fmaxf(), which are library calls
+	// without -ffast-math; a NaN in a gives b
+	static float minf(float a, float b) { return a < b ? a : b; }
+	static float maxf(float a, float b) { return a > b ? a : b; }
+	static Vector3 vmin(const Vector3& a, const Vector3& b) { return Vector3(minf(a.x, b.x), minf(a.y, b.y), minf(a.z, b.z)); }
+	static Vector3 vmax(const Vector3& a, const Vector3& b) { return Vector3(maxf(a.x, b.x), maxf(a.y, b.y), maxf(a.z, b.z)); }
+
+	// half the surface area, only ratios of it are used
+	static float area(const Vector3& lo, const Vector3& hi)
+	{
+		Vector3 d = hi - lo;
+		return d.x < 0.0f ? 0.0f : d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	void rangeBounds(uint32_t begin, uint32_t end, Vector3& lo, Vector3& hi) const
+	{
+		lo = Vector3(INFINITY, INFINITY, INFINITY);
+		hi = Vector3(-INFINITY, -INFINITY, -INFINITY);
+		for (uint32_t i = begin; i < end; i++)
+		{
+			lo = vmin(lo, prim_lo[refs[i]]);
+			hi = vmax(hi, prim_hi[refs[i]]);
+		}
+	}
+
+	static int binOf(float c, float lo, float scale)
+	{
+		int b = (int)((c - lo) * scale);
+		return b < 0 ? 0 : b >= BVH_BINS ? BVH_BINS - 1 : b;
+	}
+
+	void fillBins(Bins& bins, uint32_t begin, uint32_t end, const Vector3& c_lo, const Vector3& scale) const
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t r = refs[i];
+			for (int a = 0; a < 3; a++)
+			{
+				int b = binOf((&centroids[r].x)[a], (&c_lo.x)[a], (&scale.x)[a]);
+				bins.lo[a][b] = vmin(bins.lo[a][b], prim_lo[r]);
+				bins.hi[a][b] = vmax(bins.hi[a][b], prim_hi[r]);
+				bins.count[a][b]++;
+			}
+		}
+	}
+
+	// split the node of r into two new nodes at the end of out, false if
+	// the node became a leaf
+	bool split(std::vector<BvhNode>& out, const Range& r, Range children[2], WorkerPool* pool)
+	{
+		BvhNode& node = out[r.node];
+		uint32_t count = r.end - r.begin;
+		node.count = count;
+		node.first = r.begin;
+		if (count <= 1 || r.depth >= BVH_MAX_DEPTH - 1)
+			return false;
+
+		Vector3 c_lo(INFINITY, INFINITY, INFINITY), c_hi(-INFINITY, -INFINITY, -INFINITY);
+		for (uint32_t i = r.begin; i < r.end; i++)
+		{
+			c_lo = vmin(c_lo, centroids[refs[i]]);
+			c_hi = vmax(c_hi, centroids[refs[i]]);
+		}
+		Vector3 extent = c_hi - c_lo;
+		Vector3 scale;
+		for (int a = 0; a < 3; a++)
+			(&scale.x)[a] = (&extent.x)[a] > 0.0f ? BVH_BINS / (&extent.x)[a] : 0.0f;
+
+		Bins bins;
+		if (pool != NULL && pool->threadCount() > 1 && count >= 2 * BVH_PARALLEL_BINS)
+		{
+			std::vector<Bins> partial((count + BVH_PARALLEL_BINS - 1) / BVH_PARALLEL_BINS);
+			pool->run(partial.size(), [&](size_t job, int) {
+				uint32_t first = r.begin + (uint32_t)(job * BVH_PARALLEL_BINS);
+				fillBins(partial[job], first, std::min(first + BVH_PARALLEL_BINS, r.end), c_lo, scale);
+			});
+			for (const Bins& p : partial)
+				for (int a = 0; a < 3; a++)
+					for (int b = 0; b < BVH_BINS; b++)
+					{
+						bins.lo[a][b] = vmin(bins.lo[a][b], p.lo[a][b]);
+						bins.hi[a][b] = vmax(bins.hi[a][b], p.hi[a][b]);
+						bins.count[a][b] += p.count[a][b];
+					}
+		}
+		else
+			fillBins(bins, r.begin, r.end, c_lo, scale);
+
+		// sweep the bin borders of every axis, left sides then right sides
+		float best_cost = INFINITY;
+		int best_axis = -1, best_bin = 0;
+		Vector3 best_lo[2], best_hi[2];
+		for (int a = 0; a < 3; a++)
+		{
+			if ((&scale.x)[a] == 0.0f)
+				continue;
+			Vector3 left_lo[BVH_BINS], left_hi[BVH_BINS];
+			uint32_t left_count[BVH_BINS];
+			Vector3 lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+			uint32_t n = 0;
+			for (int b = 0; b < BVH_BINS; b++)
+			{
+				lo = vmin(lo, bins.lo[a][b]);
+				hi = vmax(hi, bins.hi[a][b]);
+				n += bins.count[a][b];
+				left_lo[b] = lo;  left_hi[b] = hi;  left_count[b] = n;
+			}
+			lo = Vector3(INFINITY, INFINITY, INFINITY);
+			hi = Vector3(-INFINITY, -INFINITY, -INFINITY);
+			n = 0;
+			for (int b = BVH_BINS - 1; b > 0; b--)
+			{
+				lo = vmin(lo, bins.lo[a][b]);
+				hi = vmax(hi, bins.hi[a][b]);
+				n += bins.count[a][b];
+				if (n == 0 || left_count[b - 1] == 0)
+					continue;
+				float cost = area(left_lo[b - 1], left_hi[b - 1]) * left_count[b - 1] + area(lo, hi) * n;
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = a;
+					best_bin = b - 1;
+					best_lo[0] = left_lo[b - 1];  best_hi[0] = left_hi[b - 1];
+					best_lo[1] = lo;  best_hi[1] = hi;
+				}
+			}
+		}
+
+		uint32_t middle;
+		if (best_axis < 0)
+		{
+			// every centroid in one point, only the count can be halved
+			if (count <= BVH_MAX_LEAF)
+				return false;
+			middle = r.begin + count / 2;
+			rangeBounds(r.begin, middle, best_lo[0], best_hi[0]);
+			rangeBounds(middle, r.end, best_lo[1], best_hi[1]);
+		}
+		else
+		{
+			float node_area = area(node.lo, node.hi);
+			float split_cost = BVH_TRAVERSAL_COST + (node_area > 0.0f ? best_cost / node_area : 0.0f);
+			if (count <= BVH_MAX_LEAF && (float)count <= split_cost)
+				return false;
+			float c_min = (&c_lo.x)[best_axis], s = (&scale.x)[best_axis];
+			middle = (uint32_t)(std::partition(refs.begin() + r.begin, refs.begin() + r.end, [&](uint32_t ref) {
+				return binOf((&centroids[ref].x)[best_axis], c_min, s) <= best_bin;
+			}) - refs.begin());
+		}
+
+		uint32_t first = (uint32_t)out.size();
+		node.first = first;
+		node.count = 0;
+		out.resize(out.size() + 2);	// node is dangling from here on
+		for (int k = 0; k < 2; k++)
+		{
+			out[first + k].lo = best_lo[k];
+			out[first + k].hi = best_hi[k];
+			children[k].node = first + k;
+			children[k].depth = r.depth + 1;
+		}
+		children[0].begin = r.begin;  children[0].end = middle;
+		children[1].begin = middle;  children[1].end = r.end;
+		return true;
+	}
+
+	// the whole subtree of r on this thread, returns its deepest level
+	int buildSubtree(std::vector<BvhNode>& out, const Range& root)
+	{
+		int deepest = root.depth;
+		std::vector<Range> stack(1, root);
+		while (!stack.empty())
+		{
+			Range r = stack.back();
+			stack.pop_back();
+			deepest = std::max(deepest, r.depth);
+			Range children[2];
+			if (!split(out, r, children, NULL))
+				continue;
+			stack.push_back(children[1]);
+			stack.push_back(children[0]);
+		}
+		return deepest;
+	}
+
+	// entry distance of the ray into the box, false if it misses it within [t_min, t_max]
+	static bool slab(const BvhNode& n, const Vector3& origin, const Vector3& inverse, float t_min, float t_max, float& t_entry)
+	{
+		float x0 = (n.lo.x - origin.x) * inverse.x, x1 = (n.hi.x - origin.x) * inverse.x;
+		float y0 = (n.lo.y - origin.y) * inverse.y, y1 = (n.hi.y - origin.y) * inverse.y;
+		float z0 = (n.lo.z - origin.z) * inverse.z, z1 = (n.hi.z - origin.z) * inverse.z;
+		float enter = maxf(maxf(minf(x0, x1), minf(y0, y1)), maxf(minf(z0, z1), t_min));
+		float leave = minf(minf(maxf(x0, x1), maxf(y0, y1)), minf(maxf(z0, z1), t_max));
+		t_entry = enter;
+		return enter <= leave;
+	}
+
+	// Moller-Trumbore, both faces
+	static bool hitTriangle(const Triangle& tri, const Vector3& origin, const Vector3& direction, float t_min, float t_max,
+		float& t, float& u, float& v)
+	{
+		Vector3 p = direction.cross(tri.e2);
+		float det = tri.e1.dot(p);
+		if (det == 0.0f)
+			return false;
+		float inv_det = 1.0f / det;
+		Vector3 s = origin - tri.v0;
+		u = s.dot(p) * inv_det;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		Vector3 q = s.cross(tri.e1);
+		v = direction.dot(q) * inv_det;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		t = tri.e2.dot(q) * inv_det;
+		return t > t_min && t < t_max;
+	}
+
+	template <bool any>
+	bool traverse(const Vector3& origin, const Vector3& direction, float t_min, float t_max, BvhHit& hit) const
+	{
+		if (nodes.empty())
+			return false;
+		Vector3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		float t_entry;
+		if (!slab(nodes[0], origin, inverse, t_min, t_max, t_entry))
+			return false;
+
+		struct Entry
+		{
+			uint32_t node;
+			float t;
+		} stack[BVH_MAX_DEPTH];
+		int size = 0;
+		uint32_t index = 0;
+		bool found = false;
+		for (;;)
+		{
+			const BvhNode& n = nodes[index];
+			if (n.count > 0)
+			{
+				for (uint32_t i = n.first; i < n.first + n.count; i++)
+				{
+					float t, u, v;
+					if (!hitTriangle(triangles[i], origin, direction, t_min, t_max, t, u, v))
+						continue;
+					if (any)
+						return true;
+					t_max = t;
+					hit.t = t;  hit.u = u;  hit.v = v;
+					hit.mesh = ids[i].mesh;
+					hit.triangle = ids[i].triangle;
+					found = true;
+				}
+			}
+			else
+			{
+				float t0, t1;
+				bool hit0 = slab(nodes[n.first], origin, inverse, t_min, t_max, t0);
+				bool hit1 = slab(nodes[n.first + 1], origin, inverse, t_min, t_max, t1);
+				if (hit0 && hit1)
+				{
+					bool second = t1 < t0;
+					stack[size].node = n.first + !second;
+					stack[size].t = second ? t0 : t1;
+					size++;
+					index = n.first + second;
+					continue;
+				}
+				if (hit0 || hit1)
+				{
+					index = n.first + hit1;
+					continue;
+				}
+			}
+			// the far children pushed before a closer hit was found may be behind it now
+			for (;;)
+			{
+				if (size == 0)
+					return found;
+				size--;
+				if (stack[size].t <= t_max)
+					break;
+			}
+			index = stack[size].node;
+		}
+	}
+
+	std::vector<BvhNode> nodes;
+	std::vector<Triangle> triangles;	// in leaf order
+	std::vector<TriangleId> ids;	// of triangles
+	int max_depth;
+
+	// build state
+	std::vector<uint32_t> refs;	// triangle ids, partitioned into the leaves
+	std::vector<Vector3> prim_lo, prim_hi, centroids;
+};
+
+#endif
@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////////////////////////////////
+// FrameCapture.h
+// ==============
+// Asynchronous back buffer capture.
+//
+// Every captured frame is read into one of a ring of pixel buffer objects and
+// only mapped CAPTURE_RING_SIZE frames later, when the GPU has long finished
+// the transfer. Mapped pixels are copied into a pooled frame and handed to a
+// writer thread which flips and encodes them (PPM sequence or Y4M stream), so
+// the render thread never waits on readback or disk. Frames that cannot be
+// taken without waiting are dropped and counted instead.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_CAPTURE_H_DEF
+#define FRAME_CAPTURE_H_DEF
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glad/glad.h>
+
+#define CAPTURE_RING_SIZE 3		// frames between readback and map
+#define CAPTURE_QUEUE_SIZE 8	// frames waiting for the writer thread
+
+enum CaptureFormat
+{
+	CapturePPM = 0,		// one binary .ppm per frame
+	CaptureY4M = 1,		// single raw 4:4:4 .y4m stream
+};
+
+class FrameCapture
+{
+public:
+	FrameCapture() : active(false), width(0), height(0), head(0), frameIndex(0),
+		capturedCount(0), droppedCount(0), writtenCount(0), stopWriter(false), stream(NULL) {}
+	// no GL context is left at static destruction, stop() has to run before;
+	// this only finishes the writer so the output file is complete
+	~FrameCapture() { finishWriter(); }
+
+	bool isActive() const { return active; }
+	int captured() const { return capturedCount; }
+	int dropped() const { return droppedCount; }
+
+	// allocate the PBO ring and start the writer thread
+	bool start(int w, int h, CaptureFormat fmt, const std::string& prefix)
+	{
+		if (active || w <= 0 || h <= 0)
+			return false;
+
+		width = w;
+		height = h;
+		format = fmt;
+		outPrefix = prefix;
+		head = 0;
+		frameIndex = 0;
+		capturedCount = droppedCount = writtenCount = 0;
+
+		if (format == CaptureY4M)
+		{
+			streamPath = outPrefix + ".y4m";
+			stream = fopen(streamPath.c_str(), "wb");
+			if (stream == NULL)
+			{
+				printf("FrameCapture: cannot open %s\n", streamPath.c_str());
+				return false;
+			}
+			fprintf(stream, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", width, height);
+		}
+
+		glGenBuffers(CAPTURE_RING_SIZE, pbo);
+		for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes(), NULL, GL_STREAM_READ);
+			fence[i] = 0;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		stopWriter = false;
+		writer = std::thread(&FrameCapture::writerLoop, this);
+		active = true;
+		return true;
+	}
+
+	// call once per frame after rendering and before swapping buffers
+	void capture()
+	{
+		if (!active)
+			return;
+
+		GLsync& slotFence = fence[head];
+		if (slotFence != 0)
+		{
+			// the oldest readback in the ring has to be done by now, never wait for it
+			GLenum status = glClientWaitSync(slotFence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+			{
+				droppedCount++;
+				return;
+			}
+			glDeleteSync(slotFence);
+			slotFence = 0;
+			if (status == GL_WAIT_FAILED)
+				waitFailed();	// the slot is reused for this frame
+			else
+				collect(head);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[head]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadBuffer(GL_BACK);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slotFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		head = (head + 1) % CAPTURE_RING_SIZE;
+	}
+
+	// drain the ring, join the writer and release GL objects
+	void stop()
+	{
+		if (!active)
+			return;
+
+		for (int n = 0; n < CAPTURE_RING_SIZE; n++)
+		{
+			int slot = (head + n) % CAPTURE_RING_SIZE;
+			if (fence[slot] != 0)
+			{
+				GLenum status = glClientWaitSync(fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				glDeleteSync(fence[slot]);
+				fence[slot] = 0;
+				if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+					collect(slot);
+				else if (status == GL_WAIT_FAILED)
+					waitFailed();
+				else
+					droppedCount++;
+			}
+		}
+		glDeleteBuffers(CAPTURE_RING_SIZE, pbo);
+
+		finishWriter();
+		freeFrames.clear();
+		active = false;
+		printf("FrameCapture: %d frames captured, %d written, %d dropped\n", capturedCount, writtenCount, droppedCount);
+	}
+
+private:
+	// write the queued frames, join the writer thread and close the stream
+	void finishWriter()
+	{
+		if (writer.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				stopWriter = true;
+			}
+			queueReady.notify_one();
+			writer.join();
+		}
+		if (stream != NULL)
+		{
+			fclose(stream);
+			stream = NULL;
+		}
+	}
+
+	struct Frame
+	{
+		int index;
+		std::vector<unsigned char> pixels;
+	};
+
+	size_t frameBytes() const { return (size_t)width * height * 3; }
+
+	// the readback of a slot may not have finished, its frame is dropped unread
+	void waitFailed()
+	{
+		printf("FrameCapture: glClientWaitSync failed (GL error 0x%04x), frame dropped\n", glGetError());
+		droppedCount++;
+	}
+
+	// map a finished PBO and pass its content to the writer
+	void collect(int slot)
+	{
+		std::vector<unsigned char> pixels;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (pending.size() >= CAPTURE_QUEUE_SIZE)
+			{
+				droppedCount++;
+				return;
+			}
+			if (!freeFrames.empty())
+			{
+				pixels.swap(freeFrames.back());
+				freeFrames.pop_back();
+			}
+		}
+		pixels.resize(frameBytes());
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+		void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(), GL_MAP_READ_BIT);
+		if (src == NULL)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			droppedCount++;
+			return;
+		}
+		memcpy(&pixels[0], src, frameBytes());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			pending.push_back(Frame());
+			pending.back().index = frameIndex++;
+			pending.back().pixels.swap(pixels);
+		}
+		capturedCount++;
+		queueReady.notify_one();
+	}
+
+	void writerLoop()
+	{
+		std::vector<unsigned char> row;
+		for (;;)
+		{
+			Frame frame;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueReady.wait(lock, [this] { return stopWriter || !pending.empty(); });
+				if (pending.empty())
+					return;
+				frame.index = pending.front().index;
+				frame.pixels.swap(pending.front().pixels);
+				pending.pop_front();
+			}
+
+			// GL rows start at the bottom of the image
+			size_t stride = (size_t)width * 3;
+			row.resize(stride);
+			for (int y = 0; y < height / 2; y++)
+			{
+				unsigned char* top = &frame.pixels[y * stride];
+				unsigned char* bottom = &frame.pixels[(height - 1 - y) * stride];
+				memcpy(&row[0], top, stride);
+				memcpy(top, bottom, stride);
+				memcpy(bottom, &row[0], stride);
+			}
+
+			if (format == CaptureY4M)
+				writeY4M(frame.pixels);
+			else
+				writePPM(frame.index, frame.pixels);
+			writtenCount++;
+
+			std::lock_guard<std::mutex> lock(queueMutex);
+			freeFrames.push_back(std::vector<unsigned char>());
+			freeFrames.back().swap(frame.pixels);
+		}
+	}
+
+	void writePPM(int index, const std::vector<unsigned char>& pixels)
+	{
+		char path[512];
+		snprintf(path, sizeof(path), "%s_%05d.ppm", outPrefix.c_str(), index);
+		FILE* fp = fopen(path, "wb");
+		if (fp == NULL)
+		{
+			printf("FrameCapture: cannot open %s\n", path);
+			return;
+		}
+		fprintf(fp, "P6\n%d %d\n255\n", width, height);
+		fwrite(&pixels[0], 1, pixels.size(), fp);
+		fclose(fp);
+	}
+
+	// BT.601 full range RGB -> planar YUV 4:4:4
+	void writeY4M(const std::vector<unsigned char>& pixels)
+	{
+		size_t count = (size_t)width * height;
+		planes.resize(count * 3);
+		unsigned char* Y = &planes[0];
+		unsigned char* U = Y + count;
+		unsigned char* V = U + count;
+		for (size_t i = 0; i < count; i++)
+		{
+			int r = pixels[i * 3 + 0], g = pixels[i * 3 + 1], b = pixels[i * 3 + 2];
+			int y = (77 * r + 150 * g + 29 * b + 128) >> 8;
+			int u = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+			int v = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+			Y[i] = (unsigned char)y;
+			U[i] = (unsigned char)(u < 0 ? 0 : (u > 255 ? 255 : u));
+			V[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+		}
+		fputs("FRAME\n", stream);
+		fwrite(&planes[0], 1, planes.size(), stream);
+	}
+
+	bool active;
+	int width, height;
+	CaptureFormat format;
+	std::string outPrefix;
+	std::string streamPath;
+
+	GLuint pbo[CAPTURE_RING_SIZE];
+	GLsync fence[CAPTURE_RING_SIZE];
+	int head;
+	int frameIndex;
+
+	int capturedCount;
+	int droppedCount;
+	int writtenCount;
+
+	std::thread writer;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+	std::deque<Frame> pending;
+	std::vector<std::vector<unsigned char> > freeFrames;
+	bool stopWriter;
+
+	FILE* stream;
+	std::vector<unsigned char> planes;	// writer thread only
+};
+
+#endif
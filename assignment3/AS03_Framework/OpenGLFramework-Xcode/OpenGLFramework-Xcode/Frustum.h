@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// Frustum.h
+// =========
+// View frustum planes and batched axis aligned box culling
+//
+// The six planes are extracted from a clip matrix (Gribb / Hartmann), e.g.
+// P * V for world space boxes or P * V * M for boxes in model space. A point
+// p is inside when a*x + b*y + c*z + d >= 0 for every plane; planes are not
+// normalized since only the sign is tested.
+//
+// Boxes are passed SoA as centers and half extents. A box is culled when it
+// lies entirely behind one plane:  n.c + |n|.e + d < 0. The test is
+// conservative, a box crossing the frustum corner outside of two planes is
+// kept. cullBoxes() runs eight boxes per iteration with AVX, four with SSE2
+// or AArch64 NEON and finishes the tail with the scalar loop, which is also
+// the whole path on other targets or when MATH_SIMD_SCALAR is defined.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MATH_FRUSTUM_H
+#define MATH_FRUSTUM_H
+
+#include <stddef.h>
+#include <cmath>
+#include "TransformBatch.h"
+
+enum FrustumPlane
+{
+    FrustumLeft,
+    FrustumRight,
+    FrustumBottom,
+    FrustumTop,
+    FrustumNear,
+    FrustumFar,
+    FrustumPlaneCount
+};
+
+struct Frustum
+{
+    Vector4 planes[FrustumPlaneCount];      // (a, b, c, d), inside >= 0
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// planes of -w <= x, y, z <= w, i.e. row3 +/- row0, row1, row2 of the matrix
+///////////////////////////////////////////////////////////////////////////////
+inline Frustum extractFrustum(const Matrix4& m)
+{
+    Frustum f;
+    for(int i = 0; i < 3; ++i)
+    {
+        f.planes[i*2]     = Vector4(m[12] + m[i*4], m[13] + m[i*4 + 1], m[14] + m[i*4 + 2], m[15] + m[i*4 + 3]);
+        f.planes[i*2 + 1] = Vector4(m[12] - m[i*4], m[13] - m[i*4 + 1], m[14] - m[i*4 + 2], m[15] - m[i*4 + 3]);
+    }
+    return f;
+}
+
+inline bool boxInFrustum(const Frustum& f, const Vector3& center, const Vector3& extent)
+{
+    for(int i = 0; i < FrustumPlaneCount; ++i)
+    {
+        const Vector4& p = f.planes[i];
+        // same association as the SIMD paths, so every path culls the same boxes
+        float dist = (p.x*center.x + p.y*center.y) + (p.z*center.z + p.w);
+        float radius = (std::fabs(p.x)*extent.x + std::fabs(p.y)*extent.y) + std::fabs(p.z)*extent.z;
+        if(dist + radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+
+
+#ifdef MATH_BATCH_SIMD
+///////////////////////////////////////////////////////////////////////////////
+// 4-wide, bit i of the mask is set when box i is behind a plane
+///////////////////////////////////////////////////////////////////////////////
+#ifdef MATH_SIMD_SSE2
+inline int batchNegativeMask(BatchVec v)    { return _mm_movemask_ps(_mm_cmplt_ps(v, _mm_setzero_ps())); }
+#else // AArch64 NEON
+inline int batchNegativeMask(BatchVec v)
+{
+    static const uint32_t bits[4] = { 1, 2, 4, 8 };
+    return (int)vaddvq_u32(vandq_u32(vcltzq_f32(v), vld1q_u32(bits)));
+}
+#endif
+
+// plane coefficients a b c d |a| |b| |c|, broadcast once per cullBoxes() call
+inline void frustumCoefficients(const Frustum& f, float k[FrustumPlaneCount][7])
+{
+    for(int i = 0; i < FrustumPlaneCount; ++i)
+    {
+        const Vector4& p = f.planes[i];
+        k[i][0] = p.x;  k[i][1] = p.y;  k[i][2] = p.z;  k[i][3] = p.w;
+        k[i][4] = std::fabs(p.x);  k[i][5] = std::fabs(p.y);  k[i][6] = std::fabs(p.z);
+    }
+}
+
+inline int cullBoxes4(const BatchVec (*k)[7], const float* cx, const float* cy, const float* cz,
+                      const float* ex, const float* ey, const float* ez)
+{
+    BatchVec x = batchLoad<false>(cx), y = batchLoad<false>(cy), z = batchLoad<false>(cz);
+    BatchVec hx = batchLoad<false>(ex), hy = batchLoad<false>(ey), hz = batchLoad<false>(ez);
+    int culled = 0;
+    for(int i = 0; i < FrustumPlaneCount; ++i)
+    {
+        const BatchVec* p = k[i];
+        BatchVec dist = batchAdd(batchAdd(batchMul(p[0], x), batchMul(p[1], y)), batchAdd(batchMul(p[2], z), p[3]));
+        BatchVec radius = batchAdd(batchAdd(batchMul(p[4], hx), batchMul(p[5], hy)), batchMul(p[6], hz));
+        culled |= batchNegativeMask(batchAdd(dist, radius));
+    }
+    return culled;
+}
+#endif // MATH_BATCH_SIMD
+
+#ifdef MATH_SIMD_AVX
+inline int cullBoxes8(const __m256 (*k)[7], const float* cx, const float* cy, const float* cz,
+                      const float* ex, const float* ey, const float* ez)
+{
+    __m256 x = _mm256_loadu_ps(cx), y = _mm256_loadu_ps(cy), z = _mm256_loadu_ps(cz);
+    __m256 hx = _mm256_loadu_ps(ex), hy = _mm256_loadu_ps(ey), hz = _mm256_loadu_ps(ez);
+    int culled = 0;
+    for(int i = 0; i < FrustumPlaneCount; ++i)
+    {
+        const __m256* p = k[i];
+        __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p[0], x), _mm256_mul_ps(p[1], y)),
+                                    _mm256_add_ps(_mm256_mul_ps(p[2], z), p[3]));
+        __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p[4], hx), _mm256_mul_ps(p[5], hy)),
+                                      _mm256_mul_ps(p[6], hz));
+        culled |= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    return culled;
+}
+#endif
+
+// visible[0..n) = !culled bit, returns the number of visible boxes
+inline size_t frustumStoreVisible(int culled, int n, unsigned char* visible)
+{
+    size_t count = 0;
+    for(int k = 0; k < n; ++k)
+    {
+        unsigned char v = !((culled >> k) & 1);
+        visible[k] = v;
+        count += v;
+    }
+    return count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// visible[i] = box i may intersect the frustum, returns the number of visible
+// boxes. NaN distances compare false and keep the box.
+///////////////////////////////////////////////////////////////////////////////
+inline size_t cullBoxes(const Frustum& f, const float* cx, const float* cy, const float* cz,
+                        const float* ex, const float* ey, const float* ez,
+                        size_t count, unsigned char* visible)
+{
+    size_t i = 0, visible_count = 0;
+#ifdef MATH_BATCH_SIMD
+    float k[FrustumPlaneCount][7];
+    frustumCoefficients(f, k);
+#endif
+#ifdef MATH_SIMD_AVX
+    if(count >= 8)
+    {
+        __m256 k8[FrustumPlaneCount][7];
+        for(int p = 0; p < FrustumPlaneCount * 7; ++p)
+            k8[p / 7][p % 7] = _mm256_set1_ps(k[p / 7][p % 7]);
+        for(; i + 8 <= count; i += 8)
+            visible_count += frustumStoreVisible(cullBoxes8(k8, cx + i, cy + i, cz + i, ex + i, ey + i, ez + i), 8, visible + i);
+    }
+#endif
+#ifdef MATH_BATCH_SIMD
+    if(count - i >= 4)
+    {
+        BatchVec k4[FrustumPlaneCount][7];
+        for(int p = 0; p < FrustumPlaneCount * 7; ++p)
+            k4[p / 7][p % 7] = batchSplat(k[p / 7][p % 7]);
+        for(; i + 4 <= count; i += 4)
+            visible_count += frustumStoreVisible(cullBoxes4(k4, cx + i, cy + i, cz + i, ex + i, ey + i, ez + i), 4, visible + i);
+    }
+#endif
+    for(; i < count; ++i)
+    {
+        unsigned char v = boxInFrustum(f, Vector3(cx[i], cy[i], cz[i]), Vector3(ex[i], ey[i], ez[i]));
+        visible[i] = v;
+        visible_count += v;
+    }
+    return visible_count;
+}
+
+#endif
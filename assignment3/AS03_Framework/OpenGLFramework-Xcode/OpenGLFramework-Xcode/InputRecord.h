@@ -0,0 +1,237 @@
+///////////////////////////////////////////////////////////////////////////////
+// InputRecord.h
+// =============
+// Record GLFW input events to a compact binary file and replay them later.
+//
+// A recording is a small header followed by fixed size events stamped with
+// the time (microseconds) since recording started. Replay ignores the wall
+// clock: it advances a virtual clock by a fixed timestep every frame and
+// feeds each due event to the same callbacks the window would have called,
+// so an interactive session becomes a reproducible benchmark.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef INPUT_RECORD_H_DEF
+#define INPUT_RECORD_H_DEF
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <GLFW/glfw3.h>
+
+#define INPUT_RECORD_MAGIC 0x43455249u	// "IREC"
+#define INPUT_RECORD_VERSION 1u
+
+enum InputEventType
+{
+	InputKey = 0,
+	InputScroll = 1,
+	InputMouseButton = 2,
+	InputCursorPos = 3,
+};
+
+#pragma pack(push, 1)
+struct InputEvent
+{
+	uint32_t time_us;	// since start of recording
+	uint8_t type;		// InputEventType
+	uint8_t action;		// key / button action
+	int16_t code;		// key or button
+	int16_t scancode;
+	int16_t mods;
+	float x, y;			// scroll offset or cursor position
+};
+
+struct InputRecordHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t event_count;
+	uint32_t duration_us;
+};
+#pragma pack(pop)
+
+// the callbacks the events are dispatched to
+struct InputHandlers
+{
+	GLFWkeyfun key;
+	GLFWscrollfun scroll;
+	GLFWmousebuttonfun mouse_button;
+	GLFWcursorposfun cursor_pos;
+};
+
+class InputRecorder
+{
+public:
+	InputRecorder() : fp(NULL), start_time(0.0), count(0) {}
+	~InputRecorder() { end(); }
+
+	bool isRecording() const { return fp != NULL; }
+
+	bool begin(const char* path)
+	{
+		fp = fopen(path, "wb");
+		if (fp == NULL)
+		{
+			printf("InputRecorder: cannot open %s\n", path);
+			return false;
+		}
+		InputRecordHeader header = { INPUT_RECORD_MAGIC, INPUT_RECORD_VERSION, 0, 0 };
+		fwrite(&header, sizeof(header), 1, fp);
+		start_time = glfwGetTime();
+		count = 0;
+		return true;
+	}
+
+	// patch event count and duration into the header
+	void end()
+	{
+		if (fp == NULL)
+			return;
+		InputRecordHeader header = { INPUT_RECORD_MAGIC, INPUT_RECORD_VERSION, count, now() };
+		fseek(fp, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, fp);
+		fclose(fp);
+		fp = NULL;
+		printf("InputRecorder: %u events recorded\n", header.event_count);
+	}
+
+	void key(int key, int scancode, int action, int mods)
+	{
+		InputEvent e = make(InputKey);
+		e.code = (int16_t)key;
+		e.scancode = (int16_t)scancode;
+		e.action = (uint8_t)action;
+		e.mods = (int16_t)mods;
+		write(e);
+	}
+
+	void scroll(double xoffset, double yoffset)
+	{
+		InputEvent e = make(InputScroll);
+		e.x = (float)xoffset;
+		e.y = (float)yoffset;
+		write(e);
+	}
+
+	void mouseButton(int button, int action, int mods)
+	{
+		InputEvent e = make(InputMouseButton);
+		e.code = (int16_t)button;
+		e.action = (uint8_t)action;
+		e.mods = (int16_t)mods;
+		write(e);
+	}
+
+	void cursorPos(double xpos, double ypos)
+	{
+		InputEvent e = make(InputCursorPos);
+		e.x = (float)xpos;
+		e.y = (float)ypos;
+		write(e);
+	}
+
+private:
+	uint32_t now() const { return (uint32_t)((glfwGetTime() - start_time) * 1e6); }
+
+	InputEvent make(InputEventType type) const
+	{
+		InputEvent e;
+		memset(&e, 0, sizeof(e));
+		e.time_us = now();
+		e.type = (uint8_t)type;
+		return e;
+	}
+
+	void write(const InputEvent& e)
+	{
+		if (fp == NULL)
+			return;
+		fwrite(&e, sizeof(e), 1, fp);
+		count++;
+	}
+
+	FILE* fp;
+	double start_time;
+	uint32_t count;
+};
+
+class InputReplayer
+{
+public:
+	InputReplayer() : loaded(false), next(0), clock_us(0), duration_us(0), step_us(0), frames(0) {}
+
+	bool isLoaded() const { return loaded; }
+	// frames remain until every event is dispatched and the recorded duration
+	// has passed, at least one even for a recording without events
+	bool isReplaying() const { return loaded && (frames == 0 || next < events.size() || clock_us < duration_us); }
+	int frameCount() const { return frames; }
+	size_t eventCount() const { return events.size(); }
+
+	bool load(const char* path, double timestep)
+	{
+		FILE* fp = fopen(path, "rb");
+		if (fp == NULL)
+		{
+			printf("InputReplayer: cannot open %s\n", path);
+			return false;
+		}
+		InputRecordHeader header;
+		if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != INPUT_RECORD_MAGIC || header.version != INPUT_RECORD_VERSION)
+		{
+			printf("InputReplayer: %s is not an input recording\n", path);
+			fclose(fp);
+			return false;
+		}
+		events.resize(header.event_count);
+		size_t n = header.event_count ? fread(&events[0], sizeof(InputEvent), header.event_count, fp) : 0;
+		fclose(fp);
+		events.resize(n);
+
+		loaded = true;
+		next = 0;
+		clock_us = 0;
+		duration_us = header.duration_us;
+		step_us = (uint32_t)(timestep * 1e6);
+		frames = 0;
+		printf("InputReplayer: %d events over %.2f s\n", (int)n, header.duration_us / 1e6);
+		return true;
+	}
+
+	// advance the virtual clock by one step and dispatch every event that became due
+	void dispatch(GLFWwindow* window, const InputHandlers& handlers)
+	{
+		clock_us += step_us;
+		frames++;
+		while (next < events.size() && events[next].time_us <= clock_us)
+		{
+			const InputEvent& e = events[next++];
+			switch (e.type)
+			{
+			case InputKey:
+				handlers.key(window, e.code, e.scancode, e.action, e.mods);
+				break;
+			case InputScroll:
+				handlers.scroll(window, e.x, e.y);
+				break;
+			case InputMouseButton:
+				handlers.mouse_button(window, e.code, e.action, e.mods);
+				break;
+			case InputCursorPos:
+				handlers.cursor_pos(window, e.x, e.y);
+				break;
+			}
+		}
+	}
+
+private:
+	bool loaded;
+	std::vector<InputEvent> events;
+	size_t next;
+	uint32_t clock_us;
+	uint32_t duration_us;
+	uint32_t step_us;
+	int frames;
+};
+
+#endif
@@ -0,0 +1,297 @@
+///////////////////////////////////////////////////////////////////////////////
+// Logger.h
+// ========
+// Asynchronous logger for the input and render paths.
+//
+// Callers only fill a fixed size record (level, time, format literal and up to
+// LOG_MAX_ARGS numeric arguments) into a lock-free bounded ring; formatting
+// and the actual write to stdout happen on a background flusher thread. When
+// the ring is full the record is dropped and counted instead of blocking.
+// LOG_RATE() additionally throttles a single call site to one record per
+// interval, which is what the per-event camera prints need during drags.
+// Records below the minimum level, LogInfo unless setLevel() changes it, are
+// skipped before they take a slot.
+//
+// Format strings must be literals. LOG() checks them against the arguments
+// like printf (-Wformat) and static_asserts the argument count; integers are
+// kept as 64 bit integers, floating point values as doubles, and write()
+// formats every conversion with the type it was stored with.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LOGGER_H_DEF
+#define LOGGER_H_DEF
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+
+#define LOG_RING_SIZE 1024		// must be a power of two
+#define LOG_MAX_ARGS 4
+
+enum LogLevel
+{
+	LogDebug = 0,
+	LogInfo = 1,
+	LogWarn = 2,
+	LogError = 3,
+};
+
+class Logger
+{
+public:
+	explicit Logger(FILE* output = stdout) : out(output), min_level(LogInfo), enqueue_pos(0), dequeue_pos(0), dropped(0), running(true)
+	{
+		for (size_t i = 0; i < LOG_RING_SIZE; i++)
+			ring[i].sequence.store(i, std::memory_order_relaxed);
+		flusher = std::thread(&Logger::flushLoop, this);
+	}
+
+	~Logger()
+	{
+		running.store(false, std::memory_order_release);
+		flusher.join();
+	}
+
+	static Logger& instance()
+	{
+		static Logger logger;
+		return logger;
+	}
+
+	static uint64_t now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool enabled(LogLevel level) const { return level >= min_level.load(std::memory_order_relaxed); }
+	void setLevel(LogLevel level) { min_level.store(level, std::memory_order_relaxed); }
+
+	// "debug", "info", "warn" or "error"; any other name keeps the level
+	bool setLevel(const char* name)
+	{
+		static const char* names[] = { "debug", "info", "warn", "error" };
+		for (int i = 0; i < 4; i++)
+		{
+			if (strcmp(name, names[i]) == 0)
+			{
+				setLevel((LogLevel)i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// wait-free for the producer unless another producer is mid-write on the same slot
+	template <typename... Args>
+	void log(LogLevel level, const char* fmt, Args... args)
+	{
+		static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "LOG takes at most LOG_MAX_ARGS arguments");
+		if (!enabled(level))
+			return;
+
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &ring[pos & (LOG_RING_SIZE - 1)];
+			size_t seq = slot->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0)
+			{
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else
+			{
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		Record& r = slot->record;
+		r.time_us = now();
+		r.level = level;
+		r.fmt = fmt;
+		r.argc = (int)sizeof...(Args);
+		const Arg values[] = { makeArg(args)..., Arg() };
+		for (size_t i = 0; i < sizeof...(Args); i++)
+			r.args[i] = values[i];
+		slot->sequence.store(pos + 1, std::memory_order_release);
+	}
+
+	uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Arg
+	{
+		bool integer;
+		union
+		{
+			int64_t i;
+			double d;
+		};
+	};
+
+	struct Record
+	{
+		uint64_t time_us;
+		const char* fmt;
+		int level;
+		int argc;
+		Arg args[LOG_MAX_ARGS];
+	};
+
+	template <typename T>
+	static Arg makeArg(T value)
+	{
+		static_assert(std::is_arithmetic<T>::value, "LOG arguments must be numbers");
+		Arg a;
+		a.integer = std::is_integral<T>::value;
+		if (a.integer)
+			a.i = (int64_t)value;
+		else
+			a.d = (double)value;
+		return a;
+	}
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		Record record;
+	};
+
+	bool pop(Record& out)
+	{
+		Slot& slot = ring[dequeue_pos & (LOG_RING_SIZE - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1)
+			return false;
+		out = slot.record;
+		slot.sequence.store(dequeue_pos + LOG_RING_SIZE, std::memory_order_release);
+		dequeue_pos++;
+		return true;
+	}
+
+	void write(const Record& r)
+	{
+		static const char* names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+		char msg[256];
+		size_t len = 0;
+		int next_arg = 0;
+		const char* p = r.fmt;
+		while (*p != '\0' && len + 1 < sizeof(msg))
+		{
+			if (p[0] != '%' || p[1] == '%')
+			{
+				msg[len++] = *p;
+				p += p[0] == '%' ? 2 : 1;
+				continue;
+			}
+
+			// the conversion without its length modifier, which the stored type replaces
+			char spec[24];
+			size_t n = 0;
+			spec[n++] = *p++;
+			while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL && n + 4 < sizeof(spec))
+				spec[n++] = *p++;
+			while (*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+				p++;
+			char conversion = *p != '\0' ? *p++ : 'g';
+			if (next_arg == r.argc)
+				break;
+			const Arg& a = r.args[next_arg++];
+			int written;
+			if (strchr("diouxX", conversion) != NULL)
+			{
+				spec[n++] = 'l';
+				spec[n++] = 'l';
+				spec[n++] = conversion;
+				spec[n] = '\0';
+				written = snprintf(msg + len, sizeof(msg) - len, spec, a.integer ? (long long)a.i : (long long)a.d);
+			}
+			else
+			{
+				spec[n++] = strchr("feEgGaA", conversion) != NULL ? conversion : 'g';
+				spec[n] = '\0';
+				written = snprintf(msg + len, sizeof(msg) - len, spec, a.integer ? (double)a.i : a.d);
+			}
+			if (written > 0)
+				len = len + written < sizeof(msg) ? len + written : sizeof(msg) - 1;
+		}
+		msg[len] = '\0';
+		fprintf(out, "[%10.3f] %-5s %s\n", r.time_us / 1e6, names[r.level], msg);
+	}
+
+	void flushLoop()
+	{
+		Record r;
+		uint64_t reported_drops = 0;
+		for (;;)
+		{
+			bool stopping = !running.load(std::memory_order_acquire);
+			int written = 0;
+			while (pop(r))
+			{
+				write(r);
+				written++;
+			}
+			uint64_t drops = dropped.load(std::memory_order_relaxed);
+			if (drops != reported_drops)
+			{
+				fprintf(out, "Logger: %llu records dropped\n", (unsigned long long)(drops - reported_drops));
+				reported_drops = drops;
+				written++;
+			}
+			if (written)
+				fflush(out);
+			if (stopping)
+				return;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+	}
+
+	FILE* out;
+	std::atomic<LogLevel> min_level;
+	Slot ring[LOG_RING_SIZE];
+	std::atomic<size_t> enqueue_pos;
+	size_t dequeue_pos;		// flusher thread only
+	std::atomic<uint64_t> dropped;
+	std::atomic<bool> running;
+	std::thread flusher;
+};
+
+// never called, only gives the compiler a printf signature to check LOG() against
+#if defined(__GNUC__) || defined(__clang__)
+inline void logFormatCheck(const char*, ...) __attribute__((format(printf, 1, 2)));
+#else
+inline void logFormatCheck(const char*, ...);
+#endif
+inline void logFormatCheck(const char*, ...) {}
+
+#define LOG(level, fmt, ...) \
+	do { \
+		if (0) \
+			logFormatCheck(fmt, ##__VA_ARGS__); \
+		Logger::instance().log(level, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+// at most one record per interval_ms from this call site
+#define LOG_RATE(level, interval_ms, fmt, ...) \
+	do { \
+		static uint64_t log_last_us_ = 0; \
+		uint64_t log_now_us_ = Logger::now(); \
+		if (log_now_us_ - log_last_us_ >= (uint64_t)(interval_ms) * 1000) { \
+			log_last_us_ = log_now_us_; \
+			LOG(level, fmt, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+#endif
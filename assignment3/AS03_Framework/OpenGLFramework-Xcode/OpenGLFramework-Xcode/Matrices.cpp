@@ -113,23 +113,6 @@ Matrix3& Matrix3::invert()
 
 
 
-///////////////////////////////////////////////////////////////////////////////
-// transpose 4x4 matrix
-///////////////////////////////////////////////////////////////////////////////
-Matrix4& Matrix4::transpose()
-{
-    std::swap(m[1],  m[4]);
-    std::swap(m[2],  m[8]);
-    std::swap(m[3],  m[12]);
-    std::swap(m[6],  m[9]);
-    std::swap(m[7],  m[13]);
-    std::swap(m[11], m[14]);
-
-    return *this;
-}
-
-
-
 ///////////////////////////////////////////////////////////////////////////////
 // inverse 4x4 matrix
 ///////////////////////////////////////////////////////////////////////////////
@@ -305,7 +288,7 @@ Matrix4& Matrix4::invertProjective()
 
     // assemble inverse matrix
     m[0] = a1[0];  m[1] = a1[1];  m[2] = b1[0];  m[3] = b1[1];
-    m[4] = a1[2];  m[5] = a1[3];  m[6] = b1[1];  m[2] = b1[3];
+    m[4] = a1[2];  m[5] = a1[3];  m[6] = b1[2];  m[7] = b1[3];
     m[8] = c1[0];  m[9] = c1[1];  m[10]= d1[0];  m[11]= d1[1];
     m[12]= c1[2];  m[13]= c1[3];  m[14]= d1[2];  m[15]= d1[3];
 
@@ -320,6 +303,20 @@ Matrix4& Matrix4::invertProjective()
 // M^-1 = adj(M) / det(M)
 ///////////////////////////////////////////////////////////////////////////////
 Matrix4& Matrix4::invertGeneral()
+{
+    // block-wise SIMD inverse when available, see MatrixKernels.h
+    // inv(M^T) = inv(M)^T, so either storage order can be inverted in place
+    if(!mat4Inverse(m.v, m.v))
+        return identity();
+    return *this;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scalar Cramer's Rule version of invertGeneral(), kept as the reference
+///////////////////////////////////////////////////////////////////////////////
+Matrix4& Matrix4::invertGeneralScalar()
 {
     // get cofactors of minor matrices
     float cofactor0 = getCofactor(m[5],m[6],m[7], m[9],m[10],m[11], m[13],m[14],m[15]);
@@ -382,6 +379,13 @@ Matrix4& Matrix4::invertGeneral()
 // return determinant of 4x4 matrix
 ///////////////////////////////////////////////////////////////////////////////
 float Matrix4::getDeterminant()
+{
+    return mat4Determinant(m.v);
+}
+
+
+
+float Matrix4::getDeterminantScalar()
 {
     return m[0] * getCofactor(m[5],m[6],m[7], m[9],m[10],m[11], m[13],m[14],m[15]) -
            m[1] * getCofactor(m[4],m[6],m[7], m[8],m[10],m[11], m[12],m[14],m[15]) +
@@ -0,0 +1,572 @@
+///////////////////////////////////////////////////////////////////////////////
+// MatrixN.h
+// =========
+// Vector<T,N> / Matrix<T,N> of any element type and dimension
+//
+// Vector<T,N> and Matrix<T,N> name the hand written float classes of
+// Vectors.h / Matrices.h for T = float and N = 2, 3, 4, so float code keeps
+// its SIMD kernels, and the generic VectorN / MatrixN templates otherwise,
+// e.g. Vector<double,3> for CPU side preprocessing of large coordinates.
+//
+// Precision never changes implicitly:
+//   VectorN<U,N>(v), MatrixN<U,N>(m)   between generic types
+//   toVectorN<T>(), toMatrixN<T>()     float class -> generic type
+//   toFloat()                          generic type -> float class, i.e. at
+//                                      the GPU boundary
+//
+// MatrixN is indexed row major like Matrix2/3/4.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MATH_MATRIX_N_H
+#define MATH_MATRIX_N_H
+
+#include <stddef.h>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include "Matrices.h"
+
+template <class T, int N> struct VectorN;
+template <class T, int N> class MatrixN;
+
+template <class T, int N> struct VectorType         { typedef VectorN<T,N> type; };
+template <> struct VectorType<float, 2>             { typedef Vector2 type; };
+template <> struct VectorType<float, 3>             { typedef Vector3 type; };
+template <> struct VectorType<float, 4>             { typedef Vector4 type; };
+
+template <class T, int N> struct MatrixType         { typedef MatrixN<T,N> type; };
+template <> struct MatrixType<float, 2>             { typedef Matrix2 type; };
+template <> struct MatrixType<float, 3>             { typedef Matrix3 type; };
+template <> struct MatrixType<float, 4>             { typedef Matrix4 type; };
+
+template <class T, int N> using Vector = typename VectorType<T,N>::type;
+template <class T, int N> using Matrix = typename MatrixType<T,N>::type;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// N-D vector
+///////////////////////////////////////////////////////////////////////////////
+template <class T, int N>
+struct VectorN
+{
+    T v[N];
+
+    // ctors
+    MATH_CONSTEXPR VectorN() : v() {}
+    MATH_CONSTEXPR explicit VectorN(T s) : v() { for(int i = 0; i < N; ++i) v[i] = s; }
+    template <class... A>
+    MATH_CONSTEXPR VectorN(T x, T y, A... rest) : v{x, y, T(rest)...}
+    {
+        static_assert(sizeof...(A) + 2 == N, "one argument per component");
+    }
+    template <class U>
+    MATH_CONSTEXPR explicit VectorN(const VectorN<U,N>& u) : v() { for(int i = 0; i < N; ++i) v[i] = T(u[i]); }
+
+    // utils functions
+    T           length() const;                         //
+    T           distance(const VectorN& vec) const;     // distance between two vectors
+    VectorN&    normalize();                            //
+    MATH_CONSTEXPR T dot(const VectorN& vec) const;     // dot product
+
+    // operators
+    MATH_CONSTEXPR VectorN     operator-() const;                      // unary operator (negate)
+    MATH_CONSTEXPR VectorN     operator+(const VectorN& rhs) const;    // add rhs
+    MATH_CONSTEXPR VectorN     operator-(const VectorN& rhs) const;    // subtract rhs
+    MATH_CONSTEXPR VectorN&    operator+=(const VectorN& rhs);         // add rhs and update this object
+    MATH_CONSTEXPR VectorN&    operator-=(const VectorN& rhs);         // subtract rhs and update this object
+    MATH_CONSTEXPR VectorN     operator*(const T scale) const;         // scale
+    MATH_CONSTEXPR VectorN     operator*(const VectorN& rhs) const;    // multiply each element
+    MATH_CONSTEXPR VectorN&    operator*=(const T scale);              // scale and update this object
+    MATH_CONSTEXPR VectorN     operator/(const T scale) const;         // inverse scale
+    MATH_CONSTEXPR VectorN&    operator/=(const T scale);              // scale and update this object
+    MATH_CONSTEXPR bool        operator==(const VectorN& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const VectorN& rhs) const;   // exact compare, no epsilon
+    MATH_CONSTEXPR T           operator[](int index) const { return v[index]; }
+    MATH_CONSTEXPR T&          operator[](int index)       { return v[index]; }
+
+    friend MATH_CONSTEXPR VectorN operator*(const T a, const VectorN& vec) { return vec * a; }
+    friend std::ostream& operator<<(std::ostream& os, const VectorN& vec)
+    {
+        os << "(";
+        for(int i = 0; i < N; ++i)
+            os << vec.v[i] << (i + 1 < N ? ", " : ")");
+        return os;
+    }
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// NxN matrix
+///////////////////////////////////////////////////////////////////////////////
+template <class T, int N>
+class MatrixN
+{
+public:
+    // constructors
+    MATH_CONSTEXPR MatrixN() : m() { identity(); }      // init with identity
+    MATH_CONSTEXPR explicit MatrixN(const T src[N*N]) : m() { set(src); }
+    template <class U>
+    MATH_CONSTEXPR explicit MatrixN(const MatrixN<U,N>& u) : m() { for(int i = 0; i < N*N; ++i) m[i] = T(u[i]); }
+
+    MATH_CONSTEXPR void        set(const T src[N*N])   { for(int i = 0; i < N*N; ++i) m[i] = src[i]; }
+    MATH_CONSTEXPR const T*    get() const             { return m; }
+    MATH_CONSTEXPR MatrixN&    identity();
+    MATH_CONSTEXPR MatrixN&    transpose();                             // transpose itself and return reference
+    T           getDeterminant() const;
+    MatrixN&    invert();                                               // identity if singular
+
+    // operators
+    MATH_CONSTEXPR MatrixN     operator+(const MatrixN& rhs) const;     // add rhs
+    MATH_CONSTEXPR MatrixN     operator-(const MatrixN& rhs) const;     // subtract rhs
+    MATH_CONSTEXPR MatrixN     operator*(const MatrixN& rhs) const;     // multiplication: M3 = M1 * M2
+    MATH_CONSTEXPR VectorN<T,N> operator*(const VectorN<T,N>& rhs) const; // multiplication: v' = M * v
+    MATH_CONSTEXPR MatrixN&    operator*=(const MatrixN& rhs)           { return *this = *this * rhs; }
+    MATH_CONSTEXPR bool        operator==(const MatrixN& rhs) const;    // exact compare, no epsilon
+    MATH_CONSTEXPR bool        operator!=(const MatrixN& rhs) const     { return !(*this == rhs); }
+    MATH_CONSTEXPR T           operator[](int index) const { return m[index]; }
+    MATH_CONSTEXPR T&          operator[](int index)       { return m[index]; }
+
+    friend MATH_CONSTEXPR MatrixN operator*(T s, const MatrixN& rhs)
+    {
+        MatrixN r;
+        for(int i = 0; i < N*N; ++i)
+            r.m[i] = s * rhs.m[i];
+        return r;
+    }
+    friend std::ostream& operator<<(std::ostream& os, const MatrixN& mat)
+    {
+        for(int i = 0; i < N; ++i)
+        {
+            os << "(";
+            for(int j = 0; j < N; ++j)
+                os << mat.m[i*N + j] << (j + 1 < N ? ",\t" : ")\n");
+        }
+        return os;
+    }
+
+private:
+    T m[N*N];
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// inline functions for VectorN
+///////////////////////////////////////////////////////////////////////////////
+template <class T, int N>
+inline T VectorN<T,N>::length() const
+{
+    return std::sqrt(dot(*this));
+}
+
+template <class T, int N>
+inline T VectorN<T,N>::distance(const VectorN& vec) const
+{
+    return (vec - *this).length();
+}
+
+template <class T, int N>
+inline VectorN<T,N>& VectorN<T,N>::normalize()
+{
+    T len = length();
+    if(len > T(0))
+        *this /= len;
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR T VectorN<T,N>::dot(const VectorN& rhs) const
+{
+    T r = T(0);
+    for(int i = 0; i < N; ++i)
+        r += v[i] * rhs.v[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator-() const
+{
+    VectorN r;
+    for(int i = 0; i < N; ++i)
+        r.v[i] = -v[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator+(const VectorN& rhs) const
+{
+    VectorN r(*this);
+    return r += rhs;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator-(const VectorN& rhs) const
+{
+    VectorN r(*this);
+    return r -= rhs;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N>& VectorN<T,N>::operator+=(const VectorN& rhs)
+{
+    for(int i = 0; i < N; ++i)
+        v[i] += rhs.v[i];
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N>& VectorN<T,N>::operator-=(const VectorN& rhs)
+{
+    for(int i = 0; i < N; ++i)
+        v[i] -= rhs.v[i];
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator*(const T a) const
+{
+    VectorN r(*this);
+    return r *= a;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator*(const VectorN& rhs) const
+{
+    VectorN r(*this);
+    for(int i = 0; i < N; ++i)
+        r.v[i] *= rhs.v[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N>& VectorN<T,N>::operator*=(const T a)
+{
+    for(int i = 0; i < N; ++i)
+        v[i] *= a;
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> VectorN<T,N>::operator/(const T a) const
+{
+    VectorN r(*this);
+    return r /= a;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N>& VectorN<T,N>::operator/=(const T a)
+{
+    for(int i = 0; i < N; ++i)
+        v[i] /= a;
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR bool VectorN<T,N>::operator==(const VectorN& rhs) const
+{
+    for(int i = 0; i < N; ++i)
+        if(v[i] != rhs.v[i])
+            return false;
+    return true;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR bool VectorN<T,N>::operator!=(const VectorN& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template <class T>
+inline MATH_CONSTEXPR VectorN<T,3> cross(const VectorN<T,3>& a, const VectorN<T,3>& b)
+{
+    return VectorN<T,3>(a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]);
+}
+
+// component-wise min / max, e.g. for bounds
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> minimum(const VectorN<T,N>& a, const VectorN<T,N>& b)
+{
+    VectorN<T,N> r;
+    for(int i = 0; i < N; ++i)
+        r[i] = b[i] < a[i] ? b[i] : a[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> maximum(const VectorN<T,N>& a, const VectorN<T,N>& b)
+{
+    VectorN<T,N> r;
+    for(int i = 0; i < N; ++i)
+        r[i] = a[i] < b[i] ? b[i] : a[i];
+    return r;
+}
+// END OF VECTORN INLINE //////////////////////////////////////////////////////
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// inline functions for MatrixN
+///////////////////////////////////////////////////////////////////////////////
+template <class T, int N>
+inline MATH_CONSTEXPR MatrixN<T,N>& MatrixN<T,N>::identity()
+{
+    for(int i = 0; i < N*N; ++i)
+        m[i] = (i % (N + 1) == 0) ? T(1) : T(0);
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR MatrixN<T,N>& MatrixN<T,N>::transpose()
+{
+    for(int i = 0; i < N; ++i)
+        for(int j = i + 1; j < N; ++j)
+        {
+            T t = m[i*N + j];
+            m[i*N + j] = m[j*N + i];
+            m[j*N + i] = t;
+        }
+    return *this;
+}
+
+// Gaussian elimination with partial pivoting
+template <class T, int N>
+inline T MatrixN<T,N>::getDeterminant() const
+{
+    T a[N*N];
+    for(int i = 0; i < N*N; ++i)
+        a[i] = m[i];
+
+    T det = T(1);
+    for(int c = 0; c < N; ++c)
+    {
+        int p = c;
+        for(int i = c + 1; i < N; ++i)
+            if(std::fabs(a[i*N + c]) > std::fabs(a[p*N + c]))
+                p = i;
+        if(a[p*N + c] == T(0))
+            return T(0);
+        if(p != c)
+        {
+            for(int j = c; j < N; ++j)
+            {
+                T t = a[c*N + j];  a[c*N + j] = a[p*N + j];  a[p*N + j] = t;
+            }
+            det = -det;
+        }
+        det *= a[c*N + c];
+        for(int i = c + 1; i < N; ++i)
+        {
+            T f = a[i*N + c] / a[c*N + c];
+            for(int j = c + 1; j < N; ++j)
+                a[i*N + j] -= f * a[c*N + j];
+        }
+    }
+    return det;
+}
+
+// Gauss-Jordan elimination with partial pivoting, same singular test as Matrix4
+template <class T, int N>
+inline MatrixN<T,N>& MatrixN<T,N>::invert()
+{
+    T a[N*N];
+    for(int i = 0; i < N*N; ++i)
+        a[i] = m[i];
+    identity();
+
+    for(int c = 0; c < N; ++c)
+    {
+        int p = c;
+        for(int i = c + 1; i < N; ++i)
+            if(std::fabs(a[i*N + c]) > std::fabs(a[p*N + c]))
+                p = i;
+        if(std::fabs(a[p*N + c]) <= T(MATH_SINGULAR_EPSILON))
+            return identity();
+        if(p != c)
+        {
+            for(int j = 0; j < N; ++j)
+            {
+                T t = a[c*N + j];  a[c*N + j] = a[p*N + j];  a[p*N + j] = t;
+                t = m[c*N + j];    m[c*N + j] = m[p*N + j];  m[p*N + j] = t;
+            }
+        }
+
+        T inv = T(1) / a[c*N + c];
+        for(int j = 0; j < N; ++j)
+        {
+            a[c*N + j] *= inv;
+            m[c*N + j] *= inv;
+        }
+        for(int i = 0; i < N; ++i)
+        {
+            T f = a[i*N + c];
+            if(i == c || f == T(0))
+                continue;
+            for(int j = 0; j < N; ++j)
+            {
+                a[i*N + j] -= f * a[c*N + j];
+                m[i*N + j] -= f * m[c*N + j];
+            }
+        }
+    }
+    return *this;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR MatrixN<T,N> MatrixN<T,N>::operator+(const MatrixN& rhs) const
+{
+    MatrixN r;
+    for(int i = 0; i < N*N; ++i)
+        r.m[i] = m[i] + rhs.m[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR MatrixN<T,N> MatrixN<T,N>::operator-(const MatrixN& rhs) const
+{
+    MatrixN r;
+    for(int i = 0; i < N*N; ++i)
+        r.m[i] = m[i] - rhs.m[i];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR MatrixN<T,N> MatrixN<T,N>::operator*(const MatrixN& n) const
+{
+    MatrixN r;
+    for(int i = 0; i < N; ++i)
+        for(int j = 0; j < N; ++j)
+        {
+            T s = T(0);
+            for(int k = 0; k < N; ++k)
+                s += m[i*N + k] * n.m[k*N + j];
+            r.m[i*N + j] = s;
+        }
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR VectorN<T,N> MatrixN<T,N>::operator*(const VectorN<T,N>& rhs) const
+{
+    VectorN<T,N> r;
+    for(int i = 0; i < N; ++i)
+        for(int k = 0; k < N; ++k)
+            r[i] += m[i*N + k] * rhs[k];
+    return r;
+}
+
+template <class T, int N>
+inline MATH_CONSTEXPR bool MatrixN<T,N>::operator==(const MatrixN& rhs) const
+{
+    for(int i = 0; i < N*N; ++i)
+        if(m[i] != rhs.m[i])
+            return false;
+    return true;
+}
+
+// p' = M * (p, 1), the projective row of M is ignored
+template <class T>
+inline MATH_CONSTEXPR VectorN<T,3> transformPoint(const MatrixN<T,4>& m, const VectorN<T,3>& p)
+{
+    return VectorN<T,3>(m[0]*p[0] + m[1]*p[1] + m[2]*p[2]  + m[3],
+                        m[4]*p[0] + m[5]*p[1] + m[6]*p[2]  + m[7],
+                        m[8]*p[0] + m[9]*p[1] + m[10]*p[2] + m[11]);
+}
+// END OF MATRIXN INLINE //////////////////////////////////////////////////////
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// explicit conversions between the float classes and the generic types
+///////////////////////////////////////////////////////////////////////////////
+inline MATH_CONSTEXPR float*       vectorData(Vector2& v)          { return &v.x; }
+inline MATH_CONSTEXPR float*       vectorData(Vector3& v)          { return &v.x; }
+inline MATH_CONSTEXPR float*       vectorData(Vector4& v)          { return &v.x; }
+inline MATH_CONSTEXPR const float* vectorData(const Vector2& v)    { return &v.x; }
+inline MATH_CONSTEXPR const float* vectorData(const Vector3& v)    { return &v.x; }
+inline MATH_CONSTEXPR const float* vectorData(const Vector4& v)    { return &v.x; }
+template <class T, int N>
+inline MATH_CONSTEXPR T*           vectorData(VectorN<T,N>& v)     { return v.v; }
+
+template <class T, int N, class V>
+inline MATH_CONSTEXPR VectorN<T,N> toVectorNFrom(const V& v)
+{
+    VectorN<T,N> r;
+    const float* p = vectorData(v);
+    for(int i = 0; i < N; ++i)
+        r[i] = T(p[i]);
+    return r;
+}
+
+template <class T> inline MATH_CONSTEXPR VectorN<T,2> toVectorN(const Vector2& v) { return toVectorNFrom<T,2>(v); }
+template <class T> inline MATH_CONSTEXPR VectorN<T,3> toVectorN(const Vector3& v) { return toVectorNFrom<T,3>(v); }
+template <class T> inline MATH_CONSTEXPR VectorN<T,4> toVectorN(const Vector4& v) { return toVectorNFrom<T,4>(v); }
+
+template <class T, int N, class M>
+inline MATH_CONSTEXPR MatrixN<T,N> toMatrixNFrom(const M& m)
+{
+    MatrixN<T,N> r;
+    for(int i = 0; i < N*N; ++i)
+        r[i] = T(m[i]);
+    return r;
+}
+
+template <class T> inline MATH_CONSTEXPR MatrixN<T,2> toMatrixN(const Matrix2& m) { return toMatrixNFrom<T,2>(m); }
+template <class T> inline MATH_CONSTEXPR MatrixN<T,3> toMatrixN(const Matrix3& m) { return toMatrixNFrom<T,3>(m); }
+template <class T> inline MATH_CONSTEXPR MatrixN<T,4> toMatrixN(const Matrix4& m) { return toMatrixNFrom<T,4>(m); }
+
+// rounds every element to float, e.g. before uploading to OpenGL
+template <class T, int N>
+inline Vector<float,N> toFloat(const VectorN<T,N>& v)
+{
+    Vector<float,N> r;
+    float* p = vectorData(r);
+    for(int i = 0; i < N; ++i)
+        p[i] = float(v[i]);
+    return r;
+}
+
+template <class T, int N>
+inline Matrix<float,N> toFloat(const MatrixN<T,N>& m)
+{
+    Matrix<float,N> r;
+    for(int i = 0; i < N*N; ++i)
+        r[i] = float(m[i]);
+    return r;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// float point arrays transformed in T precision
+// Same AoS layout as transformPoints() in TransformBatch.h, but each point is
+// promoted to T, transformed by the affine rows of m and rounded back to float
+// once, so large coordinates do not lose their low bits to cancellation.
+///////////////////////////////////////////////////////////////////////////////
+template <class T>
+inline void transformPoints(const MatrixN<T,4>& m, const float* in, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        VectorN<T,3> p = transformPoint(m, VectorN<T,3>(T(in[i*3]), T(in[i*3 + 1]), T(in[i*3 + 2])));
+        out[i*3]     = float(p[0]);
+        out[i*3 + 1] = float(p[1]);
+        out[i*3 + 2] = float(p[2]);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// compile time checks
+///////////////////////////////////////////////////////////////////////////////
+static_assert(std::is_same<Vector<float,3>, Vector3>::value && std::is_same<Matrix<float,4>, Matrix4>::value, "float aliases name the SIMD classes");
+static_assert(sizeof(Vector<double,3>) == 3 * sizeof(double), "VectorN has no padding");
+#ifdef MATH_HAS_CONSTEXPR
+static_assert(VectorN<double,3>(1, 2, 3).dot(VectorN<double,3>(4, 5, 6)) == 32, "VectorN::dot()");
+static_assert(cross(VectorN<double,3>(1, 0, 0), VectorN<double,3>(0, 1, 0))[2] == 1, "cross()");
+static_assert((MatrixN<double,3>() * VectorN<double,3>(1, 2, 3))[1] == 2, "MatrixN * VectorN");
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshOptimizer.h
+// ===============
+// Index a triangle soup and reorder it for the GPU vertex pipeline.
+//
+// The stage runs in three passes over an indexed triangle list:
+//   optimizeVertexCache()  Tipsify (Sander, Nehab, Barczak 2007): emit the
+//                          remaining triangles around one vertex at a time,
+//                          next fanning the oldest vertex whose fan still
+//                          fits before the simulated post-transform cache
+//                          evicts it, so consecutive triangles share vertices
+//   optimizeOverdraw()     cut that order into clusters where the cache is
+//                          flushed anyway (or the ACMR target is met) and
+//                          draw outward facing clusters first, so the depth
+//                          test rejects more fragments of the ones behind
+//   optimizeVertexFetch()  renumber vertices in order of first use, so the
+//                          vertex fetch walks the buffer forwards
+// analyzeVertexCache() reports ACMR (vertex shader runs per triangle, 0.5
+// is the best a regular grid can do, 3 the worst) and ATVR (runs per unique
+// vertex, 1 is ideal) through a FIFO cache simulation.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_OPTIMIZER_H_DEF
+#define MESH_OPTIMIZER_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#define MESH_CACHE_SIZE 16	// FIFO entries the passes and the statistics assume
+
+struct MeshCacheStats
+{
+	size_t triangles = 0;
+	size_t vertices = 0;	// unique vertices referenced
+	size_t transforms = 0;	// cache misses, i.e. vertex shader invocations
+
+	double acmr() const { return triangles ? (double)transforms / triangles : 0.0; }
+	double atvr() const { return vertices ? (double)transforms / vertices : 0.0; }
+
+	MeshCacheStats& operator+=(const MeshCacheStats& rhs)
+	{
+		triangles += rhs.triangles;
+		vertices += rhs.vertices;
+		transforms += rhs.transforms;
+		return *this;
+	}
+};
+
+// a vertex is in the FIFO while fewer than cache_size misses happened since
+// its own miss; time starts past cache_size so every vertex starts outside
+struct MeshFifoCache
+{
+	std::vector<unsigned int> stamp;
+	unsigned int time;
+	unsigned int size;
+
+	MeshFifoCache(size_t vertex_count, int cache_size) : stamp(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+	bool contains(unsigned int v) const { return time - stamp[v] <= size; }
+
+	void flush() { time += size + 1; }
+
+	// returns 1 if v had to be transformed
+	int access(unsigned int v)
+	{
+		if (contains(v))
+			return 0;
+		stamp[v] = time++;
+		return 1;
+	}
+};
+
+inline MeshCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertex_count, int cache_size = MESH_CACHE_SIZE)
+{
+	MeshCacheStats stats;
+	MeshFifoCache cache(vertex_count, cache_size);
+	std::vector<char> used(vertex_count, 0);
+	for (size_t i = 0; i < indices.size(); i++) {
+		stats.transforms += cache.access(indices[i]);
+		if (!used[indices[i]]) {
+			used[indices[i]] = 1;
+			stats.vertices++;
+		}
+	}
+	stats.triangles = indices.size() / 3;
+	return stats;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// vertices of stride floats that are bitwise equal get one index; unique
+// receives the first occurrence of each, in input order
+///////////////////////////////////////////////////////////////////////////////
+inline void weldVertices(const float* data, size_t count, size_t stride, std::vector<float>& unique, std::vector<unsigned int>& indices)
+{
+	size_t table_size = 1;
+	while (table_size < count * 2)
+		table_size *= 2;
+	std::vector<unsigned int> table(table_size, 0);	// unique index + 1, 0 = empty
+	size_t bytes = stride * sizeof(float);
+
+	unique.clear();
+	indices.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		const float* vertex = data + i * stride;
+		// FNV-1a over the attribute bits
+		uint32_t hash = 2166136261u;
+		const unsigned char* p = (const unsigned char*)vertex;
+		for (size_t b = 0; b < bytes; b++)
+			hash = (hash ^ p[b]) * 16777619u;
+
+		size_t slot = hash & (table_size - 1);
+		while (table[slot] != 0 && memcmp(&unique[(table[slot] - 1) * stride], vertex, bytes) != 0)
+			slot = (slot + 1) & (table_size - 1);
+		if (table[slot] == 0) {
+			table[slot] = (unsigned int)(unique.size() / stride) + 1;
+			unique.insert(unique.end(), vertex, vertex + stride);
+		}
+		indices[i] = table[slot] - 1;
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Tipsify, linear in the number of triangles
+///////////////////////////////////////////////////////////////////////////////
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertex_count, int cache_size = MESH_CACHE_SIZE)
+{
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	// triangles around each vertex, CSR
+	std::vector<unsigned int> live(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		live[indices[i]]++;
+	for (size_t v = 0; v < vertex_count; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned int> stamp(vertex_count, 0), dead_end, candidates, result;
+	std::vector<char> emitted(triangle_count, 0);
+	result.reserve(indices.size());
+	dead_end.reserve(indices.size());
+	unsigned int time = cache_size + 1;
+	size_t cursor = 0;	// next vertex to try when the dead end stack runs dry
+	long fan = indices[0];
+
+	while (fan >= 0) {
+		candidates.clear();
+		for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++) {
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				result.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > (unsigned int)cache_size)
+					stamp[v] = time++;
+			}
+		}
+
+		// the candidate still in cache after fanning all its remaining
+		// triangles, oldest first; 2 * live estimates the misses of that fan
+		fan = -1;
+		int best_priority = -1;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			unsigned int v = candidates[c];
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - stamp[v] + 2 * live[v] <= (unsigned int)cache_size)
+				priority = time - stamp[v];
+			if (priority > best_priority) {
+				best_priority = priority;
+				fan = (long)v;
+			}
+		}
+		if (fan < 0) {
+			while (!dead_end.empty() && fan < 0) {
+				unsigned int v = dead_end.back();
+				dead_end.pop_back();
+				if (live[v] > 0)
+					fan = (long)v;
+			}
+			for (; cursor < vertex_count && fan < 0; cursor++) {
+				if (live[cursor] > 0)
+					fan = (long)cursor;
+			}
+		}
+	}
+	indices.swap(result);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Overdraw: the positions are the first three floats of every stride floats.
+// A cluster ends where all three vertices of a triangle miss the cache, or
+// once its running ACMR from a cold cache is within threshold of the whole
+// run it belongs to (Sander et al. 2007).
+///////////////////////////////////////////////////////////////////////////////
+inline void optimizeOverdraw(std::vector<unsigned int>& indices, const float* vertices, size_t vertex_count, size_t stride,
+	float threshold = 1.05f, int cache_size = MESH_CACHE_SIZE)
+{
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count < 2)
+		return;
+
+	// hard boundaries, the cache state does not carry over them
+	std::vector<size_t> hard, clusters;
+	std::vector<int> misses(triangle_count);
+	MeshFifoCache cache(vertex_count, cache_size);
+	for (size_t t = 0; t < triangle_count; t++) {
+		misses[t] = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+		if (t == 0 || misses[t] == 3)
+			hard.push_back(t);
+	}
+	hard.push_back(triangle_count);
+
+	// soft boundaries inside each run
+	for (size_t h = 0; h + 1 < hard.size(); h++) {
+		size_t begin = hard[h], end = hard[h + 1];
+		int run_misses = 0;
+		for (size_t t = begin; t < end; t++)
+			run_misses += misses[t];
+		float target = threshold * run_misses / (float)(end - begin);
+
+		// each cluster is drawn after an unrelated one, so it pays its own
+		// cold cache misses and only ends once they are amortized
+		clusters.push_back(begin);
+		cache.flush();
+		int cluster_misses = 0, cluster_triangles = 0;
+		for (size_t t = begin; t + 1 < end; t++) {
+			cluster_misses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+			cluster_triangles++;
+			if (cluster_misses <= target * cluster_triangles) {
+				clusters.push_back(t + 1);
+				cache.flush();
+				cluster_misses = cluster_triangles = 0;
+			}
+		}
+	}
+	clusters.push_back(triangle_count);
+
+	// area weighted centroid and normal of every cluster and of the mesh
+	size_t cluster_count = clusters.size() - 1;
+	std::vector<float> sort_key(cluster_count);
+	std::vector<float> centroids(cluster_count * 3), normals(cluster_count * 3, 0.0f);
+	double mesh_centroid[3] = { 0, 0, 0 }, mesh_area = 0;
+	for (size_t c = 0; c < cluster_count; c++) {
+		double centroid[3] = { 0, 0, 0 }, area = 0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const float* p0 = vertices + indices[t * 3] * stride;
+			const float* p1 = vertices + indices[t * 3 + 1] * stride;
+			const float* p2 = vertices + indices[t * 3 + 2] * stride;
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			double a = sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+			for (int k = 0; k < 3; k++) {
+				centroid[k] += a * (p0[k] + p1[k] + p2[k]) / 3;
+				normals[c * 3 + k] += n[k];
+			}
+			area += a;
+		}
+		for (int k = 0; k < 3; k++) {
+			mesh_centroid[k] += centroid[k];
+			centroids[c * 3 + k] = area > 0 ? (float)(centroid[k] / area) : 0.0f;
+		}
+		mesh_area += area;
+	}
+	for (int k = 0; k < 3; k++)
+		mesh_centroid[k] = mesh_area > 0 ? mesh_centroid[k] / mesh_area : 0;
+
+	// clusters facing away from the center are likely in front, draw them first
+	std::vector<unsigned int> order(cluster_count);
+	for (size_t c = 0; c < cluster_count; c++) {
+		order[c] = (unsigned int)c;
+		sort_key[c] = 0;
+		for (int k = 0; k < 3; k++)
+			sort_key[c] += (centroids[c * 3 + k] - (float)mesh_centroid[k]) * normals[c * 3 + k];
+	}
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sort_key[a] > sort_key[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t c = 0; c < cluster_count; c++)
+		result.insert(result.end(), indices.begin() + clusters[order[c]] * 3, indices.begin() + clusters[order[c] + 1] * 3);
+	indices.swap(result);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// renumber vertices in order of first use and move their stride floats
+// along, unreferenced vertices are dropped; returns the new vertex count
+///////////////////////////////////////////////////////////////////////////////
+inline size_t optimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<float>& vertices, size_t stride)
+{
+	size_t vertex_count = vertices.size() / stride;
+	const unsigned int UNUSED = ~0u;
+	std::vector<unsigned int> remap(vertex_count, UNUSED);
+	std::vector<float> result;
+	result.reserve(vertices.size());
+	unsigned int next = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int v = indices[i];
+		if (remap[v] == UNUSED) {
+			remap[v] = next++;
+			result.insert(result.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+		}
+		indices[i] = remap[v];
+	}
+	vertices.swap(result);
+	return next;
+}
+
+// all three passes, vertex positions are the first three floats of each vertex
+inline void optimizeMesh(std::vector<unsigned int>& indices, std::vector<float>& vertices, size_t stride)
+{
+	size_t vertex_count = vertices.size() / stride;
+	optimizeVertexCache(indices, vertex_count);
+	optimizeOverdraw(indices, &vertices[0], vertex_count, stride);
+	optimizeVertexFetch(indices, vertices, stride);
+}
+
+#endif
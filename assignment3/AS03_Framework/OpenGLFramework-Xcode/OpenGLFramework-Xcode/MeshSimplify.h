@@ -0,0 +1,435 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshSimplify.h
+// ==============
+// Quadric error edge collapse (Garland / Heckbert 1997) and LOD chains.
+//
+// Collapses are half edge: a vertex moves onto one of its neighbours, so
+// every level indexes a subset of the original vertices and all levels of a
+// mesh share one vertex buffer. Attributes are never interpolated.
+//
+// The loader welds corners only when all their attributes match, so a UV or
+// normal seam is an open border in the index list whose vertices pair up
+// with a twin of the same position on the other side. Such seam vertices
+// may only move along the seam, onto a seam neighbour, and their twin moves
+// onto the neighbour's counterpart in the same step, so both sides stay
+// closed. Other border vertices (holes, material borders of the one Shape
+// per material, corners where more than two sides meet) are locked.
+//
+// Every vertex accumulates the planes of its triangles as a quadric
+// Q = p p^T (MatrixN<double, 4>) and counts them; moving u onto v costs
+// v^T (Qu + Qv) v / (nu + nv), the mean squared distance of v to the planes
+// u and v stand for. The square root of the largest cost so far is the
+// error of a level, an RMS distance to the original surface. Collapses that
+// flip a triangle or break the link condition of their edge are rejected.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_SIMPLIFY_H_DEF
+#define MESH_SIMPLIFY_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include "MatrixN.h"
+
+#define MESH_LOD_LEVELS 4	// full resolution and three levels of about 1/2, 1/4, 1/8
+#define MESH_LOD_MAX_ERROR 0.02f	// of the bounding box diagonal, coarser levels are not built
+#define MESH_NO_TWIN 0xffffffffu	// a vertex that is not on a seam
+
+typedef MatrixN<double, 4> Quadric;
+
+struct MeshLod
+{
+	size_t first;	// in the index list of all levels
+	size_t count;	// indices
+	float error;	// distance bound to the original surface, in position units
+};
+
+inline Quadric quadricZero()
+{
+	const double zero[16] = {};
+	return Quadric(zero);
+}
+
+// plane a x + b y + c z + d = 0 with a unit normal
+inline Quadric quadricFromPlane(double a, double b, double c, double d)
+{
+	const double p[4] = { a, b, c, d };
+	Quadric q;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			q[i * 4 + j] = p[i] * p[j];
+	return q;
+}
+
+inline double quadricError(const Quadric& q, const float* position)
+{
+	VectorN<double, 4> v(position[0], position[1], position[2], 1.0);
+	return std::max(0.0, v.dot(q * v));
+}
+
+inline void meshTriangleNormal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+	double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+	double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Greedy collapses, cheapest first. simplify() can be called again with a
+// smaller target to continue from the current level, the quadrics and the
+// error keep accumulating across calls.
+///////////////////////////////////////////////////////////////////////////////
+class MeshSimplifier
+{
+public:
+	// vertices: stride floats per vertex, the position first
+	MeshSimplifier(const std::vector<unsigned int>& indices, const float* vertices, size_t vertex_count, size_t stride)
+		: triangles(indices), positions(vertices), stride(stride), around(vertex_count), removed(indices.size() / 3, 0),
+		  quadrics(vertex_count, quadricZero()), planes(vertex_count, 0.0), locked(vertex_count, 0), collapsed(vertex_count, 0),
+		  twin(vertex_count, MESH_NO_TWIN), target(vertex_count, 0), twin_target(vertex_count, 0),
+		  stamp(vertex_count, 0), live_triangles(indices.size() / 3), max_cost(0.0)
+	{
+		std::unordered_map<uint64_t, int> edges;
+		for (size_t t = 0; t < live_triangles; t++) {
+			const unsigned int* tri = &triangles[t * 3];
+			double n[3];
+			meshTriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]), n);
+			double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			Quadric q = quadricZero();
+			if (length > 0) {
+				n[0] /= length;  n[1] /= length;  n[2] /= length;
+				const float* p = position(tri[0]);
+				q = quadricFromPlane(n[0], n[1], n[2], -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]));
+			}
+			for (int k = 0; k < 3; k++) {
+				around[tri[k]].push_back((unsigned int)t);
+				quadrics[tri[k]] = quadrics[tri[k]] + q;
+				planes[tri[k]] += length > 0 ? 1.0 : 0.0;
+				edges[edgeKey(tri[k], tri[(k + 1) % 3])]++;
+			}
+		}
+
+		// border edges per vertex; non-manifold edges lock their vertices
+		std::vector<int> border_edges(vertex_count, 0);
+		for (std::unordered_map<uint64_t, int>::const_iterator e = edges.begin(); e != edges.end(); ++e) {
+			unsigned int a = (unsigned int)(e->first >> 32), b = (unsigned int)e->first;
+			if (e->second == 1) {
+				border_edges[a]++;
+				border_edges[b]++;
+			}
+			else if (e->second > 2)
+				locked[a] = locked[b] = 1;
+		}
+
+		// a border vertex is a seam vertex when exactly one other border
+		// vertex shares its position and both lie on two border edges
+		std::vector<unsigned int> order;
+		for (size_t v = 0; v < vertex_count; v++) {
+			if (border_edges[v] > 0)
+				order.push_back((unsigned int)v);
+		}
+		std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return lessPosition(a, b); });
+		for (size_t i = 0; i < order.size(); ) {
+			size_t j = i + 1;
+			while (j < order.size() && !lessPosition(order[i], order[j]))
+				j++;
+			unsigned int a = order[i], b = order[j - 1];
+			if (j - i == 2 && border_edges[a] == 2 && border_edges[b] == 2 && !locked[a] && !locked[b]) {
+				twin[a] = b;
+				twin[b] = a;
+			}
+			else {
+				for (size_t k = i; k < j; k++)
+					locked[order[k]] = 1;
+			}
+			i = j;
+		}
+
+		for (size_t v = 0; v < vertex_count; v++)
+			updateCandidate((unsigned int)v);
+	}
+
+	// collapse until at most target_index_count indices are left, or the next
+	// collapse would exceed max_error, or nothing can be collapsed; returns
+	// the error bound of the current level
+	float simplify(size_t target_index_count, float max_error)
+	{
+		while (live_triangles * 3 > target_index_count && !heap.empty()) {
+			HeapEntry e = heap.top();
+			if (collapsed[e.vertex] || e.stamp != stamp[e.vertex]) {
+				heap.pop();
+				continue;
+			}
+			if (e.cost > (double)max_error * max_error)
+				break;
+			heap.pop();
+			max_cost = std::max(max_cost, e.cost);
+			collapse(e.vertex);
+		}
+		return error();
+	}
+
+	float error() const { return (float)sqrt(max_cost); }
+	size_t indexCount() const { return live_triangles * 3; }
+
+	void getIndices(std::vector<unsigned int>& out) const
+	{
+		out.clear();
+		for (size_t t = 0; t < removed.size(); t++) {
+			if (!removed[t])
+				out.insert(out.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+		}
+	}
+
+private:
+	struct HeapEntry
+	{
+		double cost;
+		unsigned int vertex;
+		unsigned int stamp;
+		bool operator<(const HeapEntry& rhs) const { return cost > rhs.cost; }	// min heap
+	};
+
+	static uint64_t edgeKey(unsigned int a, unsigned int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	const float* position(unsigned int v) const { return positions + v * stride; }
+
+	bool lessPosition(unsigned int a, unsigned int b) const
+	{
+		const float* p = position(a);
+		const float* q = position(b);
+		return p[0] != q[0] ? p[0] < q[0] : p[1] != q[1] ? p[1] < q[1] : p[2] < q[2];
+	}
+
+	bool samePosition(unsigned int a, unsigned int b) const { return !lessPosition(a, b) && !lessPosition(b, a); }
+
+	// the edge u v is used by exactly one live triangle
+	bool isBorderEdge(unsigned int u, unsigned int v) const
+	{
+		int used = 0;
+		for (size_t i = 0; i < around[u].size(); i++) {
+			unsigned int t = around[u][i];
+			const unsigned int* tri = &triangles[t * 3];
+			used += !removed[t] && (tri[0] == v || tri[1] == v || tri[2] == v);
+		}
+		return used == 1;
+	}
+
+	// mean squared distance of v to the planes of u and v
+	double collapseCost(unsigned int u, unsigned int v) const
+	{
+		return quadricError(quadrics[u] + quadrics[v], position(v)) / std::max(1.0, planes[u] + planes[v]);
+	}
+
+	void neighbours(unsigned int v, std::vector<unsigned int>& out) const
+	{
+		out.clear();
+		for (size_t i = 0; i < around[v].size(); i++) {
+			unsigned int t = around[v][i];
+			if (removed[t])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				if (triangles[t * 3 + k] != v)
+					out.push_back(triangles[t * 3 + k]);
+			}
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	// u onto v keeps the mesh manifold and no triangle of u turns over;
+	// ring_u are the neighbours of u, a border edge has one opposite vertex
+	bool canCollapse(unsigned int u, unsigned int v, const std::vector<unsigned int>& ring_u, bool border)
+	{
+		neighbours(v, scratch_v);
+		size_t shared = 0;
+		for (size_t i = 0; i < ring_u.size(); i++)
+			shared += std::binary_search(scratch_v.begin(), scratch_v.end(), ring_u[i]);
+		if (shared != (border ? 1u : 2u))
+			return false;
+
+		for (size_t i = 0; i < around[u].size(); i++) {
+			unsigned int t = around[u][i];
+			const unsigned int* tri = &triangles[t * 3];
+			if (removed[t] || tri[0] == v || tri[1] == v || tri[2] == v)
+				continue;
+			const float* p[3], *q[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = position(tri[k]);
+				q[k] = tri[k] == u ? position(v) : p[k];
+			}
+			double before[3], after[3];
+			meshTriangleNormal(p[0], p[1], p[2], before);
+			meshTriangleNormal(q[0], q[1], q[2], after);
+			if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0)
+				return false;
+		}
+		return true;
+	}
+
+	void updateCandidate(unsigned int u)
+	{
+		stamp[u]++;
+		if (locked[u] || collapsed[u])
+			return;
+		neighbours(u, scratch_u);
+		double best = -1;
+		if (twin[u] == MESH_NO_TWIN) {
+			for (size_t i = 0; i < scratch_u.size(); i++) {
+				unsigned int v = scratch_u[i];
+				double c = collapseCost(u, v);
+				if ((best < 0 || c < best) && canCollapse(u, v, scratch_u, false)) {
+					best = c;
+					target[u] = v;
+				}
+			}
+		}
+		else {
+			// along the seam on both sides: u onto v and the twin w of u onto
+			// the neighbour of w at the position of v
+			unsigned int w = twin[u];
+			std::vector<unsigned int> ring_u = scratch_u, ring_w;
+			neighbours(w, ring_w);
+			for (size_t i = 0; i < ring_u.size(); i++) {
+				unsigned int v = ring_u[i];
+				if (v == w || !isBorderEdge(u, v))
+					continue;
+				for (size_t j = 0; j < ring_w.size(); j++) {
+					unsigned int x = ring_w[j];
+					if (x == u || !samePosition(v, x) || !isBorderEdge(w, x))
+						continue;
+					double c = (quadricError(quadrics[u] + quadrics[v], position(v)) + quadricError(quadrics[w] + quadrics[x], position(x))) /
+						std::max(1.0, planes[u] + planes[v] + planes[w] + planes[x]);
+					if ((best < 0 || c < best) && canCollapse(u, v, ring_u, true) && canCollapse(w, x, ring_w, true)) {
+						best = c;
+						target[u] = v;
+						twin_target[u] = x;
+					}
+				}
+			}
+		}
+		if (best >= 0) {
+			HeapEntry e = { best, u, stamp[u] };
+			heap.push(e);
+		}
+	}
+
+	// u onto its target, a seam vertex together with its twin, then new
+	// candidates around the vertices they moved onto
+	void collapse(unsigned int u)
+	{
+		unsigned int moved[2] = { target[u], twin[u] != MESH_NO_TWIN ? twin_target[u] : MESH_NO_TWIN };
+		move(u, moved[0]);
+		if (moved[1] != MESH_NO_TWIN)
+			move(twin[u], moved[1]);
+
+		std::vector<unsigned int> ring;
+		for (int m = 0; m < 2 && moved[m] != MESH_NO_TWIN; m++) {
+			neighbours(moved[m], ring);
+			ring.push_back(moved[m]);
+			for (size_t i = 0; i < ring.size(); i++) {
+				// the candidate of a seam vertex depends on the side of its twin too
+				updateCandidate(ring[i]);
+				if (twin[ring[i]] != MESH_NO_TWIN)
+					updateCandidate(twin[ring[i]]);
+			}
+		}
+	}
+
+	void move(unsigned int u, unsigned int v)
+	{
+		for (size_t i = 0; i < around[u].size(); i++) {
+			unsigned int t = around[u][i];
+			if (removed[t])
+				continue;
+			unsigned int* tri = &triangles[t * 3];
+			if (tri[0] == v || tri[1] == v || tri[2] == v) {
+				removed[t] = 1;
+				live_triangles--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == u)
+					tri[k] = v;
+			}
+			around[v].push_back(t);
+		}
+		around[u].clear();
+		collapsed[u] = 1;
+		quadrics[v] = quadrics[v] + quadrics[u];
+		planes[v] += planes[u];
+	}
+
+	std::vector<unsigned int> triangles;
+	const float* positions;
+	size_t stride;
+	std::vector<std::vector<unsigned int> > around;	// triangles of each vertex, removed ones included
+	std::vector<char> removed;
+	std::vector<Quadric> quadrics;
+	std::vector<double> planes;	// absorbed by each quadric
+	std::vector<char> locked, collapsed;
+	std::vector<unsigned int> twin;	// the other side of a seam vertex, or MESH_NO_TWIN
+	std::vector<unsigned int> target;	// cheapest valid collapse of each vertex
+	std::vector<unsigned int> twin_target;	// where the twin of a seam vertex moves with it
+	std::vector<unsigned int> stamp;	// heap entries of older stamps are stale
+	std::priority_queue<HeapEntry> heap;
+	std::vector<unsigned int> scratch_u, scratch_v;
+	size_t live_triangles;
+	double max_cost;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Replace indices by all levels back to back, level 0 being the input, each
+// next one with about half the triangles of the previous. The chain stops
+// early once a level would keep more than 90% of the previous one, e.g.
+// when borders lock most vertices or MESH_LOD_MAX_ERROR is reached.
+///////////////////////////////////////////////////////////////////////////////
+inline std::vector<MeshLod> buildLodChain(std::vector<unsigned int>& indices, const float* vertices, size_t vertex_count, size_t stride,
+	int max_levels = MESH_LOD_LEVELS)
+{
+	std::vector<MeshLod> lods;
+	MeshLod full = { 0, indices.size(), 0.0f };
+	lods.push_back(full);
+	if (indices.empty())
+		return lods;
+
+	double lo[3], hi[3];
+	for (int k = 0; k < 3; k++)
+		lo[k] = hi[k] = vertices[indices[0] * stride + k];
+	for (size_t i = 0; i < indices.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], (double)vertices[indices[i] * stride + k]);
+			hi[k] = std::max(hi[k], (double)vertices[indices[i] * stride + k]);
+		}
+	}
+	float max_error = MESH_LOD_MAX_ERROR * (float)sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+
+	MeshSimplifier simplifier(indices, vertices, vertex_count, stride);
+	std::vector<unsigned int> level;
+	for (int l = 1; l < max_levels; l++) {
+		size_t previous = lods.back().count;
+		float error = simplifier.simplify(previous / 6 * 3, max_error);
+		if (simplifier.indexCount() * 10 > previous * 9)
+			break;
+		simplifier.getIndices(level);
+		MeshLod lod = { indices.size(), level.size(), error };
+		indices.insert(indices.end(), level.begin(), level.end());
+		lods.push_back(lod);
+	}
+	return lods;
+}
+
+#endif
@@ -0,0 +1,472 @@
+///////////////////////////////////////////////////////////////////////////////
+// PhongKernels.h
+// ==============
+// The lighting of PhongLighting.h over arrays of samples, several lanes at a
+// time, for the per vertex (Gouraud) and per pixel modes of the software
+// backend.
+//
+// Samples are passed SoA as view space normals and positions and come back
+// as colors. Like main() of both shaders the kernel normalizes the normal
+// before lighting it, so interpolated normals can be passed as they are.
+// The backend is selected at compile time:
+//   AVX2 (+FMA)  8 lanes, when __AVX2__ (and __FMA__) is defined
+//   SSE2         4 lanes, on any x86-64 build
+//   NEON         4 lanes, on AArch64
+//   scalar       phongShade() per sample, otherwise or with MATH_SIMD_SCALAR
+// The SIMD paths finish the tail with phongShade(), which is also the
+// reference phongShadeSamplesScalar() is built on.
+//
+// The lanes trade exactness for speed in three places: normalize is the
+// rsqrt estimate with one Newton step (see fastInvSqrt()), pow() is
+// exp(s log(x)) with the Cephes polynomials, and the spot cone test compares
+// the cosine against cos(cutoff) instead of the angle against the cutoff.
+// The last one only differs for samples on the cone edge, where the light
+// is already scaled down by pow(cos, exponent).
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef PHONG_KERNELS_H_DEF
+#define PHONG_KERNELS_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "PhongLighting.h"
+
+#if !defined(MATH_SIMD_SCALAR) && defined(__AVX2__)
+	#define PHONG_SIMD_AVX2
+	#define PHONG_LANES 8
+	#include <immintrin.h>
+#elif defined(MATH_SIMD_SSE2)
+	#define PHONG_SIMD_SSE2
+	#define PHONG_LANES 4
+#elif defined(MATH_SIMD_NEON) && defined(__aarch64__)
+	#define PHONG_SIMD_NEON
+	#define PHONG_LANES 4
+#else
+	#define PHONG_LANES 1
+#endif
+
+#if PHONG_LANES > 1
+	#define PHONG_SIMD
+#endif
+
+// SoA view of count samples, the arrays of a call must not overlap
+struct PhongSamples
+{
+	const float* normal[3];	// x, y, z, view space, need not be normalized
+	const float* position[3];	// x, y, z, view space
+	float* color[3];	// r, g, b out
+};
+
+inline const char* phongKernelBackend()
+{
+#if defined(PHONG_SIMD_AVX2) && defined(__FMA__)
+	return "AVX2+FMA";
+#elif defined(PHONG_SIMD_AVX2)
+	return "AVX2";
+#elif defined(PHONG_SIMD_SSE2)
+	return "SSE2";
+#elif defined(PHONG_SIMD_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+inline void phongShadeSampleRange(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		Vector3 N = Vector3(s.normal[0][i], s.normal[1][i], s.normal[2][i]).normalize();
+		Vector3 c = phongShade(view, m, N, Vector3(s.position[0][i], s.position[1][i], s.position[2][i]));
+		s.color[0][i] = c.x;  s.color[1][i] = c.y;  s.color[2][i] = c.z;
+	}
+}
+
+// phongShade() per sample, the reference of phongShadeSamples()
+inline void phongShadeSamplesScalar(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t count)
+{
+	phongShadeSampleRange(view, m, s, 0, count);
+}
+
+
+
+#ifdef PHONG_SIMD
+///////////////////////////////////////////////////////////////////////////////
+// lane primitives of the selected backend
+///////////////////////////////////////////////////////////////////////////////
+#if defined(PHONG_SIMD_AVX2)
+typedef __m256 ShadeVec;
+typedef __m256 ShadeMask;
+
+inline ShadeVec shadeSplat(float f)	{ return _mm256_set1_ps(f); }
+inline ShadeVec shadeLoad(const float* p)	{ return _mm256_loadu_ps(p); }
+inline void shadeStore(float* p, ShadeVec v)	{ _mm256_storeu_ps(p, v); }
+inline ShadeVec shadeAdd(ShadeVec a, ShadeVec b)	{ return _mm256_add_ps(a, b); }
+inline ShadeVec shadeSub(ShadeVec a, ShadeVec b)	{ return _mm256_sub_ps(a, b); }
+inline ShadeVec shadeMul(ShadeVec a, ShadeVec b)	{ return _mm256_mul_ps(a, b); }
+inline ShadeVec shadeDiv(ShadeVec a, ShadeVec b)	{ return _mm256_div_ps(a, b); }
+inline ShadeVec shadeMin(ShadeVec a, ShadeVec b)	{ return _mm256_min_ps(a, b); }
+inline ShadeVec shadeMax(ShadeVec a, ShadeVec b)	{ return _mm256_max_ps(a, b); }
+inline ShadeVec shadeSqrt(ShadeVec a)	{ return _mm256_sqrt_ps(a); }
+inline ShadeVec shadeFloor(ShadeVec a)	{ return _mm256_floor_ps(a); }
+inline ShadeMask shadeGreater(ShadeVec a, ShadeVec b)	{ return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline ShadeMask shadeLess(ShadeVec a, ShadeVec b)	{ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline ShadeVec shadeSelect(ShadeMask m, ShadeVec a, ShadeVec b)	{ return _mm256_blendv_ps(b, a, m); }
+inline ShadeVec shadeRsqrtEstimate(ShadeVec a)	{ return _mm256_rsqrt_ps(a); }
+#ifdef __FMA__
+inline ShadeVec shadeMulAdd(ShadeVec a, ShadeVec b, ShadeVec c)	{ return _mm256_fmadd_ps(a, b, c); }
+#else
+inline ShadeVec shadeMulAdd(ShadeVec a, ShadeVec b, ShadeVec c)	{ return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+// 2^n for integral n in [-126, 127]
+inline ShadeVec shadePow2(ShadeVec n)
+{
+	__m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+	return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+}
+
+// x = m 2^e with m in [0.5, 1), for positive normal x
+inline ShadeVec shadeFrexp(ShadeVec x, ShadeVec& e)
+{
+	__m256i bits = _mm256_castps_si256(x);
+	e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+	bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000));
+	return _mm256_castsi256_ps(bits);
+}
+
+#elif defined(PHONG_SIMD_SSE2)
+typedef __m128 ShadeVec;
+typedef __m128 ShadeMask;
+
+inline ShadeVec shadeSplat(float f)	{ return _mm_set1_ps(f); }
+inline ShadeVec shadeLoad(const float* p)	{ return _mm_loadu_ps(p); }
+inline void shadeStore(float* p, ShadeVec v)	{ _mm_storeu_ps(p, v); }
+inline ShadeVec shadeAdd(ShadeVec a, ShadeVec b)	{ return _mm_add_ps(a, b); }
+inline ShadeVec shadeSub(ShadeVec a, ShadeVec b)	{ return _mm_sub_ps(a, b); }
+inline ShadeVec shadeMul(ShadeVec a, ShadeVec b)	{ return _mm_mul_ps(a, b); }
+inline ShadeVec shadeDiv(ShadeVec a, ShadeVec b)	{ return _mm_div_ps(a, b); }
+inline ShadeVec shadeMin(ShadeVec a, ShadeVec b)	{ return _mm_min_ps(a, b); }
+inline ShadeVec shadeMax(ShadeVec a, ShadeVec b)	{ return _mm_max_ps(a, b); }
+inline ShadeVec shadeSqrt(ShadeVec a)	{ return _mm_sqrt_ps(a); }
+inline ShadeMask shadeGreater(ShadeVec a, ShadeVec b)	{ return _mm_cmpgt_ps(a, b); }
+inline ShadeMask shadeLess(ShadeVec a, ShadeVec b)	{ return _mm_cmplt_ps(a, b); }
+inline ShadeVec shadeSelect(ShadeMask m, ShadeVec a, ShadeVec b)	{ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline ShadeVec shadeRsqrtEstimate(ShadeVec a)	{ return _mm_rsqrt_ps(a); }
+inline ShadeVec shadeMulAdd(ShadeVec a, ShadeVec b, ShadeVec c)	{ return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+// SSE2 has no roundps, truncate and step down where that rounded up
+inline ShadeVec shadeFloor(ShadeVec a)
+{
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+
+inline ShadeVec shadePow2(ShadeVec n)
+{
+	__m128i e = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+	return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+}
+
+inline ShadeVec shadeFrexp(ShadeVec x, ShadeVec& e)
+{
+	__m128i bits = _mm_castps_si128(x);
+	e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+	bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000));
+	return _mm_castsi128_ps(bits);
+}
+
+#else // AArch64 NEON
+typedef float32x4_t ShadeVec;
+typedef uint32x4_t ShadeMask;
+
+inline ShadeVec shadeSplat(float f)	{ return vdupq_n_f32(f); }
+inline ShadeVec shadeLoad(const float* p)	{ return vld1q_f32(p); }
+inline void shadeStore(float* p, ShadeVec v)	{ vst1q_f32(p, v); }
+inline ShadeVec shadeAdd(ShadeVec a, ShadeVec b)	{ return vaddq_f32(a, b); }
+inline ShadeVec shadeSub(ShadeVec a, ShadeVec b)	{ return vsubq_f32(a, b); }
+inline ShadeVec shadeMul(ShadeVec a, ShadeVec b)	{ return vmulq_f32(a, b); }
+inline ShadeVec shadeDiv(ShadeVec a, ShadeVec b)	{ return vdivq_f32(a, b); }
+inline ShadeVec shadeMin(ShadeVec a, ShadeVec b)	{ return vminq_f32(a, b); }
+inline ShadeVec shadeMax(ShadeVec a, ShadeVec b)	{ return vmaxq_f32(a, b); }
+inline ShadeVec shadeSqrt(ShadeVec a)	{ return vsqrtq_f32(a); }
+inline ShadeVec shadeFloor(ShadeVec a)	{ return vrndmq_f32(a); }
+inline ShadeMask shadeGreater(ShadeVec a, ShadeVec b)	{ return vcgtq_f32(a, b); }
+inline ShadeMask shadeLess(ShadeVec a, ShadeVec b)	{ return vcltq_f32(a, b); }
+inline ShadeVec shadeSelect(ShadeMask m, ShadeVec a, ShadeVec b)	{ return vbslq_f32(m, a, b); }
+inline ShadeVec shadeMulAdd(ShadeVec a, ShadeVec b, ShadeVec c)	{ return vfmaq_f32(c, a, b); }
+
+// vrsqrte has ~8 bits, one vrsqrts step brings it to the SSE estimate
+inline ShadeVec shadeRsqrtEstimate(ShadeVec a)
+{
+	float32x4_t y = vrsqrteq_f32(a);
+	return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+}
+
+inline ShadeVec shadePow2(ShadeVec n)
+{
+	int32x4_t e = vaddq_s32(vcvtnq_s32_f32(n), vdupq_n_s32(127));
+	return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+}
+
+inline ShadeVec shadeFrexp(ShadeVec x, ShadeVec& e)
+{
+	uint32x4_t bits = vreinterpretq_u32_f32(x);
+	e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(126)));
+	bits = vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffff)), vdupq_n_u32(0x3f000000));
+	return vreinterpretq_f32_u32(bits);
+}
+#endif
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// lane math shared by the backends
+///////////////////////////////////////////////////////////////////////////////
+struct ShadeVec3
+{
+	ShadeVec x, y, z;
+};
+
+inline ShadeVec3 shadeSplat3(const Vector3& v)
+{
+	ShadeVec3 r = { shadeSplat(v.x), shadeSplat(v.y), shadeSplat(v.z) };
+	return r;
+}
+
+inline ShadeVec3 shadeLoad3(const float* const* p, size_t i)
+{
+	ShadeVec3 r = { shadeLoad(p[0] + i), shadeLoad(p[1] + i), shadeLoad(p[2] + i) };
+	return r;
+}
+
+inline ShadeVec3 shadeAdd3(const ShadeVec3& a, const ShadeVec3& b)
+{
+	ShadeVec3 r = { shadeAdd(a.x, b.x), shadeAdd(a.y, b.y), shadeAdd(a.z, b.z) };
+	return r;
+}
+
+inline ShadeVec3 shadeSub3(const ShadeVec3& a, const ShadeVec3& b)
+{
+	ShadeVec3 r = { shadeSub(a.x, b.x), shadeSub(a.y, b.y), shadeSub(a.z, b.z) };
+	return r;
+}
+
+inline ShadeVec shadeDot3(const ShadeVec3& a, const ShadeVec3& b)
+{
+	return shadeMulAdd(a.z, b.z, shadeMulAdd(a.y, b.y, shadeMul(a.x, b.x)));
+}
+
+// rsqrt estimate and one Newton step, the error of fastInvSqrt()
+inline ShadeVec shadeRsqrt(ShadeVec a)
+{
+	ShadeVec y = shadeRsqrtEstimate(a);
+	ShadeVec ayy = shadeMul(shadeMul(a, y), y);
+	return shadeMul(y, shadeSub(shadeSplat(1.5f), shadeMul(shadeSplat(0.5f), ayy)));
+}
+
+inline ShadeVec3 shadeNormalize3(const ShadeVec3& v)
+{
+	ShadeVec inv = shadeRsqrt(shadeDot3(v, v));
+	ShadeVec3 r = { shadeMul(v.x, inv), shadeMul(v.y, inv), shadeMul(v.z, inv) };
+	return r;
+}
+
+// ln(x) for positive normal x, Cephes logf: x = m 2^e with m in [sqrt(1/2), sqrt(2))
+inline ShadeVec shadeLog(ShadeVec x)
+{
+	ShadeVec e;
+	ShadeVec m = shadeFrexp(x, e);
+	ShadeMask small = shadeLess(m, shadeSplat(0.707106781186547524f));
+	e = shadeSub(e, shadeSelect(small, shadeSplat(1.0f), shadeSplat(0.0f)));
+	m = shadeAdd(shadeSub(m, shadeSplat(1.0f)), shadeSelect(small, m, shadeSplat(0.0f)));
+
+	ShadeVec z = shadeMul(m, m);
+	ShadeVec y = shadeSplat(7.0376836292e-2f);
+	y = shadeMulAdd(y, m, shadeSplat(-1.1514610310e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(1.1676998740e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(-1.2420140846e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(1.4249322787e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(-1.6668057665e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(2.0000714765e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(-2.4999993993e-1f));
+	y = shadeMulAdd(y, m, shadeSplat(3.3333331174e-1f));
+	y = shadeMul(shadeMul(y, m), z);
+	y = shadeMulAdd(e, shadeSplat(-2.12194440e-4f), y);
+	y = shadeMulAdd(z, shadeSplat(-0.5f), y);
+	return shadeMulAdd(e, shadeSplat(0.693359375f), shadeAdd(m, y));
+}
+
+// e^x, Cephes expf; x is clamped to the normal range of the result
+inline ShadeVec shadeExp(ShadeVec x)
+{
+	x = shadeMin(shadeMax(x, shadeSplat(-87.3f)), shadeSplat(88.3f));
+	ShadeVec n = shadeFloor(shadeMulAdd(x, shadeSplat(1.44269504088896341f), shadeSplat(0.5f)));
+	x = shadeMulAdd(n, shadeSplat(-0.693359375f), x);
+	x = shadeMulAdd(n, shadeSplat(2.12194440e-4f), x);
+
+	ShadeVec y = shadeSplat(1.9875691500e-4f);
+	y = shadeMulAdd(y, x, shadeSplat(1.3981999507e-3f));
+	y = shadeMulAdd(y, x, shadeSplat(8.3334519073e-3f));
+	y = shadeMulAdd(y, x, shadeSplat(4.1665795894e-2f));
+	y = shadeMulAdd(y, x, shadeSplat(1.6666665459e-1f));
+	y = shadeMulAdd(y, x, shadeSplat(5.0000001201e-1f));
+	y = shadeMulAdd(y, shadeMul(x, x), shadeAdd(x, shadeSplat(1.0f)));
+	return shadeMul(y, shadePow2(n));
+}
+
+// pow(max(x, 0), s) as phongSpecular(); zero is the scalar powf(0, s).
+// Results under e^-80 are flushed to 0, scaling them by the attenuation
+// would otherwise run on denormals, several times slower on x86
+inline ShadeVec shadePow(ShadeVec x, ShadeVec s, ShadeVec zero)
+{
+	ShadeVec t = shadeMul(s, shadeLog(shadeMax(x, shadeSplat(1.17549435e-38f))));
+	ShadeVec r = shadeSelect(shadeGreater(t, shadeSplat(-80.0f)), shadeExp(t), shadeSplat(0.0f));
+	return shadeSelect(shadeGreater(x, shadeSplat(0.0f)), r, zero);
+}
+
+inline ShadeVec shadeAttenuation(const ShadeVec3& light_position, const ShadeVec3& V1, float constant, float linear, float quadratic)
+{
+	ShadeVec3 d = shadeSub3(light_position, V1);
+	ShadeVec distance = shadeSqrt(shadeDot3(d, d));
+	ShadeVec denominator = shadeMulAdd(shadeMulAdd(shadeSplat(quadratic), distance, shadeSplat(linear)), distance, shadeSplat(constant));
+	return shadeDiv(shadeSplat(1.0f), denominator);
+}
+
+inline void shadeStoreColor(const PhongSamples& s, size_t i, ShadeVec r, ShadeVec g, ShadeVec b)
+{
+	shadeStore(s.color[0] + i, r);
+	shadeStore(s.color[1] + i, g);
+	shadeStore(s.color[2] + i, b);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one kernel per light mode, each returns the number of samples it shaded
+///////////////////////////////////////////////////////////////////////////////
+inline size_t phongDirectionalLanes(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t count)
+{
+	const PhongDirectionalLight& light = view.lights.directional;
+	ShadeVec3 position = shadeSplat3(light.position);
+	ShadeVec3 ambient = shadeSplat3(light.ambient * m.ambient);
+	ShadeVec3 diffuse = shadeSplat3(light.diffuse * m.diffuse);
+	ShadeVec3 specular = shadeSplat3(m.specular);
+	ShadeVec shininess = shadeSplat(m.shininess), zero = shadeSplat(phongSpecular(0.0f, m.shininess));
+
+	size_t i = 0;
+	for (; i + PHONG_LANES <= count; i += PHONG_LANES)
+	{
+		ShadeVec3 N = shadeNormalize3(shadeLoad3(s.normal, i));
+		ShadeVec3 V = shadeLoad3(s.position, i);
+		ShadeVec3 L = shadeNormalize3(shadeSub3(position, V));
+		ShadeVec3 E = shadeNormalize3(shadeSub3(shadeSplat3(Vector3()), V));
+		ShadeVec lambert = shadeDot3(N, L);
+		// reflect(-L, N) = N 2 (N.L) - L
+		ShadeVec twice = shadeAdd(lambert, lambert);
+		ShadeVec3 H = { shadeMulAdd(N.x, twice, shadeSub(shadeSplat(0.0f), L.x)),
+			shadeMulAdd(N.y, twice, shadeSub(shadeSplat(0.0f), L.y)),
+			shadeMulAdd(N.z, twice, shadeSub(shadeSplat(0.0f), L.z)) };
+		ShadeVec spec = shadePow(shadeDot3(H, E), shininess, zero);
+		lambert = shadeMax(lambert, shadeSplat(0.0f));
+		shadeStoreColor(s, i,
+			shadeMulAdd(specular.x, spec, shadeMulAdd(diffuse.x, lambert, ambient.x)),
+			shadeMulAdd(specular.y, spec, shadeMulAdd(diffuse.y, lambert, ambient.y)),
+			shadeMulAdd(specular.z, spec, shadeMulAdd(diffuse.z, lambert, ambient.z)));
+	}
+	return i;
+}
+
+inline size_t phongPointLanes(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t count)
+{
+	const PhongPointLight& light = view.lights.point;
+	ShadeVec3 position = shadeSplat3(light.position);
+	ShadeVec3 in_view = shadeSplat3(view.point_in_view);
+	ShadeVec3 S = shadeSplat3(Vector3(view.point_in_view).normalize());
+	ShadeVec3 ambient = shadeSplat3(m.ambient * light.ambient);
+	ShadeVec3 diffuse = shadeSplat3(m.diffuse * light.diffuse);
+	ShadeVec3 specular = shadeSplat3(m.specular);
+	ShadeVec shininess = shadeSplat(m.shininess), zero = shadeSplat(phongSpecular(0.0f, m.shininess));
+
+	size_t i = 0;
+	for (; i + PHONG_LANES <= count; i += PHONG_LANES)
+	{
+		ShadeVec3 N = shadeNormalize3(shadeLoad3(s.normal, i));
+		ShadeVec3 V1 = shadeLoad3(s.position, i);
+		ShadeVec3 V = shadeNormalize3(shadeSub3(shadeSplat3(Vector3()), V1));
+		ShadeVec3 H = shadeNormalize3(shadeAdd3(S, V));
+		ShadeVec3 L = shadeNormalize3(shadeSub3(in_view, V1));
+		ShadeVec attenuation = shadeAttenuation(position, V1, light.constant, light.linear, light.quadratic);
+		ShadeVec lambert = shadeMul(shadeMax(shadeDot3(N, L), shadeSplat(0.0f)), attenuation);
+		ShadeVec spec = shadeMul(shadePow(shadeDot3(N, H), shininess, zero), attenuation);
+		shadeStoreColor(s, i,
+			shadeMulAdd(specular.x, spec, shadeMulAdd(diffuse.x, lambert, ambient.x)),
+			shadeMulAdd(specular.y, spec, shadeMulAdd(diffuse.y, lambert, ambient.y)),
+			shadeMulAdd(specular.z, spec, shadeMulAdd(diffuse.z, lambert, ambient.z)));
+	}
+	return i;
+}
+
+inline size_t phongSpotLanes(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t count)
+{
+	const PhongSpotLight& light = view.lights.spot;
+	ShadeVec3 position = shadeSplat3(light.position);
+	ShadeVec3 in_view = shadeSplat3(view.spot_in_view);
+	ShadeVec3 S = shadeSplat3(Vector3(view.spot_in_view).normalize());
+	ShadeVec3 axis = shadeSplat3(view.spot_axis);
+	ShadeVec3 ambient = shadeSplat3(light.ambient * m.ambient);
+	ShadeVec3 diffuse = shadeSplat3(light.diffuse * m.diffuse);
+	ShadeVec3 specular = shadeSplat3(m.specular);
+	ShadeVec shininess = shadeSplat(m.shininess), zero = shadeSplat(phongSpecular(0.0f, m.shininess));
+	ShadeVec exponent = shadeSplat(light.exponent), exponent_zero = shadeSplat(phongSpecular(0.0f, light.exponent));
+	// lit where acos(cos) < cutoff, acos decreases over [-1, 1]
+	float cos_cutoff = light.cutoff <= 0.0f ? 2.0f : light.cutoff > 180.0f ? -2.0f : cosf(light.cutoff * (3.14159265f / 180.0f));
+	ShadeVec inside = shadeSplat(cos_cutoff);
+
+	size_t i = 0;
+	for (; i + PHONG_LANES <= count; i += PHONG_LANES)
+	{
+		ShadeVec3 N = shadeNormalize3(shadeLoad3(s.normal, i));
+		ShadeVec3 V1 = shadeLoad3(s.position, i);
+		ShadeVec3 V = shadeNormalize3(shadeSub3(shadeSplat3(Vector3()), V1));
+		ShadeVec3 H = shadeNormalize3(shadeAdd3(S, V));
+		ShadeVec3 L = shadeNormalize3(shadeSub3(in_view, V1));
+		ShadeVec attenuation = shadeAttenuation(position, V1, light.constant, light.linear, light.quadratic);
+
+		ShadeVec spot_cos = shadeSub(shadeSplat(0.0f), shadeDot3(L, axis));
+		ShadeVec scale = shadeMul(attenuation, shadePow(spot_cos, exponent, exponent_zero));
+		scale = shadeSelect(shadeGreater(spot_cos, inside), scale, shadeSplat(0.0f));
+		// the spot diffuse term is not clamped, as in the GLSL
+		ShadeVec lambert = shadeMul(shadeDot3(L, N), scale);
+		ShadeVec spec = shadeMul(shadePow(shadeDot3(H, N), shininess, zero), scale);
+		shadeStoreColor(s, i,
+			shadeMulAdd(specular.x, spec, shadeMulAdd(diffuse.x, lambert, ambient.x)),
+			shadeMulAdd(specular.y, spec, shadeMulAdd(diffuse.y, lambert, ambient.y)),
+			shadeMulAdd(specular.z, spec, shadeMulAdd(diffuse.z, lambert, ambient.z)));
+	}
+	return i;
+}
+#endif // PHONG_SIMD
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// phongShade() of the normalized normal and the position of every sample,
+// with the light picked by view.lights.mode
+///////////////////////////////////////////////////////////////////////////////
+inline void phongShadeSamples(const PhongView& view, const PhongSurface& m, const PhongSamples& s, size_t count)
+{
+	size_t i = 0;
+#ifdef PHONG_SIMD
+	if (view.lights.mode == PhongDirectional)
+		i = phongDirectionalLanes(view, m, s, count);
+	else if (view.lights.mode == PhongPoint)
+		i = phongPointLanes(view, m, s, count);
+	else
+		i = phongSpotLanes(view, m, s, count);
+#endif
+	phongShadeSampleRange(view, m, s, i, count);
+}
+
+#endif
@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////////
+// PhongLighting.h
+// ===============
+// The light uniforms of shader.vs.glsl / shader.fs.glsl and a CPU version of
+// their CalcuDirecLight / CalcuPointLight / CalcuSpotLight.
+//
+// The functions follow the GLSL line by line, quirks included, so the
+// software backend lights a fragment the same way the driver does: N and V
+// are the view space normal and position, the directional light position
+// and the distance of the point / spot attenuation are taken in world space
+// against the view space V, and the spot diffuse term is not clamped.
+// Everything that only depends on the lights and the view matrix is folded
+// once per frame into PhongView.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef PHONG_LIGHTING_H_DEF
+#define PHONG_LIGHTING_H_DEF
+
+#include <math.h>
+#include "Vectors.h"
+#include "Matrices.h"
+
+enum PhongLightMode
+{
+	PhongDirectional = 0,
+	PhongPoint = 1,
+	PhongSpot = 2,
+};
+
+struct PhongDirectionalLight
+{
+	Vector3 position;
+	Vector3 direction;
+	Vector3 diffuse;
+	Vector3 ambient;
+};
+
+struct PhongPointLight
+{
+	Vector3 position;
+	float constant, linear, quadratic;
+	Vector3 diffuse;
+	Vector3 ambient;
+};
+
+struct PhongSpotLight
+{
+	Vector3 position;
+	Vector3 direction;
+	float exponent;
+	float cutoff;	// degrees
+	float constant, linear, quadratic;
+	Vector3 diffuse;
+	Vector3 ambient;
+};
+
+// the "directional", "point", "spot" and "lightmode" uniforms
+struct PhongLights
+{
+	PhongDirectionalLight directional;
+	PhongPointLight point;
+	PhongSpotLight spot;
+	int mode;	// PhongLightMode
+};
+
+// the "material" uniform
+struct PhongSurface
+{
+	Vector3 ambient, diffuse, specular;
+	float shininess;
+};
+
+// per frame terms of the lights in view space
+struct PhongView
+{
+	PhongLights lights;
+	Vector3 point_in_view;	// um4v * point.position
+	Vector3 spot_in_view;	// um4v * spot.position
+	Vector3 spot_axis;	// normalize(transpose(inverse(um4v)) * spot.direction)
+};
+
+inline PhongView makePhongView(const PhongLights& lights, const Matrix4& view)
+{
+	PhongView v;
+	v.lights = lights;
+	Vector4 p = view * Vector4(lights.point.position.x, lights.point.position.y, lights.point.position.z, 1.0f);
+	Vector4 s = view * Vector4(lights.spot.position.x, lights.spot.position.y, lights.spot.position.z, 1.0f);
+	v.point_in_view = Vector3(p.x, p.y, p.z);
+	v.spot_in_view = Vector3(s.x, s.y, s.z);
+	// the w = 1 of the GLSL only meets the last row of inverse(um4v), 0 0 0 1
+	Matrix4 axis = view;
+	axis.invert().transpose();
+	v.spot_axis = (axis * lights.spot.direction).normalize();
+	return v;
+}
+
+inline float phongSpecular(float cosine, float shininess)
+{
+	return powf(cosine > 0.0f ? cosine : 0.0f, shininess);
+}
+
+inline Vector3 phongDirectional(const PhongView& view, const PhongSurface& m, const Vector3& N, const Vector3& V)
+{
+	const PhongDirectionalLight& light = view.lights.directional;
+	Vector3 L = (light.position - V).normalize();
+	Vector3 E = (-V).normalize();
+	Vector3 H = -L - N * (2.0f * N.dot(-L));	// reflect(-L, N)
+	float lambert = N.dot(L);
+	return light.ambient * m.ambient + light.diffuse * m.diffuse * (lambert > 0.0f ? lambert : 0.0f)
+		+ m.specular * phongSpecular(H.dot(E), m.shininess);
+}
+
+inline Vector3 phongPoint(const PhongView& view, const PhongSurface& m, const Vector3& N, const Vector3& V1)
+{
+	const PhongPointLight& light = view.lights.point;
+	Vector3 S = Vector3(view.point_in_view).normalize();
+	Vector3 V = (-V1).normalize();
+	Vector3 H = (S + V).normalize();
+	Vector3 L = (view.point_in_view - V1).normalize();
+	float distance = (light.position - V1).length();
+	float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+	float lambert = N.dot(L);
+	Vector3 diffuse = m.diffuse * light.diffuse * (lambert > 0.0f ? lambert : 0.0f);
+	Vector3 specular = m.specular * phongSpecular(N.dot(H), m.shininess);
+	return m.ambient * light.ambient + (diffuse + specular) * attenuation;
+}
+
+inline Vector3 phongSpot(const PhongView& view, const PhongSurface& m, const Vector3& N, const Vector3& V1)
+{
+	const PhongSpotLight& light = view.lights.spot;
+	Vector3 S = Vector3(view.spot_in_view).normalize();
+	Vector3 V = (-V1).normalize();
+	Vector3 H = (S + V).normalize();
+	Vector3 L = (view.spot_in_view - V1).normalize();
+	float distance = (light.position - V1).length();
+	float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+
+	float spot_cos = (-L).dot(view.spot_axis);
+	Vector3 ambient = light.ambient * m.ambient;
+	if (light.cutoff <= acosf(fminf(fmaxf(spot_cos, -1.0f), 1.0f)) * (180.0f / 3.14159265f))
+		return ambient;
+	float exponent = powf(spot_cos > 0.0f ? spot_cos : 0.0f, light.exponent);
+	Vector3 diffuse = light.diffuse * m.diffuse * L.dot(N);
+	Vector3 specular = m.specular * phongSpecular(H.dot(N), m.shininess);
+	return ambient + (diffuse + specular) * (attenuation * exponent);
+}
+
+// CalcuDirecLight / CalcuPointLight / CalcuSpotLight as picked by lightmode
+inline Vector3 phongShade(const PhongView& view, const PhongSurface& m, const Vector3& N, const Vector3& V)
+{
+	if (view.lights.mode == PhongDirectional)
+		return phongDirectional(view, m, N, V);
+	else if (view.lights.mode == PhongPoint)
+		return phongPoint(view, m, N, V);
+	return phongSpot(view, m, N, V);
+}
+
+#endif
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue.h
+// =============
+// Draws of a frame ordered by the state they need.
+//
+// Every draw is pushed with a 64 bit key holding, from the most significant
+// bits down, its program, texture, material, vertex array and quantized
+// depth, and the index of the caller's draw record. sort() orders the keys
+// with an LSD radix sort of 8 bit digits; digits that are equal in every key
+// are skipped, so fields the frame does not vary cost no pass. Short queues,
+// like the few shapes of one model, are insertion sorted instead. Both are
+// stable, draws with equal keys keep the order they were pushed in.
+//
+// Walking the sorted items, a state only has to be set where its field
+// differs from the previous item; items whose state fields are all equal
+// can be merged into one multi-draw. stateChanges() counts the fields set
+// that way, sort() keeps the count of the submission order for comparison.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef RENDER_QUEUE_H_DEF
+#define RENDER_QUEUE_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// field widths, most significant first; depth takes the remaining low bits
+#define RENDER_KEY_PROGRAM_BITS 4
+#define RENDER_KEY_TEXTURE_BITS 16
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_VAO_BITS 4
+#define RENDER_KEY_DEPTH_BITS 24
+
+#define RENDER_QUEUE_RADIX_MIN 64	// fewer items are sorted by insertion, cheaper than the histograms
+
+enum RenderKeyField
+{
+	RenderKeyProgram,
+	RenderKeyTexture,
+	RenderKeyMaterial,
+	RenderKeyVao,
+	RenderKeyStateFields	// depth is not a state
+};
+
+const int RENDER_KEY_SHIFT[RenderKeyStateFields] = {
+	RENDER_KEY_TEXTURE_BITS + RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS,
+	RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS,
+	RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS,
+	RENDER_KEY_DEPTH_BITS,
+};
+const uint64_t RENDER_KEY_MASK[RenderKeyStateFields] = {
+	((1ull << RENDER_KEY_PROGRAM_BITS) - 1) << RENDER_KEY_SHIFT[RenderKeyProgram],
+	((1ull << RENDER_KEY_TEXTURE_BITS) - 1) << RENDER_KEY_SHIFT[RenderKeyTexture],
+	((1ull << RENDER_KEY_MATERIAL_BITS) - 1) << RENDER_KEY_SHIFT[RenderKeyMaterial],
+	((1ull << RENDER_KEY_VAO_BITS) - 1) << RENDER_KEY_SHIFT[RenderKeyVao],
+};
+const uint64_t RENDER_KEY_STATE_MASK = ~((1ull << RENDER_KEY_DEPTH_BITS) - 1);
+
+// ids are truncated to their field; depth in [0, 1] is clamped, 0 sorts first
+inline uint64_t makeRenderKey(uint32_t program, uint32_t texture, uint32_t material, uint32_t vao, float depth)
+{
+	const uint32_t depth_max = (1u << RENDER_KEY_DEPTH_BITS) - 1;
+	uint32_t d = depth > 0.0f ? (depth < 1.0f ? (uint32_t)(depth * depth_max) : depth_max) : 0;
+	return ((uint64_t)program << RENDER_KEY_SHIFT[RenderKeyProgram] & RENDER_KEY_MASK[RenderKeyProgram]) |
+		((uint64_t)texture << RENDER_KEY_SHIFT[RenderKeyTexture] & RENDER_KEY_MASK[RenderKeyTexture]) |
+		((uint64_t)material << RENDER_KEY_SHIFT[RenderKeyMaterial] & RENDER_KEY_MASK[RenderKeyMaterial]) |
+		((uint64_t)vao << RENDER_KEY_SHIFT[RenderKeyVao] & RENDER_KEY_MASK[RenderKeyVao]) | d;
+}
+
+inline uint32_t renderKeyField(uint64_t key, RenderKeyField field)
+{
+	return (uint32_t)((key & RENDER_KEY_MASK[field]) >> RENDER_KEY_SHIFT[field]);
+}
+
+struct RenderItem
+{
+	uint64_t key;
+	uint32_t draw;	// the caller's draw record
+};
+
+class RenderQueue
+{
+public:
+	RenderQueue() : submitted_changes(0) {}
+
+	void clear() { entries.clear(); }
+	void push(uint64_t key, uint32_t draw)
+	{
+		RenderItem item = { key, draw };
+		entries.push_back(item);
+	}
+
+	void sort()
+	{
+		size_t n = entries.size();
+		submitted_changes = stateChanges();
+		if (n < 2)
+			return;
+		if (n < RENDER_QUEUE_RADIX_MIN)
+		{
+			for (size_t i = 1; i < n; i++)
+			{
+				RenderItem item = entries[i];
+				size_t j = i;
+				for (; j > 0 && entries[j - 1].key > item.key; j--)
+					entries[j] = entries[j - 1];
+				entries[j] = item;
+			}
+			return;
+		}
+
+		// the histograms of all eight digits in one pass over the keys
+		size_t counts[8][256];
+		memset(counts, 0, sizeof(counts));
+		for (const RenderItem& item : entries)
+		{
+			for (int digit = 0; digit < 8; digit++)
+				counts[digit][(item.key >> (digit * 8)) & 0xff]++;
+		}
+
+		scratch.resize(n);
+		RenderItem* src = &entries[0];
+		RenderItem* dst = &scratch[0];
+		for (int digit = 0; digit < 8; digit++)
+		{
+			int shift = digit * 8;
+			if (counts[digit][(src[0].key >> shift) & 0xff] == n)
+				continue;
+			size_t offsets[256];
+			size_t sum = 0;
+			for (int b = 0; b < 256; b++)
+			{
+				offsets[b] = sum;
+				sum += counts[digit][b];
+			}
+			for (size_t i = 0; i < n; i++)
+				dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+			RenderItem* t = src;
+			src = dst;
+			dst = t;
+		}
+		if (src != &entries[0])
+			entries.swap(scratch);
+	}
+
+	// states set walking the items in their current order, all of them for the first
+	size_t stateChanges() const
+	{
+		size_t changes = 0;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			for (int field = 0; field < RenderKeyStateFields; field++)
+				changes += i == 0 || ((entries[i].key ^ entries[i - 1].key) & RENDER_KEY_MASK[field]) != 0;
+		}
+		return changes;
+	}
+
+	size_t submittedStateChanges() const { return submitted_changes; }	// before the last sort()
+	const std::vector<RenderItem>& items() const { return entries; }
+
+private:
+	std::vector<RenderItem> entries;
+	std::vector<RenderItem> scratch;
+	size_t submitted_changes;
+};
+
+#endif
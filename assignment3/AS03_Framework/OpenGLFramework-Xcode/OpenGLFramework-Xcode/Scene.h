@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////
+// Scene.h
+// =======
+// Many instances of the loaded models, placed on a grid, scattered at random
+// or listed in a text file, for loading the viewer like a real scene does.
+//
+// SceneBatcher keeps the world matrix and world box of every instance. Each
+// build() culls the boxes against the view frustum, picks the LOD level of
+// every visible instance from its depth and packs the matrices sorted by
+// model and level, so one batch of the result is drawn with a single
+// glDrawElementsInstanced() per shape. A matrix is packed as its top three
+// rows, the last row of an instance transform is always 0 0 0 1.
+//
+// A scene file has one instance per line:
+//     <model> <x> <y> <z> [<yaw degrees> [<scale>]]
+// where <model> is an index into the model list or a model file name with or
+// without its extension; everything after # is a comment.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SCENE_H_DEF
+#define SCENE_H_DEF
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Vectors.h"
+#include "Matrices.h"
+#include "Frustum.h"
+
+#define SCENE_INSTANCE_FLOATS 12	// rows 0 .. 2 of the world matrix
+
+struct SceneInstance
+{
+	int model;	// index into the loaded models
+	Vector3 position;
+	Quaternion orientation;
+	float scale;	// uniform
+};
+
+// what the batcher needs of a loaded model
+struct SceneModelInfo
+{
+	Vector3 bound_center, bound_extent;	// model space box of all shapes
+	std::vector<float> lod_errors;	// per level, the largest error of the shapes, full resolution first
+};
+
+// instances [first, first + count) of the packed matrices, all of one model and level
+struct SceneBatch
+{
+	int model;
+	int level;
+	uint32_t first;
+	uint32_t count;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// placement, every call appends count instances cycling through the models
+///////////////////////////////////////////////////////////////////////////////
+
+// rows of a square grid in the y = 0 plane, centered on x and receding
+// into -z from the origin, each instance turned a little further
+inline void placeSceneGrid(std::vector<SceneInstance>& instances, int count, int model_count, float spacing)
+{
+	int side = (int)ceil(sqrt((double)count));
+	for (int i = 0; i < count; i++)
+	{
+		SceneInstance instance;
+		instance.model = i % model_count;
+		instance.position = Vector3(((i % side) - (side - 1) * 0.5f) * spacing, 0.0f, -(i / side) * spacing);
+		instance.orientation = Quaternion::fromAxisAngle(Vector3(0.0f, 1.0f, 0.0f), i * 0.37f);
+		instance.scale = 1.0f;
+		instances.push_back(instance);
+	}
+}
+
+// uniform in the square of the same area as the grid, random yaw and a
+// scale of 0.5 .. 1.5; the same seed gives the same scene
+inline void placeSceneScatter(std::vector<SceneInstance>& instances, int count, int model_count, float spacing, unsigned int seed)
+{
+	float side = (float)sqrt((double)count) * spacing;
+	auto random = [&](float lo, float hi) {
+		seed = seed * 1664525u + 1013904223u;
+		return lo + (hi - lo) * (seed >> 8) * (1.0f / 16777216.0f);
+	};
+	for (int i = 0; i < count; i++)
+	{
+		SceneInstance instance;
+		instance.model = i % model_count;
+		float x = random(-0.5f, 0.5f) * side;
+		instance.position = Vector3(x, 0.0f, random(-1.0f, 0.0f) * side);
+		instance.orientation = Quaternion::fromAxisAngle(Vector3(0.0f, 1.0f, 0.0f), random(0.0f, 6.2831853f));
+		instance.scale = random(0.5f, 1.5f);
+		instances.push_back(instance);
+	}
+}
+
+// model_names are the file names of the models without directory or extension
+inline bool loadSceneFile(const char* path, const std::vector<std::string>& model_names, std::vector<SceneInstance>& instances)
+{
+	FILE* fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		printf("loadSceneFile: cannot open %s\n", path);
+		return false;
+	}
+	char line[512];
+	int line_number = 0;
+	size_t first = instances.size();
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		line_number++;
+		if (char* comment = strchr(line, '#'))
+			*comment = '\0';
+		char name[256];
+		float x, y, z, yaw = 0.0f, scale = 1.0f;
+		int fields = sscanf(line, "%255s %f %f %f %f %f", name, &x, &y, &z, &yaw, &scale);
+		if (fields <= 0)
+			continue;
+
+		int model = -1;
+		char* end;
+		long index = strtol(name, &end, 10);
+		if (*end == '\0')
+			model = index >= 0 && index < (long)model_names.size() ? (int)index : -1;
+		for (size_t m = 0; m < model_names.size() && model < 0; m++)
+		{
+			const std::string& n = model_names[m];
+			if (n == name || (n + ".obj") == name)
+				model = (int)m;
+		}
+		if (fields < 4 || model < 0)
+		{
+			printf("loadSceneFile: %s:%d: expected <model> <x> <y> <z> [<yaw> [<scale>]]\n", path, line_number);
+			fclose(fp);
+			instances.resize(first);
+			return false;
+		}
+
+		SceneInstance instance;
+		instance.model = model;
+		instance.position = Vector3(x, y, z);
+		instance.orientation = Quaternion::fromAxisAngle(Vector3(0.0f, 1.0f, 0.0f), yaw * (3.14159265f / 180.0f));
+		instance.scale = scale;
+		instances.push_back(instance);
+	}
+	fclose(fp);
+	printf("loadSceneFile: %d instances from %s\n", (int)(instances.size() - first), path);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// per frame culling, LOD selection and packing of the instance matrices
+///////////////////////////////////////////////////////////////////////////////
+class SceneBatcher
+{
+public:
+	SceneBatcher() : levels(1), visible_count(0) {}
+
+	// world matrices and boxes of the instances, again whenever they change
+	void setInstances(const std::vector<SceneInstance>& instances, const std::vector<SceneModelInfo>& models)
+	{
+		size_t count = instances.size();
+		model_infos = models;
+		levels = 1;
+		for (const SceneModelInfo& info : models)
+			levels = std::max(levels, (int)info.lod_errors.size());
+
+		world.resize(count * SCENE_INSTANCE_FLOATS);
+		model_of.resize(count);
+		scale_of.resize(count);
+		cx.resize(count);  cy.resize(count);  cz.resize(count);
+		ex.resize(count);  ey.resize(count);  ez.resize(count);
+		visible.resize(count);
+		keys.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const SceneInstance& instance = instances[i];
+			const SceneModelInfo& info = models[instance.model];
+			float s = instance.scale;
+			Matrix4 m = composeTRS(instance.position, instance.orientation, Vector3(s, s, s));
+			float* w = &world[i * SCENE_INSTANCE_FLOATS];
+			for (int k = 0; k < SCENE_INSTANCE_FLOATS; k++)
+				w[k] = m[k];
+
+			// the box of the rotated box: |M| e around M c
+			const Vector3& c = info.bound_center;
+			const Vector3& e = info.bound_extent;
+			cx[i] = w[0] * c.x + w[1] * c.y + w[2] * c.z + w[3];
+			cy[i] = w[4] * c.x + w[5] * c.y + w[6] * c.z + w[7];
+			cz[i] = w[8] * c.x + w[9] * c.y + w[10] * c.z + w[11];
+			ex[i] = fabsf(w[0]) * e.x + fabsf(w[1]) * e.y + fabsf(w[2]) * e.z;
+			ey[i] = fabsf(w[4]) * e.x + fabsf(w[5]) * e.y + fabsf(w[6]) * e.z;
+			ez[i] = fabsf(w[8]) * e.x + fabsf(w[9]) * e.y + fabsf(w[10]) * e.z;
+			model_of[i] = instance.model;
+			scale_of[i] = fabsf(s);
+		}
+		key_counts.assign(models.size() * levels, 0);
+		packed.clear();
+		batch_list.clear();
+		visible_count = 0;
+	}
+
+	// pixels_per_unit = |P[5]| * viewport height / 2, the size of a unit at w = 1;
+	// an instance draws the coarsest level whose error stays within
+	// max_pixel_error pixels at the depth of its box center
+	void build(const Matrix4& view_projection, float pixels_per_unit, float max_pixel_error)
+	{
+		size_t count = model_of.size();
+		batch_list.clear();
+		visible_count = count > 0 ? cullBoxes(extractFrustum(view_projection), &cx[0], &cy[0], &cz[0], &ex[0], &ey[0], &ez[0], count, &visible[0]) : 0;
+		packed.resize(visible_count * SCENE_INSTANCE_FLOATS);
+		if (visible_count == 0)
+			return;
+
+		// key = model * levels + level, counted for the placement below
+		std::fill(key_counts.begin(), key_counts.end(), 0u);
+		const Matrix4& vp = view_projection;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!visible[i])
+				continue;
+			const std::vector<float>& errors = model_infos[model_of[i]].lod_errors;
+			float w = vp[12] * cx[i] + vp[13] * cy[i] + vp[14] * cz[i] + vp[15];
+			int level = 0;
+			if (w > 0.0f)
+			{
+				float pixels = scale_of[i] * pixels_per_unit / w;
+				while (level + 1 < (int)errors.size() && errors[level + 1] * pixels <= max_pixel_error)
+					level++;
+			}
+			uint32_t key = (uint32_t)(model_of[i] * levels + level);
+			keys[i] = key;
+			key_counts[key]++;
+		}
+
+		// counting sort: the counts become the first slot of every key
+		uint32_t first = 0;
+		for (size_t key = 0; key < key_counts.size(); key++)
+		{
+			uint32_t n = key_counts[key];
+			if (n > 0)
+			{
+				SceneBatch batch = { (int)(key / levels), (int)(key % levels), first, n };
+				batch_list.push_back(batch);
+			}
+			key_counts[key] = first;
+			first += n;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!visible[i])
+				continue;
+			float* dst = &packed[(size_t)key_counts[keys[i]]++ * SCENE_INSTANCE_FLOATS];
+			const float* src = &world[i * SCENE_INSTANCE_FLOATS];
+			for (int k = 0; k < SCENE_INSTANCE_FLOATS; k++)
+				dst[k] = src[k];
+		}
+	}
+
+	size_t instanceCount() const { return model_of.size(); }
+	size_t visibleCount() const { return visible_count; }
+	const std::vector<float>& matrices() const { return packed; }	// SCENE_INSTANCE_FLOATS per visible instance
+	const std::vector<SceneBatch>& batches() const { return batch_list; }	// by model, then level
+
+private:
+	std::vector<SceneModelInfo> model_infos;
+	int levels;	// the most of any model, keys are model * levels + level
+
+	// per instance, the boxes SoA for cullBoxes()
+	std::vector<float> world;
+	std::vector<int> model_of;
+	std::vector<float> scale_of;
+	std::vector<float> cx, cy, cz, ex, ey, ez;
+	std::vector<unsigned char> visible;
+	std::vector<uint32_t> keys;
+
+	std::vector<uint32_t> key_counts;
+	std::vector<float> packed;
+	std::vector<SceneBatch> batch_list;
+	size_t visible_count;
+};
+
+#endif
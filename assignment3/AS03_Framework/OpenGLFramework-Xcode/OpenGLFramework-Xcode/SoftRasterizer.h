@@ -0,0 +1,614 @@
+///////////////////////////////////////////////////////////////////////////////
+// SoftRasterizer.h
+// ================
+// Multithreaded tile based software rasterizer, a CPU backend for the
+// RenderScene() draws on machines without a GPU.
+//
+// A frame is recorded as draws (one indexed Shape with its matrices,
+// material, texture and viewport each) between begin() and end(); end()
+// then runs three parallel passes over a WorkerPool:
+//   vertex   shader.vs.glsl on every vertex: clip position, view space
+//            position and normal, texture coordinate and, for the per
+//            vertex mode, the vertex color lit SOFT_SHADE_BATCH at a time
+//   bin      clip each triangle against the near plane, snap it to
+//            SOFT_SUBPIXEL_BITS fixed point and append it to the list of
+//            every SOFT_TILE_SIZE square tile its box touches; every batch
+//            of triangles has its own lists, so a tile reads its triangles
+//            back in submission order without any locking
+//   raster   one tile per job: walk the edge functions of its triangles
+//            over the pixel centers (top-left fill rule), test and write
+//            the depth buffer and keep the triangle and barycentrics of the
+//            nearest one per pixel, then run shader.fs.glsl once per
+//            covered pixel with perspective correct varyings, lighting
+//            runs of pixels of the same draw in one batch. The shader
+//            has no side effects, so shading after the depth pass gives the
+//            same image as shading every passing fragment, without paying
+//            for the overdraw
+// The depth test is GL_LESS against a cleared 1.0 and there is no face
+// culling, as in the GL path. Lighting is PhongKernels.h and texturing
+// SoftTexture.h, with the level of detail of every pixel taken from the
+// screen derivatives of its perspective correct texture coordinate.
+// The framebuffer is RGBA8 with row 0 at the bottom, like glReadPixels().
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SOFT_RASTERIZER_H_DEF
+#define SOFT_RASTERIZER_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Vectors.h"
+#include "Matrices.h"
+#include "PhongKernels.h"
+#include "SoftTexture.h"
+#include "WorkerPool.h"
+
+#define SOFT_TILE_SIZE 64	// pixels per tile side
+#define SOFT_SUBPIXEL_BITS 4	// fixed point bits of the snapped vertex positions
+#define SOFT_VERTEX_STRIDE 11	// input floats per vertex: position, color, normal, texture coordinate
+#define SOFT_VERTEX_BATCH 1024	// vertices per vertex pass job
+#define SOFT_TRIANGLE_BATCH 1024	// triangles per bin pass job
+#define SOFT_SHADE_BATCH 256	// samples per phongShadeSamples() call
+
+// varyings of shader.vs.glsl: fragpos, vertex_normal, texCoord, vertex_color
+enum SoftVarying
+{
+	SoftPosition = 0,
+	SoftNormal = 3,
+	SoftTexCoord = 6,
+	SoftColor = 8,
+	SoftVaryingCount = 11,
+};
+#define SOFT_POST_STRIDE (4 + SoftVaryingCount)	// clip position, varyings
+
+inline uint32_t softPackColor(const Vector3& c)
+{
+	uint32_t r = (uint32_t)(fminf(fmaxf(c.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+	uint32_t g = (uint32_t)(fminf(fmaxf(c.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+	uint32_t b = (uint32_t)(fminf(fmaxf(c.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | 0xff000000u;
+}
+
+struct SoftFramebuffer
+{
+	int width = 0, height = 0;
+	std::vector<uint32_t> color;	// RGBA8, row 0 at the bottom
+	std::vector<float> depth;	// window z, 0 near and 1 far
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		color.resize((size_t)w * h);
+		depth.resize((size_t)w * h);
+	}
+
+	void clear(const Vector3& rgb)
+	{
+		std::fill(color.begin(), color.end(), softPackColor(rgb));
+		std::fill(depth.begin(), depth.end(), 1.0f);
+	}
+};
+
+// one glDrawElements() of RenderScene() with the state it depends on
+struct SoftDraw
+{
+	const float* vertices;	// SOFT_VERTEX_STRIDE floats per vertex
+	const unsigned int* indices;
+	size_t vertex_count, index_count;
+	Matrix4 model_view, projection;	// um4v * um4m, um4p
+	PhongSurface surface;
+	const SoftTexture* texture;	// NULL samples white
+	SoftSampler sampler;
+	int per_vertex_or_per_pixel;	// 0 Gouraud, 1 per pixel, as the uniform
+	int viewport[4];	// x, y, width, height as glViewport()
+};
+
+struct SoftStats
+{
+	size_t triangles = 0;	// submitted
+	size_t clipped = 0;	// dropped or split by the near plane, or outside the viewport
+	size_t fragments = 0;	// shaded, one per covered pixel
+};
+
+class SoftRasterizer
+{
+public:
+	// threads = 0 uses every hardware thread; the caller is one of them
+	explicit SoftRasterizer(int threads = 0) : pool(threads)
+	{
+		fragments.resize(pool.threadCount() * FRAGMENT_PAD);
+		samples.resize(pool.threadCount(), std::vector<TileSample>(SOFT_TILE_SIZE * SOFT_TILE_SIZE));
+		shade_batches.resize(pool.threadCount());
+	}
+
+	int threadCount() const { return pool.threadCount(); }
+
+	void begin(SoftFramebuffer& fb, const PhongView& view)
+	{
+		target = &fb;
+		phong = view;
+		draws.clear();
+	}
+
+	void draw(const SoftDraw& d)
+	{
+		if (d.index_count >= 3 && d.vertex_count > 0)
+			draws.push_back(d);
+	}
+
+	// render the draws recorded since begin() into its framebuffer
+	SoftStats end()
+	{
+		SoftStats stats;
+		if (draws.empty())
+			return stats;
+		tiles_x = (target->width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		tiles_y = (target->height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+
+		// vertex pass, jobs of SOFT_VERTEX_BATCH vertices of one draw
+		size_t vertex_total = 0;
+		post_offset.resize(draws.size());
+		normal_matrix.resize(draws.size());
+		vertex_jobs.clear();
+		for (size_t d = 0; d < draws.size(); d++)
+		{
+			post_offset[d] = vertex_total;
+			vertex_total += draws[d].vertex_count;
+			normal_matrix[d] = draws[d].model_view;
+			normal_matrix[d].invert().transpose();	// mat3(transpose(inverse(um4v * um4m)))
+			for (size_t first = 0; first < draws[d].vertex_count; first += SOFT_VERTEX_BATCH)
+				vertex_jobs.push_back(Batch{ d, first, std::min(first + SOFT_VERTEX_BATCH, draws[d].vertex_count) });
+			stats.triangles += draws[d].index_count / 3;
+		}
+		post.resize(vertex_total * SOFT_POST_STRIDE);
+		pool.run(vertex_jobs.size(), [this](size_t job, int thread) { shadeVertices(vertex_jobs[job], thread); });
+
+		// bin pass, jobs of SOFT_TRIANGLE_BATCH triangles of one draw
+		size_t job_count = 0;
+		for (size_t d = 0; d < draws.size(); d++)
+		{
+			size_t triangles = draws[d].index_count / 3;
+			for (size_t first = 0; first < triangles; first += SOFT_TRIANGLE_BATCH)
+			{
+				if (job_count == bins.size())
+					bins.push_back(BinJob());
+				BinJob& job = bins[job_count++];
+				job.batch = Batch{ d, first, std::min(first + SOFT_TRIANGLE_BATCH, triangles) };
+				job.triangles.clear();
+				job.tiles.resize((size_t)tiles_x * tiles_y);
+				for (std::vector<uint32_t>& tile : job.tiles)
+					tile.clear();
+				job.clipped = 0;
+			}
+		}
+		bin_count = job_count;
+		pool.run(bin_count, [this](size_t job, int) { binTriangles(bins[job]); });
+		for (size_t j = 0; j < bin_count; j++)
+			stats.clipped += bins[j].clipped;
+
+		// raster pass, one tile per job
+		std::fill(fragments.begin(), fragments.end(), 0);
+		pool.run((size_t)tiles_x * tiles_y, [this](size_t tile, int thread) { rasterizeTile(tile, thread); });
+		for (size_t t = 0; t < fragments.size(); t += FRAGMENT_PAD)
+			stats.fragments += fragments[t];
+		return stats;
+	}
+
+private:
+	enum { FRAGMENT_PAD = 16 };	// a counter per thread, a cache line apart
+
+	struct Batch
+	{
+		size_t draw, first, last;
+	};
+
+	// edge i runs from vertex i + 1 to i + 2, E(x, y) = a x + b y + c over
+	// sub-pixel coordinates is >= 0 inside a counter-clockwise triangle
+	struct SoftTriangle
+	{
+		int64_t a[3], b[3], c[3];
+		int min_x, min_y, max_x, max_y;	// pixels, inside the viewport
+		float inv_area;
+		float z[3], inv_w[3];
+		float varying[3][SoftVaryingCount];
+		uint32_t draw;
+	};
+
+	// nearest triangle of a pixel in the tile being rasterized
+	struct TileSample
+	{
+		const SoftTriangle* triangle;
+		float l[3];	// screen space barycentrics
+	};
+
+	// SoA samples of one draw on their way through phongShadeSamples()
+	struct ShadeBatch
+	{
+		float normal[3][SOFT_SHADE_BATCH], position[3][SOFT_SHADE_BATCH];
+		float color[3][SOFT_SHADE_BATCH], texcoord[2][SOFT_SHADE_BATCH], lod[SOFT_SHADE_BATCH];
+		uint32_t* pixel[SOFT_SHADE_BATCH];
+
+		PhongSamples phongSamples()
+		{
+			PhongSamples s = { { normal[0], normal[1], normal[2] }, { position[0], position[1], position[2] },
+				{ color[0], color[1], color[2] } };
+			return s;
+		}
+	};
+
+	struct BinJob
+	{
+		Batch batch;
+		std::vector<SoftTriangle> triangles;
+		std::vector<std::vector<uint32_t> > tiles;	// triangles touching each tile, in order
+		size_t clipped;
+	};
+
+	void shadeVertices(const Batch& b, int thread)
+	{
+		const SoftDraw& d = draws[b.draw];
+		const Matrix4& nm = normal_matrix[b.draw];
+		ShadeBatch& batch = shade_batches[thread];
+		float* post_first = &post[post_offset[b.draw] * SOFT_POST_STRIDE];
+		for (size_t first = b.first; first < b.last; first += SOFT_SHADE_BATCH)
+		{
+			size_t count = std::min((size_t)SOFT_SHADE_BATCH, b.last - first);
+			for (size_t k = 0; k < count; k++)
+			{
+				const float* in = d.vertices + (first + k) * SOFT_VERTEX_STRIDE;
+				float* out = post_first + (first + k) * SOFT_POST_STRIDE;
+				Vector4 view = d.model_view * Vector4(in[0], in[1], in[2], 1.0f);
+				Vector4 clip = d.projection * view;
+				Vector3 normal = nm * Vector3(in[6], in[7], in[8]);
+				out[0] = clip.x;  out[1] = clip.y;  out[2] = clip.z;  out[3] = clip.w;
+				float* v = out + 4;
+				v[SoftPosition] = view.x;  v[SoftPosition + 1] = view.y;  v[SoftPosition + 2] = view.z;
+				v[SoftNormal] = normal.x;  v[SoftNormal + 1] = normal.y;  v[SoftNormal + 2] = normal.z;
+				v[SoftTexCoord] = in[9];  v[SoftTexCoord + 1] = in[10];
+				v[SoftColor] = v[SoftColor + 1] = v[SoftColor + 2] = 0.0f;
+				batch.normal[0][k] = normal.x;  batch.normal[1][k] = normal.y;  batch.normal[2][k] = normal.z;
+				batch.position[0][k] = view.x;  batch.position[1][k] = view.y;  batch.position[2][k] = view.z;
+			}
+			if (d.per_vertex_or_per_pixel != 0)
+				continue;
+			phongShadeSamples(phong, d.surface, batch.phongSamples(), count);
+			for (size_t k = 0; k < count; k++)
+			{
+				float* v = post_first + (first + k) * SOFT_POST_STRIDE + 4;
+				v[SoftColor] = batch.color[0][k];  v[SoftColor + 1] = batch.color[1][k];  v[SoftColor + 2] = batch.color[2][k];
+			}
+		}
+	}
+
+	void binTriangles(BinJob& job)
+	{
+		const Batch& b = job.batch;
+		const SoftDraw& d = draws[b.draw];
+		const float* base = &post[post_offset[b.draw] * SOFT_POST_STRIDE];
+		for (size_t t = b.first; t < b.last; t++)
+		{
+			const float* v[3];
+			bool index_ok = true;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int index = d.indices[t * 3 + k];
+				index_ok &= index < d.vertex_count;
+				v[k] = base + (size_t)index * SOFT_POST_STRIDE;
+			}
+			if (!index_ok)
+			{
+				job.clipped++;
+				continue;
+			}
+
+			// all three outside the same side plane or the far plane
+			bool outside = false;
+			for (int axis = 0; axis < 3 && !outside; axis++)
+			{
+				outside |= v[0][axis] > v[0][3] && v[1][axis] > v[1][3] && v[2][axis] > v[2][3];
+				if (axis < 2)
+					outside |= v[0][axis] < -v[0][3] && v[1][axis] < -v[1][3] && v[2][axis] < -v[2][3];
+			}
+			if (outside)
+			{
+				job.clipped++;
+				continue;
+			}
+
+			bool near_inside[3] = { v[0][2] >= -v[0][3], v[1][2] >= -v[1][3], v[2][2] >= -v[2][3] };
+			if (near_inside[0] && near_inside[1] && near_inside[2])
+			{
+				setupTriangle(job, b.draw, v[0], v[1], v[2]);
+				continue;
+			}
+
+			// Sutherland-Hodgman against z = -w, at most a quad comes out
+			job.clipped++;
+			float polygon[4][SOFT_POST_STRIDE];
+			int n = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const float* p = v[k];
+				const float* q = v[(k + 1) % 3];
+				if (near_inside[k])
+					std::copy(p, p + SOFT_POST_STRIDE, polygon[n++]);
+				if (near_inside[k] != near_inside[(k + 1) % 3])
+				{
+					float dp = p[2] + p[3], dq = q[2] + q[3];
+					float s = dp / (dp - dq);
+					for (int i = 0; i < SOFT_POST_STRIDE; i++)
+						polygon[n][i] = p[i] + (q[i] - p[i]) * s;
+					n++;
+				}
+			}
+			for (int k = 2; k < n; k++)
+				setupTriangle(job, b.draw, polygon[0], polygon[k - 1], polygon[k]);
+		}
+	}
+
+	void setupTriangle(BinJob& job, size_t draw, const float* p0, const float* p1, const float* p2)
+	{
+		const SoftDraw& d = draws[draw];
+		const float* p[3] = { p0, p1, p2 };
+		const float scale = (float)(1 << SOFT_SUBPIXEL_BITS);
+		const float limit = (float)(1 << 24);	// sub-pixel units, keeps the edge products in 64 bits
+		SoftTriangle tri;
+		int64_t x[3], y[3];
+		for (int k = 0; k < 3; k++)
+		{
+			float inv_w = 1.0f / p[k][3];
+			float fx = (d.viewport[0] + (p[k][0] * inv_w * 0.5f + 0.5f) * d.viewport[2]) * scale;
+			float fy = (d.viewport[1] + (p[k][1] * inv_w * 0.5f + 0.5f) * d.viewport[3]) * scale;
+			if (!(fabsf(fx) < limit && fabsf(fy) < limit))
+			{
+				job.clipped++;
+				return;
+			}
+			x[k] = (int64_t)lrintf(fx);
+			y[k] = (int64_t)lrintf(fy);
+			tri.z[k] = p[k][2] * inv_w * 0.5f + 0.5f;
+			tri.inv_w[k] = inv_w;
+		}
+
+		int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+		if (area == 0)
+			return;
+		int order[3] = { 0, 1, 2 };
+		if (area < 0)
+		{
+			// clockwise on screen, no face culling: swap to counter-clockwise
+			std::swap(order[1], order[2]);
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(tri.z[1], tri.z[2]);
+			std::swap(tri.inv_w[1], tri.inv_w[2]);
+			area = -area;
+		}
+
+		int64_t lo_x = std::min(x[0], std::min(x[1], x[2])), hi_x = std::max(x[0], std::max(x[1], x[2]));
+		int64_t lo_y = std::min(y[0], std::min(y[1], y[2])), hi_y = std::max(y[0], std::max(y[1], y[2]));
+		tri.min_x = (int)std::max<int64_t>(d.viewport[0], lo_x >> SOFT_SUBPIXEL_BITS);
+		tri.min_y = (int)std::max<int64_t>(d.viewport[1], lo_y >> SOFT_SUBPIXEL_BITS);
+		tri.max_x = (int)std::min<int64_t>(std::min(d.viewport[0] + d.viewport[2], target->width) - 1, hi_x >> SOFT_SUBPIXEL_BITS);
+		tri.max_y = (int)std::min<int64_t>(std::min(d.viewport[1] + d.viewport[3], target->height) - 1, hi_y >> SOFT_SUBPIXEL_BITS);
+		tri.min_x = std::max(tri.min_x, 0);
+		tri.min_y = std::max(tri.min_y, 0);
+		if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+		{
+			job.clipped++;
+			return;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			int i = (k + 1) % 3, j = (k + 2) % 3;
+			int64_t dx = x[j] - x[i], dy = y[j] - y[i];
+			tri.a[k] = -dy;
+			tri.b[k] = dx;
+			tri.c[k] = dy * x[i] - dx * y[i];
+			// top-left rule: pixels on a right or bottom edge belong to the neighbour
+			if (!(dy < 0 || (dy == 0 && dx < 0)))
+				tri.c[k] -= 1;
+			std::copy(p[order[k]] + 4, p[order[k]] + SOFT_POST_STRIDE, tri.varying[k]);
+		}
+		tri.inv_area = 1.0f / (float)area;
+		tri.draw = (uint32_t)draw;
+
+		uint32_t index = (uint32_t)job.triangles.size();
+		job.triangles.push_back(tri);
+		for (int ty = tri.min_y / SOFT_TILE_SIZE; ty <= tri.max_y / SOFT_TILE_SIZE; ty++)
+			for (int tx = tri.min_x / SOFT_TILE_SIZE; tx <= tri.max_x / SOFT_TILE_SIZE; tx++)
+				job.tiles[(size_t)ty * tiles_x + tx].push_back(index);
+	}
+
+	void rasterizeTile(size_t tile, int thread)
+	{
+		int tile_x0 = (int)(tile % tiles_x) * SOFT_TILE_SIZE, tile_y0 = (int)(tile / tiles_x) * SOFT_TILE_SIZE;
+		int tile_x1 = std::min(tile_x0 + SOFT_TILE_SIZE, target->width) - 1;
+		int tile_y1 = std::min(tile_y0 + SOFT_TILE_SIZE, target->height) - 1;
+		// only the part of the tile under some triangle box is cleared and shaded
+		int x0 = tile_x1 + 1, y0 = tile_y1 + 1, x1 = tile_x0 - 1, y1 = tile_y0 - 1;
+		for (size_t j = 0; j < bin_count; j++)
+		{
+			const BinJob& job = bins[j];
+			for (uint32_t index : job.tiles[tile])
+			{
+				const SoftTriangle& tri = job.triangles[index];
+				x0 = std::min(x0, tri.min_x);  y0 = std::min(y0, tri.min_y);
+				x1 = std::max(x1, tri.max_x);  y1 = std::max(y1, tri.max_y);
+			}
+		}
+		x0 = std::max(x0, tile_x0);  y0 = std::max(y0, tile_y0);
+		x1 = std::min(x1, tile_x1);  y1 = std::min(y1, tile_y1);
+		if (x0 > x1 || y0 > y1)
+			return;
+
+		TileSample* tile_samples = &samples[thread][0];
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				tile_samples[(y - tile_y0) * SOFT_TILE_SIZE + (x - tile_x0)].triangle = NULL;
+
+		for (size_t j = 0; j < bin_count; j++)
+		{
+			const BinJob& job = bins[j];
+			for (uint32_t index : job.tiles[tile])
+			{
+				const SoftTriangle& tri = job.triangles[index];
+				rasterizeTriangle(tri, tile_samples, tile_x0, tile_y0, std::max(x0, tri.min_x), std::max(y0, tri.min_y),
+					std::min(x1, tri.max_x), std::min(y1, tri.max_y));
+			}
+		}
+
+		ShadeBatch& batch = shade_batches[thread];
+		size_t shaded = 0, count = 0;
+		uint32_t batch_draw = 0;
+		for (int y = y0; y <= y1; y++)
+		{
+			const TileSample* sample = tile_samples + (y - tile_y0) * SOFT_TILE_SIZE + (x0 - tile_x0);
+			uint32_t* color = &target->color[(size_t)y * target->width];
+			for (int x = x0; x <= x1; x++, sample++)
+			{
+				if (sample->triangle == NULL)
+					continue;
+				if (count == SOFT_SHADE_BATCH || (count > 0 && sample->triangle->draw != batch_draw))
+				{
+					shadeFragments(draws[batch_draw], batch, count);
+					shaded += count;
+					count = 0;
+				}
+				batch_draw = sample->triangle->draw;
+				interpolateFragment(*sample->triangle, sample->l, batch, count);
+				batch.pixel[count++] = &color[x];
+			}
+		}
+		if (count > 0)
+			shadeFragments(draws[batch_draw], batch, count);
+		fragments[thread * FRAGMENT_PAD] += shaded + count;
+	}
+
+	// depth pass of one triangle over [x0, x1] x [y0, y1] of the tile at tile_x0, tile_y0
+	void rasterizeTriangle(const SoftTriangle& tri, TileSample* tile_samples, int tile_x0, int tile_y0, int x0, int y0, int x1, int y1)
+	{
+		const int64_t step = 1 << SOFT_SUBPIXEL_BITS, half = step / 2;
+		int64_t px = x0 * step + half, py = y0 * step + half;
+		int64_t row[3];
+		for (int k = 0; k < 3; k++)
+			row[k] = tri.a[k] * px + tri.b[k] * py + tri.c[k];
+
+		for (int y = y0; y <= y1; y++)
+		{
+			int64_t e0 = row[0], e1 = row[1], e2 = row[2];
+			size_t pixel = (size_t)y * target->width + x0;
+			TileSample* sample = tile_samples + (y - tile_y0) * SOFT_TILE_SIZE + (x0 - tile_x0);
+			for (int x = x0; x <= x1; x++, pixel++, sample++)
+			{
+				if ((e0 | e1 | e2) >= 0)
+				{
+					float l0 = (float)e0 * tri.inv_area, l1 = (float)e1 * tri.inv_area, l2 = (float)e2 * tri.inv_area;
+					// from z0 and the differences: with the near plane at 0.001 all
+					// depths are close to 1 and the plain weighted sum loses the bits
+					// that keep the back of a silhouette fold behind its front
+					float z = tri.z[0] + l1 * (tri.z[1] - tri.z[0]) + l2 * (tri.z[2] - tri.z[0]);
+					if (z < target->depth[pixel] && z <= 1.0f)
+					{
+						target->depth[pixel] = z;
+						sample->triangle = &tri;
+						sample->l[0] = l0;
+						sample->l[1] = l1;
+						sample->l[2] = l2;
+					}
+				}
+				e0 += tri.a[0] * step;
+				e1 += tri.a[1] * step;
+				e2 += tri.a[2] * step;
+			}
+			for (int k = 0; k < 3; k++)
+				row[k] += tri.b[k] * step;
+		}
+	}
+
+	// varyings of the screen space barycentrics l into sample k of the batch
+	void interpolateFragment(const SoftTriangle& tri, const float* l, ShadeBatch& batch, size_t k)
+	{
+		// perspective correct weights, l / w renormalized
+		float w0 = l[0] * tri.inv_w[0], w1 = l[1] * tri.inv_w[1], w2 = l[2] * tri.inv_w[2];
+		float inv_sum = 1.0f / (w0 + w1 + w2);
+		w0 *= inv_sum;  w1 *= inv_sum;  w2 *= inv_sum;
+		float v[SoftVaryingCount];
+		for (int i = 0; i < SoftVaryingCount; i++)
+			v[i] = w0 * tri.varying[0][i] + w1 * tri.varying[1][i] + w2 * tri.varying[2][i];
+
+		for (int i = 0; i < 3; i++)
+		{
+			batch.normal[i][k] = v[SoftNormal + i];
+			batch.position[i][k] = v[SoftPosition + i];
+			batch.color[i][k] = v[SoftColor + i];
+		}
+		batch.texcoord[0][k] = v[SoftTexCoord];
+		batch.texcoord[1][k] = v[SoftTexCoord + 1];
+
+		// level of detail from the screen derivatives of the texture
+		// coordinate: with A = sum l_i q_i t_i and B = sum l_i q_i it is
+		// t = A / B, so dt = (dA - t dB) / B, and l_i moves by a_i (b_i)
+		// sub-pixel steps per pixel in x (y)
+		const SoftTexture* texture = draws[tri.draw].texture;
+		if (texture == NULL || texture->empty())
+			return;
+		float step = (float)(1 << SOFT_SUBPIXEL_BITS) * tri.inv_area;
+		float dB[2] = {}, du[2] = {}, dv[2] = {};
+		for (int i = 0; i < 3; i++)
+		{
+			float qx = (float)tri.a[i] * step * tri.inv_w[i], qy = (float)tri.b[i] * step * tri.inv_w[i];
+			dB[0] += qx;
+			dB[1] += qy;
+			du[0] += qx * tri.varying[i][SoftTexCoord];
+			du[1] += qy * tri.varying[i][SoftTexCoord];
+			dv[0] += qx * tri.varying[i][SoftTexCoord + 1];
+			dv[1] += qy * tri.varying[i][SoftTexCoord + 1];
+		}
+		float rho2[2];
+		for (int d = 0; d < 2; d++)
+		{
+			float dudp = (du[d] - v[SoftTexCoord] * dB[d]) * inv_sum * texture->width;
+			float dvdp = (dv[d] - v[SoftTexCoord + 1] * dB[d]) * inv_sum * texture->height;
+			rho2[d] = dudp * dudp + dvdp * dvdp;
+		}
+		batch.lod[k] = 0.5f * log2f(std::max(rho2[0], rho2[1]));
+	}
+
+	// shader.fs.glsl on the first count samples of the batch, all of draw d;
+	// the per vertex mode keeps the interpolated vertex colors
+	void shadeFragments(const SoftDraw& d, ShadeBatch& batch, size_t count)
+	{
+		if (d.per_vertex_or_per_pixel != 0)
+			phongShadeSamples(phong, d.surface, batch.phongSamples(), count);
+		if (d.texture != NULL && !d.texture->empty())
+		{
+			float* color[3] = { batch.color[0], batch.color[1], batch.color[2] };
+			softModulateTexture(*d.texture, d.sampler, batch.texcoord[0], batch.texcoord[1], batch.lod, color, count);
+		}
+		for (size_t k = 0; k < count; k++)
+			*batch.pixel[k] = softPackColor(Vector3(batch.color[0][k], batch.color[1][k], batch.color[2][k]));
+	}
+
+	SoftFramebuffer* target;
+	PhongView phong;
+	std::vector<SoftDraw> draws;
+	std::vector<Matrix4> normal_matrix;	// per draw
+	std::vector<size_t> post_offset;	// first vertex of each draw in post
+	std::vector<float> post;	// SOFT_POST_STRIDE floats per transformed vertex
+	std::vector<Batch> vertex_jobs;
+	std::vector<BinJob> bins;	// reused across frames, the first bin_count are live
+	size_t bin_count;
+	int tiles_x, tiles_y;
+	std::vector<size_t> fragments;	// shaded per thread
+	std::vector<std::vector<TileSample> > samples;	// per thread, one tile
+	std::vector<ShadeBatch> shade_batches;	// per thread
+
+	WorkerPool pool;
+};
+
+#endif
@@ -0,0 +1,401 @@
+///////////////////////////////////////////////////////////////////////////////
+// SoftTexture.h
+// =============
+// Textures of the software backend: the mip chain glGenerateMipmap() builds
+// for an image of LoadTextureImage(), sampled the way textureMode() sets up
+// GL: GL_LINEAR / GL_NEAREST magnification, GL_LINEAR_MIPMAP_LINEAR /
+// GL_NEAREST minification and GL_REPEAT / GL_MIRRORED_REPEAT wrapping.
+//
+// Every level is stored row by row (SoftLinear) or in Morton order
+// (SoftMorton), where the bits of x and y are interleaved so a 2x2
+// footprint, or any small square of texels, shares a few cache lines
+// whichever direction the texture is walked in. The layout is a pair of
+// offset tables per level, texel (x, y) is at column[x] + row[y], so the
+// filters do not depend on it. Morton levels are padded to powers of two.
+//
+// The level of detail is log2 of the texel footprint of a pixel as the GL
+// spec defines it, <= 0 magnifies. softModulateTexture() multiplies arrays
+// of colors by the texture; the texels of a sample are filtered together,
+// the 4 of a bilinear one in a 128 bit register (SSE2, NEON) and the 8 of a
+// trilinear one in a 256 bit register (AVX2). sampleTexture() is the scalar
+// reference and what the SIMD paths are checked against.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SOFT_TEXTURE_H_DEF
+#define SOFT_TEXTURE_H_DEF
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Vectors.h"
+
+#if !defined(MATH_SIMD_SCALAR) && defined(__AVX2__)
+	#define SOFT_TEXTURE_AVX2
+	#define SOFT_TEXTURE_SSE2
+	#include <immintrin.h>
+#elif defined(MATH_SIMD_SSE2)
+	#define SOFT_TEXTURE_SSE2
+	#include <emmintrin.h>
+#elif defined(MATH_SIMD_NEON) && defined(__aarch64__)
+	#define SOFT_TEXTURE_NEON
+	#include <arm_neon.h>
+#endif
+
+enum SoftTextureLayout
+{
+	SoftLinear,
+	SoftMorton,
+};
+
+struct SoftTextureLevel
+{
+	int width = 0, height = 0;
+	std::vector<uint32_t> texels;	// RGBA8, row 0 is t = 0 as uploaded to GL
+	std::vector<uint32_t> column, row;	// texel (x, y) is texels[column[x] + row[y]]
+};
+
+struct SoftTexture
+{
+	int width = 0, height = 0;	// of level 0
+	SoftTextureLayout layout = SoftMorton;
+	std::vector<SoftTextureLevel> levels;	// level 0 down to 1 x 1
+
+	bool empty() const { return levels.empty(); }
+};
+
+// the filters and wrap mode of textureMode()
+struct SoftSampler
+{
+	bool linear;	// GL_LINEAR magnification, else GL_NEAREST
+	bool mipmap;	// GL_LINEAR_MIPMAP_LINEAR minification, else GL_NEAREST
+	bool repeat;	// GL_REPEAT, else GL_MIRRORED_REPEAT
+};
+
+inline const char* softTextureBackend()
+{
+#if defined(SOFT_TEXTURE_AVX2)
+	return "AVX2";
+#elif defined(SOFT_TEXTURE_SSE2)
+	return "SSE2";
+#elif defined(SOFT_TEXTURE_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+// the low 16 bits of v spread to the even bits
+inline uint32_t softMortonSpread(uint32_t v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+// offset tables and storage of a level; a Morton level that is not square
+// interleaves the bits both sides have and puts the rest of the longer side on top
+inline void softLayoutLevel(SoftTextureLevel& level, SoftTextureLayout layout)
+{
+	level.column.resize(level.width);
+	level.row.resize(level.height);
+	if (layout == SoftLinear)
+	{
+		for (int x = 0; x < level.width; x++)
+			level.column[x] = x;
+		for (int y = 0; y < level.height; y++)
+			level.row[y] = (uint32_t)y * level.width;
+		level.texels.assign((size_t)level.width * level.height, 0);
+		return;
+	}
+	int bits_x = 0, bits_y = 0;
+	while ((1 << bits_x) < level.width)
+		bits_x++;
+	while ((1 << bits_y) < level.height)
+		bits_y++;
+	int common = std::min(bits_x, bits_y);
+	uint32_t mask = (1u << common) - 1;
+	for (int x = 0; x < level.width; x++)
+		level.column[x] = softMortonSpread(x & mask) | ((uint32_t)(x >> common) << (2 * common));
+	for (int y = 0; y < level.height; y++)
+		level.row[y] = (softMortonSpread(y & mask) << 1) | ((uint32_t)(y >> common) << (2 * common));
+	level.texels.assign((size_t)1 << (bits_x + bits_y), 0);
+}
+
+// the texture and its mip chain from width x height RGBA8 pixels, row 0
+// first; every level is the 2x2 box average of the one above it, as
+// glGenerateMipmap() does on the usual drivers
+inline SoftTexture makeSoftTexture(const uint32_t* rgba, int width, int height, SoftTextureLayout layout = SoftMorton)
+{
+	SoftTexture t;
+	t.width = width;
+	t.height = height;
+	t.layout = layout;
+	if (width <= 0 || height <= 0)
+		return t;
+
+	std::vector<uint32_t> pixels(rgba, rgba + (size_t)width * height), half;
+	int w = width, h = height;
+	for (;;)
+	{
+		t.levels.push_back(SoftTextureLevel());
+		SoftTextureLevel& level = t.levels.back();
+		level.width = w;
+		level.height = h;
+		softLayoutLevel(level, layout);
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+				level.texels[level.column[x] + level.row[y]] = pixels[(size_t)y * w + x];
+		if (w == 1 && h == 1)
+			break;
+
+		int half_w = std::max(w / 2, 1), half_h = std::max(h / 2, 1);
+		half.resize((size_t)half_w * half_h);
+		for (int y = 0; y < half_h; y++)
+			for (int x = 0; x < half_w; x++)
+			{
+				int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+				int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+				uint32_t c[4] = { pixels[(size_t)y0 * w + x0], pixels[(size_t)y0 * w + x1], pixels[(size_t)y1 * w + x0], pixels[(size_t)y1 * w + x1] };
+				uint32_t out = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+				{
+					uint32_t sum = ((c[0] >> shift) & 0xff) + ((c[1] >> shift) & 0xff) + ((c[2] >> shift) & 0xff) + ((c[3] >> shift) & 0xff);
+					out |= ((sum + 2) >> 2) << shift;
+				}
+				half[(size_t)y * half_w + x] = out;
+			}
+		pixels.swap(half);
+		w = half_w;
+		h = half_h;
+	}
+	return t;
+}
+
+inline int softWrap(int i, int size, bool repeat)
+{
+	if ((unsigned int)i < (unsigned int)size)
+		return i;
+	if (repeat)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+	// (size - 1) - mirror((i mod 2 size) - size)
+	int period = 2 * size;
+	i %= period;
+	if (i < 0)
+		i += period;
+	i -= size;
+	return size - 1 - (i >= 0 ? i : -1 - i);
+}
+
+inline uint32_t softTexelBits(const SoftTextureLevel& level, int x, int y)
+{
+	return level.texels[level.column[x] + level.row[y]];
+}
+
+inline Vector3 softTexel(const SoftTextureLevel& level, int x, int y)
+{
+	uint32_t c = softTexelBits(level, x, y);
+	return Vector3((float)(c & 0xff), (float)((c >> 8) & 0xff), (float)((c >> 16) & 0xff)) * (1.0f / 255.0f);
+}
+
+inline Vector3 softNearest(const SoftTextureLevel& level, bool repeat, float u, float v)
+{
+	return softTexel(level, softWrap((int)floorf(u * level.width), level.width, repeat),
+		softWrap((int)floorf(v * level.height), level.height, repeat));
+}
+
+// the 2x2 texels around (u, v) and their weights, scaled by scale:
+// (x0, y0), (x1, y0), (x0, y1), (x1, y1)
+struct SoftFootprint
+{
+	uint32_t offset[4];
+	float weight[4];
+};
+
+inline void softBilinearFootprint(const SoftTextureLevel& level, bool repeat, float u, float v, float scale, SoftFootprint& f)
+{
+	float x = u * level.width - 0.5f, y = v * level.height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float ax = x - fx, ay = y - fy;
+	int x0 = softWrap((int)fx, level.width, repeat), x1 = softWrap((int)fx + 1, level.width, repeat);
+	int y0 = softWrap((int)fy, level.height, repeat), y1 = softWrap((int)fy + 1, level.height, repeat);
+	f.offset[0] = level.column[x0] + level.row[y0];
+	f.offset[1] = level.column[x1] + level.row[y0];
+	f.offset[2] = level.column[x0] + level.row[y1];
+	f.offset[3] = level.column[x1] + level.row[y1];
+	f.weight[0] = (1.0f - ax) * (1.0f - ay) * scale;
+	f.weight[1] = ax * (1.0f - ay) * scale;
+	f.weight[2] = (1.0f - ax) * ay * scale;
+	f.weight[3] = ax * ay * scale;
+}
+
+inline Vector3 softBilinear(const SoftTextureLevel& level, bool repeat, float u, float v)
+{
+	float x = u * level.width - 0.5f, y = v * level.height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float ax = x - fx, ay = y - fy;
+	int x0 = softWrap((int)fx, level.width, repeat), x1 = softWrap((int)fx + 1, level.width, repeat);
+	int y0 = softWrap((int)fy, level.height, repeat), y1 = softWrap((int)fy + 1, level.height, repeat);
+	Vector3 bottom = softTexel(level, x0, y0) * (1.0f - ax) + softTexel(level, x1, y0) * ax;
+	Vector3 top = softTexel(level, x0, y1) * (1.0f - ax) + softTexel(level, x1, y1) * ax;
+	return bottom * (1.0f - ay) + top * ay;
+}
+
+// texture(tex, (u, v)).rgb at level of detail lod
+inline Vector3 sampleTexture(const SoftTexture& t, const SoftSampler& s, float u, float v, float lod = 0.0f)
+{
+	const SoftTextureLevel& base = t.levels[0];
+	if (!(lod > 0.0f))
+		return s.linear ? softBilinear(base, s.repeat, u, v) : softNearest(base, s.repeat, u, v);
+	if (!s.mipmap)
+		return softNearest(base, s.repeat, u, v);
+	int last = (int)t.levels.size() - 1;
+	lod = std::min(lod, (float)last);
+	int level = (int)lod;
+	float blend = lod - level;
+	Vector3 color = softBilinear(t.levels[level], s.repeat, u, v);
+	if (blend > 0.0f)
+		color = color * (1.0f - blend) + softBilinear(t.levels[level + 1], s.repeat, u, v) * blend;
+	return color;
+}
+
+// weighted sum of the texels of up to two footprints into rgba, 0 .. 255
+#if defined(SOFT_TEXTURE_SSE2)
+
+inline __m128 softFilter4(const uint32_t* texels, const SoftFootprint& f)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i t = _mm_setr_epi32((int)texels[f.offset[0]], (int)texels[f.offset[1]], (int)texels[f.offset[2]], (int)texels[f.offset[3]]);
+	__m128i lo = _mm_unpacklo_epi8(t, zero), hi = _mm_unpackhi_epi8(t, zero);
+	__m128 sum = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_set1_ps(f.weight[0]));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), _mm_set1_ps(f.weight[1])));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_set1_ps(f.weight[2])));
+	return _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), _mm_set1_ps(f.weight[3])));
+}
+
+inline void softFilter(const uint32_t* texels, const SoftFootprint& f, float* rgba)
+{
+	_mm_storeu_ps(rgba, softFilter4(texels, f));
+}
+
+inline void softFilter(const uint32_t* texels0, const SoftFootprint& f0, const uint32_t* texels1, const SoftFootprint& f1, float* rgba)
+{
+#if defined(SOFT_TEXTURE_AVX2)
+	// 128 bit lanes: texel k of footprint 0 and texel k of footprint 1
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i t = _mm256_setr_epi32((int)texels0[f0.offset[0]], (int)texels0[f0.offset[1]], (int)texels0[f0.offset[2]], (int)texels0[f0.offset[3]],
+		(int)texels1[f1.offset[0]], (int)texels1[f1.offset[1]], (int)texels1[f1.offset[2]], (int)texels1[f1.offset[3]]);
+	__m256i lo = _mm256_unpacklo_epi8(t, zero), hi = _mm256_unpackhi_epi8(t, zero);
+	__m256 sum = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_unpacklo_epi16(lo, zero)), _mm256_setr_m128(_mm_set1_ps(f0.weight[0]), _mm_set1_ps(f1.weight[0])));
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_unpackhi_epi16(lo, zero)), _mm256_setr_m128(_mm_set1_ps(f0.weight[1]), _mm_set1_ps(f1.weight[1]))));
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_unpacklo_epi16(hi, zero)), _mm256_setr_m128(_mm_set1_ps(f0.weight[2]), _mm_set1_ps(f1.weight[2]))));
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_unpackhi_epi16(hi, zero)), _mm256_setr_m128(_mm_set1_ps(f0.weight[3]), _mm_set1_ps(f1.weight[3]))));
+	_mm_storeu_ps(rgba, _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+#else
+	_mm_storeu_ps(rgba, _mm_add_ps(softFilter4(texels0, f0), softFilter4(texels1, f1)));
+#endif
+}
+
+#elif defined(SOFT_TEXTURE_NEON)
+
+inline float32x4_t softFilter4(const uint32_t* texels, const SoftFootprint& f)
+{
+	uint32_t bits[4] = { texels[f.offset[0]], texels[f.offset[1]], texels[f.offset[2]], texels[f.offset[3]] };
+	uint8x16_t t = vreinterpretq_u8_u32(vld1q_u32(bits));
+	uint16x8_t lo = vmovl_u8(vget_low_u8(t)), hi = vmovl_u8(vget_high_u8(t));
+	float32x4_t sum = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), f.weight[0]);
+	sum = vmlaq_n_f32(sum, vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), f.weight[1]);
+	sum = vmlaq_n_f32(sum, vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), f.weight[2]);
+	return vmlaq_n_f32(sum, vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), f.weight[3]);
+}
+
+inline void softFilter(const uint32_t* texels, const SoftFootprint& f, float* rgba)
+{
+	vst1q_f32(rgba, softFilter4(texels, f));
+}
+
+inline void softFilter(const uint32_t* texels0, const SoftFootprint& f0, const uint32_t* texels1, const SoftFootprint& f1, float* rgba)
+{
+	vst1q_f32(rgba, vaddq_f32(softFilter4(texels0, f0), softFilter4(texels1, f1)));
+}
+
+#else
+
+inline void softFilter(const uint32_t* texels, const SoftFootprint& f, float* rgba)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		float sum = 0.0f;
+		for (int k = 0; k < 4; k++)
+			sum += (float)((texels[f.offset[k]] >> (8 * c)) & 0xff) * f.weight[k];
+		rgba[c] = sum;
+	}
+}
+
+inline void softFilter(const uint32_t* texels0, const SoftFootprint& f0, const uint32_t* texels1, const SoftFootprint& f1, float* rgba)
+{
+	float second[4];
+	softFilter(texels0, f0, rgba);
+	softFilter(texels1, f1, second);
+	for (int c = 0; c < 4; c++)
+		rgba[c] += second[c];
+}
+
+#endif
+
+// color[c][k] *= texture(tex, (u[k], v[k])).rgb at level of detail lod[k],
+// for k in [0, count); lod may be NULL to sample level 0 only
+inline void softModulateTexture(const SoftTexture& t, const SoftSampler& s, const float* u, const float* v, const float* lod,
+	float* const color[3], size_t count)
+{
+	const SoftTextureLevel& base = t.levels[0];
+	const int last = (int)t.levels.size() - 1;
+	for (size_t k = 0; k < count; k++)
+	{
+		float rgba[4];
+		float level_of_detail = lod != NULL ? lod[k] : 0.0f;
+		bool minify = level_of_detail > 0.0f;
+		if (minify ? !s.mipmap : !s.linear)
+		{
+			uint32_t c = softTexelBits(base, softWrap((int)floorf(u[k] * base.width), base.width, s.repeat),
+				softWrap((int)floorf(v[k] * base.height), base.height, s.repeat));
+			for (int i = 0; i < 3; i++)
+				rgba[i] = (float)((c >> (8 * i)) & 0xff);
+		}
+		else if (!minify)
+		{
+			SoftFootprint f;
+			softBilinearFootprint(base, s.repeat, u[k], v[k], 1.0f, f);
+			softFilter(&base.texels[0], f, rgba);
+		}
+		else
+		{
+			float clamped = std::min(level_of_detail, (float)last);
+			int level = (int)clamped;
+			float blend = clamped - level;
+			const SoftTextureLevel& near_level = t.levels[level];
+			SoftFootprint f0;
+			softBilinearFootprint(near_level, s.repeat, u[k], v[k], 1.0f - blend, f0);
+			if (blend > 0.0f)
+			{
+				const SoftTextureLevel& far_level = t.levels[level + 1];
+				SoftFootprint f1;
+				softBilinearFootprint(far_level, s.repeat, u[k], v[k], blend, f1);
+				softFilter(&near_level.texels[0], f0, &far_level.texels[0], f1, rgba);
+			}
+			else
+				softFilter(&near_level.texels[0], f0, rgba);
+		}
+		for (int i = 0; i < 3; i++)
+			color[i][k] *= rgba[i] * (1.0f / 255.0f);
+	}
+}
+
+#endif
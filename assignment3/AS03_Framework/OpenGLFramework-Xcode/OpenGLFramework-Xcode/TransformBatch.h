@@ -0,0 +1,493 @@
+///////////////////////////////////////////////////////////////////////////////
+// TransformBatch.h
+// ================
+// Transform arrays of points / directions by a Matrix4, compute bounds and
+// normalize arrays of vectors
+//
+// Two layouts are accepted:
+//   AoS  packed x y z triples, e.g. tinyobj::attrib_t::vertices
+//   SoA  separate x[], y[], z[] arrays
+// Each call runs four points per iteration with SSE2 or AArch64 NEON (AoS
+// triples are deinterleaved in registers) and finishes the tail with the
+// scalar loop, which is also the whole path on other targets or when
+// MATH_SIMD_SCALAR is defined. Aligned loads and stores are used when every
+// array of the call is 16-byte aligned. Output arrays may be the input
+// arrays, but must not partially overlap them.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MATH_TRANSFORM_BATCH_H
+#define MATH_TRANSFORM_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Matrices.h"
+
+#if defined(MATH_SIMD_SSE2) || (defined(MATH_SIMD_NEON) && defined(__aarch64__))
+    #define MATH_BATCH_SIMD
+#endif
+
+enum BatchTransform
+{
+    BatchPoint,         // w = 1
+    BatchDirection,     // w = 0, translation ignored
+    BatchProject,       // w = 1, result divided by w'
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scalar path, handles the tails of the SIMD loops
+///////////////////////////////////////////////////////////////////////////////
+template <BatchTransform mode>
+inline void batchTransformScalar(const Matrix4& m, float& x, float& y, float& z)
+{
+    float w = (mode == BatchDirection) ? 0.0f : 1.0f;
+    float rx = m[0]*x + m[1]*y + m[2]*z  + m[3]*w;
+    float ry = m[4]*x + m[5]*y + m[6]*z  + m[7]*w;
+    float rz = m[8]*x + m[9]*y + m[10]*z + m[11]*w;
+    if(mode == BatchProject)
+    {
+        float iw = 1.0f / (m[12]*x + m[13]*y + m[14]*z + m[15]);
+        rx *= iw;  ry *= iw;  rz *= iw;
+    }
+    x = rx;  y = ry;  z = rz;
+}
+
+
+
+inline void batchBoundsScalar(float x, float y, float z, Vector3& lo, Vector3& hi)
+{
+    lo.x = x < lo.x ? x : lo.x;  hi.x = x > hi.x ? x : hi.x;
+    lo.y = y < lo.y ? y : lo.y;  hi.y = y > hi.y ? y : hi.y;
+    lo.z = z < lo.z ? z : lo.z;  hi.z = z > hi.z ? z : hi.z;
+}
+
+
+
+#ifdef MATH_BATCH_SIMD
+///////////////////////////////////////////////////////////////////////////////
+// 4-wide primitives of the selected backend
+///////////////////////////////////////////////////////////////////////////////
+#ifdef MATH_SIMD_SSE2
+typedef __m128 BatchVec;
+
+inline BatchVec batchSplat(float f)                 { return _mm_set1_ps(f); }
+inline BatchVec batchAdd(BatchVec a, BatchVec b)    { return _mm_add_ps(a, b); }
+inline BatchVec batchMul(BatchVec a, BatchVec b)    { return _mm_mul_ps(a, b); }
+inline BatchVec batchDiv(BatchVec a, BatchVec b)    { return _mm_div_ps(a, b); }
+inline BatchVec batchMin(BatchVec a, BatchVec b)    { return _mm_min_ps(a, b); }
+inline BatchVec batchMax(BatchVec a, BatchVec b)    { return _mm_max_ps(a, b); }
+inline BatchVec batchSqrt(BatchVec a)               { return _mm_sqrt_ps(a); }
+
+// rsqrtps estimate and one Newton step, the error of fastInvSqrt()
+inline BatchVec batchRsqrt(BatchVec a)
+{
+    __m128 y = _mm_rsqrt_ps(a);
+    __m128 ayy = _mm_mul_ps(_mm_mul_ps(a, y), y);
+    return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_set1_ps(0.5f), ayy)));
+}
+
+template <bool aligned> inline BatchVec batchLoad(const float* p)     { return aligned ? _mm_load_ps(p) : _mm_loadu_ps(p); }
+template <bool aligned> inline void batchStore(float* p, BatchVec v)  { if(aligned) _mm_store_ps(p, v); else _mm_storeu_ps(p, v); }
+
+inline float batchReduceMin(BatchVec v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+inline float batchReduceMax(BatchVec v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] -> [x0..x3] [y0..y3] [z0..z3]
+template <bool aligned>
+inline void batchLoadXYZ(const float* p, BatchVec& x, BatchVec& y, BatchVec& z)
+{
+    __m128 a = batchLoad<aligned>(p);
+    __m128 b = batchLoad<aligned>(p + 4);
+    __m128 c = batchLoad<aligned>(p + 8);
+    __m128 t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));      // x2 y2 x3 y3
+    __m128 t2 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));      // y0 z0 y1 z1
+    x = _mm_shuffle_ps(a, t1, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(t2, t1, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm_shuffle_ps(t2, c, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+template <bool aligned>
+inline void batchStoreXYZ(float* p, BatchVec x, BatchVec y, BatchVec z)
+{
+    __m128 xy_lo = _mm_unpacklo_ps(x, y);                           // x0 y0 x1 y1
+    __m128 xy_hi = _mm_unpackhi_ps(x, y);                           // x2 y2 x3 y3
+    __m128 zx = _mm_shuffle_ps(z, xy_lo, _MM_SHUFFLE(2, 2, 0, 0));  // z0 z0 x1 x1
+    __m128 yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));      // y1 y1 z1 z1
+    __m128 zx3 = _mm_shuffle_ps(z, xy_hi, _MM_SHUFFLE(2, 2, 2, 2)); // z2 z2 x3 x3
+    __m128 yz3 = _mm_shuffle_ps(xy_hi, z, _MM_SHUFFLE(3, 3, 3, 3)); // y3 y3 z3 z3
+    batchStore<aligned>(p,     _mm_shuffle_ps(xy_lo, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+    batchStore<aligned>(p + 4, _mm_shuffle_ps(yz, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+    batchStore<aligned>(p + 8, _mm_shuffle_ps(zx3, yz3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+#else // AArch64 NEON
+typedef float32x4_t BatchVec;
+
+inline BatchVec batchSplat(float f)                 { return vdupq_n_f32(f); }
+inline BatchVec batchAdd(BatchVec a, BatchVec b)    { return vaddq_f32(a, b); }
+inline BatchVec batchMul(BatchVec a, BatchVec b)    { return vmulq_f32(a, b); }
+inline BatchVec batchDiv(BatchVec a, BatchVec b)    { return vdivq_f32(a, b); }
+inline BatchVec batchMin(BatchVec a, BatchVec b)    { return vminq_f32(a, b); }
+inline BatchVec batchMax(BatchVec a, BatchVec b)    { return vmaxq_f32(a, b); }
+inline BatchVec batchSqrt(BatchVec a)               { return vsqrtq_f32(a); }
+
+// vrsqrte has ~8 bits, two Newton steps bring it near fastInvSqrt()
+inline BatchVec batchRsqrt(BatchVec a)
+{
+    float32x4_t y = vrsqrteq_f32(a);
+    y = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+    return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+}
+
+// NEON loads have no alignment requirement
+template <bool aligned> inline BatchVec batchLoad(const float* p)     { return vld1q_f32(p); }
+template <bool aligned> inline void batchStore(float* p, BatchVec v)  { vst1q_f32(p, v); }
+
+inline float batchReduceMin(BatchVec v)             { return vminvq_f32(v); }
+inline float batchReduceMax(BatchVec v)             { return vmaxvq_f32(v); }
+
+template <bool aligned>
+inline void batchLoadXYZ(const float* p, BatchVec& x, BatchVec& y, BatchVec& z)
+{
+    float32x4x3_t v = vld3q_f32(p);
+    x = v.val[0];  y = v.val[1];  z = v.val[2];
+}
+
+template <bool aligned>
+inline void batchStoreXYZ(float* p, BatchVec x, BatchVec y, BatchVec z)
+{
+    float32x4x3_t v;
+    v.val[0] = x;  v.val[1] = y;  v.val[2] = z;
+    vst3q_f32(p, v);
+}
+#endif
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// matrix elements splatted once per call
+///////////////////////////////////////////////////////////////////////////////
+struct BatchMatrix
+{
+    BatchVec e[16];
+
+    BatchMatrix(const Matrix4& m)
+    {
+        for(int i = 0; i < 16; ++i)
+            e[i] = batchSplat(m[i]);
+    }
+};
+
+template <BatchTransform mode>
+inline void batchTransform4(const BatchMatrix& k, BatchVec& x, BatchVec& y, BatchVec& z)
+{
+    BatchVec rx = batchAdd(batchAdd(batchMul(k.e[0], x), batchMul(k.e[1], y)), batchMul(k.e[2], z));
+    BatchVec ry = batchAdd(batchAdd(batchMul(k.e[4], x), batchMul(k.e[5], y)), batchMul(k.e[6], z));
+    BatchVec rz = batchAdd(batchAdd(batchMul(k.e[8], x), batchMul(k.e[9], y)), batchMul(k.e[10], z));
+    if(mode != BatchDirection)
+    {
+        rx = batchAdd(rx, k.e[3]);
+        ry = batchAdd(ry, k.e[7]);
+        rz = batchAdd(rz, k.e[11]);
+    }
+    if(mode == BatchProject)
+    {
+        BatchVec w = batchAdd(batchAdd(batchMul(k.e[12], x), batchMul(k.e[13], y)), batchAdd(batchMul(k.e[14], z), k.e[15]));
+        BatchVec iw = batchDiv(batchSplat(1.0f), w);
+        rx = batchMul(rx, iw);
+        ry = batchMul(ry, iw);
+        rz = batchMul(rz, iw);
+    }
+    x = rx;  y = ry;  z = rz;
+}
+
+inline bool batchAligned(const void* a, const void* b = NULL, const void* c = NULL,
+                         const void* d = NULL, const void* e = NULL, const void* f = NULL)
+{
+    return (((uintptr_t)a | (uintptr_t)b | (uintptr_t)c | (uintptr_t)d | (uintptr_t)e | (uintptr_t)f) & 15) == 0;
+}
+
+
+
+template <BatchTransform mode, bool aligned>
+inline size_t batchTransformAoS4(const Matrix4& m, const float* in, float* out, size_t count)
+{
+    BatchMatrix k(m);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        BatchVec x, y, z;
+        batchLoadXYZ<aligned>(in + i*3, x, y, z);
+        batchTransform4<mode>(k, x, y, z);
+        batchStoreXYZ<aligned>(out + i*3, x, y, z);
+    }
+    return i;
+}
+
+template <BatchTransform mode, bool aligned>
+inline size_t batchTransformSoA4(const Matrix4& m, const float* x, const float* y, const float* z,
+                                 float* ox, float* oy, float* oz, size_t count)
+{
+    BatchMatrix k(m);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        BatchVec vx = batchLoad<aligned>(x + i), vy = batchLoad<aligned>(y + i), vz = batchLoad<aligned>(z + i);
+        batchTransform4<mode>(k, vx, vy, vz);
+        batchStore<aligned>(ox + i, vx);
+        batchStore<aligned>(oy + i, vy);
+        batchStore<aligned>(oz + i, vz);
+    }
+    return i;
+}
+
+// bounds of the AoS points, transformed by m first unless m is NULL
+template <bool aligned>
+inline size_t batchBoundsAoS4(const Matrix4* m, const float* in, size_t count, Vector3& lo, Vector3& hi)
+{
+    if(count < 4)
+        return 0;
+    BatchMatrix k(m ? *m : Matrix4());
+    BatchVec x, y, z;
+    batchLoadXYZ<aligned>(in, x, y, z);
+    if(m)
+        batchTransform4<BatchPoint>(k, x, y, z);
+    BatchVec lx = x, ly = y, lz = z, hx = x, hy = y, hz = z;
+    size_t i = 4;
+    for(; i + 4 <= count; i += 4)
+    {
+        batchLoadXYZ<aligned>(in + i*3, x, y, z);
+        if(m)
+            batchTransform4<BatchPoint>(k, x, y, z);
+        lx = batchMin(lx, x);  ly = batchMin(ly, y);  lz = batchMin(lz, z);
+        hx = batchMax(hx, x);  hy = batchMax(hy, y);  hz = batchMax(hz, z);
+    }
+    lo = Vector3(batchReduceMin(lx), batchReduceMin(ly), batchReduceMin(lz));
+    hi = Vector3(batchReduceMax(hx), batchReduceMax(hy), batchReduceMax(hz));
+    return i;
+}
+
+template <bool aligned>
+inline size_t batchBoundsSoA4(const float* x, const float* y, const float* z, size_t count, Vector3& lo, Vector3& hi)
+{
+    if(count < 4)
+        return 0;
+    BatchVec lx = batchLoad<aligned>(x), ly = batchLoad<aligned>(y), lz = batchLoad<aligned>(z);
+    BatchVec hx = lx, hy = ly, hz = lz;
+    size_t i = 4;
+    for(; i + 4 <= count; i += 4)
+    {
+        BatchVec vx = batchLoad<aligned>(x + i), vy = batchLoad<aligned>(y + i), vz = batchLoad<aligned>(z + i);
+        lx = batchMin(lx, vx);  ly = batchMin(ly, vy);  lz = batchMin(lz, vz);
+        hx = batchMax(hx, vx);  hy = batchMax(hy, vy);  hz = batchMax(hz, vz);
+    }
+    lo = Vector3(batchReduceMin(lx), batchReduceMin(ly), batchReduceMin(lz));
+    hi = Vector3(batchReduceMax(hx), batchReduceMax(hy), batchReduceMax(hz));
+    return i;
+}
+
+template <bool fast, bool aligned>
+inline size_t batchNormalizeAoS4(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        BatchVec x, y, z;
+        batchLoadXYZ<aligned>(in + i*3, x, y, z);
+        BatchVec xxyyzz = batchAdd(batchAdd(batchMul(x, x), batchMul(y, y)), batchMul(z, z));
+        BatchVec inv = fast ? batchRsqrt(xxyyzz) : batchDiv(batchSplat(1.0f), batchSqrt(xxyyzz));
+        batchStoreXYZ<aligned>(out + i*3, batchMul(x, inv), batchMul(y, inv), batchMul(z, inv));
+    }
+    return i;
+}
+#endif // MATH_BATCH_SIMD
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transforms
+///////////////////////////////////////////////////////////////////////////////
+template <BatchTransform mode>
+inline void transformBatch(const Matrix4& m, const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+#ifdef MATH_BATCH_SIMD
+    if(batchAligned(in, out))
+        i = batchTransformAoS4<mode, true>(m, in, out, count);
+    else
+        i = batchTransformAoS4<mode, false>(m, in, out, count);
+#endif
+    for(; i < count; ++i)
+    {
+        float x = in[i*3], y = in[i*3 + 1], z = in[i*3 + 2];
+        batchTransformScalar<mode>(m, x, y, z);
+        out[i*3] = x;  out[i*3 + 1] = y;  out[i*3 + 2] = z;
+    }
+}
+
+template <BatchTransform mode>
+inline void transformBatch(const Matrix4& m, const float* x, const float* y, const float* z,
+                           float* ox, float* oy, float* oz, size_t count)
+{
+    size_t i = 0;
+#ifdef MATH_BATCH_SIMD
+    if(batchAligned(x, y, z, ox, oy, oz))
+        i = batchTransformSoA4<mode, true>(m, x, y, z, ox, oy, oz, count);
+    else
+        i = batchTransformSoA4<mode, false>(m, x, y, z, ox, oy, oz, count);
+#endif
+    for(; i < count; ++i)
+    {
+        float px = x[i], py = y[i], pz = z[i];
+        batchTransformScalar<mode>(m, px, py, pz);
+        ox[i] = px;  oy[i] = py;  oz[i] = pz;
+    }
+}
+
+// AoS, out[i] = M * (in[i], 1)
+inline void transformPoints(const Matrix4& m, const float* in, float* out, size_t count)
+{
+    transformBatch<BatchPoint>(m, in, out, count);
+}
+
+// AoS, out[i] = M * (in[i], 0)
+inline void transformDirections(const Matrix4& m, const float* in, float* out, size_t count)
+{
+    transformBatch<BatchDirection>(m, in, out, count);
+}
+
+// AoS, out[i] = (M * (in[i], 1)).xyz / w, e.g. to NDC with a projection matrix
+inline void projectPoints(const Matrix4& m, const float* in, float* out, size_t count)
+{
+    transformBatch<BatchProject>(m, in, out, count);
+}
+
+inline void transformPoints(const Matrix4& m, const float* x, const float* y, const float* z,
+                            float* ox, float* oy, float* oz, size_t count)
+{
+    transformBatch<BatchPoint>(m, x, y, z, ox, oy, oz, count);
+}
+
+inline void transformDirections(const Matrix4& m, const float* x, const float* y, const float* z,
+                                float* ox, float* oy, float* oz, size_t count)
+{
+    transformBatch<BatchDirection>(m, x, y, z, ox, oy, oz, count);
+}
+
+inline void projectPoints(const Matrix4& m, const float* x, const float* y, const float* z,
+                          float* ox, float* oy, float* oz, size_t count)
+{
+    transformBatch<BatchProject>(m, x, y, z, ox, oy, oz, count);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// normalize, e.g. normals after welding or a non-uniform scale
+///////////////////////////////////////////////////////////////////////////////
+template <bool fast>
+inline void normalizeBatch(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+#ifdef MATH_BATCH_SIMD
+    if(batchAligned(in, out))
+        i = batchNormalizeAoS4<fast, true>(in, out, count);
+    else
+        i = batchNormalizeAoS4<fast, false>(in, out, count);
+#endif
+    for(; i < count; ++i)
+    {
+        Vector3 v(in[i*3], in[i*3 + 1], in[i*3 + 2]);
+        if(fast)
+            v.fastNormalize();
+        else
+            v.normalize();
+        out[i*3] = v.x;  out[i*3 + 1] = v.y;  out[i*3 + 2] = v.z;
+    }
+}
+
+// AoS, out[i] = in[i] / |in[i]|, same results as Vector3::normalize()
+inline void normalizeVectors(const float* in, float* out, size_t count)
+{
+    normalizeBatch<false>(in, out, count);
+}
+
+// AoS, as Vector3::fastNormalize(), within the error bound of fastInvSqrt()
+inline void fastNormalizeVectors(const float* in, float* out, size_t count)
+{
+    normalizeBatch<true>(in, out, count);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// axis aligned bounds, return false (lo / hi untouched) if count is 0
+///////////////////////////////////////////////////////////////////////////////
+inline bool computeBounds(const float* in, size_t count, Vector3& lo, Vector3& hi)
+{
+    if(count == 0)
+        return false;
+    size_t i = 0;
+    Vector3 l(in[0], in[1], in[2]), h = l;
+#ifdef MATH_BATCH_SIMD
+    i = batchAligned(in) ? batchBoundsAoS4<true>(NULL, in, count, l, h)
+                         : batchBoundsAoS4<false>(NULL, in, count, l, h);
+#endif
+    for(; i < count; ++i)
+        batchBoundsScalar(in[i*3], in[i*3 + 1], in[i*3 + 2], l, h);
+    lo = l;  hi = h;
+    return true;
+}
+
+inline bool computeBounds(const float* x, const float* y, const float* z, size_t count, Vector3& lo, Vector3& hi)
+{
+    if(count == 0)
+        return false;
+    size_t i = 0;
+    Vector3 l(x[0], y[0], z[0]), h = l;
+#ifdef MATH_BATCH_SIMD
+    i = batchAligned(x, y, z) ? batchBoundsSoA4<true>(x, y, z, count, l, h)
+                              : batchBoundsSoA4<false>(x, y, z, count, l, h);
+#endif
+    for(; i < count; ++i)
+        batchBoundsScalar(x[i], y[i], z[i], l, h);
+    lo = l;  hi = h;
+    return true;
+}
+
+// bounds of M * (in[i], 1) without writing the transformed points
+inline bool computeTransformedBounds(const Matrix4& m, const float* in, size_t count, Vector3& lo, Vector3& hi)
+{
+    if(count == 0)
+        return false;
+    size_t i = 0;
+    float x = in[0], y = in[1], z = in[2];
+    batchTransformScalar<BatchPoint>(m, x, y, z);
+    Vector3 l(x, y, z), h = l;
+#ifdef MATH_BATCH_SIMD
+    i = batchAligned(in) ? batchBoundsAoS4<true>(&m, in, count, l, h)
+                         : batchBoundsAoS4<false>(&m, in, count, l, h);
+#endif
+    for(; i < count; ++i)
+    {
+        x = in[i*3];  y = in[i*3 + 1];  z = in[i*3 + 2];
+        batchTransformScalar<BatchPoint>(m, x, y, z);
+        batchBoundsScalar(x, y, z, l, h);
+    }
+    lo = l;  hi = h;
+    return true;
+}
+
+#endif
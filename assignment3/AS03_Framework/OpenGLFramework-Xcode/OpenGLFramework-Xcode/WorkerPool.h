@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// WorkerPool.h
+// ============
+// Persistent worker threads for the CPU renderers.
+//
+// run(count, fn) calls fn(job, thread) once for every job in [0, count) and
+// returns when all of them are done. The caller takes part as thread 0 and
+// the workers are 1 .. threadCount() - 1, so per thread scratch can be
+// indexed by thread. Jobs are handed out through an atomic counter, in
+// order but not necessarily finished in order; run() must not be called
+// from inside a job.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef WORKER_POOL_H_DEF
+#define WORKER_POOL_H_DEF
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+class WorkerPool
+{
+public:
+	// threads = 0 uses every hardware thread; the caller is one of them
+	explicit WorkerPool(int threads = 0) : stopping(false), generation(0), pending(0), task(NULL), task_count(0)
+	{
+		if (threads <= 0)
+			threads = (int)std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 1; i < threads; i++)
+			workers.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers)
+			t.join();
+	}
+
+	int threadCount() const { return (int)workers.size() + 1; }
+
+	// run fn(job, thread) for job in [0, count) on the caller and the workers
+	void run(size_t count, const std::function<void(size_t, int)>& fn)
+	{
+		if (workers.empty() || count <= 1)
+		{
+			for (size_t i = 0; i < count; i++)
+				fn(i, 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = &fn;
+			task_count = count;
+			next_job = 0;
+			pending = (int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+		work(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+		task = NULL;
+	}
+
+private:
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+
+	void work(int thread)
+	{
+		size_t job;
+		while ((job = next_job.fetch_add(1)) < task_count)
+			(*task)(job, thread);
+	}
+
+	void workerLoop(int thread)
+	{
+		unsigned int seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			work(thread);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0)
+				done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	bool stopping;
+	unsigned int generation;
+	int pending;
+	const std::function<void(size_t, int)>* task;
+	size_t task_count;
+	std::atomic<size_t> next_job;
+};
+
+#endif
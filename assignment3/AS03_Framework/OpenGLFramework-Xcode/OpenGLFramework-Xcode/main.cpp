@@ -12,8 +12,21 @@
 
 #include "Vectors.h"
 #include "Matrices.h"
+#include "TransformBatch.h"
+#include "Frustum.h"
+#include "MatrixN.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "FrameCapture.h"
+#include "InputRecord.h"
+#include "Logger.h"
+#include "Benchmark.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplify.h"
+#include "SoftRasterizer.h"
+#include "Bvh.h"
+#include "Scene.h"
+#include "RenderQueue.h"
 
 #ifndef max
 # define max(a,b) (((a)>(b))?(a):(b))
@@ -31,6 +44,7 @@ int screenWidth = WINDOW_WIDTH, screenHeight = WINDOW_HEIGHT;
 bool mouse_pressed = false;
 int starting_press_x = -1;
 int starting_press_y = -1;
+double cursor_x = 0, cursor_y = 0;	// last cursor_pos_callback() position, also during replay
 
 enum TransMode
 {
@@ -54,39 +68,127 @@ typedef struct
 	Vector3 Ks;
 
 	GLuint diffuseTexture;
+	int diffuseImage;	// in texture_images, -1 if the image did not load
+	int id;	// over the materials of all models, for the render queue keys
 } PhongMaterial;
 
 typedef struct
 {
-	GLuint vao;
-	GLuint vbo;
-	GLuint vboTex;
-	GLuint ebo;
-	GLuint p_color;
+	GLint base_vertex;	// of the vertices in geometry_arena
+	GLuint first_index;	// of the indices in geometry_arena, lods[] are relative to it
 	int vertex_count;
-	GLuint p_normal;
-	GLuint p_texCoord;
+	int material_id;	// in the .mtl of the model, shapes of one id share all draw state
 	PhongMaterial material;
 	int indexCount;
+	Vector3 bound_center, bound_extent;	// model space box of the vertices
+	vector<MeshLod> lods;	// index ranges of the ebo, full resolution first
+	vector<GLfloat> vertices;	// SOFT_VERTEX_STRIDE floats per vertex, as the vbos hold them
+	vector<GLuint> indices;	// as the ebo holds them
 } Shape;
 
+// every rebuilt matrix gets a fresh version, so a version identifies its content
+unsigned int matrix_version_counter = 0;
+
+// a matrix cached together with the inputs it was built from
+struct transform_cache
+{
+	Vector3 position, scale;
+	Quaternion orientation;
+	Matrix4 matrix;
+	unsigned int version = 0;	// 0 = never built
+};
+
 struct model
 {
 	Vector3 position = Vector3(0, 0, 0);
 	Vector3 scale = Vector3(1, 1, 1);
-	Vector3 rotation = Vector3(0, 0, 0);	// Euler form
+	Vector3 rotation = Vector3(0, 0, 0);	// Euler form, as the R mode edits it
+	Quaternion orientation;	// model to world rotation of the Euler angles, kept by setModelRotation()
 
 	vector<Shape> shapes;
+
+	transform_cache world;	// T * R * S of the fields above
+	unsigned int mvp_versions[3] = { 0, 0, 0 };	// world, view, projection versions mvp was built from
+	Matrix4 mvp;
+
+	// shape boxes as SoA centers / half extents for cullBoxes(), filled at load
+	vector<float> bound_cx, bound_cy, bound_cz, bound_ex, bound_ey, bound_ez;
+	vector<unsigned char> shape_visible;
+	vector<int> visible_shapes;	// indices of the shapes RenderScene draws
+	vector<int> material_order;	// shape indices by material_id, RenderSceneInstanced() sets a run of one id once
+	int drawn_triangles = 0;	// over the selected LODs, logged when it changes
+	unsigned int cull_versions[3] = { 0, 0, 0 };	// mvp versions the shapes were culled against
+
+	Bvh bvh;	// full resolution shapes in model space, built by modelBvh() on first use
 };
 vector<model> models;
+int loaded_material_count = 0;	// PhongMaterial ids are handed out in load order
+
+// the vertices and indices of every shape of every model in one buffer each,
+// so a frame binds one vao; the vertices are SOFT_VERTEX_STRIDE floats interleaved
+struct geometry_buffer
+{
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint ebo = 0;
+	size_t vertex_count = 0;
+	size_t index_count = 0;
+};
+geometry_buffer geometry_arena;
+
+// per multi-draw, refilled for every run of equal state
+vector<GLsizei> multi_draw_counts;
+vector<const void*> multi_draw_offsets;
+vector<GLint> multi_draw_base_vertices;
+
+// draws of the frame, RenderScene() queues them and FlushRenderQueue() sorts
+// them by state; the key fields are the pass, the texture image + 1, the
+// material id, the vao (only the arena for now) and the depth
+const uint32_t RENDER_QUEUE_ARENA_VAO = 1;
+struct queued_draw
+{
+	const Shape* shape;
+	GLsizei count;
+	const void* offset;	// in the geometry_arena ebo
+	GLint base_vertex;
+};
+struct render_pass
+{
+	int x, y, width, height;	// glViewport()
+	int per_vertex_or_per_pixel;
+};
+struct render_queue_stats
+{
+	int draws;
+	int submitted_changes, sorted_changes;
+	int multi_draws;
+};
+RenderQueue render_queue;
+vector<queued_draw> queued_draws;
+vector<render_pass> render_passes;
+render_queue_stats render_queue_logged = { 0, 0, 0, 0 };	// logged when a frame differs
+
+// mip chains of every loaded texture image, sampled by the software backend
+vector<SoftTexture> texture_images;
+
+// false when --soft renders on the CPU, the loader then creates no GL objects
+bool gl_backend = true;
 
 struct camera
 {
+	// the gluLookAt() vectors the view modes edit
 	Vector3 position;
 	Vector3 center;
 	Vector3 up_vector;
+	Quaternion orientation;	// camera to world rotation of the three, kept by setViewingMatrix(); the camera looks down its -z axis
 };
 camera main_camera;
+// default camera, its view matrix is folded at compile time
+constexpr camera DEFAULT_CAMERA = { Vector3(0.0f, 0.0f, 2.0f), Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f), Quaternion() };
+constexpr Matrix4 DEFAULT_VIEW_MATRIX = makeView(DEFAULT_CAMERA.position, DEFAULT_CAMERA.orientation);
+static_assert(DEFAULT_VIEW_MATRIX[11] == -2.0f, "default camera sits 2 units in front of the origin");
+unsigned int view_version = 0;
+unsigned int project_version = 0;
 
 struct project_setting
 {
@@ -129,61 +231,90 @@ struct light_attribute{
 };
 light_attribute lightAtt;
 
+// light uniforms as setShaders() sets them, lightAtt starts from these
+const PhongLights DEFAULT_LIGHTS = {
+	{ Vector3(1, 1, 1), Vector3(-1, -1, -1), Vector3(1, 1, 1), Vector3(0.15f, 0.15f, 0.15f) },
+	{ Vector3(0, 2, 1), 0.01f, 0.8f, 0.1f, Vector3(1, 1, 1), Vector3(0.15f, 0.15f, 0.15f) },
+	{ Vector3(0, 0, 2), Vector3(0, 0, -1), 50.0f, 30.0f, 0.05f, 0.3f, 0.6f, Vector3(1, 1, 1), Vector3(0.15f, 0.15f, 0.15f) },
+	PhongDirectional
+};
+
+constexpr Vector3 CLEAR_COLOR = Vector3(0.2f, 0.2f, 0.2f);
+
 // uniforms location
 GLuint iLocP;
 GLuint iLocV;
 GLuint iLocM;
 GLuint iLocTex;
+GLuint iLocInstanced;
+
+// versions of the matrices currently held by um4m / um4v / um4p
+unsigned int uploaded_model_version = 0;
+unsigned int uploaded_view_version = 0;
+unsigned int uploaded_project_version = 0;
 
 bool mag_mode = true;
 bool min_mode = true;
 bool coor_addr = true;
 
+// turntable capture: one full turn of the current model around y
+const int TURNTABLE_FRAMES = 360;
+FrameCapture frame_capture;
+int turntable_frames_left = 0;
+
+// --soft renders a turntable of this many frames per model by default
+const int SOFT_TURNTABLE_FRAMES = 60;
+
+// input recording / fixed timestep replay
+const double REPLAY_TIMESTEP = 1.0 / 60.0;
+InputRecorder input_recorder;
+InputReplayer input_replayer;
+
+// camera state prints are throttled to this interval while dragging
+const int CAMERA_LOG_INTERVAL_MS = 50;
+
+// a coarser LOD is drawn while its simplification error stays below this many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+// false draws every shape at full resolution, like the ray tracer (--raytrace)
+bool lod_selection = true;
+
+// time spent inside cursor_pos_callback, summarized every CURSOR_LATENCY_WINDOW events
+const int CURSOR_LATENCY_WINDOW = 1000;
+struct callback_latency {
+	int count;
+	uint64_t total_us;
+	uint64_t max_us;
+};
+callback_latency cursor_latency = { 0, 0, 0 };
+
+// --scene / N: instances of every loaded model, drawn with glDrawElementsInstanced()
+const int SCENE_DEFAULT_INSTANCES = 10000;
+const float SCENE_SPACING = 2.5f;	// between grid cells, the models fit in [-1, 1]
+const unsigned int SCENE_SEED = 12345;	// of the scatter placement
+const int SCENE_REPORT_FRAMES = 300;	// frame time is summarized over this many frames
+vector<SceneInstance> scene_instances;
+SceneBatcher scene_batcher;
+bool scene_mode = false;	// RenderSceneInstanced() instead of RenderScene()
+GLuint scene_vbo = 0;	// matrices of the last scene_batcher.build()
+unsigned int scene_versions[2] = { 0, 0 };	// view, projection versions the batches were built for
+int scene_height = 0;	// viewport height the LOD levels were picked for
+int scene_drawn_triangles = 0;
+struct frame_timing {
+	int count;
+	double total_ms;
+	double max_ms;
+};
+frame_timing scene_frame_time = { 0, 0, 0 };
 
-static GLvoid Normalize(GLfloat v[3])
-{
-	GLfloat l;
-
-	l = (GLfloat)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
-	v[0] /= l;
-	v[1] /= l;
-	v[2] /= l;
-}
 
-static GLvoid Cross(GLfloat u[3], GLfloat v[3], GLfloat n[3])
+constexpr Matrix4 translate(Vector3 vec)
 {
-
-	n[0] = u[1] * v[2] - u[2] * v[1];
-	n[1] = u[2] * v[0] - u[0] * v[2];
-	n[2] = u[0] * v[1] - u[1] * v[0];
+	return makeTranslation(vec);
 }
 
-Matrix4 translate(Vector3 vec)
+constexpr Matrix4 scaling(Vector3 vec)
 {
-	Matrix4 mat;
-
-	mat = Matrix4(
-		1.0f, 0.0f, 0.0f, vec.x,
-		0.0f, 1.0f, 0.0f, vec.y,
-		0.0f, 0.0f, 1.0f, vec.z,
-		0.0f, 0.0f, 0.0f, 1.0f
-	);
-
-	return mat;
-}
-
-Matrix4 scaling(Vector3 vec)
-{
-	Matrix4 mat;
-
-	mat = Matrix4(
-		vec.x, 0.0f, 0.0f, 0.0f,
-		0.0f, vec.y, 0.0f, 0.0f,
-		0.0f, 0.0f, vec.z, 0.0f,
-		0.0f, 0.0f, 0.0f, 1.0f
-	);
-
-	return mat;
+	return makeScale(vec);
 }
 
 Matrix4 rotateX(GLfloat val)
@@ -233,82 +364,100 @@ Matrix4 rotate(Vector3 vec)
 	return rotateX(vec.x)*rotateY(vec.y)*rotateZ(vec.z);
 }
 
+// rotation of the gluLookAt() basis, the up vector is made orthogonal to the viewing direction
+Quaternion lookAtOrientation(const Vector3& eye, const Vector3& center, const Vector3& up)
+{
+	Vector3 back = eye - center;
+	back /= back.length();
+	Vector3 right = up.cross(back).normalize();
+	return Quaternion::fromBasis(right, back.cross(right), back);
+}
+
 void setViewingMatrix()
 {
-	float F[3] = { main_camera.position.x - main_camera.center.x, main_camera.position.y - main_camera.center.y, main_camera.position.z - main_camera.center.z };
-	float U[3] = { main_camera.up_vector.x, main_camera.up_vector.y, main_camera.up_vector.z };
-	float R[3];
-	Normalize(F);
-	Cross(U, F, R);
-	Normalize(R);
-	Cross(F, R, U);
-	Normalize(U);
-
-	view_matrix[0] = R[0];
-	view_matrix[1] = R[1];
-	view_matrix[2] = R[2];
-	view_matrix[3] = 0;
-	view_matrix[4] = U[0];
-	view_matrix[5] = U[1];
-	view_matrix[6] = U[2];
-	view_matrix[7] = 0;
-	view_matrix[8] = F[0];
-	view_matrix[9] = F[1];
-	view_matrix[10] = F[2];
-	view_matrix[11] = 0;
-	view_matrix[12] = 0;
-	view_matrix[13] = 0;
-	view_matrix[14] = 0;
-	view_matrix[15] = 1;
-
-	view_matrix = view_matrix * translate(-main_camera.position);
+	main_camera.orientation = lookAtOrientation(main_camera.position, main_camera.center, main_camera.up_vector);
+	view_matrix = makeView(main_camera.position, main_camera.orientation);
+	view_version = ++matrix_version_counter;
+}
+
+// the Euler angles of a model and the quaternion its matrix is composed from
+void setModelRotation(model& m, const Vector3& rotation)
+{
+	m.rotation = rotation;
+	m.orientation = Quaternion::fromEuler(rotation);
+}
+
+// add to the Euler angles of a model
+void rotateModel(model& m, const Vector3& angles)
+{
+	setModelRotation(m, m.rotation + angles);
 }
 
 void setOrthogonal()
 {
 	cur_proj_mode = Orthogonal;
 	// handle side by side view
-	float right = proj.right / 2;
-	float left = proj.left / 2;
-	project_matrix[0] = 2 / (right - left);
-	project_matrix[1] = 0;
-	project_matrix[2] = 0;
-	project_matrix[3] = -(right + left) / (right - left);
-	project_matrix[4] = 0;
-	project_matrix[5] = 2 / (proj.top - proj.bottom);
-	project_matrix[6] = 0;
-	project_matrix[7] = -(proj.top + proj.bottom) / (proj.top - proj.bottom);
-	project_matrix[8] = 0;
-	project_matrix[9] = 0;
-	project_matrix[10] = -2 / (proj.farClip - proj.nearClip);
-	project_matrix[11] = -(proj.farClip + proj.nearClip) / (proj.farClip - proj.nearClip);
-	project_matrix[12] = 0;
-	project_matrix[13] = 0;
-	project_matrix[14] = 0;
-	project_matrix[15] = 1;
+	project_matrix = makeOrthographic(proj.left / 2, proj.right / 2, proj.bottom, proj.top, proj.nearClip, proj.farClip);
+	project_version = ++matrix_version_counter;
 }
 
 void setPerspective()
 {
-	const float tanHalfFOV = tanf((proj.fovy / 2.0) / 180.0 * acosf(-1.0));
-	
 	cur_proj_mode = Perspective;
-	project_matrix[0] = 1.0f / (tanHalfFOV * proj.aspect);
-	project_matrix[1] = 0;
-	project_matrix[2] = 0;
-	project_matrix[3] = 0;
-	project_matrix[4] = 0;
-	project_matrix[5] = 1.0f / tanHalfFOV;
-	project_matrix[6] = 0;
-	project_matrix[7] = 0;
-	project_matrix[8] = 0;
-	project_matrix[9] = 0;
-	project_matrix[10] = -(proj.farClip + proj.nearClip) / (proj.farClip - proj.nearClip);
-	project_matrix[11] = -(2 * proj.farClip * proj.nearClip) / (proj.farClip - proj.nearClip);
-	project_matrix[12] = 0;
-	project_matrix[13] = 0;
-	project_matrix[14] = -1;
-	project_matrix[15] = 0;
+	project_matrix = makePerspective(proj.fovy, proj.aspect, proj.nearClip, proj.farClip);
+	project_version = ++matrix_version_counter;
+}
+
+// rebuild the model matrix only when position / rotation / scale changed
+const Matrix4& modelMatrix(model& m)
+{
+	transform_cache& world = m.world;
+	if (world.version == 0 || world.position != m.position || world.orientation != m.orientation || world.scale != m.scale) {
+		world.position = m.position;
+		world.orientation = m.orientation;
+		world.scale = m.scale;
+		world.matrix = composeTRS(m.position, m.orientation, m.scale);
+		world.version = ++matrix_version_counter;
+	}
+	return world.matrix;
+}
+
+// project * view * model, rebuilt only when one of the three changed
+const Matrix4& modelViewProjection(model& m)
+{
+	modelMatrix(m);
+	if (m.mvp_versions[0] != m.world.version || m.mvp_versions[1] != view_version || m.mvp_versions[2] != project_version) {
+		m.mvp = project_matrix * view_matrix * m.world.matrix;
+		m.mvp_versions[0] = m.world.version;
+		m.mvp_versions[1] = view_version;
+		m.mvp_versions[2] = project_version;
+	}
+	return m.mvp;
+}
+
+// shapes of the model inside the view frustum, culled again only when mvp changed
+const vector<int>& visibleShapes(model& m)
+{
+	const Matrix4& mvp = modelViewProjection(m);
+	if (memcmp(m.cull_versions, m.mvp_versions, sizeof(m.cull_versions)) != 0) {
+		size_t count = m.shapes.size();
+		size_t last_visible = m.visible_shapes.size();
+		m.shape_visible.resize(count);
+		m.visible_shapes.clear();
+		if (count > 0) {
+			// boxes are in model space, so the planes come from the full mvp
+			cullBoxes(extractFrustum(mvp), &m.bound_cx[0], &m.bound_cy[0], &m.bound_cz[0],
+				&m.bound_ex[0], &m.bound_ey[0], &m.bound_ez[0], count, &m.shape_visible[0]);
+		}
+		for (size_t i = 0; i < count; i++) {
+			if (m.shape_visible[i])
+				m.visible_shapes.push_back((int)i);
+		}
+		memcpy(m.cull_versions, m.mvp_versions, sizeof(m.cull_versions));
+		if (m.visible_shapes.size() != last_visible)
+			LOG(LogInfo, "Frustum culling: %d of %d shapes visible", (int)m.visible_shapes.size(), (int)count);
+	}
+	return m.visible_shapes;
 }
 
 // Call back function for window reshape
@@ -320,6 +469,12 @@ void ChangeSize(GLFWwindow* window, int width, int height)
 		setPerspective();
 	}
 
+	// the PBO ring is sized for the old framebuffer
+	if (frame_capture.isActive() && (width != screenWidth || height != screenHeight)) {
+		frame_capture.stop();
+		turntable_frames_left = 0;
+	}
+
 	screenWidth = width;
 	screenHeight = height;
 }
@@ -364,37 +519,571 @@ void textureMode() {
 	}
 }
 
-// Render function for display rendering
-void RenderScene(int per_vertex_or_per_pixel) {	
-	Vector3 modelPos = models[cur_idx].position;
+// coarsest level of the shape whose error projects to at most LOD_PIXEL_ERROR
+// pixels, from the depth of the shape's box center
+int selectLod(const Shape& shape, const Matrix4& mvp, float max_scale)
+{
+	const Vector3& c = shape.bound_center;
+	float w = mvp[12] * c.x + mvp[13] * c.y + mvp[14] * c.z + mvp[15];
+	if (w <= 0.0f || !lod_selection)
+		return 0;
+	float pixels_per_unit = max_scale * fabsf(project_matrix[5]) / w * screenHeight * 0.5f;
+	size_t level = 0;
+	while (level + 1 < shape.lods.size() && shape.lods[level + 1].error * pixels_per_unit <= LOD_PIXEL_ERROR)
+		level++;
+	return (int)level;
+}
+
+// view / projection uniforms, uploaded only when their version changed
+void uploadCameraMatrices()
+{
+	if (uploaded_view_version != view_version) {
+		glUniformMatrix4fv(iLocV, 1, GL_FALSE, view_matrix.getTranspose());
+		uploaded_view_version = view_version;
+	}
+	if (uploaded_project_version != project_version) {
+		glUniformMatrix4fv(iLocP, 1, GL_FALSE, project_matrix.getTranspose());
+		uploaded_project_version = project_version;
+	}
+}
+
+// [TODO] Bind texture and modify texture filtering & wrapping mode
+// Hint: glActiveTexture, glBindTexture, glTexParameteri
+void bindShapeTexture(const Shape& shape)
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, shape.material.diffuseTexture);
+	textureMode();
+}
+
+void setMaterialUniforms(const Shape& shape)
+{
+	setVector3("material.ambient", shape.material.Ka);
+	setVector3("material.diffuse", shape.material.Kd);
+	setVector3("material.specular", shape.material.Ks);
+	setfloat("material.shininess", lightAtt.shininess);
+}
 
-	Matrix4 T, R, S;
-	T = translate(models[cur_idx].position);
-	R = rotate(models[cur_idx].rotation);
-	S = scaling(models[cur_idx].scale);
+// texture and material uniforms of a shape
+void bindShapeMaterial(const Shape& shape)
+{
+	bindShapeTexture(shape);
+	setMaterialUniforms(shape);
+}
 
-	// render object
-	Matrix4 model_matrix = T * R * S;
-	glUniformMatrix4fv(iLocM, 1, GL_FALSE, model_matrix.getTranspose());
-	glUniformMatrix4fv(iLocV, 1, GL_FALSE, view_matrix.getTranspose());
-	glUniformMatrix4fv(iLocP, 1, GL_FALSE, project_matrix.getTranspose());
+// Render function for display rendering: queues the current model for one
+// viewport, FlushRenderQueue() draws the queued viewports together
+void RenderScene(int per_vertex_or_per_pixel, int x, int y, int width, int height) {	
+	// render object, matrices are only rebuilt / uploaded when their version changed
+	model& cur_model = models[cur_idx];
+	modelMatrix(cur_model);
+	if (uploaded_model_version != cur_model.world.version) {
+		glUniformMatrix4fv(iLocM, 1, GL_FALSE, cur_model.world.matrix.getTranspose());
+		uploaded_model_version = cur_model.world.version;
+	}
+	uploadCameraMatrices();
 	
+	// both viewports share the matrices, the second one reuses the culled set
+	const vector<int>& visible = visibleShapes(cur_model);
+	if (visible.empty())
+		return;
+
+	// the pass is the program field of the key: the shader path with its viewport
+	render_pass pass = { x, y, width, height, per_vertex_or_per_pixel };
+	uint32_t pass_index = (uint32_t)render_passes.size();
+	render_passes.push_back(pass);
+
+	// model units to pixels at the model center: P[5] / w scales y to NDC
+	const Matrix4& mvp = modelViewProjection(cur_model);
+	float max_scale = max(fabsf(cur_model.scale.x), max(fabsf(cur_model.scale.y), fabsf(cur_model.scale.z)));
+	int drawn_triangles = 0;
+
+	for (size_t v = 0; v < visible.size(); v++)
+	{
+		const Shape& shape = cur_model.shapes[visible[v]];
+		const MeshLod& lod = shape.lods[selectLod(shape, mvp, max_scale)];
+		queued_draw draw = { &shape, (GLsizei)lod.count, (void*)((shape.first_index + lod.first) * sizeof(GLuint)), shape.base_vertex };
+		drawn_triangles += (int)lod.count / 3;
+
+		// front to back within equal state, by the clip w of the box center
+		const Vector3& c = shape.bound_center;
+		float w = mvp[12] * c.x + mvp[13] * c.y + mvp[14] * c.z + mvp[15];
+		uint64_t key = makeRenderKey(pass_index, (uint32_t)(shape.material.diffuseImage + 1), (uint32_t)shape.material.id,
+			RENDER_QUEUE_ARENA_VAO, w / proj.farClip);
+		render_queue.push(key, (uint32_t)queued_draws.size());
+		queued_draws.push_back(draw);
+	}
+	if (drawn_triangles != cur_model.drawn_triangles) {
+		LOG(LogInfo, "LOD: %d triangles drawn", drawn_triangles);
+		cur_model.drawn_triangles = drawn_triangles;
+	}
+}
+
+// sort the queued draws by state and issue them, setting only the states that
+// differ from the previous draw; draws of equal state go out as one multi-draw
+void FlushRenderQueue()
+{
+	render_queue.sort();
+	const vector<RenderItem>& items = render_queue.items();
+	int draw_calls = 0;
+	auto flush = [&]() {
+		if (multi_draw_counts.empty())
+			return;
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &multi_draw_counts[0], GL_UNSIGNED_INT, &multi_draw_offsets[0],
+			(GLsizei)multi_draw_counts.size(), &multi_draw_base_vertices[0]);
+		multi_draw_counts.clear();
+		multi_draw_offsets.clear();
+		multi_draw_base_vertices.clear();
+		draw_calls++;
+	};
+
+	for (size_t i = 0; i < items.size(); i++) {
+		const queued_draw& draw = queued_draws[items[i].draw];
+		// every state is set for the first draw, nothing is assumed across frames
+		uint64_t changed = i == 0 ? ~0ull : items[i].key ^ items[i - 1].key;
+		if (changed & RENDER_KEY_STATE_MASK) {
+			flush();
+			if (changed & RENDER_KEY_MASK[RenderKeyProgram]) {
+				const render_pass& pass = render_passes[renderKeyField(items[i].key, RenderKeyProgram)];
+				glViewport(pass.x, pass.y, pass.width, pass.height);
+				glUniform1i(glGetUniformLocation(program, "per_vertex_or_per_pixel"), pass.per_vertex_or_per_pixel);
+			}
+			if (changed & RENDER_KEY_MASK[RenderKeyTexture])
+				bindShapeTexture(*draw.shape);
+			if (changed & RENDER_KEY_MASK[RenderKeyMaterial])
+				setMaterialUniforms(*draw.shape);
+			if (changed & RENDER_KEY_MASK[RenderKeyVao])
+				glBindVertexArray(geometry_arena.vao);
+		}
+		multi_draw_counts.push_back(draw.count);
+		multi_draw_offsets.push_back(draw.offset);
+		multi_draw_base_vertices.push_back(draw.base_vertex);
+	}
+	flush();
+
+	// the submission order is the shape order of every viewport, as RenderScene() used to draw
+	render_queue_stats stats = { (int)items.size(), (int)render_queue.submittedStateChanges(), (int)render_queue.stateChanges(), draw_calls };
+	if (memcmp(&stats, &render_queue_logged, sizeof(stats)) != 0) {
+		LOG(LogInfo, "Render queue: %d draws, %d state changes in submission order, %d sorted, %d multi-draws",
+			stats.draws, stats.submitted_changes, stats.sorted_changes, stats.multi_draws);
+		render_queue_logged = stats;
+	}
+	render_queue.clear();
+	queued_draws.clear();
+	render_passes.clear();
+}
+
+// instance matrices of the scene, culled and sorted again only when the camera
+// or the viewport height changed; the model transforms do not apply
+void RenderSceneInstanced(int per_vertex_or_per_pixel)
+{
+	uploadCameraMatrices();
+	glBindBuffer(GL_ARRAY_BUFFER, scene_vbo);
+	if (scene_versions[0] != view_version || scene_versions[1] != project_version || scene_height != screenHeight) {
+		scene_batcher.build(project_matrix * view_matrix, fabsf(project_matrix[5]) * screenHeight * 0.5f, LOD_PIXEL_ERROR);
+		const vector<float>& matrices = scene_batcher.matrices();
+		// orphan the old storage, the previous frame may still read it
+		glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(float), matrices.empty() ? NULL : &matrices[0], GL_STREAM_DRAW);
+		scene_versions[0] = view_version;
+		scene_versions[1] = project_version;
+		scene_height = screenHeight;
+
+		int drawn_triangles = 0;
+		for (const SceneBatch& batch : scene_batcher.batches()) {
+			for (const Shape& shape : models[batch.model].shapes)
+				drawn_triangles += (int)shape.lods[min(batch.level, (int)shape.lods.size() - 1)].count / 3 * (int)batch.count;
+		}
+		if (drawn_triangles != scene_drawn_triangles) {
+			LOG(LogInfo, "Scene: %d of %d instances visible in %d batches, %d triangles drawn", (int)scene_batcher.visibleCount(),
+				(int)scene_batcher.instanceCount(), (int)scene_batcher.batches().size(), drawn_triangles);
+			scene_drawn_triangles = drawn_triangles;
+		}
+	}
+
 	glUniform1i(glGetUniformLocation(program, "per_vertex_or_per_pixel"), per_vertex_or_per_pixel);
-	for (int i = 0; i < models[cur_idx].shapes.size(); i++) 
+	glUniform1i(iLocInstanced, 1);
+	glBindVertexArray(geometry_arena.vao);
+	for (int row = 0; row < 3; row++)
+		glEnableVertexAttribArray(4 + row);
+	// the batches of a model are adjacent: the material changes once per run of
+	// its shapes, and every shape draws each level, pointing the instance rows
+	// at the batch, as GL 3.3 has no base instance
+	const vector<SceneBatch>& batches = scene_batcher.batches();
+	const GLsizei row_stride = SCENE_INSTANCE_FLOATS * sizeof(float);
+	for (size_t b = 0; b < batches.size(); ) {
+		size_t end = b + 1;
+		while (end < batches.size() && batches[end].model == batches[b].model)
+			end++;
+		const model& m = models[batches[b].model];
+		int material_id = -1;
+		for (int s : m.material_order) {
+			const Shape& shape = m.shapes[s];
+			if (shape.material_id != material_id) {
+				bindShapeMaterial(shape);
+				material_id = shape.material_id;
+			}
+			for (size_t k = b; k < end; k++) {
+				const SceneBatch& batch = batches[k];
+				for (int row = 0; row < 3; row++)
+					glVertexAttribPointer(4 + row, 4, GL_FLOAT, GL_FALSE, row_stride, (void*)(((size_t)batch.first * SCENE_INSTANCE_FLOATS + row * 4) * sizeof(float)));
+				const MeshLod& lod = shape.lods[min(batch.level, (int)shape.lods.size() - 1)];
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)lod.count, GL_UNSIGNED_INT, (void*)((shape.first_index + lod.first) * sizeof(GLuint)),
+					(GLsizei)batch.count, shape.base_vertex);
+			}
+		}
+		b = end;
+	}
+	// RenderScene() draws the same vao without instances
+	for (int row = 0; row < 3; row++)
+		glDisableVertexAttribArray(4 + row);
+	glUniform1i(iLocInstanced, 0);
+}
+
+// frame times in scene mode, summarized every SCENE_REPORT_FRAMES frames
+void reportSceneFrame(double ms)
+{
+	scene_frame_time.count++;
+	scene_frame_time.total_ms += ms;
+	scene_frame_time.max_ms = max(scene_frame_time.max_ms, ms);
+	if (scene_frame_time.count == SCENE_REPORT_FRAMES) {
+		LOG(LogInfo, "Scene frame time: %d frames, avg %.3f ms, max %.3f ms, %d instances",
+			scene_frame_time.count, scene_frame_time.total_ms / scene_frame_time.count, scene_frame_time.max_ms, (int)scene_instances.size());
+		scene_frame_time.count = 0;
+		scene_frame_time.total_ms = 0;
+		scene_frame_time.max_ms = 0;
+	}
+}
+
+// box around all shapes and the largest error of each level, a shape with
+// fewer levels counts its coarsest one for the rest
+SceneModelInfo sceneModelInfo(const model& m)
+{
+	SceneModelInfo info;
+	info.lod_errors.assign(MESH_LOD_LEVELS, 0.0f);
+	if (m.shapes.empty())
+		return info;
+	Vector3 lo = m.shapes[0].bound_center - m.shapes[0].bound_extent;
+	Vector3 hi = m.shapes[0].bound_center + m.shapes[0].bound_extent;
+	for (const Shape& s : m.shapes) {
+		Vector3 shape_lo = s.bound_center - s.bound_extent, shape_hi = s.bound_center + s.bound_extent;
+		lo = Vector3(min(lo.x, shape_lo.x), min(lo.y, shape_lo.y), min(lo.z, shape_lo.z));
+		hi = Vector3(max(hi.x, shape_hi.x), max(hi.y, shape_hi.y), max(hi.z, shape_hi.z));
+		for (int l = 0; l < MESH_LOD_LEVELS; l++)
+			info.lod_errors[l] = max(info.lod_errors[l], s.lods[min(l, (int)s.lods.size() - 1)].error);
+	}
+	info.bound_center = (lo + hi) * 0.5f;
+	info.bound_extent = (hi - lo) * 0.5f;
+	return info;
+}
+
+// replace the scene by count instances on a grid, scattered, or the
+// instances of a scene file, and prepare the vaos to draw them
+bool createScene(const char* placement, int count)
+{
+	vector<SceneInstance> instances;
+	if (strcmp(placement, "grid") == 0) {
+		placeSceneGrid(instances, count, (int)models.size(), SCENE_SPACING);
+	}
+	else if (strcmp(placement, "scatter") == 0) {
+		placeSceneScatter(instances, count, (int)models.size(), SCENE_SPACING, SCENE_SEED);
+	}
+	else {
+		vector<string> names;
+		for (const string& path : model_list) {
+			string name = path.substr(path.find_last_of("/\\") + 1);
+			names.push_back(name.substr(0, name.find_last_of('.')));
+		}
+		if (!loadSceneFile(placement, names, instances))
+			return false;
+	}
+	scene_instances.swap(instances);
+
+	vector<SceneModelInfo> infos;
+	for (const model& m : models)
+		infos.push_back(sceneModelInfo(m));
+	scene_batcher.setInstances(scene_instances, infos);
+	scene_versions[0] = scene_versions[1] = 0;
+
+	if (scene_vbo == 0) {
+		glGenBuffers(1, &scene_vbo);
+		// one matrix row per instance attribute, the pointers are set per batch
+		glBindVertexArray(geometry_arena.vao);
+		for (int row = 0; row < 3; row++)
+			glVertexAttribDivisor(4 + row, 1);
+	}
+	LOG(LogInfo, "Scene: %d instances of %d models", (int)scene_instances.size(), (int)models.size());
+	return true;
+}
+
+// the light uniforms as setShaders() and the callbacks have set them
+PhongLights sceneLights()
+{
+	PhongLights lights = DEFAULT_LIGHTS;
+	lights.directional.position = lightAtt.directional_position;
+	lights.directional.diffuse = lightAtt.directional_diffuse;
+	lights.point.position = lightAtt.point_position;
+	lights.point.diffuse = lightAtt.point_diffuse;
+	lights.spot.position = lightAtt.spot_position;
+	lights.spot.cutoff = lightAtt.spot_cutoff;
+	lights.mode = cur_light_idx;
+	return lights;
+}
+
+// the "material" uniforms RenderScene() sets for the shape
+PhongSurface shapeSurface(const Shape& shape)
+{
+	PhongSurface surface = { shape.material.Ka, shape.material.Kd, shape.material.Ks, lightAtt.shininess };
+	return surface;
+}
+
+const SoftTexture* shapeTexture(const Shape& shape)
+{
+	return shape.material.diffuseImage >= 0 ? &texture_images[shape.material.diffuseImage] : NULL;
+}
+
+// the filters and wrap mode of textureMode()
+SoftSampler textureSampler()
+{
+	SoftSampler sampler;
+	sampler.linear = mag_mode;
+	sampler.mipmap = min_mode;
+	sampler.repeat = coor_addr;
+	return sampler;
+}
+
+// RenderScene() on the software backend, the viewport as glViewport()
+void RenderSceneSoftware(SoftRasterizer& rasterizer, int per_vertex_or_per_pixel, int x, int y, int width, int height)
+{
+	model& cur_model = models[cur_idx];
+	const vector<int>& visible = visibleShapes(cur_model);
+	const Matrix4& mvp = modelViewProjection(cur_model);
+	Matrix4 model_view = view_matrix * cur_model.world.matrix;
+	float max_scale = max(fabsf(cur_model.scale.x), max(fabsf(cur_model.scale.y), fabsf(cur_model.scale.z)));
+
+	for (size_t v = 0; v < visible.size(); v++)
 	{
-		glBindVertexArray(models[cur_idx].shapes[i].vao);
-		// [TODO] Bind texture and modify texture filtering & wrapping mode
-		// Hint: glActiveTexture, glBindTexture, glTexParameteri
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, models[cur_idx].shapes[i].material.diffuseTexture);
-		textureMode();
-		glDrawArrays(GL_TRIANGLES, 0, models[cur_idx].shapes[i].vertex_count);
-
-		setVector3("material.ambient", models[cur_idx].shapes[i].material.Ka);
-		setVector3("material.diffuse", models[cur_idx].shapes[i].material.Kd);
-		setVector3("material.specular", models[cur_idx].shapes[i].material.Ks);
-		setfloat("material.shininess", lightAtt.shininess);
+		const Shape& shape = cur_model.shapes[visible[v]];
+		const MeshLod& lod = shape.lods[selectLod(shape, mvp, max_scale)];
+		SoftDraw draw;
+		draw.vertices = &shape.vertices[0];
+		draw.indices = &shape.indices[lod.first];
+		draw.vertex_count = shape.vertex_count;
+		draw.index_count = lod.count;
+		draw.model_view = model_view;
+		draw.projection = project_matrix;
+		draw.surface = shapeSurface(shape);
+		draw.texture = shapeTexture(shape);
+		draw.sampler = textureSampler();
+		draw.per_vertex_or_per_pixel = per_vertex_or_per_pixel;
+		draw.viewport[0] = x;
+		draw.viewport[1] = y;
+		draw.viewport[2] = width;
+		draw.viewport[3] = height;
+		rasterizer.draw(draw);
+	}
+}
+
+// the ray through (x, y) in normalized device coordinates, in the space
+// inverse_mvp maps clip space to; it runs from the near plane at t = 0 to the
+// far plane at t = 1, so it sees what glDrawElements() would draw there
+void cameraRay(const Matrix4& inverse_mvp, float x, float y, Vector3& origin, Vector3& direction)
+{
+	Vector4 n = inverse_mvp * Vector4(x, y, -1.0f, 1.0f);
+	Vector4 f = inverse_mvp * Vector4(x, y, 1.0f, 1.0f);
+	origin = Vector3(n.x, n.y, n.z) * (1.0f / n.w);
+	direction = Vector3(f.x, f.y, f.z) * (1.0f / f.w) - origin;
+}
+
+// the model's BVH over the full resolution level of every shape, a BvhHit
+// mesh is an index into m.shapes
+const Bvh& modelBvh(model& m, WorkerPool& pool)
+{
+	if (m.bvh.empty()) {
+		vector<BvhMesh> meshes;
+		for (const Shape& shape : m.shapes) {
+			BvhMesh mesh = { &shape.vertices[0], SOFT_VERTEX_STRIDE, &shape.indices[shape.lods[0].first], shape.lods[0].count / 3 };
+			meshes.push_back(mesh);
+		}
+		m.bvh.build(meshes, pool);
 	}
+	return m.bvh;
+}
+
+// the rays through the next pixel center in x and in y, for the texture
+// footprint of a hit
+struct RayDifferentials
+{
+	Vector3 origin[2];
+	Vector3 direction[2];
+};
+
+// barycentrics of corners 1 and 2 where the ray meets the plane of p0 p1 p2
+bool planeBarycentrics(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& origin, const Vector3& direction,
+	float& u, float& v)
+{
+	Vector3 e1 = p1 - p0, e2 = p2 - p0;
+	Vector3 n = e1.cross(e2);
+	float denominator = n.dot(direction);
+	if (denominator == 0.0f)
+		return false;
+	Vector3 q = origin + direction * (n.dot(p0 - origin) / denominator) - p0;
+	float inv_nn = 1.0f / n.dot(n);
+	u = q.cross(e2).dot(n) * inv_nn;
+	v = e1.cross(q).dot(n) * inv_nn;
+	return true;
+}
+
+// shader.vs.glsl and shader.fs.glsl at a ray hit: the vertex attributes are
+// interpolated with the barycentrics of the hit, which are perspective
+// correct by construction; the per vertex mode lights the three corners.
+// The texture level comes from the texture coordinates where the rays of
+// the neighbouring pixels meet the plane of the triangle, the same screen
+// derivatives the software rasterizer takes
+uint32_t shadeRayHit(const model& m, const BvhHit& hit, const PhongView& phong, const Matrix4& model_view,
+	const Matrix4& normal_matrix, int per_vertex_or_per_pixel, const RayDifferentials& differentials)
+{
+	const Shape& shape = m.shapes[hit.mesh];
+	const GLuint* corner = &shape.indices[shape.lods[0].first + hit.triangle * 3];
+	float weight[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+	PhongSurface surface = shapeSurface(shape);
+
+	Vector3 position, normal, color;
+	float u = 0.0f, v = 0.0f;
+	for (int k = 0; k < 3; k++) {
+		const GLfloat* in = &shape.vertices[corner[k] * SOFT_VERTEX_STRIDE];
+		Vector4 p = model_view * Vector4(in[0], in[1], in[2], 1.0f);
+		Vector3 n = normal_matrix * Vector3(in[6], in[7], in[8]);
+		if (per_vertex_or_per_pixel == 0)
+			color += phongShade(phong, surface, n.normalize(), Vector3(p.x, p.y, p.z)) * weight[k];
+		position += Vector3(p.x, p.y, p.z) * weight[k];
+		normal += n * weight[k];
+		u += in[9] * weight[k];
+		v += in[10] * weight[k];
+	}
+	if (per_vertex_or_per_pixel != 0)
+		color = phongShade(phong, surface, normal.normalize(), position);
+	const SoftTexture* texture = shapeTexture(shape);
+	if (texture != NULL && !texture->empty()) {
+		const GLfloat* in[3];
+		for (int k = 0; k < 3; k++)
+			in[k] = &shape.vertices[corner[k] * SOFT_VERTEX_STRIDE];
+		Vector3 p[3];
+		for (int k = 0; k < 3; k++)
+			p[k] = Vector3(in[k][0], in[k][1], in[k][2]);
+		float rho2 = 0.0f;
+		for (int d = 0; d < 2; d++) {
+			float du, dv;
+			if (!planeBarycentrics(p[0], p[1], p[2], differentials.origin[d], differentials.direction[d], du, dv))
+				continue;
+			float dw = 1.0f - du - dv;
+			float dudp = (dw * in[0][9] + du * in[1][9] + dv * in[2][9] - u) * texture->width;
+			float dvdp = (dw * in[0][10] + du * in[1][10] + dv * in[2][10] - v) * texture->height;
+			rho2 = max(rho2, dudp * dudp + dvdp * dvdp);
+		}
+		float lod = rho2 > 0.0f ? 0.5f * log2f(rho2) : 0.0f;
+		color *= sampleTexture(*texture, textureSampler(), u, v, lod);
+	}
+	return softPackColor(color);
+}
+
+// what a click hit: the model, the shape and its triangle in the full
+// resolution index list, and the barycentrics of corners 1 and 2
+struct PickHit
+{
+	int model, shape, triangle;
+	float u, v;
+	float t;	// along the world ray, the nearest model wins
+};
+
+// the world space ray under a window point, x and y in [0, 1) from the top
+// left; both halves of the window show the scene through the same camera
+void cursorRay(float x, float y, Vector3& origin, Vector3& direction)
+{
+	Matrix4 inverse_view = view_matrix, inverse_projection = project_matrix;
+	Matrix4 inverse_vp = inverse_view.invert() * inverse_projection.invert();
+	cameraRay(inverse_vp, (x < 0.5f ? x : x - 0.5f) * 4.0f - 1.0f, 1.0f - y * 2.0f, origin, direction);
+}
+
+// ray cast against models[index] up to hit.t; the world ray is taken into
+// model space by undoing T * R * S field by field, which keeps t as it is
+bool pickModel(int index, const Vector3& origin, const Vector3& direction, WorkerPool& pool, PickHit& hit)
+{
+	model& m = models[index];
+	const Bvh& bvh = modelBvh(m, pool);
+	Quaternion inverse = m.orientation.conjugate();
+	Vector3 inverse_scale(1.0f / m.scale.x, 1.0f / m.scale.y, 1.0f / m.scale.z);
+	BvhHit h;
+	if (!bvh.intersect(inverse.rotate(origin - m.position) * inverse_scale, inverse.rotate(direction) * inverse_scale, 0.0f, hit.t, h))
+		return false;
+	hit.model = index;
+	hit.shape = (int)h.mesh;
+	hit.triangle = (int)h.triangle;
+	hit.u = h.u;
+	hit.v = h.v;
+	hit.t = h.t;
+	return true;
+}
+
+// the nearest triangle under a window point, false over the background
+bool pickScene(float x, float y, PickHit& hit)
+{
+	static WorkerPool pool;	// for the BVH builds of the first picks
+	Vector3 origin, direction;
+	cursorRay(x, y, origin, direction);
+	hit.t = 1.0f;
+	// RenderScene() draws the current model only
+	return pickModel(cur_idx, origin, direction, pool, hit);
+}
+
+// RenderScene() by casting a ray through every pixel center of the viewport,
+// at full resolution and without culling, as a reference for the rasterizers
+void RenderSceneRayTraced(WorkerPool& pool, SoftFramebuffer& framebuffer, const PhongView& phong, int per_vertex_or_per_pixel,
+	int x, int y, int width, int height)
+{
+	model& cur_model = models[cur_idx];
+	const Bvh& bvh = modelBvh(cur_model, pool);
+	Matrix4 model_view = view_matrix * modelMatrix(cur_model);
+	Matrix4 normal_matrix = model_view;
+	normal_matrix.invert().transpose();
+	Matrix4 inverse_mvp = project_matrix * model_view;
+	inverse_mvp.invert();
+
+	pool.run(height, [&](size_t row, int) {
+		uint32_t* color = &framebuffer.color[(y + row) * framebuffer.width + x];
+		float ndc_y = (row + 0.5f) / height * 2.0f - 1.0f;
+		for (int col = 0; col < width; col++) {
+			Vector3 origin, direction;
+			float ndc_x = (col + 0.5f) / width * 2.0f - 1.0f;
+			cameraRay(inverse_mvp, ndc_x, ndc_y, origin, direction);
+			BvhHit hit;
+			if (bvh.intersect(origin, direction, 0.0f, 1.0f, hit)) {
+				RayDifferentials differentials;
+				cameraRay(inverse_mvp, ndc_x + 2.0f / width, ndc_y, differentials.origin[0], differentials.direction[0]);
+				cameraRay(inverse_mvp, ndc_x, ndc_y + 2.0f / height, differentials.origin[1], differentials.direction[1]);
+				color[col] = shadeRayHit(cur_model, hit, phong, model_view, normal_matrix, per_vertex_or_per_pixel, differentials);
+			}
+		}
+	});
+}
+
+// RenderFrameSoftware() by ray casting, returns the number of rays
+size_t RenderFrameRayTraced(WorkerPool& pool, SoftFramebuffer& framebuffer)
+{
+	framebuffer.clear(CLEAR_COLOR);
+	PhongView phong = makePhongView(sceneLights(), view_matrix);
+	RenderSceneRayTraced(pool, framebuffer, phong, 1, 0, 0, screenWidth / 2, screenHeight);
+	RenderSceneRayTraced(pool, framebuffer, phong, 0, screenWidth / 2, 0, screenWidth / 2, screenHeight);
+	return (size_t)(screenWidth / 2) * 2 * screenHeight;
+}
+
+// one frame of the main loop, both viewports, on the software backend
+SoftStats RenderFrameSoftware(SoftRasterizer& rasterizer, SoftFramebuffer& framebuffer)
+{
+	framebuffer.clear(CLEAR_COLOR);
+	rasterizer.begin(framebuffer, makePhongView(sceneLights(), view_matrix));
+	RenderSceneSoftware(rasterizer, 1, 0, 0, screenWidth / 2, screenHeight);
+	RenderSceneSoftware(rasterizer, 0, screenWidth / 2, 0, screenWidth / 2, screenHeight);
+	return rasterizer.end();
 }
 
 // Call back function for keyboard
@@ -404,7 +1093,8 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		switch (key)
 		{
 		case GLFW_KEY_ESCAPE:
-			exit(0);
+			// leave the main loop, so a replay reports and a recording ends its file
+			glfwSetWindowShouldClose(window, GLFW_TRUE);
 			break;
 		case GLFW_KEY_Z:
 			cur_idx = (cur_idx + 1) % model_list.size();
@@ -468,6 +1158,24 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		case GLFW_KEY_V:
 			coor_addr = !coor_addr;
 			break;
+		case GLFW_KEY_F:
+			if (frame_capture.isActive()) {
+				frame_capture.stop();
+				turntable_frames_left = 0;
+			}
+			else if (frame_capture.start(screenWidth, screenHeight, (mods & GLFW_MOD_SHIFT) ? CaptureY4M : CapturePPM, "turntable")) {
+				turntable_frames_left = TURNTABLE_FRAMES;
+			}
+			break;
+		case GLFW_KEY_N:
+			// a grid of every model unless --scene created a scene
+			if (scene_instances.empty() && !createScene("grid", SCENE_DEFAULT_INSTANCES))
+				break;
+			scene_mode = !scene_mode;
+			scene_frame_time.count = 0;
+			scene_frame_time.total_ms = 0;
+			scene_frame_time.max_ms = 0;
+			break;
 		default:
 			break;
 		}
@@ -482,17 +1190,17 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	case ViewEye:
 		main_camera.position.z -= 0.025 * (float)yoffset;
 		setViewingMatrix();
-		printf("Camera Position = ( %f , %f , %f )\n", main_camera.position.x, main_camera.position.y, main_camera.position.z);
+		LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Position = ( %f , %f , %f )", main_camera.position.x, main_camera.position.y, main_camera.position.z);
 		break;
 	case ViewCenter:
 		main_camera.center.z += 0.1 * (float)yoffset;
 		setViewingMatrix();
-		printf("Camera Viewing Direction = ( %f , %f , %f )\n", main_camera.center.x, main_camera.center.y, main_camera.center.z);
+		LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Viewing Direction = ( %f , %f , %f )", main_camera.center.x, main_camera.center.y, main_camera.center.z);
 		break;
 	case ViewUp:
 		main_camera.up_vector.z += 0.33 * (float)yoffset;
 		setViewingMatrix();
-		printf("Camera Up Vector = ( %f , %f , %f )\n", main_camera.up_vector.x, main_camera.up_vector.y, main_camera.up_vector.z);
+		LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Up Vector = ( %f , %f , %f )", main_camera.up_vector.x, main_camera.up_vector.y, main_camera.up_vector.z);
 		break;
 	case GeoTranslation:
 		models[cur_idx].position.z += 0.1 * (float)yoffset;
@@ -501,7 +1209,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 		models[cur_idx].scale.z += 0.01 * (float)yoffset;
 		break;
 	case GeoRotation:
-		models[cur_idx].rotation.z += (acosf(-1.0f) / 180.0) * 5 * (float)yoffset;
+		rotateModel(models[cur_idx], Vector3(0.0f, 0.0f, (acosf(-1.0f) / 180.0f) * 5 * (float)yoffset));
 		break;
 	case LightEdit:
 		if (cur_light_idx == 0) {
@@ -509,7 +1217,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 			setVector3("directional.diffuse", lightAtt.directional_diffuse);
 		} else if (cur_light_idx == 1) {
 			lightAtt.point_diffuse -= Vector3(yoffset * 0.1, yoffset * 0.1, yoffset * 0.1);
-			setVector3("point.diffuse", lightAtt.directional_diffuse);
+			setVector3("point.diffuse", lightAtt.point_diffuse);
 		} else {
 			lightAtt.spot_cutoff -= yoffset * 0.1;
 			setfloat("spot.cutoff", lightAtt.spot_cutoff);
@@ -531,11 +1239,49 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 		starting_press_x = -1;
 		starting_press_y = -1;
 	}
-		
+	// a right click picks the triangle under the cursor
+	else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
+		int width, height;
+		glfwGetWindowSize(window, &width, &height);
+		if (width <= 0 || height <= 0)
+			return;
+		uint64_t begin = Logger::now();
+		PickHit hit;
+		bool found = pickScene((float)(cursor_x / width), (float)(cursor_y / height), hit);
+		uint64_t elapsed = Logger::now() - begin;
+		if (found) {
+			LOG(LogInfo, "Pick: model %d shape %d triangle %d in %llu us", hit.model, hit.shape, hit.triangle, (unsigned long long)elapsed);
+			LOG(LogInfo, "Pick: barycentrics ( %f , %f , %f )", 1.0f - hit.u - hit.v, hit.u, hit.v);
+		}
+		else
+			LOG(LogInfo, "Pick: nothing under the cursor, %llu us", (unsigned long long)elapsed);
+	}
 }
 
+static void cursor_pos_event(double xpos, double ypos);
+
 static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 {
+	uint64_t begin = Logger::now();
+	cursor_pos_event(xpos, ypos);
+	uint64_t elapsed = Logger::now() - begin;
+
+	cursor_latency.count++;
+	cursor_latency.total_us += elapsed;
+	cursor_latency.max_us = max(cursor_latency.max_us, elapsed);
+	if (cursor_latency.count == CURSOR_LATENCY_WINDOW) {
+		LOG(LogInfo, "cursor_pos_callback: %d events, avg %.3f us, max %llu us",
+			cursor_latency.count, (double)cursor_latency.total_us / cursor_latency.count, (unsigned long long)cursor_latency.max_us);
+		cursor_latency.count = 0;
+		cursor_latency.total_us = 0;
+		cursor_latency.max_us = 0;
+	}
+}
+
+static void cursor_pos_event(double xpos, double ypos)
+{
+	cursor_x = xpos;
+	cursor_y = ypos;
 	if (mouse_pressed) {
 		if (starting_press_x < 0 || starting_press_y < 0) {
 			starting_press_x = (int)xpos;
@@ -552,19 +1298,19 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 				main_camera.position.x += diff_x * (1.0 / 400.0);
 				main_camera.position.y += diff_y * (1.0 / 400.0);
 				setViewingMatrix();
-				printf("Camera Position = ( %f , %f , %f )\n", main_camera.position.x, main_camera.position.y, main_camera.position.z);
+				LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Position = ( %f , %f , %f )", main_camera.position.x, main_camera.position.y, main_camera.position.z);
 				break;
 			case ViewCenter:
 				main_camera.center.x += diff_x * (1.0 / 400.0);
 				main_camera.center.y -= diff_y * (1.0 / 400.0);
 				setViewingMatrix();
-				printf("Camera Viewing Direction = ( %f , %f , %f )\n", main_camera.center.x, main_camera.center.y, main_camera.center.z);
+				LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Viewing Direction = ( %f , %f , %f )", main_camera.center.x, main_camera.center.y, main_camera.center.z);
 				break;
 			case ViewUp:
 				main_camera.up_vector.x += diff_x * 0.1;
 				main_camera.up_vector.y += diff_y * 0.1;
 				setViewingMatrix();
-				printf("Camera Up Vector = ( %f , %f , %f )\n", main_camera.up_vector.x, main_camera.up_vector.y, main_camera.up_vector.z);
+				LOG_RATE(LogInfo, CAMERA_LOG_INTERVAL_MS, "Camera Up Vector = ( %f , %f , %f )", main_camera.up_vector.x, main_camera.up_vector.y, main_camera.up_vector.z);
 				break;
 			case GeoTranslation:
 				models[cur_idx].position.x += -diff_x * (1.0 / 400.0);
@@ -575,8 +1321,7 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 				models[cur_idx].scale.y += diff_y * 0.001;
 				break;
 			case GeoRotation:
-				models[cur_idx].rotation.x += acosf(-1.0f) / 180.0*diff_y*(45.0 / 400.0);
-				models[cur_idx].rotation.y += acosf(-1.0f) / 180.0*diff_x*(45.0 / 400.0);
+				rotateModel(models[cur_idx], Vector3(diff_y, diff_x, 0.0f) * (acosf(-1.0f) / 180.0f * (45.0f / 400.0f)));
 				break;
 			case LightEdit:
 				lightAtt.directional_position -= Vector3(diff_x * 0.1, -diff_y * 0.1, 0);
@@ -591,6 +1336,30 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 	}
 }
 
+void record_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	input_recorder.key(key, scancode, action, mods);
+	KeyCallback(window, key, scancode, action, mods);
+}
+
+void record_scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	input_recorder.scroll(xoffset, yoffset);
+	scroll_callback(window, xoffset, yoffset);
+}
+
+void record_mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	input_recorder.mouseButton(button, action, mods);
+	mouse_button_callback(window, button, action, mods);
+}
+
+static void record_cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	input_recorder.cursorPos(xpos, ypos);
+	cursor_pos_callback(window, xpos, ypos);
+}
+
 void setShaders()
 {
 	GLuint v, f, p;
@@ -660,124 +1429,51 @@ void setShaders()
 
 	program = p;
 
-	setVector3("directional.position", 1, 1, 1);
-	setVector3("directional.direction", -1, -1, -1);
-	setVector3("directional.diffuse", 1, 1, 1);
-	setVector3("directional.ambient", 0.15, 0.15, 0.15);
-
-	setVector3("point.position", 0, 2, 1);
-	setVector3("point.diffuse", 1, 1, 1);
-	setVector3("point.ambient", 0.15, 0.15, 0.15);
-	setfloat("point.constant", 0.01);
-	setfloat("point.linear", 0.8);
-	setfloat("point.quadratic", 0.1);
-
-	setVector3("spot.position", 0, 0, 2);
-	setVector3("spot.direction", 0, 0, -1);
-	setVector3("spot.diffuse", 1, 1, 1);
-	setVector3("spot.ambient", 0.15, 0.15, 0.15);
-	setfloat("spot.exponent", 50);
-	setfloat("spot.cutoff", 30);
-	setfloat("spot.constant", 0.05);
-	setfloat("spot.linear", 0.3);
-	setfloat("spot.quadratic", 0.6);
+	const PhongLights& l = DEFAULT_LIGHTS;
+	setVector3("directional.position", l.directional.position);
+	setVector3("directional.direction", l.directional.direction);
+	setVector3("directional.diffuse", l.directional.diffuse);
+	setVector3("directional.ambient", l.directional.ambient);
+
+	setVector3("point.position", l.point.position);
+	setVector3("point.diffuse", l.point.diffuse);
+	setVector3("point.ambient", l.point.ambient);
+	setfloat("point.constant", l.point.constant);
+	setfloat("point.linear", l.point.linear);
+	setfloat("point.quadratic", l.point.quadratic);
+
+	setVector3("spot.position", l.spot.position);
+	setVector3("spot.direction", l.spot.direction);
+	setVector3("spot.diffuse", l.spot.diffuse);
+	setVector3("spot.ambient", l.spot.ambient);
+	setfloat("spot.exponent", l.spot.exponent);
+	setfloat("spot.cutoff", l.spot.cutoff);
+	setfloat("spot.constant", l.spot.constant);
+	setfloat("spot.linear", l.spot.linear);
+	setfloat("spot.quadratic", l.spot.quadratic);
 	glUniform1i(glGetUniformLocation(program, "lightmode"), cur_light_idx);
 }
 
 void normalization(tinyobj::attrib_t* attrib, vector<GLfloat>& vertices, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords, vector<int>& material_id, tinyobj::shape_t* shape)
 {
-	vector<float> xVector, yVector, zVector;
-	float minX = 10000, maxX = -10000, minY = 10000, maxY = -10000, minZ = 10000, maxZ = -10000;
-
-	// find out min and max value of X, Y and Z axis
-	for (int i = 0; i < attrib->vertices.size(); i++)
+	// center the model at the origin and scale its greatest axis to [-1, 1]
+	// the fit runs in double, in float p / scale - offset / scale cancels the
+	// low bits of scans far from the origin and the mesh jitters
+	float* positions = attrib->vertices.empty() ? NULL : &attrib->vertices[0];
+	size_t position_count = attrib->vertices.size() / 3;
+	Vector3 lo, hi;
+	if (computeBounds(positions, position_count, lo, hi))
 	{
-		//maxs = max(maxs, attrib->vertices.at(i));
-		if (i % 3 == 0)
-		{
-
-			xVector.push_back(attrib->vertices.at(i));
-
-			if (attrib->vertices.at(i) < minX)
-			{
-				minX = attrib->vertices.at(i);
-			}
-
-			if (attrib->vertices.at(i) > maxX)
-			{
-				maxX = attrib->vertices.at(i);
-			}
-		}
-		else if (i % 3 == 1)
-		{
-			yVector.push_back(attrib->vertices.at(i));
-
-			if (attrib->vertices.at(i) < minY)
-			{
-				minY = attrib->vertices.at(i);
-			}
-
-			if (attrib->vertices.at(i) > maxY)
-			{
-				maxY = attrib->vertices.at(i);
-			}
-		}
-		else if (i % 3 == 2)
-		{
-			zVector.push_back(attrib->vertices.at(i));
-
-			if (attrib->vertices.at(i) < minZ)
-			{
-				minZ = attrib->vertices.at(i);
-			}
-
-			if (attrib->vertices.at(i) > maxZ)
-			{
-				maxZ = attrib->vertices.at(i);
-			}
+		Vector<double, 3> offset = (toVectorN<double>(lo) + toVectorN<double>(hi)) * 0.5;
+		Vector<double, 3> extent = toVectorN<double>(hi) - toVectorN<double>(lo);
+		double scale = max(extent[0], max(extent[1], extent[2])) / 2;
+
+		Matrix<double, 4> fit;	// scaling(1 / scale) * translate(-offset)
+		for (int i = 0; i < 3; i++) {
+			fit[i * 5] = 1 / scale;
+			fit[i * 4 + 3] = -offset[i] / scale;
 		}
-	}
-	
-	float offsetX = (maxX + minX) / 2;
-	float offsetY = (maxY + minY) / 2;
-	float offsetZ = (maxZ + minZ) / 2;
-
-	for (int i = 0; i < attrib->vertices.size(); i++)
-	{
-		if (offsetX != 0 && i % 3 == 0)
-		{
-			attrib->vertices.at(i) = attrib->vertices.at(i) - offsetX;
-		}
-		else if (offsetY != 0 && i % 3 == 1)
-		{
-			attrib->vertices.at(i) = attrib->vertices.at(i) - offsetY;
-		}
-		else if (offsetZ != 0 && i % 3 == 2)
-		{
-			attrib->vertices.at(i) = attrib->vertices.at(i) - offsetZ;
-		}
-	}
-
-	float greatestAxis = maxX - minX;
-	float distanceOfYAxis = maxY - minY;
-	float distanceOfZAxis = maxZ - minZ;
-
-	if (distanceOfYAxis > greatestAxis)
-	{
-		greatestAxis = distanceOfYAxis;
-	}
-
-	if (distanceOfZAxis > greatestAxis)
-	{
-		greatestAxis = distanceOfZAxis;
-	}
-
-	float scale = greatestAxis / 2;
-
-	for (int i = 0; i < attrib->vertices.size(); i++)
-	{
-		//std::cout << i << " = " << (double)(attrib.vertices.at(i) / greatestAxis) << std::endl;
-		attrib->vertices.at(i) = attrib->vertices.at(i)/ scale;
+		transformPoints(fit, positions, positions, position_count);
 	}
 	size_t index_offset = 0;
 	for (size_t f = 0; f < shape->mesh.num_face_vertices.size(); f++) {
@@ -814,7 +1510,9 @@ static string GetBaseDir(const string& filepath) {
 	return "";
 }
 
-GLuint LoadTextureImage(string image_path)
+// the pixels and their mip chain are kept in texture_images as well, image
+// receives their index
+GLuint LoadTextureImage(string image_path, int& image)
 {
 	int channel, width, height;
 	int require_channel = 4;
@@ -826,11 +1524,16 @@ GLuint LoadTextureImage(string image_path)
 
 		// [TODO] Bind the image to texture
 		// Hint: glGenTextures, glBindTexture, glTexImage2D, glGenerateMipmap
-		glGenTextures(1, &tex);
-		glBindTexture(GL_TEXTURE_2D, tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		
+		if (gl_backend) {
+			glGenTextures(1, &tex);
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+
+		image = (int)texture_images.size();
+		texture_images.push_back(makeSoftTexture((const uint32_t*)data, width, height));
+
 		// free the image from memory after binding to texture
 		stbi_image_free(data);
 		return tex;
@@ -838,11 +1541,66 @@ GLuint LoadTextureImage(string image_path)
 	else
 	{
 		cout << "LoadTextureImage: Cannot load image from " << image_path << endl;
+		image = -1;
 		return -1;
 	}
 }
 
-vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords, vector<int>& material_id, vector<PhongMaterial>& materials)
+// weld the per corner attribute streams of a triangle soup into unique
+// vertices, build its LOD chain and order every level by MeshOptimizer.h;
+// the streams are replaced by the unique vertices, vertices receives them
+// interleaved and indices all levels back to back. before / after get the
+// cache statistics of the welded OBJ order and of the optimized full
+// resolution level
+void IndexShapeGeometry(vector<GLfloat>& positions, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords,
+	vector<GLfloat>& vertices, vector<unsigned int>& indices, vector<MeshLod>& lods, MeshCacheStats& before, MeshCacheStats& after)
+{
+	const size_t STRIDE = SOFT_VERTEX_STRIDE;	// position, color, normal, texture coordinate
+	size_t count = positions.size() / 3;
+	vector<GLfloat> soup(count * STRIDE);
+	for (size_t i = 0; i < count; i++) {
+		GLfloat* v = &soup[i * STRIDE];
+		for (int k = 0; k < 3; k++) {
+			v[k] = positions[i * 3 + k];
+			v[3 + k] = colors[i * 3 + k];
+			v[6 + k] = normals[i * 3 + k];
+		}
+		v[9] = textureCoords[i * 2];
+		v[10] = textureCoords[i * 2 + 1];
+	}
+	weldVertices(&soup[0], count, STRIDE, vertices, indices);
+	count = vertices.size() / STRIDE;
+	before += analyzeVertexCache(indices, count);
+
+	// the levels share the vertices, so only the fetch order spans all of them
+	lods = buildLodChain(indices, &vertices[0], count, STRIDE);
+	for (size_t l = 0; l < lods.size(); l++) {
+		vector<unsigned int> level(indices.begin() + lods[l].first, indices.begin() + lods[l].first + lods[l].count);
+		optimizeVertexCache(level, count);
+		optimizeOverdraw(level, &vertices[0], count, STRIDE);
+		std::copy(level.begin(), level.end(), indices.begin() + lods[l].first);
+	}
+	count = optimizeVertexFetch(indices, vertices, STRIDE);
+	after += analyzeVertexCache(vector<unsigned int>(indices.begin(), indices.begin() + lods[0].count), count);
+
+	positions.resize(count * 3);
+	colors.resize(count * 3);
+	normals.resize(count * 3);
+	textureCoords.resize(count * 2);
+	for (size_t i = 0; i < count; i++) {
+		const GLfloat* v = &vertices[i * STRIDE];
+		for (int k = 0; k < 3; k++) {
+			positions[i * 3 + k] = v[k];
+			colors[i * 3 + k] = v[3 + k];
+			normals[i * 3 + k] = v[6 + k];
+		}
+		textureCoords[i * 2] = v[9];
+		textureCoords[i * 2 + 1] = v[10];
+	}
+}
+
+vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords, vector<int>& material_id, vector<PhongMaterial>& materials,
+	MeshCacheStats& cache_before, MeshCacheStats& cache_after)
 {
 	vector<Shape> res;
 	for (int m = 0; m < materials.size(); m++)
@@ -873,36 +1631,20 @@ vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& c
 		if (!m_vertices.empty())
 		{
 			Shape tmp_shape;
-			glGenVertexArrays(1, &tmp_shape.vao);
-			glBindVertexArray(tmp_shape.vao);
-
-			glGenBuffers(1, &tmp_shape.vbo);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.vbo);
-			glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(GL_FLOAT), &m_vertices.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+			IndexShapeGeometry(m_vertices, m_colors, m_normals, m_textureCoords, tmp_shape.vertices, tmp_shape.indices, tmp_shape.lods, cache_before, cache_after);
+			tmp_shape.indexCount = tmp_shape.indices.size();
 			tmp_shape.vertex_count = m_vertices.size() / 3;
 
-			glGenBuffers(1, &tmp_shape.p_color);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_color);
-			glBufferData(GL_ARRAY_BUFFER, m_colors.size() * sizeof(GL_FLOAT), &m_colors.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glGenBuffers(1, &tmp_shape.p_normal);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_normal);
-			glBufferData(GL_ARRAY_BUFFER, m_normals.size() * sizeof(GL_FLOAT), &m_normals.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glGenBuffers(1, &tmp_shape.p_texCoord);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_texCoord);
-			glBufferData(GL_ARRAY_BUFFER, m_textureCoords.size() * sizeof(GL_FLOAT), &m_textureCoords.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
-			glEnableVertexAttribArray(2);
-			glEnableVertexAttribArray(3);
+			Vector3 lo, hi;
+			computeBounds(&m_vertices[0], tmp_shape.vertex_count, lo, hi);
+			tmp_shape.bound_center = (lo + hi) * 0.5f;
+			tmp_shape.bound_extent = (hi - lo) * 0.5f;
 
 			tmp_shape.material = materials[m];
+			tmp_shape.material_id = m;
+			// the gl buffers are filled by createGeometryArena() once all models are loaded
+			tmp_shape.base_vertex = 0;
+			tmp_shape.first_index = 0;
 			res.push_back(tmp_shape);
 		}
 	}
@@ -948,6 +1690,7 @@ void LoadTexturedModels(string model_path)
 
 	printf("Load Models Success ! Shapes size %d Material size %d\n", shapes.size(), materials.size());
 	model tmp_model;
+	MeshCacheStats cache_before, cache_after;	// of all shapes, FIFO of MESH_CACHE_SIZE
 
 	vector<PhongMaterial> allMaterial;
 	for (int i = 0; i < materials.size(); i++)
@@ -957,7 +1700,7 @@ void LoadTexturedModels(string model_path)
 		material.Kd = Vector3(materials[i].diffuse[0], materials[i].diffuse[1], materials[i].diffuse[2]);
 		material.Ks = Vector3(materials[i].specular[0], materials[i].specular[1], materials[i].specular[2]);
 
-		material.diffuseTexture = LoadTextureImage(base_dir + string(materials[i].diffuse_texname));
+		material.diffuseTexture = LoadTextureImage(base_dir + string(materials[i].diffuse_texname), material.diffuseImage);
 		if (material.diffuseTexture == -1)
 		{
 			cout << "LoadTexturedModels: Fail to load model's material " << i << endl;
@@ -965,6 +1708,7 @@ void LoadTexturedModels(string model_path)
 			
 		}
 		
+		material.id = loaded_material_count++;
 		allMaterial.push_back(material);
 	}
 	
@@ -980,16 +1724,93 @@ void LoadTexturedModels(string model_path)
 		// printf("Vertices size: %d", vertices.size() / 3);
 
 		// split current shape into multiple shapes base on material_id.
-		vector<Shape> splitedShapeByMaterial = SplitShapeByMaterial(vertices, colors, normals, textureCoords, material_id, allMaterial);
+		vector<Shape> splitedShapeByMaterial = SplitShapeByMaterial(vertices, colors, normals, textureCoords, material_id, allMaterial, cache_before, cache_after);
 
 		// concatenate splited shape to model's shape list
 		tmp_model.shapes.insert(tmp_model.shapes.end(), splitedShapeByMaterial.begin(), splitedShapeByMaterial.end());
 	}
+	printf("Vertex cache: %d triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", (int)cache_after.triangles,
+		cache_before.acmr(), cache_after.acmr(), cache_before.atvr(), cache_after.atvr());
+	// a shape with fewer levels draws its coarsest one for the rest; the
+	// error is relative to the bbox diagonal of its shape, like the cap
+	for (int l = 0; l < MESH_LOD_LEVELS; l++) {
+		size_t triangles = 0;
+		float error = 0;
+		for (const Shape& s : tmp_model.shapes) {
+			const MeshLod& lod = s.lods[min(l, (int)s.lods.size() - 1)];
+			float diagonal = 2.0f * s.bound_extent.length();
+			triangles += lod.count / 3;
+			if (diagonal > 0.0f)
+				error = max(error, lod.error / diagonal);
+		}
+		printf("LOD %d: %d triangles, error %.3f%% of the bbox diagonal (cap %.0f%%)\n", l, (int)triangles, error * 100, MESH_LOD_MAX_ERROR * 100);
+	}
+	for (int i = 0; i < tmp_model.shapes.size(); i++)
+	{
+		const Shape& s = tmp_model.shapes[i];
+		tmp_model.bound_cx.push_back(s.bound_center.x);
+		tmp_model.bound_cy.push_back(s.bound_center.y);
+		tmp_model.bound_cz.push_back(s.bound_center.z);
+		tmp_model.bound_ex.push_back(s.bound_extent.x);
+		tmp_model.bound_ey.push_back(s.bound_extent.y);
+		tmp_model.bound_ez.push_back(s.bound_extent.z);
+		tmp_model.material_order.push_back(i);
+	}
+	std::stable_sort(tmp_model.material_order.begin(), tmp_model.material_order.end(),
+		[&](int a, int b) { return tmp_model.shapes[a].material_id < tmp_model.shapes[b].material_id; });
 	shapes.clear();
 	materials.clear();
 	models.push_back(tmp_model);
 }
 
+// one vertex and one index buffer for the shapes of all models, the shapes
+// keep their indices relative to their own vertices and draw with base_vertex
+void createGeometryArena()
+{
+	vector<GLfloat> vertices;
+	vector<GLuint> indices;
+	int shape_count = 0;
+	for (model& m : models) {
+		for (Shape& shape : m.shapes) {
+			shape.base_vertex = (GLint)(vertices.size() / SOFT_VERTEX_STRIDE);
+			shape.first_index = (GLuint)indices.size();
+			vertices.insert(vertices.end(), shape.vertices.begin(), shape.vertices.end());
+			indices.insert(indices.end(), shape.indices.begin(), shape.indices.end());
+			shape_count++;
+		}
+	}
+	geometry_buffer& arena = geometry_arena;
+	arena.vertex_count = vertices.size() / SOFT_VERTEX_STRIDE;
+	arena.index_count = indices.size();
+	if (indices.empty())
+		return;
+
+	glGenVertexArrays(1, &arena.vao);
+	glBindVertexArray(arena.vao);
+
+	glGenBuffers(1, &arena.ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+
+	// position, color, normal, texture coordinate, interleaved as IndexShapeGeometry() left them
+	const GLsizei stride = SOFT_VERTEX_STRIDE * sizeof(GLfloat);
+	glGenBuffers(1, &arena.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));
+	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, (void*)(9 * sizeof(GLfloat)));
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+
+	LOG(LogInfo, "Geometry arena: %d shapes, %d vertices, %d indices, %.1f MB", shape_count, (int)arena.vertex_count,
+		(int)arena.index_count, (vertices.size() * sizeof(GLfloat) + indices.size() * sizeof(GLuint)) / 1048576.0);
+}
+
 void initParameter()
 {
 	proj.left = -1;
@@ -1001,18 +1822,17 @@ void initParameter()
 	proj.fovy = 80;
 	proj.aspect = (float)(WINDOW_WIDTH / 2) / (float)WINDOW_HEIGHT; // adjust width for side by side view
 
-	main_camera.position = Vector3(0.0f, 0.0f, 2.0f);
-	main_camera.center = Vector3(0.0f, 0.0f, 0.0f);
-	main_camera.up_vector = Vector3(0.0f, 1.0f, 0.0f);
-	lightAtt.directional_position = Vector3(1, 1, 1);
-	lightAtt.directional_diffuse = Vector3(1, 1, 1);
-	lightAtt.point_position = Vector3(0, 2, 1);
-	lightAtt.point_diffuse = Vector3(1, 1, 1);
-	lightAtt.spot_position = Vector3(0, 0, 2);
-	lightAtt.spot_cutoff = 30;
+	main_camera = DEFAULT_CAMERA;
+	lightAtt.directional_position = DEFAULT_LIGHTS.directional.position;
+	lightAtt.directional_diffuse = DEFAULT_LIGHTS.directional.diffuse;
+	lightAtt.point_position = DEFAULT_LIGHTS.point.position;
+	lightAtt.point_diffuse = DEFAULT_LIGHTS.point.diffuse;
+	lightAtt.spot_position = DEFAULT_LIGHTS.spot.position;
+	lightAtt.spot_cutoff = DEFAULT_LIGHTS.spot.cutoff;
 	lightAtt.shininess = 64;
 
-	setViewingMatrix();
+	view_matrix = DEFAULT_VIEW_MATRIX;	// same as setViewingMatrix() for the default camera
+	view_version = ++matrix_version_counter;
 	setPerspective();	//set default projection matrix as perspective matrix
 }
 
@@ -1025,6 +1845,9 @@ void setUniformVariables()
 	// [TODO] Get uniform location of texture
 	iLocTex = glGetUniformLocation(program, "tex");
 	glUniform1i(iLocTex, 0);
+
+	iLocInstanced = glGetUniformLocation(program, "instanced");
+	glUniform1i(iLocInstanced, 0);
 }
 
 void setupRC()
@@ -1035,11 +1858,12 @@ void setupRC()
 	setUniformVariables();
 
 	// OpenGL States and Values
-	glClearColor(0.2, 0.2, 0.2, 1.0);
+	glClearColor(CLEAR_COLOR.x, CLEAR_COLOR.y, CLEAR_COLOR.z, 1.0);
 
 	for (string model_path : model_list){
 		LoadTexturedModels(model_path);
 	}
+	createGeometryArena();
 }
 
 void glPrintContextInfo(bool printExtension)
@@ -1061,14 +1885,1348 @@ void glPrintContextInfo(bool printExtension)
 }
 
 
+// Matrix4 kernels of every backend compiled into this build, validated against the scalar code
+void benchMatrixKernels()
+{
+	const int SAMPLES = 256;
+	vector<Matrix4> a(SAMPLES), b(SAMPLES);
+	for (int i = 0; i < SAMPLES; i++) {
+		a[i] = composeTRS(Vector3(i * 0.01f, 1.0f, -2.0f), Vector3(i * 0.1f, i * 0.2f, 0.3f), Vector3(1.0f + i * 0.001f, 2.0f, 0.5f));
+		b[i] = project_matrix * composeTRS(Vector3(0.0f, -i * 0.02f, 1.0f), Vector3(0.7f, i * 0.05f, -0.1f), Vector3(1.0f, 1.0f, 1.0f + i * 0.01f));
+	}
+
+	typedef void(*multiply_kernel)(const float*, const float*, float*);
+	typedef bool(*inverse_kernel)(const float*, float*);
+	struct { const char* name; multiply_kernel mul; inverse_kernel inv; } backends[] = {
+		{ "scalar", mat4MultiplyScalar, mat4InverseScalar },
+#ifdef MATH_SIMD_SSE2
+		{ "SSE2", mat4MultiplySSE, mat4InverseSSE },
+#endif
+#ifdef MATH_SIMD_AVX
+		{ "AVX", mat4MultiplyAVX, NULL },
+#endif
+#ifdef MATH_SIMD_NEON
+		{ "NEON", mat4MultiplyNEON, NULL },
+#endif
+	};
+
+	printf("-- Matrix4 kernels (selected backend: %s) --\n", mat4Backend());
+	char name[64];
+	for (size_t k = 0; k < sizeof(backends) / sizeof(backends[0]); k++) {
+		float max_err = 0.0f, max_inv_err = 0.0f;
+		for (int i = 0; i < SAMPLES; i++) {
+			float ref[16], got[16];
+			mat4MultiplyScalar(a[i].getStorage(), b[i].getStorage(), ref);
+			backends[k].mul(a[i].getStorage(), b[i].getStorage(), got);
+			for (int j = 0; j < 16; j++)
+				max_err = max(max_err, fabsf(ref[j] - got[j]));
+			if (backends[k].inv && mat4InverseScalar(b[i].getStorage(), ref) && backends[k].inv(b[i].getStorage(), got))
+				for (int j = 0; j < 16; j++)
+					max_inv_err = max(max_inv_err, fabsf(ref[j] - got[j]) / max(1.0f, fabsf(ref[j])));
+		}
+
+		int i = 0;
+		float out[16];
+		snprintf(name, sizeof(name), "%s multiply (max err %.1e)", backends[k].name, max_err);
+		benchRun(name, [&] {
+			i = (i + 1) & (SAMPLES - 1);
+			backends[k].mul(a[i].getStorage(), b[i].getStorage(), out);
+			benchSink(out[0] + out[15]);
+		});
+		if (backends[k].inv) {
+			snprintf(name, sizeof(name), "%s inverse (max rel err %.1e)", backends[k].name, max_inv_err);
+			benchRun(name, [&] {
+				i = (i + 1) & (SAMPLES - 1);
+				backends[k].inv(b[i].getStorage(), out);
+				benchSink(out[0] + out[15]);
+			});
+		}
+	}
+}
+
+// batch transforms of BENCH_POINTS points against the per-point Matrix4 operators
+void benchBatchTransforms()
+{
+	const int BENCH_POINTS = 1024;
+	vector<float> aos(BENCH_POINTS * 3), out(BENCH_POINTS * 3);
+	vector<float> x(BENCH_POINTS), y(BENCH_POINTS), z(BENCH_POINTS), ox(BENCH_POINTS), oy(BENCH_POINTS), oz(BENCH_POINTS);
+	for (int i = 0; i < BENCH_POINTS * 3; i++)
+		aos[i] = sinf(i * 0.37f) * 2.0f;
+	for (int i = 0; i < BENCH_POINTS; i++) {
+		x[i] = aos[i * 3];  y[i] = aos[i * 3 + 1];  z[i] = aos[i * 3 + 2];
+	}
+	Matrix4 m = composeTRS(Vector3(0.5f, -1.0f, 2.0f), Vector3(0.3f, 0.6f, 0.1f), Vector3(1.5f, 1.5f, 1.5f));
+	Matrix4 mvp = project_matrix * view_matrix * m;
+
+	printf("-- batch transforms (%d points) --\n", BENCH_POINTS);
+	benchRun("Matrix4 * Vector4 per point", [&] {
+		for (int i = 0; i < BENCH_POINTS; i++) {
+			Vector4 v = m * Vector4(aos[i * 3], aos[i * 3 + 1], aos[i * 3 + 2], 1.0f);
+			out[i * 3] = v.x;  out[i * 3 + 1] = v.y;  out[i * 3 + 2] = v.z;
+		}
+		benchSink(out[0]);
+	});
+	benchRun("transformPoints AoS", [&] {
+		transformPoints(m, &aos[0], &out[0], BENCH_POINTS);
+		benchSink(out[0]);
+	});
+	benchRun("transformPoints SoA", [&] {
+		transformPoints(m, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], BENCH_POINTS);
+		benchSink(ox[0]);
+	});
+	benchRun("projectPoints AoS", [&] {
+		projectPoints(mvp, &aos[0], &out[0], BENCH_POINTS);
+		benchSink(out[0]);
+	});
+	benchRun("min / max per component", [&] {
+		Vector3 lo(aos[0], aos[1], aos[2]), hi = lo;
+		for (int i = 0; i < BENCH_POINTS; i++) {
+			lo.x = min(lo.x, aos[i * 3]);  lo.y = min(lo.y, aos[i * 3 + 1]);  lo.z = min(lo.z, aos[i * 3 + 2]);
+			hi.x = max(hi.x, aos[i * 3]);  hi.y = max(hi.y, aos[i * 3 + 1]);  hi.z = max(hi.z, aos[i * 3 + 2]);
+		}
+		benchSink(lo.x + hi.z);
+	});
+	benchRun("computeBounds AoS", [&] {
+		Vector3 lo, hi;
+		computeBounds(&aos[0], BENCH_POINTS, lo, hi);
+		benchSink(lo.x + hi.z);
+	});
+	benchRun("computeTransformedBounds AoS", [&] {
+		Vector3 lo, hi;
+		computeTransformedBounds(m, &aos[0], BENCH_POINTS, lo, hi);
+		benchSink(lo.x + hi.z);
+	});
+}
+
+// renormalize the vertex normals of the Phong viewer's models, per vector and batched
+void benchNormalModels()
+{
+	const string NORMAL_MODELS_DIR = "../../../../assignment2/AS02_Framework/HW2_Xcode_Framework/NormalModels/";
+	const char* NORMAL_MODELS[] = { "bunny5KN.obj", "dragon10KN.obj", "lucy25KN.obj", "teapot4KN.obj", "dolphinN.obj" };
+	vector<float> normals;
+	for (const char* name : NORMAL_MODELS) {
+		tinyobj::attrib_t attrib;
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string warn, err;
+		if (tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, (NORMAL_MODELS_DIR + name).c_str(), NORMAL_MODELS_DIR.c_str()))
+			normals.insert(normals.end(), attrib.normals.begin(), attrib.normals.end());
+	}
+	if (normals.empty()) {
+		printf("-- normalize: no models in %s --\n", NORMAL_MODELS_DIR.c_str());
+		return;
+	}
+	size_t count = normals.size() / 3;
+	vector<float> out(normals.size());
+
+	printf("-- normalize (%d NormalModels normals) --\n", (int)count);
+	benchRun("Vector3::normalize() per normal", [&] {
+		for (size_t i = 0; i < count; i++) {
+			Vector3 n(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+			n.normalize();
+			out[i * 3] = n.x;  out[i * 3 + 1] = n.y;  out[i * 3 + 2] = n.z;
+		}
+		benchSink(out[0]);
+	});
+	benchRun("Vector3::fastNormalize() per normal", [&] {
+		for (size_t i = 0; i < count; i++) {
+			Vector3 n(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+			n.fastNormalize();
+			out[i * 3] = n.x;  out[i * 3 + 1] = n.y;  out[i * 3 + 2] = n.z;
+		}
+		benchSink(out[0]);
+	});
+	benchRun("normalizeVectors()", [&] {
+		normalizeVectors(&normals[0], &out[0], count);
+		benchSink(out[0]);
+	});
+	benchRun("fastNormalizeVectors()", [&] {
+		fastNormalizeVectors(&normals[0], &out[0], count);
+		benchSink(out[0]);
+	});
+}
+
+const string COLOR_MODELS_DIR = "../../../../assignment1/AS01_Framework/HW1_Xcode_Framework/ColorModels/";
+const size_t BENCH_MESH_STRIDE = 8;	// position, normal, texture coordinate
+
+// welded corners of all shapes of an OBJ file, BENCH_MESH_STRIDE floats per vertex
+bool loadBenchMesh(const string& path, vector<float>& vertices, vector<unsigned int>& indices)
+{
+	tinyobj::attrib_t attrib;
+	vector<tinyobj::shape_t> shapes;
+	vector<tinyobj::material_t> materials;
+	string warn, err;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), (GetBaseDir(path) + "/").c_str()))
+		return false;
+
+	vector<float> soup;
+	for (const tinyobj::shape_t& shape : shapes) {
+		for (const tinyobj::index_t& idx : shape.mesh.indices) {
+			float corner[BENCH_MESH_STRIDE] = {};
+			for (int k = 0; k < 3; k++) {
+				corner[k] = attrib.vertices[idx.vertex_index * 3 + k];
+				if (idx.normal_index >= 0)
+					corner[3 + k] = attrib.normals[idx.normal_index * 3 + k];
+			}
+			if (idx.texcoord_index >= 0) {
+				corner[6] = attrib.texcoords[idx.texcoord_index * 2];
+				corner[7] = attrib.texcoords[idx.texcoord_index * 2 + 1];
+			}
+			soup.insert(soup.end(), corner, corner + BENCH_MESH_STRIDE);
+		}
+	}
+	if (soup.empty())
+		return false;
+	weldVertices(&soup[0], soup.size() / BENCH_MESH_STRIDE, BENCH_MESH_STRIDE, vertices, indices);
+	return true;
+}
+
+// index and reorder the textured models and the scanned ColorModels of the
+// first viewer, one optimizeMesh() per model is timed
+void benchMeshOptimizer()
+{
+	const char* COLOR_MODELS[] = { "dragon10KC.obj", "happy10KC.obj", "lucy25KC.obj", "buddha50KC.obj", "Dino20KC.obj", "armadillo12KC.obj" };
+	vector<string> paths = model_list;
+	for (const char* name : COLOR_MODELS)
+		paths.push_back(COLOR_MODELS_DIR + name);
+
+	printf("-- mesh optimizer (FIFO %d) --\n", MESH_CACHE_SIZE);
+	printf("%-24s %8s %16s %16s %10s\n", "model", "tris", "ACMR", "ATVR", "ms");
+	for (const string& path : paths) {
+		vector<float> vertices;
+		vector<unsigned int> indices;
+		if (!loadBenchMesh(path, vertices, indices))
+			continue;
+		MeshCacheStats before = analyzeVertexCache(indices, vertices.size() / BENCH_MESH_STRIDE);
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		optimizeMesh(indices, vertices, BENCH_MESH_STRIDE);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		MeshCacheStats after = analyzeVertexCache(indices, vertices.size() / BENCH_MESH_STRIDE);
+
+		string name = path.substr(path.find_last_of("/\\") + 1);
+		printf("%-24s %8d    %.3f -> %.3f    %.3f -> %.3f %10.2f\n", name.c_str(), (int)before.triangles,
+			before.acmr(), after.acmr(), before.atvr(), after.atvr(), ms);
+	}
+}
+
+// LOD chains of the large scans; the error is given relative to the model
+// size and in pixels with the model fit to [-1, 1] and seen from the default
+// camera in one viewport, which is what selectLod() compares
+// the scale normalization() would give the mesh, center is its box center
+float benchMeshFit(const vector<float>& vertices, Vector3& center)
+{
+	size_t vertex_count = vertices.size() / BENCH_MESH_STRIDE;
+	Vector3 lo, hi;
+	vector<float> positions(vertex_count * 3);
+	for (size_t i = 0; i < vertex_count; i++)
+		memcpy(&positions[i * 3], &vertices[i * BENCH_MESH_STRIDE], 3 * sizeof(float));
+	computeBounds(&positions[0], vertex_count, lo, hi);
+	Vector3 extent = hi - lo;
+	center = (lo + hi) * 0.5f;
+	return 2.0f / max(extent.x, max(extent.y, extent.z));
+}
+
+// inverse of projection * DEFAULT_VIEW_MATRIX * fit, for cameraRay() into
+// the file's space of the fitted mesh; the fit is inverted by hand as its
+// scale is too small for invert() on some models
+Matrix4 benchMeshCamera(const vector<float>& vertices, const Matrix4& projection, Matrix4& inverse_fit)
+{
+	Vector3 center;
+	float fit = benchMeshFit(vertices, center);
+	inverse_fit = translate(center) * scaling(Vector3(1.0f / fit, 1.0f / fit, 1.0f / fit));
+	Matrix4 inverse_view = DEFAULT_VIEW_MATRIX, inverse_projection = projection;
+	return inverse_fit * inverse_view.invert() * inverse_projection.invert();
+}
+
+void benchLodChain()
+{
+	const char* LOD_MODELS[] = { "buddha50KC.obj", "lucy25KC.obj", "Dino20KC.obj", "dragon10KC.obj" };
+	const float pixels_per_unit = makePerspective(80.0f, 1.0f, 0.001f, 100.0f)[5] / (DEFAULT_CAMERA.position - DEFAULT_CAMERA.center).length() * WINDOW_HEIGHT * 0.5f;
+
+	printf("-- LOD chain (quadric error, %.0f%% cap) --\n", MESH_LOD_MAX_ERROR * 100);
+	printf("%-24s %10s  %s\n", "model", "build ms", "triangles / error % of the bbox diagonal / pixels per level");
+	for (const char* name : LOD_MODELS) {
+		vector<float> vertices;
+		vector<unsigned int> indices;
+		if (!loadBenchMesh(COLOR_MODELS_DIR + name, vertices, indices))
+			continue;
+		size_t vertex_count = vertices.size() / BENCH_MESH_STRIDE;
+		Vector3 center;
+		float fit = benchMeshFit(vertices, center);
+		Vector3 lo(vertices[0], vertices[1], vertices[2]), hi = lo;
+		for (size_t i = 0; i < vertex_count; i++) {
+			Vector3 p(vertices[i * BENCH_MESH_STRIDE], vertices[i * BENCH_MESH_STRIDE + 1], vertices[i * BENCH_MESH_STRIDE + 2]);
+			lo = Vector3(min(lo.x, p.x), min(lo.y, p.y), min(lo.z, p.z));
+			hi = Vector3(max(hi.x, p.x), max(hi.y, p.y), max(hi.z, p.z));
+		}
+		float diagonal = (hi - lo).length();
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		vector<MeshLod> lods = buildLodChain(indices, &vertices[0], vertex_count, BENCH_MESH_STRIDE);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		printf("%-24s %10.1f ", name, ms);
+		for (const MeshLod& lod : lods)
+			printf(" %6d / %.3f / %.2f", (int)lod.count / 3, lod.error / diagonal * 100, lod.error * fit * pixels_per_unit);
+		printf("\n");
+	}
+}
+
+// pickScene() latency on the large ColorModels: BVH build on the first pick,
+// then one ray cast per click over a grid of cursor positions
+void benchPicking()
+{
+	const char* PICK_MODELS[] = { "buddha50KC.obj", "lucy25KC.obj", "Dino20KC.obj" };
+	const int PICK_GRID = 64;
+	const Matrix4 projection = makePerspective(80.0f, 1.0f, 0.001f, 100.0f);
+	WorkerPool pool;
+
+	printf("-- BVH picking (%dx%d cursor grid) --\n", PICK_GRID, PICK_GRID);
+	printf("%-24s %10s %10s %10s %10s %8s\n", "model", "tris", "build ms", "avg us", "max us", "hits");
+	for (const char* name : PICK_MODELS) {
+		vector<float> vertices;
+		vector<unsigned int> indices;
+		if (!loadBenchMesh(COLOR_MODELS_DIR + name, vertices, indices))
+			continue;
+		Matrix4 inverse_fit;
+		Matrix4 inverse_mvp = benchMeshCamera(vertices, projection, inverse_fit);
+		vector<BvhMesh> meshes(1);
+		BvhMesh mesh = { &vertices[0], BENCH_MESH_STRIDE, &indices[0], indices.size() / 3 };
+		meshes[0] = mesh;
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		Bvh bvh;
+		bvh.build(meshes, pool);
+		double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		double total_us = 0, max_us = 0;
+		int hits = 0;
+		for (int i = 0; i < PICK_GRID * PICK_GRID; i++) {
+			begin = std::chrono::steady_clock::now();
+			Vector3 origin, direction;
+			cameraRay(inverse_mvp, ((i % PICK_GRID) + 0.5f) / PICK_GRID * 2.0f - 1.0f, ((i / PICK_GRID) + 0.5f) / PICK_GRID * 2.0f - 1.0f, origin, direction);
+			BvhHit hit;
+			hits += bvh.intersect(origin, direction, 0.0f, 1.0f, hit);
+			double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+			total_us += us;
+			max_us = max(max_us, us);
+		}
+		printf("%-24s %10d %10.2f %10.3f %10.3f %8d\n", name, (int)bvh.triangleCount(), build_ms, total_us / (PICK_GRID * PICK_GRID), max_us, hits);
+	}
+}
+
+// visibility of scattered shape boxes, one boxInFrustum() per box against cullBoxes()
+void benchFrustumCulling()
+{
+	const int BENCH_BOXES = 1024;
+	vector<float> cx(BENCH_BOXES), cy(BENCH_BOXES), cz(BENCH_BOXES), ex(BENCH_BOXES), ey(BENCH_BOXES), ez(BENCH_BOXES);
+	vector<unsigned char> visible(BENCH_BOXES), reference(BENCH_BOXES);
+	for (int i = 0; i < BENCH_BOXES; i++) {
+		cx[i] = sinf(i * 0.37f) * 4.0f;  cy[i] = sinf(i * 0.71f) * 4.0f;  cz[i] = sinf(i * 1.13f) * 4.0f;
+		ex[i] = 0.05f + 0.25f * fabsf(sinf(i * 0.13f));  ey[i] = ex[i] * 0.5f;  ez[i] = ex[i];
+	}
+	// the default camera, about a third of the boxes are in view
+	Frustum frustum = extractFrustum(makePerspective(80.0f, 1.0f, 0.001f, 100.0f) * DEFAULT_VIEW_MATRIX);
+
+	size_t visible_count = 0;
+	for (int i = 0; i < BENCH_BOXES; i++)
+		visible_count += reference[i] = boxInFrustum(frustum, Vector3(cx[i], cy[i], cz[i]), Vector3(ex[i], ey[i], ez[i]));
+	cullBoxes(frustum, &cx[0], &cy[0], &cz[0], &ex[0], &ey[0], &ez[0], BENCH_BOXES, &visible[0]);
+	int mismatches = 0;
+	for (int i = 0; i < BENCH_BOXES; i++)
+		mismatches += visible[i] != reference[i];
+
+	printf("-- frustum culling (%d boxes, %d visible, %d mismatches) --\n", BENCH_BOXES, (int)visible_count, mismatches);
+	benchRun("boxInFrustum() per box", [&] {
+		for (int i = 0; i < BENCH_BOXES; i++)
+			visible[i] = boxInFrustum(frustum, Vector3(cx[i], cy[i], cz[i]), Vector3(ex[i], ey[i], ez[i]));
+		benchSink(visible[0]);
+	});
+	benchRun("cullBoxes()", [&] {
+		benchSink(cullBoxes(frustum, &cx[0], &cy[0], &cz[0], &ex[0], &ey[0], &ez[0], BENCH_BOXES, &visible[0]));
+	});
+}
+
+// per frame work of the scene mode on the CPU for a grid and a scatter of
+// unit boxes, seen from the default camera
+void benchSceneBatching()
+{
+	const int SCENE_MODELS = 7;
+	const int SCENE_FRAMES = 50;
+	const float LOD_ERRORS[MESH_LOD_LEVELS] = { 0.0f, 0.002f, 0.005f, 0.012f };
+	vector<SceneModelInfo> infos(SCENE_MODELS);
+	for (SceneModelInfo& info : infos) {
+		info.bound_center = Vector3(0.0f, 0.0f, 0.0f);
+		info.bound_extent = Vector3(1.0f, 1.0f, 1.0f);
+		info.lod_errors.assign(LOD_ERRORS, LOD_ERRORS + MESH_LOD_LEVELS);
+	}
+	const Matrix4 projection = makePerspective(80.0f, 1.0f, 0.001f, 100.0f);
+	const Matrix4 view_projection = projection * DEFAULT_VIEW_MATRIX;
+	const float pixels_per_unit = fabsf(projection[5]) * WINDOW_HEIGHT * 0.5f;
+
+	printf("-- scene batching (%d frames) --\n", SCENE_FRAMES);
+	printf("%-24s %10s %10s %10s %10s %10s\n", "scene", "instances", "visible", "batches", "setup ms", "build ms");
+	const struct { const char* name; bool scatter; int count; } SCENES[] = {
+		{ "grid", false, 10000 }, { "grid", false, 50000 }, { "scatter", true, 50000 },
+	};
+	for (const auto& scene : SCENES) {
+		vector<SceneInstance> instances;
+		if (scene.scatter)
+			placeSceneScatter(instances, scene.count, SCENE_MODELS, SCENE_SPACING, SCENE_SEED);
+		else
+			placeSceneGrid(instances, scene.count, SCENE_MODELS, SCENE_SPACING);
+
+		SceneBatcher batcher;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		batcher.setInstances(instances, infos);
+		double setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		begin = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < SCENE_FRAMES; frame++)
+			batcher.build(view_projection, pixels_per_unit, LOD_PIXEL_ERROR);
+		double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / SCENE_FRAMES;
+		benchSink(batcher.matrices().empty() ? 0.0f : batcher.matrices()[0]);
+		printf("%-24s %10d %10d %10d %10.3f %10.3f\n", scene.name, scene.count, (int)batcher.visibleCount(),
+			(int)batcher.batches().size(), setup_ms, build_ms);
+	}
+}
+
+// radix sort of the render queue against std::stable_sort() of the same
+// items, for draws spread over 2 passes, 64 textures and 256 materials
+void benchRenderQueue()
+{
+	const int QUEUE_SIZES[] = { 16, 1024, 16384, 65536 };
+	const int QUEUE_REPEATS = 20;
+	printf("-- render queue (%d sorts) --\n", QUEUE_REPEATS);
+	printf("%-24s %10s %10s %10s %10s %10s\n", "draws", "changes", "sorted", "sort() us", "std us", "mismatch");
+	for (int size : QUEUE_SIZES) {
+		unsigned int seed = 12345;
+		vector<RenderItem> submitted(size);
+		for (int i = 0; i < size; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			uint32_t material = (seed >> 8) % 256;
+			float depth = (seed >> 16 & 0xff) / 255.0f;
+			// a material always uses the same texture, as in the loaded models
+			RenderItem item = { makeRenderKey(i * 2 / size, material % 64, material, RENDER_QUEUE_ARENA_VAO, depth), (uint32_t)i };
+			submitted[i] = item;
+		}
+
+		RenderQueue queue;
+		double radix_us = 0;
+		for (int r = 0; r < QUEUE_REPEATS; r++) {
+			queue.clear();
+			for (const RenderItem& item : submitted)
+				queue.push(item.key, item.draw);
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			queue.sort();
+			radix_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+		}
+
+		vector<RenderItem> reference;
+		double std_us = 0;
+		for (int r = 0; r < QUEUE_REPEATS; r++) {
+			reference = submitted;
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			std::stable_sort(reference.begin(), reference.end(), [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+			std_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+		}
+		int mismatches = 0;
+		for (int i = 0; i < size; i++)
+			mismatches += queue.items()[i].draw != reference[i].draw;
+		benchSink((float)queue.items()[0].draw);
+		printf("%-24d %10d %10d %10.2f %10.2f %10d\n", size, (int)queue.submittedStateChanges(), (int)queue.stateChanges(),
+			radix_us / QUEUE_REPEATS, std_us / QUEUE_REPEATS, mismatches);
+	}
+}
+
+// count view space samples of surfaces in [-1, 1]^3 seen from the default
+// camera, with normals facing every way; storage holds the SoA arrays
+PhongSamples makePhongTestSamples(vector<float>& storage, size_t count)
+{
+	storage.assign(count * 9, 0.0f);
+	float* a[9];
+	for (int k = 0; k < 9; k++)
+		a[k] = &storage[k * count];
+	for (size_t i = 0; i < count; i++) {
+		Vector4 p = DEFAULT_VIEW_MATRIX * Vector4(sinf(i * 0.37f), sinf(i * 0.71f), sinf(i * 1.13f), 1.0f);
+		a[0][i] = sinf(i * 0.53f);  a[1][i] = cosf(i * 0.29f);  a[2][i] = sinf(i * 0.97f + 1.0f);
+		a[3][i] = p.x;  a[4][i] = p.y;  a[5][i] = p.z;
+	}
+	PhongSamples s = { { a[0], a[1], a[2] }, { a[3], a[4], a[5] }, { a[6], a[7], a[8] } };
+	return s;
+}
+
+const PhongSurface TEST_SURFACE = { Vector3(0.2f, 0.2f, 0.2f), Vector3(0.8f, 0.7f, 0.6f), Vector3(0.5f, 0.5f, 0.5f), 64.0f };
+
+// the default lights on the test samples, phongShade() per sample against
+// phongShadeSamples(); the error is the largest channel difference
+void benchPhongShading()
+{
+	const int BENCH_SAMPLES = 1024;
+	const char* MODES[] = { "directional", "point", "spot" };
+	vector<float> storage, reference_storage;
+	PhongSamples lanes = makePhongTestSamples(storage, BENCH_SAMPLES);
+	PhongSamples reference = makePhongTestSamples(reference_storage, BENCH_SAMPLES);
+
+	printf("-- Phong shading (%d samples, %s, %d lanes) --\n", BENCH_SAMPLES, phongKernelBackend(), PHONG_LANES);
+	for (int mode = PhongDirectional; mode <= PhongSpot; mode++) {
+		PhongLights lights = DEFAULT_LIGHTS;
+		lights.mode = mode;
+		PhongView view = makePhongView(lights, DEFAULT_VIEW_MATRIX);
+		phongShadeSamplesScalar(view, TEST_SURFACE, reference, BENCH_SAMPLES);
+		phongShadeSamples(view, TEST_SURFACE, lanes, BENCH_SAMPLES);
+		float error = 0.0f;
+		for (int k = 0; k < 3; k++)
+			for (int i = 0; i < BENCH_SAMPLES; i++)
+				error = max(error, fabsf(lanes.color[k][i] - reference.color[k][i]));
+
+		string scalar_name = string("phongShade() ") + MODES[mode], lanes_name = string("phongShadeSamples() ") + MODES[mode];
+		double scalar_ns = benchRun(scalar_name.c_str(), [&] {
+			phongShadeSamplesScalar(view, TEST_SURFACE, reference, BENCH_SAMPLES);
+			benchSink(reference.color[0][0]);
+		});
+		double lanes_ns = benchRun(lanes_name.c_str(), [&] {
+			phongShadeSamples(view, TEST_SURFACE, lanes, BENCH_SAMPLES);
+			benchSink(lanes.color[0][0]);
+		});
+		printf("%-40s %10.1f -> %.1f Msamples/s (%.1fx), max error %.2g\n", MODES[mode], BENCH_SAMPLES * 1e3 / scalar_ns,
+			BENCH_SAMPLES * 1e3 / lanes_ns, scalar_ns / lanes_ns, error);
+	}
+}
+
+// an RGBA8 pattern with detail down to single texels, for the texture cases
+vector<uint32_t> makeTestImage(int width, int height)
+{
+	vector<uint32_t> image((size_t)width * height);
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+			uint32_t r = (x * 255 / width) ^ (h & 0x1f), g = (y * 255 / height) ^ ((h >> 8) & 0x1f), b = ((x ^ y) & 0xff);
+			image[(size_t)y * width + x] = r | (g << 8) | (b << 16) | 0xff000000u;
+		}
+	return image;
+}
+
+// softModulateTexture() over a texture larger than the caches, Morton
+// against row by row: a 512 x 512 screen walks it row by row, with the
+// texture at 0, 30 and 90 degrees to the screen, magnified (bilinear) and
+// at 4 texels per pixel (trilinear between levels 2 and 3)
+void benchTextureSampling()
+{
+	const int TEXTURE_SIZE = 2048, SCREEN = 512;
+	vector<uint32_t> image = makeTestImage(TEXTURE_SIZE, TEXTURE_SIZE);
+	SoftTexture textures[2] = { makeSoftTexture(&image[0], TEXTURE_SIZE, TEXTURE_SIZE, SoftLinear),
+		makeSoftTexture(&image[0], TEXTURE_SIZE, TEXTURE_SIZE, SoftMorton) };
+	const SoftSampler sampler = { true, true, true };
+	struct { const char* name; float degrees, texels_per_pixel; } patterns[] = {
+		{ "bilinear 0 deg", 0.0f, 1.0f }, { "bilinear 30 deg", 30.0f, 1.0f }, { "bilinear 90 deg", 90.0f, 1.0f },
+		{ "trilinear 0 deg", 0.0f, 4.0f }, { "trilinear 30 deg", 30.0f, 4.0f }, { "trilinear 90 deg", 90.0f, 4.0f },
+	};
+	vector<float> u(SCREEN), v(SCREEN), lod(SCREEN), r(SCREEN), g(SCREEN), b(SCREEN);
+	float* color[3] = { &r[0], &g[0], &b[0] };
+
+	printf("-- texture sampling (%dx%d RGBA8, %s) --\n", TEXTURE_SIZE, TEXTURE_SIZE, softTextureBackend());
+	for (auto& pattern : patterns) {
+		float angle = pattern.degrees * acosf(-1.0f) / 180.0f;
+		float step = pattern.texels_per_pixel / TEXTURE_SIZE;
+		float dx_u = cosf(angle) * step, dx_v = sinf(angle) * step;
+		float level = log2f(pattern.texels_per_pixel) + 0.5f;	// halfway between two levels
+		double ns[2];
+		for (int layout = 0; layout < 2; layout++) {
+			int y = 0;
+			string name = string(pattern.name) + (layout == SoftLinear ? " (linear)" : " (Morton)");
+			ns[layout] = benchRun(name.c_str(), [&] {
+				y = (y + 1) % SCREEN;
+				for (int x = 0; x < SCREEN; x++) {
+					u[x] = x * dx_u - y * dx_v + 0.1f;
+					v[x] = x * dx_v + y * dx_u + 0.1f;
+					lod[x] = pattern.texels_per_pixel > 1.0f ? level : 0.0f;
+					r[x] = g[x] = b[x] = 1.0f;
+				}
+				softModulateTexture(textures[layout], sampler, &u[0], &v[0], &lod[0], color, SCREEN);
+				benchSink(r[0] + g[SCREEN / 2] + b[SCREEN - 1]);
+			});
+		}
+		printf("%-40s %10.1f -> %.1f Msamples/s (%.2fx)\n", pattern.name, SCREEN * 1e3 / ns[SoftLinear],
+			SCREEN * 1e3 / ns[SoftMorton], ns[SoftLinear] / ns[SoftMorton]);
+	}
+}
+
+// cost of one camera record to the caller: the async logger under a burst and
+// at a steady rate, against formatting and flushing it on the calling thread
+void benchLogger()
+{
+	const int LOG_CALLS = 100000;
+	const double PACED_US = 20.0;	// far above the event rate of a mouse drag
+	FILE* sink = fopen("/dev/null", "w");
+	if (sink == NULL)
+		return;
+	vector<double> ns(LOG_CALLS);
+	auto timeCalls = [&](const char* name, double interval_us, const std::function<uint64_t(float)>& call) {
+		std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+		uint64_t dropped = 0;
+		for (int i = 0; i < LOG_CALLS; i++) {
+			while (std::chrono::steady_clock::now() < next)
+				;
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			dropped = call((float)i);
+			ns[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+			next = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(interval_us));
+		}
+		double total = 0;
+		for (double t : ns)
+			total += t;
+		std::sort(ns.begin(), ns.end());
+		printf("%-28s %10.1f %10.1f %10.1f %10d\n", name, total / LOG_CALLS, ns[LOG_CALLS * 99 / 100], ns[LOG_CALLS - 1], (int)dropped);
+	};
+
+	printf("-- logging latency per call (%d camera records to /dev/null) --\n", LOG_CALLS);
+	printf("%-28s %10s %10s %10s %10s\n", "", "avg ns", "p99 ns", "max ns", "dropped");
+	{
+		Logger logger(sink);
+		timeCalls("LOG burst", 0.0, [&](float x) {
+			logger.log(LogInfo, "Camera Position = ( %f , %f , %f )", x, 1.0f, 2.0f);
+			return logger.droppedCount();
+		});
+	}
+	{
+		Logger logger(sink);
+		timeCalls("LOG every 20 us", PACED_US, [&](float x) {
+			logger.log(LogInfo, "Camera Position = ( %f , %f , %f )", x, 1.0f, 2.0f);
+			return logger.droppedCount();
+		});
+	}
+	timeCalls("fprintf + fflush every 20 us", PACED_US, [&](float x) {
+		fprintf(sink, "Camera Position = ( %f , %f , %f )\n", x, 1.0f, 2.0f);
+		fflush(sink);
+		return (uint64_t)0;
+	});
+	fclose(sink);
+}
+
+// MV and MVP as in RenderScene of the Phong viewer, operator chain against Matrix4Chain
+void benchMatrixChains()
+{
+	const int SAMPLES = 256;
+	vector<Matrix4> models(SAMPLES);
+	for (int i = 0; i < SAMPLES; i++)
+		models[i] = composeTRS(Vector3(i * 0.01f, 1.0f, -2.0f), Vector3(i * 0.1f, i * 0.2f, 0.3f), Vector3(1.0f, 2.0f, 0.5f));
+
+	printf("-- matrix chains --\n");
+	int i = 0;
+	benchRun("V * M (general)", [&] {
+		i = (i + 1) & (SAMPLES - 1);
+		Matrix4 mv = view_matrix * models[i];
+		benchSink(mv[0] + mv[15]);
+	});
+	benchRun("V * M (multiplyAffine)", [&] {
+		i = (i + 1) & (SAMPLES - 1);
+		Matrix4 mv = view_matrix.multiplyAffine(models[i]);
+		benchSink(mv[0] + mv[15]);
+	});
+	benchRun("P * V * M, V * M (operator*)", [&] {
+		i = (i + 1) & (SAMPLES - 1);
+		Matrix4 mvp = project_matrix * view_matrix * models[i];
+		Matrix4 mv = view_matrix * models[i];
+		benchSink(mvp[0] + mv[15]);
+	});
+	benchRun("P * V * M, V * M (Matrix4Chain)", [&] {
+		i = (i + 1) & (SAMPLES - 1);
+		Matrix4Chain chain(models[i], MatrixAffine);
+		Matrix4 mv = chain.preMultiply(view_matrix, MatrixAffine).get();
+		const Matrix4& mvp = chain.preMultiply(project_matrix).get();
+		benchSink(mvp[0] + mv[15]);
+	});
+}
+
+// throughput of the math library calls on the per frame paths
+void benchMathLibrary()
+{
+	Matrix4 euclidean = translate(Vector3(0.5f, -1.0f, 2.0f)) * rotate(Vector3(0.3f, 0.6f, 0.1f));
+	Matrix4 affine = composeTRS(Vector3(0.5f, -1.0f, 2.0f), Vector3(0.3f, 0.6f, 0.1f), Vector3(1.5f, 0.5f, 2.0f));
+	Matrix4 projective = makePerspective(60.0f, 1.5f, 0.1f, 100.0f) * DEFAULT_VIEW_MATRIX * affine;
+	Vector3 v(0.3f, -1.2f, 2.5f), r(0.3f, 1.2f, -0.7f);
+	main_camera = DEFAULT_CAMERA;
+	proj.fovy = 60.0f;  proj.aspect = 1.5f;  proj.nearClip = 0.1f;  proj.farClip = 100.0f;
+
+	printf("-- math library --\n");
+	struct { const char* name; const Matrix4* m; Matrix4& (Matrix4::*invert)(); } inverses[] = {
+		{ "invert() affine", &affine, &Matrix4::invert },
+		{ "invert() projective", &projective, &Matrix4::invert },
+		{ "invertEuclidean()", &euclidean, &Matrix4::invertEuclidean },
+		{ "invertAffine()", &affine, &Matrix4::invertAffine },
+		{ "invertProjective()", &projective, &Matrix4::invertProjective },
+		{ "invertGeneral()", &projective, &Matrix4::invertGeneral },
+	};
+	for (size_t k = 0; k < sizeof(inverses) / sizeof(inverses[0]); k++) {
+		benchRun(inverses[k].name, [&] {
+			Matrix4 m = *inverses[k].m;
+			(m.*inverses[k].invert)();
+			benchSink(m[0] + m[15]);
+		});
+	}
+	benchRun("getTranspose()", [&] {
+		affine[3] += 1e-6f;
+		benchSink(affine.getTranspose()[12]);
+	});
+	benchRun("Vector3::normalize()", [&] {
+		v.x += 1e-6f;
+		Vector3 n = v;
+		benchSink(n.normalize().x);
+	});
+	benchRun("Vector3::fastNormalize()", [&] {
+		v.x += 1e-6f;
+		Vector3 n = v;
+		benchSink(n.fastNormalize().x);
+	});
+	benchRun("Vector3::length()", [&] {
+		v.x += 1e-6f;
+		benchSink(v.length());
+	});
+	benchRun("Vector3::fastLength()", [&] {
+		v.x += 1e-6f;
+		benchSink(v.fastLength());
+	});
+	benchRun("translate()", [&] {
+		v.x += 1e-6f;
+		benchSink(translate(v)[3]);
+	});
+	benchRun("rotate()", [&] {
+		r.y += 1e-6f;
+		Matrix4 m = rotate(r);
+		benchSink(m[0] + m[5]);
+	});
+	benchRun("scaling()", [&] {
+		v.x += 1e-6f;
+		benchSink(scaling(v)[0]);
+	});
+	benchRun("setViewingMatrix()", [&] {
+		main_camera.position.x += 1e-6f;
+		setViewingMatrix();
+		benchSink(view_matrix[0]);
+	});
+	benchRun("setPerspective()", [&] {
+		proj.fovy += 1e-6f;
+		setPerspective();
+		benchSink(project_matrix[0]);
+	});
+}
+
+// double precision references for runAccuracySuite()
+MatrixN<double, 4> refTranslate(const Vector3& t)
+{
+	MatrixN<double, 4> m;
+	m[3] = t.x;  m[7] = t.y;  m[11] = t.z;
+	return m;
+}
+
+MatrixN<double, 4> refScaling(const Vector3& s)
+{
+	MatrixN<double, 4> m;
+	m[0] = s.x;  m[5] = s.y;  m[10] = s.z;
+	return m;
+}
+
+// Rx * Ry * Rz like rotate()
+MatrixN<double, 4> refRotate(const Vector3& r)
+{
+	MatrixN<double, 4> x, y, z;
+	x[5] = cos((double)r.x);  x[6] = -sin((double)r.x);  x[9] = sin((double)r.x);  x[10] = cos((double)r.x);
+	y[0] = cos((double)r.y);  y[2] = sin((double)r.y);  y[8] = -sin((double)r.y);  y[10] = cos((double)r.y);
+	z[0] = cos((double)r.z);  z[1] = -sin((double)r.z);  z[4] = sin((double)r.z);  z[5] = cos((double)r.z);
+	return x * y * z;
+}
+
+// rotation matrix of q, normalized in double
+MatrixN<double, 4> refRotate(const Quaternion& q)
+{
+	VectorN<double, 4> v(q.x, q.y, q.z, q.w);
+	v.normalize();
+	double x = v[0], y = v[1], z = v[2], w = v[3];
+	MatrixN<double, 4> m;
+	m[0] = 1 - 2 * (y * y + z * z);  m[1] = 2 * (x * y - w * z);  m[2] = 2 * (x * z + w * y);
+	m[4] = 2 * (x * y + w * z);  m[5] = 1 - 2 * (x * x + z * z);  m[6] = 2 * (y * z - w * x);
+	m[8] = 2 * (x * z - w * y);  m[9] = 2 * (y * z + w * x);  m[10] = 1 - 2 * (x * x + y * y);
+	return m;
+}
+
+MatrixN<double, 4> refLookAt(const Vector3& eye, const Vector3& center, const Vector3& up)
+{
+	VectorN<double, 3> e = toVectorN<double>(eye);
+	VectorN<double, 3> f = e - toVectorN<double>(center);
+	f.normalize();
+	VectorN<double, 3> r = cross(toVectorN<double>(up), f);
+	r.normalize();
+	VectorN<double, 3> u = cross(f, r);
+	MatrixN<double, 4> m;
+	for (int i = 0; i < 3; i++) {
+		m[i] = r[i];  m[4 + i] = u[i];  m[8 + i] = f[i];
+	}
+	m[3] = -r.dot(e);  m[7] = -u.dot(e);  m[11] = -f.dot(e);
+	return m;
+}
+
+MatrixN<double, 4> refPerspective(double fovy, double aspect, double front, double back)
+{
+	double tangent = tan(fovy / 2 * 3.14159265358979323846 / 180);
+	MatrixN<double, 4> m;
+	m[0] = 1 / (tangent * aspect);
+	m[5] = 1 / tangent;
+	m[10] = -(back + front) / (back - front);
+	m[11] = -(2 * back * front) / (back - front);
+	m[14] = -1;
+	m[15] = 0;
+	return m;
+}
+
+double matrixUlpError(const Matrix4& got, const MatrixN<double, 4>& ref)
+{
+	double scale = 0.0, worst = 0.0;
+	for (int i = 0; i < 16; i++)
+		scale = max(scale, fabs(ref[i]));
+	for (int i = 0; i < 16; i++)
+		worst = max(worst, ulpError(got[i], ref[i], scale));
+	return worst;
+}
+
+// ||M|| * ||M^-1|| in the max row sum norm, how much any float inverse of M
+// amplifies rounding errors
+double conditionNumber(const MatrixN<double, 4>& m, const MatrixN<double, 4>& inverse)
+{
+	double norm = 0.0, inverse_norm = 0.0;
+	for (int i = 0; i < 4; i++) {
+		norm = max(norm, fabs(m[i * 4]) + fabs(m[i * 4 + 1]) + fabs(m[i * 4 + 2]) + fabs(m[i * 4 + 3]));
+		inverse_norm = max(inverse_norm, fabs(inverse[i * 4]) + fabs(inverse[i * 4 + 1]) + fabs(inverse[i * 4 + 2]) + fabs(inverse[i * 4 + 3]));
+	}
+	return norm * inverse_norm;
+}
+
+// ulp error of the math library against double precision references over
+// ACCURACY_SAMPLES inputs, each case gated by benchCheck(). Inverse errors
+// are divided by the condition number of the input, the projection matrices
+// are as ill-conditioned as the viewer's own (near plane down to 0.001).
+// The limits leave about 2x headroom over the errors of the current code.
+void runAccuracySuite()
+{
+	const int ACCURACY_SAMPLES = 2000;
+	unsigned int seed = 12345;
+	auto random = [&](float lo, float hi) {
+		seed = seed * 1664525u + 1013904223u;
+		return lo + (hi - lo) * (seed >> 8) * (1.0f / 16777216.0f);
+	};
+	auto randomVector = [&](float lo, float hi) {
+		float x = random(lo, hi), y = random(lo, hi);
+		return Vector3(x, y, random(lo, hi));
+	};
+
+#ifdef MATH_RSQRT_SSE
+	const double FAST_RSQRT_LIMIT = 8;	// rsqrt estimate + one Newton step
+#else
+	const double FAST_RSQRT_LIMIT = 160;	// invSqrt() + two Newton steps
+#endif
+	const double PHONG_SAMPLES_LIMIT = 1000;
+	const double TEXTURE_SAMPLES_LIMIT = 8;
+
+	enum { PRODUCT, TRANSFORM, TRANSPOSE, INV_EUCLIDEAN, INV_AFFINE, INV_PROJECTIVE, INV_GENERAL, INVERT,
+		NORMALIZE, FAST_NORMALIZE, FAST_LENGTH, NORMALIZE_BATCH, FAST_NORMALIZE_BATCH, TRANSLATE, ROTATE, SCALING, COMPOSE_TRS, COMPOSE_TRS_QUATERNION, VIEWING, PERSPECTIVE,
+		PHONG_SAMPLES, TEXTURE_SAMPLES, CASES };
+	struct { const char* name; double limit; } cases[CASES] = {
+		{ "Matrix4 * Matrix4", 2 },
+		{ "Matrix4 * Vector4", 8 },
+		{ "getTranspose()", 0 },
+		{ "invertEuclidean() / cond", 0.5 },
+		{ "invertAffine() / cond", 0.5 },
+		{ "invertProjective() / cond", 4096 },	// unpivoted 2x2 partition, invert() does not use it
+		{ "invertGeneral() / cond", 1 },
+		{ "invert() / cond", 1 },
+		{ "Vector3::normalize()", 4 },
+		{ "Vector3::fastNormalize()", FAST_RSQRT_LIMIT },
+		{ "Vector3::fastLength()", FAST_RSQRT_LIMIT },
+		{ "normalizeVectors()", 4 },
+		{ "fastNormalizeVectors()", FAST_RSQRT_LIMIT },
+		{ "translate()", 0 },
+		{ "rotate()", 2 },
+		{ "scaling()", 0 },
+		{ "composeTRS()", 4 },
+		{ "composeTRS(Quaternion)", 16 },
+		{ "setViewingMatrix()", 4 },	// through lookAtOrientation()
+		{ "setPerspective()", 10 },
+		{ "phongShadeSamples() / phongShade()", PHONG_SAMPLES_LIMIT },	// float reference, pow() of the rsqrt normalize
+		{ "softModulateTexture() / sampleTexture()", TEXTURE_SAMPLES_LIMIT },	// float reference, ulps of 1.0
+	};
+	double worst[CASES] = {};
+	vector<float> normals;	// the NORMALIZE inputs, normalized in one batch at the end
+	// not max(), the macro would evaluate err twice
+	auto record = [&](int id, double err) {
+		if (err > worst[id])
+			worst[id] = err;
+	};
+
+	for (int i = 0; i < ACCURACY_SAMPLES; i++) {
+		Vector3 t = randomVector(-10.0f, 10.0f), r = randomVector(-3.14f, 3.14f), s = randomVector(0.25f, 4.0f);
+		MatrixN<double, 4> ref_t = refTranslate(t), ref_r = refRotate(r), ref_s = refScaling(s);
+		Matrix4 euclidean = translate(t) * rotate(r);
+		Matrix4 affine = composeTRS(t, r, s);
+
+		Vector3 eye = randomVector(-20.0f, 20.0f), center = randomVector(-1.0f, 1.0f);
+		main_camera.position = eye;  main_camera.center = center;  main_camera.up_vector = Vector3(0.0f, 1.0f, 0.0f);
+		setViewingMatrix();
+		record(VIEWING, matrixUlpError(view_matrix, refLookAt(eye, center, Vector3(0.0f, 1.0f, 0.0f))));
+		proj.fovy = random(30.0f, 90.0f);  proj.aspect = random(0.5f, 2.0f);  proj.nearClip = random(0.001f, 1.0f);  proj.farClip = random(10.0f, 1000.0f);
+		setPerspective();
+		record(PERSPECTIVE, matrixUlpError(project_matrix, refPerspective(proj.fovy, proj.aspect, proj.nearClip, proj.farClip)));
+		Matrix4 projective = project_matrix * view_matrix * affine;
+
+		record(PRODUCT, matrixUlpError(project_matrix * view_matrix, toMatrixN<double>(project_matrix) * toMatrixN<double>(view_matrix)));
+		Vector4 v(t.x, t.y, t.z, 1.0f), mv = projective * v;
+		VectorN<double, 4> ref_v = toMatrixN<double>(projective) * toVectorN<double>(v);
+		double scale = max(max(fabs(ref_v[0]), fabs(ref_v[1])), max(fabs(ref_v[2]), fabs(ref_v[3])));
+		for (int j = 0; j < 4; j++)
+			record(TRANSFORM, ulpError((&mv.x)[j], ref_v[j], scale));
+		const float* columns = projective.getTranspose();
+		for (int j = 0; j < 16; j++)
+			record(TRANSPOSE, ulpError(columns[(j % 4) * 4 + j / 4], projective[j], 0.0));
+
+		struct { int id; Matrix4 m; Matrix4& (Matrix4::*invert)(); } inverses[] = {
+			{ INV_EUCLIDEAN, euclidean, &Matrix4::invertEuclidean },
+			{ INV_AFFINE, affine, &Matrix4::invertAffine },
+			{ INV_PROJECTIVE, projective, &Matrix4::invertProjective },
+			{ INV_GENERAL, projective, &Matrix4::invertGeneral },
+			{ INVERT, i % 2 ? affine : projective, &Matrix4::invert },
+		};
+		for (size_t k = 0; k < sizeof(inverses) / sizeof(inverses[0]); k++) {
+			MatrixN<double, 4> ref = toMatrixN<double>(inverses[k].m), ref_inverse = ref;
+			ref_inverse.invert();
+			Matrix4 m = inverses[k].m;
+			(m.*inverses[k].invert)();
+			record(inverses[k].id, matrixUlpError(m, ref_inverse) / conditionNumber(ref, ref_inverse));
+		}
+
+		Vector3 n = randomVector(-100.0f, 100.0f), fast_n = n;
+		normals.insert(normals.end(), &n.x, &n.x + 3);
+		VectorN<double, 3> ref_n = toVectorN<double>(n);
+		record(FAST_LENGTH, ulpError(n.fastLength(), ref_n.length(), 0.0));
+		ref_n.normalize();
+		n.normalize();
+		fast_n.fastNormalize();
+		scale = max(fabs(ref_n[0]), max(fabs(ref_n[1]), fabs(ref_n[2])));
+		for (int j = 0; j < 3; j++) {
+			record(NORMALIZE, ulpError((&n.x)[j], ref_n[j], scale));
+			record(FAST_NORMALIZE, ulpError((&fast_n.x)[j], ref_n[j], scale));
+		}
+
+		record(TRANSLATE, matrixUlpError(translate(t), ref_t));
+		record(ROTATE, matrixUlpError(rotate(r), ref_r));
+		record(SCALING, matrixUlpError(scaling(s), ref_s));
+		record(COMPOSE_TRS, matrixUlpError(affine, ref_t * ref_r * ref_s));
+		Quaternion q = Quaternion::fromEuler(r);
+		record(COMPOSE_TRS_QUATERNION, matrixUlpError(composeTRS(t, q, s), ref_t * refRotate(q) * ref_s));
+	}
+
+	vector<float> exact(normals.size()), fast(normals.size());
+	normalizeVectors(&normals[0], &exact[0], ACCURACY_SAMPLES);
+	fastNormalizeVectors(&normals[0], &fast[0], ACCURACY_SAMPLES);
+	for (int i = 0; i < ACCURACY_SAMPLES; i++) {
+		VectorN<double, 3> ref_n(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+		ref_n.normalize();
+		double scale = max(fabs(ref_n[0]), max(fabs(ref_n[1]), fabs(ref_n[2])));
+		for (int j = 0; j < 3; j++) {
+			record(NORMALIZE_BATCH, ulpError(exact[i * 3 + j], ref_n[j], scale));
+			record(FAST_NORMALIZE_BATCH, ulpError(fast[i * 3 + j], ref_n[j], scale));
+		}
+	}
+
+	vector<float> lanes_storage, reference_storage;
+	PhongSamples lanes = makePhongTestSamples(lanes_storage, ACCURACY_SAMPLES);
+	PhongSamples reference = makePhongTestSamples(reference_storage, ACCURACY_SAMPLES);
+	for (int mode = PhongDirectional; mode <= PhongSpot; mode++) {
+		PhongLights lights = DEFAULT_LIGHTS;
+		lights.mode = mode;
+		PhongView view = makePhongView(lights, DEFAULT_VIEW_MATRIX);
+		phongShadeSamples(view, TEST_SURFACE, lanes, ACCURACY_SAMPLES);
+		phongShadeSamplesScalar(view, TEST_SURFACE, reference, ACCURACY_SAMPLES);
+		for (int i = 0; i < ACCURACY_SAMPLES; i++) {
+			double scale = max(fabs(reference.color[0][i]), max(fabs(reference.color[1][i]), fabs(reference.color[2][i])));
+			for (int k = 0; k < 3; k++)
+				record(PHONG_SAMPLES, ulpError(lanes.color[k][i], reference.color[k][i], scale));
+		}
+	}
+
+	// every filter and wrap mode, both layouts, coordinates a few repeats
+	// out in both directions and levels of detail past the last level
+	const int TEST_TEXTURE_WIDTH = 37, TEST_TEXTURE_HEIGHT = 20;
+	vector<uint32_t> image = makeTestImage(TEST_TEXTURE_WIDTH, TEST_TEXTURE_HEIGHT);
+	vector<float> u(ACCURACY_SAMPLES), v(ACCURACY_SAMPLES), lod(ACCURACY_SAMPLES), rgb(3 * ACCURACY_SAMPLES);
+	float* color[3] = { &rgb[0], &rgb[ACCURACY_SAMPLES], &rgb[2 * ACCURACY_SAMPLES] };
+	for (int i = 0; i < ACCURACY_SAMPLES; i++) {
+		u[i] = random(-3.0f, 3.0f);
+		v[i] = random(-3.0f, 3.0f);
+		lod[i] = i % 4 == 0 ? random(-2.0f, 0.0f) : random(0.0f, 7.0f);
+	}
+	for (int layout = SoftLinear; layout <= SoftMorton; layout++) {
+		SoftTexture texture = makeSoftTexture(&image[0], TEST_TEXTURE_WIDTH, TEST_TEXTURE_HEIGHT, (SoftTextureLayout)layout);
+		for (int mode = 0; mode < 8; mode++) {
+			SoftSampler sampler = { (mode & 1) != 0, (mode & 2) != 0, (mode & 4) != 0 };
+			std::fill(rgb.begin(), rgb.end(), 1.0f);
+			softModulateTexture(texture, sampler, &u[0], &v[0], &lod[0], color, ACCURACY_SAMPLES);
+			for (int i = 0; i < ACCURACY_SAMPLES; i++) {
+				Vector3 reference = sampleTexture(texture, sampler, u[i], v[i], lod[i]);
+				for (int k = 0; k < 3; k++)
+					record(TEXTURE_SAMPLES, ulpError(color[k][i], (&reference.x)[k], 1.0));
+			}
+		}
+	}
+
+	printf("-- accuracy against double (%d samples) --\n", ACCURACY_SAMPLES);
+	for (int k = 0; k < CASES; k++)
+		benchCheck(cases[k].name, worst[k], cases[k].limit);
+}
+
+// CPU side micro-benchmarks, run with --bench
+void runBenchmarks()
+{
+	Vector3 t(0.25f, -0.5f, 1.0f), r(0.3f, 1.2f, -0.7f), sc(1.5f, 0.8f, 1.1f);
+
+	printf("-- model matrix --\n");
+	benchRun("translate * rotate * scaling", [&] {
+		r.y += 1e-6f;
+		Matrix4 m = translate(t) * rotate(r) * scaling(sc);
+		benchSink(m[0] + m[5] + m[10] + m[3]);
+	});
+	benchRun("composeTRS", [&] {
+		r.y += 1e-6f;
+		Matrix4 m = composeTRS(t, r, sc);
+		benchSink(m[0] + m[5] + m[10] + m[3]);
+	});
+	benchRun("(T * R * S).invert()", [&] {
+		r.y += 1e-6f;
+		Matrix4 m = translate(t) * rotate(r) * scaling(sc);
+		m.invertAffine();
+		benchSink(m[0] + m[5] + m[10] + m[3]);
+	});
+	benchRun("composeTRSInverse", [&] {
+		r.y += 1e-6f;
+		Matrix4 m = composeTRSInverse(t, r, sc);
+		benchSink(m[0] + m[5] + m[10] + m[3]);
+	});
+	benchRun("composeNormalMatrix", [&] {
+		r.y += 1e-6f;
+		Matrix3 n = composeNormalMatrix(r, sc);
+		benchSink(n[0] + n[4] + n[8]);
+	});
+
+	// one rotation drag event plus the model matrix rebuild of the next frame
+	printf("-- rotation drag --\n");
+	const float step = acosf(-1.0f) / 180.0f * (45.0f / 400.0f);
+	benchRun("Euler angles + composeTRS", [&] {
+		r.x += step;  r.y += step;
+		Matrix4 m = composeTRS(t, r, sc);
+		benchSink(m[0] + m[5] + m[10]);
+	});
+	model drag_model;
+	benchRun("rotateModel + composeTRS(Quaternion)", [&] {
+		rotateModel(drag_model, Vector3(step, step, 0.0f));
+		Matrix4 m = composeTRS(t, drag_model.orientation, sc);
+		benchSink(m[0] + m[5] + m[10]);
+	});
+	Quaternion qa = Quaternion::fromEuler(r), qb = Quaternion::fromEuler(Vector3(-0.4f, 2.0f, 0.9f));
+	float s = 0.0f;
+	benchRun("Quaternion * Quaternion", [&] {
+		qa.w += 1e-7f;
+		Quaternion q = qa * qb;
+		benchSink(q.x + q.w);
+	});
+	benchRun("slerp()", [&] {
+		s = s < 1.0f ? s + 1e-3f : 0.0f;
+		Quaternion q = slerp(qa, qb, s);
+		benchSink(q.x + q.w);
+	});
+	Vector3 eye(1.0f, 2.0f, 3.0f);
+	benchRun("makeLookAt()", [&] {
+		eye.x += 1e-6f;
+		Matrix4 m = makeLookAt(eye, Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f));
+		benchSink(m[0] + m[11]);
+	});
+	benchRun("makeView()", [&] {
+		eye.x += 1e-6f;
+		Matrix4 m = makeView(eye, qb);
+		benchSink(m[0] + m[11]);
+	});
+
+	benchMathLibrary();
+	benchMatrixKernels();
+	benchMatrixChains();
+	benchBatchTransforms();
+	benchNormalModels();
+	benchMeshOptimizer();
+	benchLodChain();
+	benchPicking();
+	benchFrustumCulling();
+	benchSceneBatching();
+	benchRenderQueue();
+	benchPhongShading();
+	benchTextureSampling();
+	benchLogger();
+}
+
+// binary PPM, top row first
+bool writeSoftwareFrame(const SoftFramebuffer& framebuffer, const string& path)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", framebuffer.width, framebuffer.height);
+	vector<unsigned char> row(framebuffer.width * 3);
+	for (int y = framebuffer.height - 1; y >= 0; y--) {
+		for (int x = 0; x < framebuffer.width; x++) {
+			uint32_t c = framebuffer.color[(size_t)y * framebuffer.width + x];
+			row[x * 3] = c & 0xff;
+			row[x * 3 + 1] = (c >> 8) & 0xff;
+			row[x * 3 + 2] = (c >> 16) & 0xff;
+		}
+		fwrite(&row[0], 1, row.size(), file);
+	}
+	fclose(file);
+	return true;
+}
+
+// --soft [frames]: load the models without a GL context and render a turntable
+// of every model on the software backend, once on one thread and once on all;
+// the last frame of each model is written to soft_<model>.ppm
+int runSoftwareRenderer(int frames)
+{
+	gl_backend = false;
+	initParameter();
+	for (string model_path : model_list)
+		LoadTexturedModels(model_path);
+
+	SoftFramebuffer framebuffer;
+	framebuffer.resize(screenWidth, screenHeight);
+	SoftRasterizer single(1), parallel;
+	const Vector3 step(0.0f, 2.0f * acosf(-1.0f) / frames, 0.0f);
+
+	printf("-- software rasterizer (%dx%d, %d frames, %d threads) --\n", screenWidth, screenHeight, frames, parallel.threadCount());
+	printf("%-20s %10s %10s %12s %12s %10s %10s\n", "model", "tris", "pixels", "1 thread ms", "threads ms", "Mtris/s", "Mpix/s");
+	double total_triangles = 0, total_fragments = 0, total_single = 0, total_parallel = 0;
+	for (cur_idx = 0; cur_idx < (int)models.size(); cur_idx++) {
+		double seconds[2];
+		SoftStats stats;
+		size_t triangles = 0, fragments = 0;
+		SoftRasterizer* rasterizers[2] = { &single, &parallel };
+		for (int r = 0; r < 2; r++) {
+			setModelRotation(models[cur_idx], Vector3(0.0f, 0.0f, 0.0f));
+			triangles = fragments = 0;
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			for (int f = 0; f < frames; f++) {
+				stats = RenderFrameSoftware(*rasterizers[r], framebuffer);
+				triangles += stats.triangles;
+				fragments += stats.fragments;
+				rotateModel(models[cur_idx], step);
+			}
+			seconds[r] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		}
+		setModelRotation(models[cur_idx], Vector3(0.0f, 0.0f, 0.0f));
+
+		string name = model_list[cur_idx].substr(model_list[cur_idx].find_last_of("/\\") + 1);
+		printf("%-20s %10d %10d %12.2f %12.2f %10.2f %10.2f\n", name.c_str(), (int)(triangles / frames), (int)(fragments / frames),
+			seconds[0] * 1000.0 / frames, seconds[1] * 1000.0 / frames, triangles / seconds[1] * 1e-6, fragments / seconds[1] * 1e-6);
+		total_triangles += triangles;
+		total_fragments += fragments;
+		total_single += seconds[0];
+		total_parallel += seconds[1];
+		writeSoftwareFrame(framebuffer, "soft_" + name.substr(0, name.find_last_of('.')) + ".ppm");
+	}
+	printf("%-20s %10s %10s %12.2f %12.2f %10.2f %10.2f  (%.2fx)\n", "all", "", "", total_single * 1000.0 / (frames * models.size()),
+		total_parallel * 1000.0 / (frames * models.size()), total_triangles / total_parallel * 1e-6, total_fragments / total_parallel * 1e-6,
+		total_single / total_parallel);
+	return 0;
+}
+
+// one ray per pixel center of a width x height viewport through inverse_mvp,
+// the hit points go to hits (a row at a time, in pixel order); returns the
+// number of rays
+size_t castPrimaryRays(WorkerPool& pool, const Bvh& bvh, const Matrix4& inverse_mvp, int width, int height, vector<Vector3>& hits)
+{
+	vector<vector<Vector3> > rows(height);
+	pool.run(height, [&](size_t row, int) {
+		float ndc_y = (row + 0.5f) / height * 2.0f - 1.0f;
+		for (int col = 0; col < width; col++) {
+			Vector3 origin, direction;
+			cameraRay(inverse_mvp, (col + 0.5f) / width * 2.0f - 1.0f, ndc_y, origin, direction);
+			BvhHit hit;
+			if (bvh.intersect(origin, direction, 0.0f, 1.0f, hit))
+				rows[row].push_back(origin + direction * hit.t);
+		}
+	});
+	hits.clear();
+	for (const vector<Vector3>& row : rows)
+		hits.insert(hits.end(), row.begin(), row.end());
+	return (size_t)width * height;
+}
+
+// a shadow ray from every point towards light, returns how many are blocked
+size_t castShadowRays(WorkerPool& pool, const Bvh& bvh, const vector<Vector3>& points, const Vector3& light)
+{
+	const size_t CHUNK = 1024;
+	vector<size_t> blocked((points.size() + CHUNK - 1) / CHUNK);
+	pool.run(blocked.size(), [&](size_t chunk, int) {
+		size_t last = min(points.size(), (chunk + 1) * CHUNK);
+		for (size_t i = chunk * CHUNK; i < last; i++)
+			blocked[chunk] += bvh.occluded(points[i], light - points[i], 1e-4f, 1.0f);
+	});
+	size_t total = 0;
+	for (size_t b : blocked)
+		total += b;
+	return total;
+}
+
+// --raytrace: ray cast both viewports of every model against its BVH, write
+// ray_<model>.ppm and compare them with the software rasterizer; then time
+// the BVH build and the ray throughput on the largest ColorModels
+int runRayTracer()
+{
+	gl_backend = false;
+	lod_selection = false;
+	initParameter();
+	for (string model_path : model_list)
+		LoadTexturedModels(model_path);
+
+	WorkerPool single(1), parallel;
+	SoftRasterizer rasterizer;
+	SoftFramebuffer traced, rasterized;
+	traced.resize(screenWidth, screenHeight);
+	rasterized.resize(screenWidth, screenHeight);
+
+	printf("-- ray traced reference (%dx%d, %d threads) --\n", screenWidth, screenHeight, parallel.threadCount());
+	printf("%-20s %10s %10s %10s %10s %12s %12s\n", "model", "tris", "build ms", "frame ms", "Mrays/s", "mean error", "pixels > 16");
+	for (cur_idx = 0; cur_idx < (int)models.size(); cur_idx++) {
+		model& m = models[cur_idx];
+		setModelRotation(m, Vector3(0.0f, 0.0f, 0.0f));
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		const Bvh& bvh = modelBvh(m, parallel);
+		double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		begin = std::chrono::steady_clock::now();
+		size_t rays = RenderFrameRayTraced(parallel, traced);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		RenderFrameSoftware(rasterizer, rasterized);
+
+		// per channel difference against the rasterizer, and the share of
+		// pixels that are off by more than 16 / 255 in any channel
+		double error = 0;
+		size_t off = 0, pixels = traced.color.size();
+		for (size_t i = 0; i < pixels; i++) {
+			int worst = 0;
+			for (int shift = 0; shift < 24; shift += 8) {
+				int d = abs((int)((traced.color[i] >> shift) & 0xff) - (int)((rasterized.color[i] >> shift) & 0xff));
+				error += d;
+				worst = max(worst, d);
+			}
+			off += worst > 16;
+		}
+
+		string name = model_list[cur_idx].substr(model_list[cur_idx].find_last_of("/\\") + 1);
+		printf("%-20s %10d %10.2f %10.2f %10.2f %12.3f %11.2f%%\n", name.c_str(), (int)bvh.triangleCount(), build_ms, seconds * 1000.0,
+			rays / seconds * 1e-6, error / (pixels * 3), off * 100.0 / pixels);
+		writeSoftwareFrame(traced, "ray_" + name.substr(0, name.find_last_of('.')) + ".ppm");
+	}
+
+	// the ColorModels have no usable materials, they only time the geometry:
+	// primary rays from the default camera into a square viewport and shadow
+	// rays from every hit towards the point light
+	const char* RAY_MODELS[] = { "buddha50KC.obj", "lucy25KC.obj", "Dino20KC.obj" };
+	const int RAY_VIEWPORT = WINDOW_HEIGHT;
+	const Matrix4 projection = makePerspective(80.0f, 1.0f, 0.001f, 100.0f);
+
+	printf("-- BVH (binned SAH, %d bins, %d threads, %dx%d rays) --\n", BVH_BINS, parallel.threadCount(), RAY_VIEWPORT, RAY_VIEWPORT);
+	printf("%-18s %8s %8s %6s %8s %12s %12s %12s %12s %8s %12s\n", "model", "tris", "nodes", "depth", "SAH", "1 thread ms", "threads ms",
+		"1 thr Mray/s", "Mrays/s", "hits", "shadow Mr/s");
+	for (const char* name : RAY_MODELS) {
+		vector<float> vertices;
+		vector<unsigned int> indices;
+		if (!loadBenchMesh(COLOR_MODELS_DIR + name, vertices, indices))
+			continue;
+		Matrix4 inverse_fit;
+		Matrix4 inverse_mvp = benchMeshCamera(vertices, projection, inverse_fit);
+		Vector4 light = inverse_fit * Vector4(DEFAULT_LIGHTS.point.position.x, DEFAULT_LIGHTS.point.position.y, DEFAULT_LIGHTS.point.position.z, 1.0f);
+
+		vector<BvhMesh> meshes(1);
+		BvhMesh mesh = { &vertices[0], BENCH_MESH_STRIDE, &indices[0], indices.size() / 3 };
+		meshes[0] = mesh;
+		Bvh bvh;
+		double build_ms[2], primary[2];
+		vector<Vector3> hits;
+		WorkerPool* pools[2] = { &single, &parallel };
+		for (int p = 0; p < 2; p++) {
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			bvh.build(meshes, *pools[p]);
+			build_ms[p] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+			begin = std::chrono::steady_clock::now();
+			size_t rays = castPrimaryRays(*pools[p], bvh, inverse_mvp, RAY_VIEWPORT, RAY_VIEWPORT, hits);
+			primary[p] = rays / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() * 1e-6;
+		}
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		castShadowRays(parallel, bvh, hits, Vector3(light.x, light.y, light.z));
+		double shadow = hits.size() / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() * 1e-6;
+
+		printf("%-18s %8d %8d %6d %8.2f %12.2f %12.2f %12.2f %12.2f %8d %12.2f\n", name, (int)bvh.triangleCount(), (int)bvh.nodeCount(),
+			bvh.depth(), bvh.sahCost(), build_ms[0], build_ms[1], primary[0], primary[1], (int)hits.size(), shadow);
+	}
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
+	// --log-level debug|info|warn|error, with any of the modes below
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--log-level") == 0 && !Logger::instance().setLevel(argv[i + 1]))
+			printf("unknown log level %s, expected debug, info, warn or error\n", argv[i + 1]);
+	}
+
+	// --bench times the CPU side math and then runs the accuracy suite,
+	// --accuracy only the latter; both exit with 1 if a case is over its limit
+	if (argc > 1 && (strcmp(argv[1], "--bench") == 0 || strcmp(argv[1], "--accuracy") == 0)) {
+		if (strcmp(argv[1], "--bench") == 0)
+			runBenchmarks();
+		runAccuracySuite();
+		return benchFailures() > 0 ? 1 : 0;
+	}
+	// --soft [frames] renders on the CPU, no window or GL context is created
+	if (argc > 1 && strcmp(argv[1], "--soft") == 0)
+		return runSoftwareRenderer(argc > 2 ? max(atoi(argv[2]), 1) : SOFT_TURNTABLE_FRAMES);
+	// --raytrace renders the same frames by ray casting and times the BVH
+	if (argc > 1 && strcmp(argv[1], "--raytrace") == 0)
+		return runRayTracer();
+
+	// --record <file> logs input, --replay <file> plays it back at a fixed timestep
+	const char* record_path = NULL;
+	const char* replay_path = NULL;
+	// --scene grid|scatter|<file> [instances] starts with a scene of many models
+	const char* scene_placement = NULL;
+	int scene_count = SCENE_DEFAULT_INSTANCES;
+	bool headless = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			record_path = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replay_path = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+			scene_placement = argv[++i];
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				scene_count = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+	}
 
     // initial glfw
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // fix compilation on OS X
@@ -1095,36 +3253,87 @@ int main(int argc, char **argv)
 
 	glPrintContextInfo(false);
     
-	// register glfw callback functions
-    glfwSetKeyCallback(window, KeyCallback);
-	glfwSetScrollCallback(window, scroll_callback);
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
-	glfwSetCursorPosCallback(window, cursor_pos_callback);
+	// register glfw callback functions, live input is ignored while replaying
+	InputHandlers handlers = { KeyCallback, scroll_callback, mouse_button_callback, cursor_pos_callback };
+	if (replay_path != NULL) {
+		if (!input_replayer.load(replay_path, REPLAY_TIMESTEP))
+			return -1;
+	}
+	else if (record_path != NULL && input_recorder.begin(record_path)) {
+		glfwSetKeyCallback(window, record_key_callback);
+		glfwSetScrollCallback(window, record_scroll_callback);
+		glfwSetMouseButtonCallback(window, record_mouse_button_callback);
+		glfwSetCursorPosCallback(window, record_cursor_pos_callback);
+	}
+	else {
+		glfwSetKeyCallback(window, handlers.key);
+		glfwSetScrollCallback(window, handlers.scroll);
+		glfwSetMouseButtonCallback(window, handlers.mouse_button);
+		glfwSetCursorPosCallback(window, handlers.cursor_pos);
+	}
 
     glfwSetFramebufferSizeCallback(window, ChangeSize);
 	glEnable(GL_DEPTH_TEST);
 	// Setup render context
 	setupRC();
+	if (scene_placement != NULL)
+		scene_mode = createScene(scene_placement, scene_count);
 
 	// main loop
+	bool replaying = input_replayer.isLoaded();
+	double replay_start = glfwGetTime();
+	double frame_start = replay_start;
     while (!glfwWindowShouldClose(window))
     {
+		if (replaying) {
+			if (!input_replayer.isReplaying())
+				break;
+			input_replayer.dispatch(window, handlers);
+		}
+
         // render
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-		// render left view
-		glViewport(0, 0, screenWidth / 2, screenHeight);
-        RenderScene(1);
-		// render right view
-		glViewport(screenWidth / 2, 0, screenWidth / 2, screenHeight);
-		RenderScene(0);
+		if (scene_mode) {
+			// render left view
+			glViewport(0, 0, screenWidth / 2, screenHeight);
+			RenderSceneInstanced(1);
+			// render right view
+			glViewport(screenWidth / 2, 0, screenWidth / 2, screenHeight);
+			RenderSceneInstanced(0);
+		}
+		else {
+			// queue the left and right views, then draw both sorted by state
+			RenderScene(1, 0, 0, screenWidth / 2, screenHeight);
+			RenderScene(0, screenWidth / 2, 0, screenWidth / 2, screenHeight);
+			FlushRenderQueue();
+		}
+
+		if (frame_capture.isActive()) {
+			frame_capture.capture();
+			rotateModel(models[cur_idx], Vector3(0.0f, 2.0f * acosf(-1.0f) / TURNTABLE_FRAMES, 0.0f));
+			if (--turntable_frames_left <= 0)
+				frame_capture.stop();
+		}
         
         // swap buffer from back to front
         glfwSwapBuffers(window);
         
         // Poll input event
         glfwPollEvents();
+
+		double frame_end = glfwGetTime();
+		if (scene_mode)
+			reportSceneFrame((frame_end - frame_start) * 1000.0);
+		frame_start = frame_end;
     }
 	
+	if (replaying) {
+		double elapsed = glfwGetTime() - replay_start;
+		printf("Replay: %d frames in %.3f s, %.3f ms/frame\n", input_replayer.frameCount(), elapsed, elapsed * 1000.0 / input_replayer.frameCount());
+	}
+	input_recorder.end();
+	frame_capture.stop();
+
 	// just for compatibiliy purposes
 	return 0;
 }
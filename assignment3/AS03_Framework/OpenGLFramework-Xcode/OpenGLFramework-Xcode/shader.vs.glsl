@@ -4,6 +4,10 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec3 aNormal;
 layout (location = 3) in vec2 aTexCoord;
+// rows 0 .. 2 of the model matrix per instance, read when instanced != 0
+layout (location = 4) in vec4 aInstanceRow0;
+layout (location = 5) in vec4 aInstanceRow1;
+layout (location = 6) in vec4 aInstanceRow2;
 
 struct Material {
 	vec3 ambient;
@@ -52,6 +56,7 @@ out vec3 fragpos;
 uniform mat4 um4p;
 uniform mat4 um4v;
 uniform mat4 um4m;
+uniform int instanced;
 
 uniform Material material;
 uniform Directional directional;
@@ -68,11 +73,14 @@ vec3 CalcuSpotLight(vec3 N, vec3 V1);
 void main() 
 {
 	// [TODO]
-	gl_Position = um4p * um4v * um4m * vec4(aPos, 1.0);
+	mat4 model = um4m;
+	if (instanced != 0)
+		model = transpose(mat4(aInstanceRow0, aInstanceRow1, aInstanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+	gl_Position = um4p * um4v * model * vec4(aPos, 1.0);
 
-	vec4 Fragpos = um4v * um4m * vec4(aPos.x, aPos.y, aPos.z, 1.0);
+	vec4 Fragpos = um4v * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);
 	fragpos = Fragpos.xyz;
-	vertex_normal = mat3(transpose(inverse(um4v * um4m))) * aNormal;
+	vertex_normal = mat3(transpose(inverse(um4v * model))) * aNormal;
 	texCoord = aTexCoord;
 
 	vec3 V = fragpos;